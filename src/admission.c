@@ -0,0 +1,163 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * TinyLFU admission filter.
+ *
+ * When the cache is full, storing an item means evicting one, whether or not
+ * the new item is any more likely to be asked for than the one it replaces.
+ * The admission filter keeps an approximate count of how often each key has
+ * been fetched, and an item is only allowed to displace the eviction victim if
+ * its key has been fetched at least as often as the victim's.
+ *
+ * The counts are kept in a count-min sketch: ADMISSION_SKETCH_DEPTH rows of
+ * 4-bit counters, packed two to a byte.  A key maps to one counter in each
+ * row, and its estimated count is the smallest of them.  Only the smallest
+ * counters are incremented (conservative update), which keeps the estimates
+ * from drifting upwards on hash collisions.  After sample_size increments,
+ * every counter is halved so that the sketch tracks recent popularity rather
+ * than all-time popularity.
+ */
+
+#include "generic.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "admission.h"
+#include "assoc.h"
+
+static uint8_t* sketch;                 /* NULL if the filter is off. */
+static uint32_t width_mask;             /* counters per row - 1. */
+static uint32_t sample_size;            /* increments between agings. */
+static uint32_t additions;              /* increments since the last aging. */
+static admission_stats_t filter_stats;
+
+
+void admission_init(size_t items) {
+    uint32_t width = ADMISSION_SKETCH_MIN_WIDTH;
+
+    memset(&filter_stats, 0, sizeof(filter_stats));
+    if (items == 0) {
+        return;
+    }
+
+    while (width < items && width < (1U << 30)) {
+        width <<= 1;
+    }
+
+    sketch = calloc((size_t) width * ADMISSION_SKETCH_DEPTH / 2, 1);
+    if (sketch == NULL) {
+        fprintf(stderr, "failed to allocate the admission filter\n");
+        exit(EXIT_FAILURE);
+    }
+    width_mask = width - 1;
+    sample_size = width * ADMISSION_SAMPLE_FACTOR;
+    additions = 0;
+    filter_stats.sketch_width = width;
+}
+
+
+/* the counters for a key are picked by double hashing off a single hash. */
+static inline void sketch_hashes(const char* key, const size_t nkey,
+                                 uint32_t* h1, uint32_t* h2) {
+    *h1 = hash(key, nkey, 0);
+    *h2 = ((*h1 >> 17) | (*h1 << 15)) | 1;
+}
+
+static inline uint32_t counter_index(uint32_t h1, uint32_t h2, unsigned row) {
+    return row * (width_mask + 1) + ((h1 + row * h2) & width_mask);
+}
+
+static inline unsigned counter_get(uint32_t ix) {
+    return (sketch[ix >> 1] >> ((ix & 1) << 2)) & 0xf;
+}
+
+static inline void counter_increment(uint32_t ix) {
+    sketch[ix >> 1] += 1 << ((ix & 1) << 2);
+}
+
+
+static unsigned sketch_estimate(const char* key, const size_t nkey) {
+    uint32_t h1, h2;
+    unsigned row, min = ADMISSION_COUNTER_MAX;
+
+    sketch_hashes(key, nkey, &h1, &h2);
+    for (row = 0; row < ADMISSION_SKETCH_DEPTH; row ++) {
+        unsigned count = counter_get(counter_index(h1, h2, row));
+        if (count < min) {
+            min = count;
+        }
+    }
+
+    return min;
+}
+
+
+/* halves every counter. */
+static void sketch_age(void) {
+    size_t i, bytes = (size_t) (width_mask + 1) * ADMISSION_SKETCH_DEPTH / 2;
+
+    for (i = 0; i < bytes; i ++) {
+        sketch[i] = (sketch[i] >> 1) & 0x77;
+    }
+    additions /= 2;
+    filter_stats.agings ++;
+}
+
+
+/*
+ * records a fetch of a key, whether or not it was a hit.
+ */
+void do_admission_record(const char* key, const size_t nkey) {
+    uint32_t h1, h2;
+    unsigned row, min;
+    bool incremented = false;
+
+    if (sketch == NULL) {
+        return;
+    }
+
+    min = sketch_estimate(key, nkey);
+    if (min == ADMISSION_COUNTER_MAX) {
+        return;
+    }
+
+    sketch_hashes(key, nkey, &h1, &h2);
+    for (row = 0; row < ADMISSION_SKETCH_DEPTH; row ++) {
+        uint32_t ix = counter_index(h1, h2, row);
+        if (counter_get(ix) == min) {
+            counter_increment(ix);
+            incremented = true;
+        }
+    }
+
+    if (incremented && ++ additions >= sample_size) {
+        sketch_age();
+    }
+}
+
+
+/*
+ * returns true if an item with the given key should displace the victim.
+ * ties go to the newcomer so that items nobody has asked for don't linger.
+ */
+bool do_admission_admit(const char* key, const size_t nkey,
+                        const char* victim_key, const size_t victim_nkey) {
+    if (sketch == NULL) {
+        return true;
+    }
+
+    if (sketch_estimate(key, nkey) >= sketch_estimate(victim_key, victim_nkey)) {
+        filter_stats.admitted ++;
+        return true;
+    }
+
+    filter_stats.rejected ++;
+    return false;
+}
+
+
+void do_admission_stats(admission_stats_t* out) {
+    *out = filter_stats;
+}
@@ -0,0 +1,33 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+#if !defined(_admission_h_)
+#define _admission_h_
+
+#include "generic.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define ADMISSION_SKETCH_DEPTH         4 /* number of rows in the sketch. */
+#define ADMISSION_SKETCH_MIN_WIDTH    16 /* min number of counters per row. */
+#define ADMISSION_SAMPLE_FACTOR       10 /* the sketch is aged after this many
+                                          * increments per counter in a row. */
+#define ADMISSION_COUNTER_MAX         15 /* counters are 4 bits wide. */
+
+typedef struct admission_stats_s admission_stats_t;
+struct admission_stats_s {
+    uint64_t sketch_width;              /* counters per row. */
+    uint64_t admitted;                  /* candidates that displaced a victim. */
+    uint64_t rejected;                  /* candidates turned away. */
+    uint64_t agings;                    /* times the counters were halved. */
+};
+
+/* TinyLFU admission filter.  all of these except admission_init(..) must be
+ * called with the cache lock held. */
+extern void admission_init(size_t items);
+extern void do_admission_record(const char* key, const size_t nkey);
+extern bool do_admission_admit(const char* key, const size_t nkey,
+                               const char* victim_key, const size_t victim_nkey);
+extern void do_admission_stats(admission_stats_t* out);
+
+#endif /* #if !defined(_admission_h_) */
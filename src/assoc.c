@@ -30,6 +30,7 @@
 #endif
 
 #include "assoc.h"
+#include "expiry.h"
 #include "memcached.h"
 
 /*
@@ -737,7 +738,7 @@ int do_assoc_expire_regex(char *pattern) {
 
             if (regexec(&regex, key, 0, NULL, 0) == 0) {
                 /* the item matches; mark it expired. */
-                ITEM_set_exptime(ITEM(iptr), 1);
+                expiry_index_set_exptime(ITEM(iptr), 1);
             }
         }
     }
@@ -753,7 +754,7 @@ int do_assoc_expire_regex(char *pattern) {
 
                 if (regexec(&regex, key, 0, NULL, 0) == 0) {
                     /* the item matches; mark it expired. */
-                    ITEM_set_exptime(ITEM(iptr), 1);
+                    expiry_index_set_exptime(ITEM(iptr), 1);
                 }
             }
         }
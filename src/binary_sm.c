@@ -31,10 +31,12 @@
 #include <sys/uio.h>
 
 #include "binary_protocol.h"
+#include "compress.h"
 #include "conn_buffer.h"
 #include "items.h"
 #include "memcached.h"
 #include "stats.h"
+#include "tier.h"
 
 #if defined(USE_SLAB_ALLOCATOR)
 #include "slabs_items_support.h"
@@ -76,6 +78,7 @@ static inline void bp_get_req_cmd_info(bp_cmd_t cmd, bp_cmd_info_t* info);
 
 // prototypes for the state machine.
 static inline void binary_sm(conn* c);
+static inline bool bp_request_buffered(conn* c);
 
 // prototypes for handlers of the various states in the SM.
 static inline bp_handler_res_t handle_header_size_unknown(conn* c);
@@ -124,8 +127,7 @@ void process_binary_protocol(conn* c) {
             return;
         }
 
-        dispatch_conn_new(sfd, conn_bp_header_size_unknown, EV_READ | EV_PERSIST,
-                          NULL, false, c->binary, &addr, addrlen);
+        dispatch_accepted_conn(c, sfd, conn_bp_header_size_unknown, &addr, addrlen);
         return;
     }
 
@@ -212,6 +214,12 @@ static inline void binary_sm(conn* c) {
                 result = handle_writing(c);
                 break;
 
+            case conn_tier_wait:
+                // conn_tier_done(..) picks the connection back up.
+                update_event(c, 0);
+                result.stop = 1;
+                break;
+
             case conn_closing:
                 if (c->udp) {
                     conn_cleanup(c);
@@ -226,16 +234,23 @@ static inline void binary_sm(conn* c) {
         }
 
         if (prev_state == conn_bp_writing &&
-            c->state == conn_bp_header_size_unknown) {
-            /* in between requests.  shrink connection buffers. */
+            c->state == conn_bp_header_size_unknown &&
+            c->msgused == 0) {
+            /* in between requests, with no replies held back.  shrink
+             * connection buffers. */
             conn_shrink(c);
         }
 
         if (result.try_buffer_read) {
+            conn_states_t state = c->state;
+
             result.try_buffer_read = 0;
 
+            /* a datagram that can't be served may still leave an error to
+             * send. */
             if ((c->udp &&
-                 try_read_udp(c)) ||
+                 (try_read_udp(c) ||
+                  c->state != state)) ||
                 (c->udp == 0 &&
                  try_read_network(c)))
                 continue;
@@ -335,6 +350,23 @@ static inline void bp_get_req_cmd_info(bp_cmd_t cmd, bp_cmd_info_t* info)
 }
 
 
+/**
+ * returns true if the whole of the next request is in the read buffer.
+ */
+static inline bool bp_request_buffered(conn* c)
+{
+    empty_req_t header;
+
+    if (c->rbytes < BINARY_PROTOCOL_REQUEST_HEADER_SZ) {
+        return false;
+    }
+
+    // the buffer may not be word-aligned.
+    memcpy(&header, c->rcurr, BINARY_PROTOCOL_REQUEST_HEADER_SZ);
+    return (size_t) c->rbytes >= BINARY_PROTOCOL_REQUEST_HEADER_SZ + ntohl(header.body_length);
+}
+
+
 static inline bp_handler_res_t handle_header_size_unknown(conn* c)
 {
     empty_req_t* null_empty_header;
@@ -342,6 +374,13 @@ static inline bp_handler_res_t handle_header_size_unknown(conn* c)
     size_t bytes_needed, bytes_available;
     bp_handler_res_t retval = {0, 0};
 
+    // replies held back go out before anything more is read.
+    if (c->held > 0 &&
+        ! bp_request_buffered(c)) {
+        c->state = conn_bp_writing;
+        return retval;
+    }
+
     // calculate how many bytes we need and how many bytes we have
     // to determine if we have enough to populate the header.
     empty_header_ptr = NULL;
@@ -383,6 +422,9 @@ static inline bp_handler_res_t handle_header_size_known(conn* c)
     bp_handler_res_t retval = {0, 0};
 
     if (bytes_available >= bytes_needed) {
+        // unless this turns out to be an update with a large value.
+        c->direct_read = false;
+
         // copy the header.  we can't use it directly from the
         // receive buffer because we cannot guarantee that the
         // buffer is word-aligned.  even if we align c->rbuf,
@@ -407,11 +449,11 @@ static inline bp_handler_res_t handle_header_size_known(conn* c)
             assert(c->riov == NULL);
             assert(c->riov_size == 0);
             c->riov = (struct iovec*) alloc_conn_buffer(c->cbg,
-                                                        0 /* no hint provided,
-                                                           * because we don't
-                                                           * know how much the
-                                                           * value will
-                                                           * require. */);
+                                                        sizeof(struct iovec) /* just
+                                                           * the key.  a value
+                                                           * that needs more
+                                                           * moves it to a big
+                                                           * buffer. */);
             if (c->riov == NULL) {
                 bp_write_err_msg(c, "out of memory");
                 return retval;
@@ -470,6 +512,7 @@ static inline bp_handler_res_t handle_direct_receive(conn* c)
 {
     stats_t *stats = STATS_GET_TLS();
     bp_handler_res_t retval = {0, 0};
+    size_t copied = 0;
 
     /*
      * check if the receive buffer has any more content.  move that to the
@@ -483,6 +526,7 @@ static inline bp_handler_res_t handle_direct_receive(conn* c)
         memcpy(current_iov->iov_base, c->rcurr, bytes_to_copy);
         c->rcurr += bytes_to_copy;      // update receive buffer.
         c->rbytes -= bytes_to_copy;
+        copied += bytes_to_copy;
         current_iov->iov_base += bytes_to_copy;
         current_iov->iov_len -= bytes_to_copy;
 
@@ -493,6 +537,13 @@ static inline bp_handler_res_t handle_direct_receive(conn* c)
         }
     }
 
+    if (copied > 0 &&
+        c->state == conn_bp_waiting_for_value) {
+        STATS_LOCK(stats);
+        stats->value_bytes_copied += copied;
+        STATS_UNLOCK(stats);
+    }
+
     /*
      * the only reason we should be here is to receive the key, which should
      * already be in the datagram.
@@ -552,6 +603,8 @@ static inline bp_handler_res_t handle_direct_receive(conn* c)
                         break;
                     }
                     c->item = it;
+                    c->direct_read = settings.direct_read_min > 0 &&
+                        value_len >= settings.direct_read_min;
                     c->state = conn_bp_waiting_for_value;
                 } else {
                     // head to processing.
@@ -587,12 +640,15 @@ static inline bp_handler_res_t handle_direct_receive(conn* c)
     }
 
     // try a direct read.
-    ssize_t res = readv(c->sfd, &c->riov[c->riov_curr],
-                        c->riov_left <= IOV_MAX ? c->riov_left : IOV_MAX);
+    ssize_t res = conn_readv(c, &c->riov[c->riov_curr],
+                             c->riov_left <= IOV_MAX ? c->riov_left : IOV_MAX);
 
     if (res > 0) {
         STATS_LOCK(stats);
         stats->bytes_read += res;
+        if (c->state == conn_bp_waiting_for_value) {
+            stats->value_bytes_direct += res;
+        }
         STATS_UNLOCK(stats);
 
         while (res > 0) {
@@ -717,9 +773,19 @@ static inline bp_handler_res_t handle_writing(conn* c)
 {
     bp_handler_res_t retval = {0, 0};
 
+    // if the next request is already in the read buffer, the reply can wait
+    // to go out with the one to it.
+    if (conn_hold_reply(c, bp_request_buffered(c))) {
+        c->state = conn_bp_header_size_unknown;
+        return retval;
+    }
+
     switch (transmit(c)) {
         case TRANSMIT_COMPLETE:
             c->icurr = c->ilist;
+#if defined(USE_ZEROCOPY)
+            zerocopy_pin_items(c);
+#endif /* #if defined(USE_ZEROCOPY) */
             while (c->ileft > 0) {
                 item *it = *(c->icurr);
                 assert(ITEM_is_valid(it));
@@ -811,9 +877,34 @@ static void handle_get_cmd(conn* c)
     item* it;
     size_t nkey = ntohl(c->u.key_req.body_length) -
         (sizeof(key_req_t) - BINARY_PROTOCOL_REQUEST_HEADER_SZ);
+    char* plain = NULL;                 // a compressed value, decompressed.
+    size_t plain_len = 0;
+#if defined(USE_SLAB_ALLOCATOR)
+    tier_io_t* io = NULL;
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
 
     // find the desired item.
+    if (settings.admission_items != 0) {
+        admission_record(c->bp_key, nkey);
+    }
     it = item_get(c->bp_key, nkey);
+#if defined(USE_SLAB_ALLOCATOR)
+    if (settings.slab_automove_interval != 0) {
+        if (it != NULL) {
+            slabs_model_hit(it);
+        } else {
+            slabs_model_miss(c->bp_key, nkey);
+        }
+    }
+
+    // a udp socket can't wait for a value to be read back from the tier, so
+    // that is a miss.
+    if (it != NULL && c->udp && ITEM_is_tiered(it)) {
+        tier_count_udp_miss();
+        item_deref(it);
+        it = NULL;
+    }
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
 
     // handle the counters.  do this all together because lock/unlock is costly.
     STATS_LOCK(stats);
@@ -848,19 +939,49 @@ static void handle_get_cmd(conn* c)
     }
 
     if (it) {
-        // the cache hit case.
         if (c->ileft >= c->isize) {
-            item **new_list = pool_realloc(c->ilist, sizeof(item *)*c->isize*2,
-                                           sizeof(item*) * c->isize, CONN_BUFFER_ILIST_POOL);
+            item **new_list = conn_scratch_grow(c, c->ilist, sizeof(item*) * c->isize,
+                                                sizeof(item *) * c->isize * 2);
             if (new_list) {
                 c->isize *= 2;
                 c->ilist = new_list;
             } else {
+                item_deref(it);
                 bp_write_err_msg(c, "out of memory");
                 return;
             }
         }
+
+#if defined(USE_SLAB_ALLOCATOR)
+        // values in the tier are read back by the tier i/o threads.  the
+        // reply is built around the item the value is read into, and waits
+        // for the read.
+        if (ITEM_is_tiered(it)) {
+            item* value = conn_tier_fetch(c, it, &io);
+
+            item_update(it);
+            if (value == NULL) {
+                item_deref(it);
+                bp_write_err_msg(c, "couldn't read value from the tier");
+                return;
+            }
+            it = value;
+        }
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
+
+        // the cache hit case.  the binary protocol has no way to mark a value
+        // as compressed, so compressed values always go out decompressed.
+        if (ITEM_is_compressed(it) &&
+            (plain = conn_decompress(c, it, &plain_len)) == NULL) {
+            item_update(it);
+            item_deref(it);
+            bp_write_err_msg(c, "couldn't decompress value");
+            return;
+        }
+
         *(c->ilist + c->ileft) = it;
+        c->ileft++;
+        c->icurr = c->ilist;
         item_update(it);
 
         STATS_LOCK(stats);
@@ -873,13 +994,29 @@ static void handle_get_cmd(conn* c)
         rep->status = mcc_res_found;
         rep->flags = ITEM_flags(it);
         rep->body_length = htonl((sizeof(*rep) - BINARY_PROTOCOL_REPLY_HEADER_SZ) +
-                                 ITEM_nbytes(it)); // chop off the '\r\n'
+                                 (plain != NULL ? plain_len : ITEM_nbytes(it))); // chop off the '\r\n'
 
         if (add_iov(c, rep, sizeof(value_rep_t), true) ||
-            add_item_value_to_iov(c, it, false /* don't send cr-lf */)) {
+            (plain != NULL ?
+             add_iov(c, plain, plain_len, false) :
+             add_item_value_to_iov(c, it, false /* don't send cr-lf */))) {
+#if defined(USE_SLAB_ALLOCATOR)
+            if (io != NULL) {
+                // the item the value was to be read into is on the item list.
+                item_deref(io->stub);
+                free(io);
+            }
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
             bp_write_err_msg(c, "couldn't build response");
             return;
         }
+#if defined(USE_SLAB_ALLOCATOR)
+        if (io != NULL) {
+            // the read holds on to the stub until it is done.
+            dispatch_tier_read(c, io);
+            c->tier_pending++;
+        }
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
 
         if (settings.verbose > 1) {
             fprintf(stderr, ">%d sending key %*s\n", c->sfd, (int) nkey, c->bp_key);
@@ -908,6 +1045,14 @@ static void handle_get_cmd(conn* c)
             return;
         }
     }
+
+#if defined(USE_SLAB_ALLOCATOR)
+    // conn_tier_done(..) moves on to the next state once the value is in.
+    if (c->tier_pending != 0) {
+        c->tier_resume = c->state;
+        c->state = conn_tier_wait;
+    }
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
 }
 
 
@@ -955,6 +1100,16 @@ static void handle_update_cmd(conn* c)
     if (settings.verbose > 1) {
         fprintf(stderr, ">%d received key %*s\n", c->sfd, c->u.key_value_req.keylen, c->bp_key);
     }
+    if (settings.compress_threshold != 0 &&
+        ITEM_nbytes(it) >= settings.compress_threshold) {
+        item* packed = item_compress(it, c->bp_key, c->u.key_value_req.keylen,
+                                     get_request_addr(c));
+        if (packed != NULL) {
+            item_deref(c->item);
+            c->item = it = packed;
+        }
+    }
+
     if (store_item(it, comm, c->bp_key)) {
         rep->status = mcc_res_stored;
     } else {
@@ -1046,6 +1201,14 @@ static void handle_delete_cmd(conn* c)
             return;
         }
     }
+
+#if defined(USE_SLAB_ALLOCATOR)
+    // conn_tier_done(..) moves on to the next state once the value is in.
+    if (c->tier_pending != 0) {
+        c->tier_resume = c->state;
+        c->state = conn_tier_wait;
+    }
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
 }
 
 
@@ -1117,12 +1280,15 @@ static void* allocate_reply_header(conn* c, size_t size, void* req)
 {
     empty_req_t* srcreq = (empty_req_t*) req;
     empty_rep_t* retval;
+    bp_hdr_pool_t* pool;
 
     // do we have enough space?
     if (c->bp_hdr_pool->bytes_free < size) {
-        if ((c->bp_hdr_pool = bp_allocate_hdr_pool(c->bp_hdr_pool)) == NULL) {
+        if (! conn_memory_allows(c, sizeof(bp_hdr_pool_t) + BP_HDR_POOL_INIT_SIZE) ||
+            (pool = bp_allocate_hdr_pool(c->bp_hdr_pool)) == NULL) {
             return NULL;
         }
+        c->bp_hdr_pool = pool;
     }
 
     retval = (empty_rep_t*) c->bp_hdr_pool->ptr;
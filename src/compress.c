@@ -0,0 +1,371 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Transparent value compression.
+ *
+ * Values of at least settings.compress_threshold bytes are compressed when
+ * they are stored, and decompressed into the connection's scratch memory when
+ * they are fetched, unless the connection has asked to receive compressed
+ * values as they are.  The codec writes the LZ4 block format: a sequence of literal
+ * runs, each followed by a back-reference (offset, length) into the last 64KB
+ * of output.  Matches are found greedily through a hash table of the last
+ * position each 4-byte string was seen at, which is the same trade-off the
+ * fast LZ4 compressor makes: a little ratio for a lot of speed.
+ */
+
+#include "generic.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "compress.h"
+#include "memcached.h"
+
+#define LZ4_HASH_LOG        12          /* 4K entry match table. */
+#define LZ4_MIN_MATCH       4
+#define LZ4_LAST_LITERALS   5           /* the block must end with at least
+                                         * this many literals... */
+#define LZ4_MFLIMIT         12          /* ...and the last match must start at
+                                         * least this far from the end. */
+#define LZ4_MAX_DISTANCE    65535
+#define LZ4_SKIP_TRIGGER    6           /* after 2^this misses in a row, the
+                                         * search starts skipping bytes. */
+#define LZ4_RUN_MASK        15
+
+static inline uint32_t lz4_read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz4_hash(uint32_t v) {
+    return (v * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+static inline uint8_t* lz4_write_length(uint8_t* op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t) len;
+    return op;
+}
+
+/* the most output a sequence of nlit literals and an nmatch byte match can
+ * take, including the token and the offset. */
+static inline size_t lz4_sequence_bound(size_t nlit, size_t nmatch) {
+    return 1 + (nlit / 255 + 1) + nlit + 2 + (nmatch / 255 + 1);
+}
+
+
+size_t lz4_compress(const void* src, size_t srclen, void* dst, size_t dstlen) {
+    const uint8_t* const base = src;
+    const uint8_t* const iend = base + srclen;
+    const uint8_t* ip = base;
+    const uint8_t* anchor = base;
+    uint8_t* op = dst;
+    uint8_t* const oend = op + dstlen;
+    uint32_t table[1 << LZ4_HASH_LOG];
+    size_t nlit;
+
+    if (srclen > LZ4_MFLIMIT) {
+        const uint8_t* const mflimit = iend - LZ4_MFLIMIT;
+        const uint8_t* const matchlimit = iend - LZ4_LAST_LITERALS;
+        unsigned int misses = 0;
+
+        /* every entry starts out pointing at the beginning of the input.
+         * candidates are always verified, so that is harmless. */
+        memset(table, 0, sizeof(table));
+        ip ++;
+
+        while (ip < mflimit) {
+            uint32_t h = lz4_hash(lz4_read32(ip));
+            const uint8_t* ref = base + table[h];
+            const uint8_t* mp;
+            size_t nmatch;
+            uint8_t* token;
+
+            table[h] = (uint32_t) (ip - base);
+            if (ip - ref > LZ4_MAX_DISTANCE ||
+                lz4_read32(ref) != lz4_read32(ip)) {
+                ip += 1 + (misses++ >> LZ4_SKIP_TRIGGER);
+                continue;
+            }
+            misses = 0;
+
+            /* extend the match backwards over the pending literals, then
+             * forwards. */
+            while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+                ip --;
+                ref --;
+            }
+            for (mp = ip + LZ4_MIN_MATCH, ref += LZ4_MIN_MATCH;
+                 mp < matchlimit && *mp == *ref;
+                 mp ++, ref ++) {
+                ;
+            }
+
+            nlit = ip - anchor;
+            nmatch = mp - ip - LZ4_MIN_MATCH;
+            if (lz4_sequence_bound(nlit, nmatch) > (size_t) (oend - op)) {
+                return 0;
+            }
+
+            token = op++;
+            if (nlit >= LZ4_RUN_MASK) {
+                *token = LZ4_RUN_MASK << 4;
+                op = lz4_write_length(op, nlit - LZ4_RUN_MASK);
+            } else {
+                *token = (uint8_t) (nlit << 4);
+            }
+            memcpy(op, anchor, nlit);
+            op += nlit;
+
+            *op++ = (uint8_t) ((mp - ref) & 0xff);
+            *op++ = (uint8_t) ((mp - ref) >> 8);
+
+            if (nmatch >= LZ4_RUN_MASK) {
+                *token |= LZ4_RUN_MASK;
+                op = lz4_write_length(op, nmatch - LZ4_RUN_MASK);
+            } else {
+                *token |= (uint8_t) nmatch;
+            }
+
+            anchor = ip = mp;
+            if (ip < mflimit) {
+                /* the position just before the next search is a good
+                 * candidate for the one after it. */
+                table[lz4_hash(lz4_read32(ip - 2))] = (uint32_t) (ip - 2 - base);
+            }
+        }
+    }
+
+    /* the rest of the input goes out as literals. */
+    nlit = iend - anchor;
+    if (1 + (nlit / 255 + 1) + nlit > (size_t) (oend - op)) {
+        return 0;
+    }
+    if (nlit >= LZ4_RUN_MASK) {
+        *op++ = LZ4_RUN_MASK << 4;
+        op = lz4_write_length(op, nlit - LZ4_RUN_MASK);
+    } else {
+        *op++ = (uint8_t) (nlit << 4);
+    }
+    memcpy(op, anchor, nlit);
+    op += nlit;
+
+    return op - (uint8_t*) dst;
+}
+
+
+ssize_t lz4_decompress(const void* src, size_t srclen, void* dst, size_t dstlen) {
+    const uint8_t* ip = src;
+    const uint8_t* const iend = ip + srclen;
+    uint8_t* op = dst;
+    uint8_t* const oend = op + dstlen;
+
+    while (ip < iend) {
+        unsigned int token = *ip++;
+        size_t len = token >> 4;
+        size_t offset;
+        const uint8_t* match;
+
+        if (len == LZ4_RUN_MASK) {
+            uint8_t b;
+            do {
+                if (ip >= iend) {
+                    return -1;
+                }
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        if (len > (size_t) (iend - ip) ||
+            len > (size_t) (oend - op)) {
+            return -1;
+        }
+        memcpy(op, ip, len);
+        ip += len;
+        op += len;
+
+        if (ip == iend) {
+            /* the last sequence has no match. */
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return -1;
+        }
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t) (op - (uint8_t*) dst)) {
+            return -1;
+        }
+
+        len = token & LZ4_RUN_MASK;
+        if (len == LZ4_RUN_MASK) {
+            uint8_t b;
+            do {
+                if (ip >= iend) {
+                    return -1;
+                }
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        len += LZ4_MIN_MATCH;
+        if (len > (size_t) (oend - op)) {
+            return -1;
+        }
+
+        match = op - offset;
+        if (offset >= len) {
+            memcpy(op, match, len);
+            op += len;
+        } else {
+            /* the match overlaps the output; it repeats the last offset
+             * bytes. */
+            while (len-- != 0) {
+                *op++ = *match++;
+            }
+        }
+    }
+
+    return op - (uint8_t*) dst;
+}
+
+
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+item* item_compress(item* it, const char* key, const size_t nkey,
+                    const struct in_addr addr) {
+    stats_t *stats = STATS_GET_TLS();
+    size_t nbytes = ITEM_nbytes(it);
+    size_t limit = nbytes - nbytes / COMPRESS_MIN_SAVINGS;
+    size_t packed_len;
+    uint64_t start;
+    char* plain;
+    char* packed;
+    item* new_it = NULL;
+
+    assert(! ITEM_is_compressed(it));
+    if (limit <= COMPRESS_HEADER_SZ) {
+        return NULL;
+    }
+
+    plain = malloc(nbytes);
+    packed = malloc(limit);
+    if (plain == NULL || packed == NULL) {
+        free(plain);
+        free(packed);
+        return NULL;
+    }
+
+    start = thread_cpu_ns();
+    item_memcpy_from(plain, it, 0, nbytes, false);
+    packed_len = lz4_compress(plain, nbytes, packed + COMPRESS_HEADER_SZ,
+                              limit - COMPRESS_HEADER_SZ);
+
+    if (packed_len != 0) {
+        packed_len += COMPRESS_HEADER_SZ;
+        packed[0] = nbytes & 0xff;
+        packed[1] = (nbytes >> 8) & 0xff;
+        packed[2] = (nbytes >> 16) & 0xff;
+        packed[3] = (nbytes >> 24) & 0xff;
+
+        new_it = item_alloc((char*) key, nkey, ITEM_flags(it), ITEM_exptime(it),
+                            packed_len, addr);
+        if (new_it != NULL) {
+            item_memcpy_to(new_it, 0, packed, packed_len, false);
+            ITEM_set_compressed(new_it);
+        }
+    }
+
+    STATS_LOCK(stats);
+    stats->compress_ns += thread_cpu_ns() - start;
+    if (new_it != NULL) {
+        stats->compressed_items ++;
+        stats->compress_bytes_in += nbytes;
+        stats->compress_bytes_out += packed_len;
+    } else if (packed_len == 0) {
+        stats->compress_skipped ++;
+    }
+    STATS_UNLOCK(stats);
+
+    free(plain);
+    free(packed);
+    return new_it;
+}
+
+
+ssize_t item_decompressed_len(item* it) {
+    stats_t *stats = STATS_GET_TLS();
+    unsigned char header[COMPRESS_HEADER_SZ];
+    size_t plain_len;
+
+    assert(ITEM_is_compressed(it));
+    if (ITEM_nbytes(it) >= COMPRESS_HEADER_SZ) {
+        item_memcpy_from(header, it, 0, COMPRESS_HEADER_SZ, false);
+        plain_len = header[0] | (header[1] << 8) | (header[2] << 16) |
+            ((size_t) header[3] << 24);
+        if (plain_len <= settings.item_size_max) {
+            return plain_len;
+        }
+    }
+
+    STATS_LOCK(stats);
+    stats->decompress_failures ++;
+    STATS_UNLOCK(stats);
+    return -1;
+}
+
+
+bool item_decompress(item* it, char* plain, const size_t plain_len) {
+    stats_t *stats = STATS_GET_TLS();
+    size_t packed_len = ITEM_nbytes(it) - COMPRESS_HEADER_SZ;
+    uint64_t start;
+    char* packed = NULL;
+    char* copy = NULL;
+    bool ok = false;
+
+    assert(ITEM_is_compressed(it));
+    start = thread_cpu_ns();
+
+    /* the block is decoded where it is, unless it is split across chunks. */
+#if defined(USE_SLAB_ALLOCATOR)
+    if (ITEM_segments(it) == 1) {
+        size_t len;
+        packed = ITEM_segment(it, 0, &len) + COMPRESS_HEADER_SZ;
+    }
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
+    if (packed == NULL &&
+        (packed = copy = malloc(packed_len)) != NULL) {
+        item_memcpy_from(copy, it, COMPRESS_HEADER_SZ, packed_len, false);
+    }
+
+    if (packed != NULL) {
+        ok = (lz4_decompress(packed, packed_len, plain, plain_len) == (ssize_t) plain_len);
+    }
+
+    STATS_LOCK(stats);
+    stats->decompress_ns += thread_cpu_ns() - start;
+    if (ok) {
+        stats->decompressed_items ++;
+    } else {
+        stats->decompress_failures ++;
+    }
+    STATS_UNLOCK(stats);
+
+    free(copy);
+    return ok;
+}
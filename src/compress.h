@@ -0,0 +1,42 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+#if !defined(_compress_h_)
+#define _compress_h_
+
+#include "generic.h"
+
+#include <netinet/in.h>
+#include <sys/types.h>
+
+#include "memcached.h"
+
+/* compressed values are stored as the length of the uncompressed value (4
+ * bytes, little endian) followed by an LZ4 block. */
+#define COMPRESS_HEADER_SZ      4
+#define COMPRESS_MIN_SAVINGS    8       /* a value is only kept compressed if
+                                         * that saves at least 1/8th of it. */
+#define COMPRESS_MIN_THRESHOLD  64      /* smallest value size worth trying. */
+
+/* LZ4 block format codec.  lz4_compress(..) returns the size of the block, or
+ * 0 if it does not fit dstlen bytes.  lz4_decompress(..) returns the number of
+ * bytes decoded, or -1 if the block is malformed or does not fit dstlen
+ * bytes. */
+extern size_t  lz4_compress(const void* src, size_t srclen, void* dst, size_t dstlen);
+extern ssize_t lz4_decompress(const void* src, size_t srclen, void* dst, size_t dstlen);
+
+/* returns a new, unlinked item holding the compressed value of it, or NULL if
+ * the value doesn't compress well enough or there is no memory.  the caller
+ * still owns its reference to it. */
+extern item* item_compress(item* it, const char* key, const size_t nkey,
+                           const struct in_addr addr);
+
+/* returns the length of the uncompressed value of the compressed item it, or
+ * -1 if the value is corrupt. */
+extern ssize_t item_decompressed_len(item* it);
+
+/* decompresses the value of the compressed item it into plain, which has
+ * room for the plain_len bytes item_decompressed_len(..) returned.  returns
+ * false if there is no memory or the value is corrupt. */
+extern bool item_decompress(item* it, char* plain, const size_t plain_len);
+
+#endif /* #if !defined(_compress_h_) */
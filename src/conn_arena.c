@@ -0,0 +1,175 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Per-thread scratch arenas for connection buffers.
+ *
+ * A connection starts out with buffers big enough for most requests.  When a
+ * request outgrows them (a large multiget, a long response, the UDP headers of
+ * a reply) the bigger buffers are carved from its thread's arena rather than
+ * realloc'ed, and the connection switches back to its own buffers once the
+ * response is sent.  Carving is a pointer bump, and the arena is reclaimed as
+ * a whole, so the request path doesn't call malloc or free once the arena has
+ * warmed up.  A connection that can't send its response for a while keeps
+ * the arena from being reset; the connections after it then use arenas of
+ * their own, so the shared one doesn't grow without bound.
+ */
+
+#include "generic.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "conn_arena.h"
+#include "memcached.h"
+
+#define ARENA_ROUND(sz)         (((sz) + CONN_ARENA_ALIGN - 1) & ~(CONN_ARENA_ALIGN - 1))
+#define BLOCK_HEADER_SZ         ARENA_ROUND(sizeof(conn_arena_block_t))
+#define BLOCK_DATA(b)           ((char*) (b) + BLOCK_HEADER_SZ)
+
+
+void conn_arena_init(conn_arena_t* arena) {
+    memset(arena, 0, sizeof(conn_arena_t));
+}
+
+
+static conn_arena_block_t* conn_arena_new_block(conn_arena_t* arena, size_t size) {
+    conn_arena_block_t* block;
+
+    if (size <= CONN_ARENA_BLOCK_SIZE && arena->spare != NULL) {
+        block = arena->spare;
+        arena->spare = block->next;
+        arena->spare_bytes -= block->size;
+    } else {
+        if (size < CONN_ARENA_BLOCK_SIZE) {
+            size = CONN_ARENA_BLOCK_SIZE;
+        }
+        block = pool_malloc(BLOCK_HEADER_SZ + size, CONN_BUFFER_ARENA_POOL);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->size = size;
+        arena->capacity += size;
+        arena->stats.block_allocs ++;
+    }
+
+    block->used = 0;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    return block;
+}
+
+
+void* conn_arena_alloc(conn_arena_t* arena, size_t size) {
+    conn_arena_block_t* block = arena->blocks;
+    void* ret;
+
+    assert(arena->holders > 0);
+
+    size = ARENA_ROUND(size);
+    if (block == NULL ||
+        block->size - block->used < size) {
+        if ((block = conn_arena_new_block(arena, size)) == NULL) {
+            arena->stats.alloc_failures ++;
+            return NULL;
+        }
+    }
+
+    ret = BLOCK_DATA(block) + block->used;
+    block->used += size;
+    arena->used += size;
+    if (arena->used > arena->stats.high_water) {
+        arena->stats.high_water = arena->used;
+    }
+    arena->stats.allocs ++;
+
+    return ret;
+}
+
+
+void* conn_arena_realloc(conn_arena_t* arena, void* ptr, size_t old_size, size_t new_size) {
+    conn_arena_block_t* block = arena->blocks;
+    void* ret;
+
+    assert(new_size >= old_size);
+
+    /* the last thing carved from the newest block can simply be extended. */
+    if (block != NULL &&
+        (char*) ptr >= BLOCK_DATA(block) &&
+        (char*) ptr + ARENA_ROUND(old_size) == BLOCK_DATA(block) + block->used &&
+        ARENA_ROUND(new_size) - ARENA_ROUND(old_size) <= block->size - block->used) {
+        size_t extra = ARENA_ROUND(new_size) - ARENA_ROUND(old_size);
+
+        block->used += extra;
+        arena->used += extra;
+        if (arena->used > arena->stats.high_water) {
+            arena->stats.high_water = arena->used;
+        }
+        arena->stats.grown_in_place ++;
+        return ptr;
+    }
+
+    if ((ret = conn_arena_alloc(arena, new_size)) != NULL &&
+        old_size != 0) {
+        memcpy(ret, ptr, old_size);
+    }
+    return ret;
+}
+
+
+static void conn_arena_reset(conn_arena_t* arena) {
+    conn_arena_block_t* block, * next;
+
+    /* standard sized blocks are kept for reuse, up to a point. */
+    for (block = arena->blocks; block != NULL; block = next) {
+        next = block->next;
+        if (! arena->own &&
+            block->size == CONN_ARENA_BLOCK_SIZE &&
+            arena->spare_bytes + block->size <= CONN_ARENA_RETAIN) {
+            block->next = arena->spare;
+            arena->spare = block;
+            arena->spare_bytes += block->size;
+        } else {
+            arena->capacity -= block->size;
+            arena->stats.block_frees ++;
+            pool_free(block, BLOCK_HEADER_SZ + block->size, CONN_BUFFER_ARENA_POOL);
+        }
+    }
+
+    arena->blocks = NULL;
+    arena->used = 0;
+    arena->stats.resets ++;
+}
+
+
+conn_arena_t* conn_arena_hold(conn_arena_t* shared) {
+    conn_arena_t* arena = shared;
+
+    assert(! shared->own);
+
+    if (shared->holders > 0 &&
+        shared->used > CONN_ARENA_SHARED_MAX) {
+        if ((arena = pool_malloc(sizeof(conn_arena_t), CONN_BUFFER_ARENA_POOL)) == NULL) {
+            shared->stats.alloc_failures ++;
+            return NULL;
+        }
+        conn_arena_init(arena);
+        arena->own = true;
+        shared->stats.own_arenas ++;
+    }
+
+    arena->holders ++;
+    return arena;
+}
+
+
+void conn_arena_release(conn_arena_t* arena) {
+    assert(arena->holders > 0);
+
+    if (-- arena->holders == 0) {
+        if (arena->blocks != NULL) {
+            conn_arena_reset(arena);
+        }
+        if (arena->own) {
+            pool_free(arena, sizeof(conn_arena_t), CONN_BUFFER_ARENA_POOL);
+        }
+    }
+}
@@ -0,0 +1,89 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+#if !defined(_conn_arena_h_)
+#define _conn_arena_h_
+
+#include "generic.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define CONN_ARENA_BLOCK_SIZE   (64 * 1024)     /* blocks are carved this much
+                                                 * at a time; larger requests
+                                                 * get a block of their own. */
+#define CONN_ARENA_RETAIN       (1024 * 1024)   /* empty blocks kept for reuse
+                                                 * after a reset. */
+#define CONN_ARENA_SHARED_MAX   (256 * 1024)    /* bytes carved from a held
+                                                 * arena before connections
+                                                 * that come to it get one of
+                                                 * their own. */
+#define CONN_ARENA_ALIGN        (sizeof(uint64_t))
+
+typedef struct conn_arena_block_s conn_arena_block_t;
+struct conn_arena_block_s {
+    conn_arena_block_t* next;
+    size_t size;                        /* usable bytes after the header. */
+    size_t used;
+};
+
+typedef struct conn_arena_stats_s conn_arena_stats_t;
+struct conn_arena_stats_s {
+    uint64_t allocs;                    /* allocations carved... */
+    uint64_t grown_in_place;            /* ... and extended where they were. */
+    uint64_t resets;
+    uint64_t block_allocs;              /* blocks taken from malloc... */
+    uint64_t block_frees;               /* ... and given back. */
+    uint64_t alloc_failures;
+    uint64_t own_arenas;                /* connections given an arena of
+                                         * their own while this one was
+                                         * full. */
+    size_t   high_water;                /* most bytes carved between resets. */
+};
+
+/*
+ * a bump allocator for the scratch memory of the requests on one thread.
+ * connections that need more than their own buffers hold the arena while
+ * their response is outstanding; once the last of them lets go, everything
+ * carved from it is reclaimed at once.  only the thread the arena belongs to
+ * may use it.
+ */
+typedef struct conn_arena_s conn_arena_t;
+struct conn_arena_s {
+    conn_arena_block_t* blocks;         /* blocks in use, the newest first. */
+    conn_arena_block_t* spare;          /* empty blocks. */
+    size_t spare_bytes;
+    unsigned holders;                   /* connections that hold the arena. */
+    size_t used;                        /* bytes carved since the last
+                                         * reset. */
+    size_t capacity;                    /* bytes in all blocks. */
+    bool own;                           /* one connection's, freed once it
+                                         * lets go. */
+    conn_arena_stats_t stats;
+};
+
+extern void conn_arena_init(conn_arena_t* arena);
+
+/* returns size bytes from the arena, or NULL if there is no memory. */
+extern void* conn_arena_alloc(conn_arena_t* arena, size_t size);
+
+/* returns new_size bytes from the arena holding the first old_size bytes of
+ * ptr, which may be memory from anywhere.  if ptr is the last thing carved
+ * from the arena, it is extended where it is. */
+extern void* conn_arena_realloc(conn_arena_t* arena, void* ptr, size_t old_size, size_t new_size);
+
+/*
+ * a connection holds an arena from before it first carves memory from it
+ * until it no longer needs any of it.  the arena is reset when the last
+ * holder lets go.
+ *
+ * a connection whose client is slow to read its response can hold the
+ * thread's arena for a long time, and nothing carved from it by the other
+ * connections is reclaimed until it lets go.  once more than
+ * CONN_ARENA_SHARED_MAX has been carved from it, the connections that come to
+ * it get an arena of their own instead, which is freed when they let go.
+ * returns the arena held, or NULL if there is no memory.
+ */
+extern conn_arena_t* conn_arena_hold(conn_arena_t* shared);
+extern void conn_arena_release(conn_arena_t* arena);
+
+#endif /* #if !defined(_conn_arena_h_) */
@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #define CONN_BUFFER_MODULE
@@ -360,6 +361,26 @@ static conn_buffer_t* get_buffer_from_data_ptr(void* _ptr) {
 }
 
 
+static conn_buffer_small_t* get_small_buffer_from_data_ptr(void* _ptr) {
+    intptr_t ptr = (intptr_t) _ptr;
+    conn_buffer_small_t* buffer;
+
+    ptr -= CONN_BUFFER_HEADER_SZ;
+    buffer = (conn_buffer_small_t*) ptr;
+
+    assert(buffer->signature == CONN_BUFFER_SMALL_SIGNATURE);
+
+    return buffer;
+}
+
+
+bool is_small_conn_buffer(const void* ptr) {
+    const uint32_t* signature = (const uint32_t*) ((const char*) ptr - CONN_BUFFER_HEADER_SZ);
+
+    return (*signature == CONN_BUFFER_SMALL_SIGNATURE);
+}
+
+
 static void conn_buffer_reclamation(conn_buffer_group_t* cbg) {
     if (cbg->reclamation_in_progress) {
         if (cbg->num_free_buffers != 0) {
@@ -448,10 +469,44 @@ void conn_buffer_init(unsigned groups,
 }
 
 
+/**
+ * allocate a small connection buffer, CONN_BUFFER_SMALL_DATA_SZ bytes long.
+ *
+ * this is a thread-guarded function, i.e., it should only be called for a
+ * connection buffer group by the thread it is assigned to.
+ */
+static void* do_alloc_small_conn_buffer(conn_buffer_group_t* cbg) {
+    conn_buffer_small_t* buffer;
+
+    assert(cbg->settings.tid == pthread_self());
+
+    if (cbg->num_small_free != 0) {
+        cbg->num_small_free --;
+        buffer = cbg->small_free[cbg->num_small_free];
+    } else {
+        buffer = (conn_buffer_small_t*) pool_malloc(sizeof(conn_buffer_small_t), CONN_BUFFER_POOL);
+        if (buffer == NULL) {
+            cbg->stats.small_allocs_failed ++;
+            return NULL;
+        }
+        memset(buffer, 0, CONN_BUFFER_HEADER_SZ);
+        buffer->signature = CONN_BUFFER_SMALL_SIGNATURE;
+    }
+
+    cbg->stats.small_allocs ++;
+
+    assert(buffer->signature == CONN_BUFFER_SMALL_SIGNATURE);
+    assert(buffer->used == false);
+    buffer->used = true;
+
+    return buffer->data;
+}
+
+
 /**
  * allocate a connection buffer.  max_rusage_hint is a hint for how much
  * of the buffer will be used in the worst case.  if it is 0, the hint is
- * discarded.  currently, the hint is ignored.
+ * discarded.  if it fits in a small buffer, a small buffer is returned.
  *
  * this is a thread-guarded function, i.e., it should only be called for a
  * connection buffer group by the thread it is assigned to.
@@ -461,6 +516,15 @@ static void* do_alloc_conn_buffer(conn_buffer_group_t* cbg, size_t max_rusage_hi
 
     assert(cbg->settings.tid == pthread_self());
 
+    if (max_rusage_hint != 0 &&
+        max_rusage_hint <= CONN_BUFFER_SMALL_DATA_SZ) {
+        void* ret;
+
+        if ((ret = do_alloc_small_conn_buffer(cbg)) != NULL) {
+            return ret;
+        }
+    }
+
     if ( (buffer = remove_conn_buffer_from_freelist(cbg, max_rusage_hint)) == NULL &&
          (buffer = make_conn_buffer(cbg)) == NULL ) {
         cbg->stats.allocs_failed ++;
@@ -482,6 +546,28 @@ static void* do_alloc_conn_buffer(conn_buffer_group_t* cbg, size_t max_rusage_hi
 }
 
 
+/**
+ * releases a small connection buffer.  up to CONN_BUFFER_SMALL_FREE_MAX of them
+ * are kept for reuse.
+ *
+ * this is a thread-guarded function, i.e., it should only be called for a
+ * connection buffer group by the thread it is assigned to.
+ */
+static void do_free_small_conn_buffer(conn_buffer_group_t* cbg, conn_buffer_small_t* buffer) {
+    assert(cbg->settings.tid == pthread_self());
+    assert(buffer->used == true);
+
+    buffer->used = false;
+
+    if (cbg->num_small_free < CONN_BUFFER_SMALL_FREE_MAX) {
+        cbg->small_free[cbg->num_small_free] = buffer;
+        cbg->num_small_free ++;
+    } else {
+        pool_free(buffer, sizeof(conn_buffer_small_t), CONN_BUFFER_POOL);
+    }
+}
+
+
 /**
  * releases a connection buffer.  max_rusage_hint is a hint for how much of the
  * buffer was used in the worst case.  if it is 0 and no one has ever called
@@ -493,7 +579,15 @@ static void* do_alloc_conn_buffer(conn_buffer_group_t* cbg, size_t max_rusage_hi
  * connection buffer group by the thread it is assigned to.
  */
 static void do_free_conn_buffer(conn_buffer_group_t* cbg, void* ptr, ssize_t max_rusage) {
-    conn_buffer_t* buffer = get_buffer_from_data_ptr(ptr);
+    conn_buffer_t* buffer;
+
+    if (is_small_conn_buffer(ptr)) {
+        cbg->stats.small_frees ++;
+        do_free_small_conn_buffer(cbg, get_small_buffer_from_data_ptr(ptr));
+        return;
+    }
+
+    buffer = get_buffer_from_data_ptr(ptr);
 
     assert(cbg->settings.tid == pthread_self());
     assert(buffer->signature == CONN_BUFFER_SIGNATURE);
@@ -554,7 +648,14 @@ static void do_free_conn_buffer(conn_buffer_group_t* cbg, void* ptr, ssize_t max
  * connection buffer group by the thread it is assigned to.
  */
 static void do_report_max_rusage(conn_buffer_group_t* cbg, void* ptr, size_t max_rusage) {
-    conn_buffer_t* buffer = get_buffer_from_data_ptr(ptr);
+    conn_buffer_t* buffer;
+
+    /* small buffers are always fully resident. */
+    if (is_small_conn_buffer(ptr)) {
+        return;
+    }
+
+    buffer = get_buffer_from_data_ptr(ptr);
 
     assert(cbg->settings.tid == pthread_self());
     assert(buffer->signature == CONN_BUFFER_SIGNATURE);
@@ -576,6 +677,33 @@ static void do_report_max_rusage(conn_buffer_group_t* cbg, void* ptr, size_t max
 }
 
 
+/**
+ * moves the first used bytes of a small connection buffer into a big one, and
+ * releases the small buffer.  returns the big buffer, or NULL if there is no
+ * memory, in which case the small buffer is left alone.
+ *
+ * this is a thread-guarded function, i.e., it should only be called for a
+ * connection buffer group by the thread it is assigned to.
+ */
+static void* do_promote_conn_buffer(conn_buffer_group_t* cbg, void* ptr, size_t used) {
+    conn_buffer_small_t* small = get_small_buffer_from_data_ptr(ptr);
+    void* ret;
+
+    assert(used <= CONN_BUFFER_SMALL_DATA_SZ);
+
+    if ((ret = do_alloc_conn_buffer(cbg, 0)) == NULL) {
+        return NULL;
+    }
+
+    memcpy(ret, ptr, used);
+    do_report_max_rusage(cbg, ret, used);
+    do_free_small_conn_buffer(cbg, small);
+    cbg->stats.promotions ++;
+
+    return ret;
+}
+
+
 void* alloc_conn_buffer(conn_buffer_group_t* cbg, size_t max_rusage_hint) {
     void* ret;
 
@@ -585,6 +713,24 @@ void* alloc_conn_buffer(conn_buffer_group_t* cbg, size_t max_rusage_hint) {
     return ret;
 }
 
+void* alloc_small_conn_buffer(conn_buffer_group_t* cbg) {
+    void* ret;
+
+    pthread_mutex_lock(&cbg->lock);
+    ret = do_alloc_small_conn_buffer(cbg);
+    pthread_mutex_unlock(&cbg->lock);
+    return ret;
+}
+
+void* promote_conn_buffer(conn_buffer_group_t* cbg, void* ptr, size_t used) {
+    void* ret;
+
+    pthread_mutex_lock(&cbg->lock);
+    ret = do_promote_conn_buffer(cbg, ptr, used);
+    pthread_mutex_unlock(&cbg->lock);
+    return ret;
+}
+
 void free_conn_buffer(conn_buffer_group_t* cbg, void* ptr, ssize_t max_rusage) {
     pthread_mutex_lock(&cbg->lock);
     do_free_conn_buffer(cbg, ptr, max_rusage);
@@ -630,6 +776,7 @@ char* conn_buffer_stats(size_t* result_size) {
     size_t num_free_buffers = 0;
     size_t total_rsize = 0;
     size_t total_rsize_in_freelist = 0;
+    size_t num_small_free = 0;
     conn_buffer_stats_t stats;
 
     if (buffer == NULL) {
@@ -649,6 +796,11 @@ char* conn_buffer_stats(size_t* result_size) {
         stats.destroys             += l.cbg_list[ix].stats.destroys;
         stats.reclamations_started += l.cbg_list[ix].stats.reclamations_started;
         stats.allocs_failed        += l.cbg_list[ix].stats.allocs_failed;
+        stats.small_allocs         += l.cbg_list[ix].stats.small_allocs;
+        stats.small_frees          += l.cbg_list[ix].stats.small_frees;
+        stats.small_allocs_failed  += l.cbg_list[ix].stats.small_allocs_failed;
+        stats.promotions           += l.cbg_list[ix].stats.promotions;
+        num_small_free             += l.cbg_list[ix].num_small_free;
         pthread_mutex_unlock(&l.cbg_list[ix].lock);
     }
 
@@ -660,7 +812,12 @@ char* conn_buffer_stats(size_t* result_size) {
                               "STAT frees %" PRINTF_INT64_MODIFIER "u\n"
                               "STAT failed_allocates %" PRINTF_INT64_MODIFIER "u\n"
                               "STAT destroys %" PRINTF_INT64_MODIFIER "u\n"
-                              "STAT reclamations_started %" PRINTF_INT64_MODIFIER "u\n",
+                              "STAT reclamations_started %" PRINTF_INT64_MODIFIER "u\n"
+                              "STAT num_free_small_buffers %" PRINTF_INT64_MODIFIER "u\n"
+                              "STAT small_allocates %" PRINTF_INT64_MODIFIER "u\n"
+                              "STAT small_frees %" PRINTF_INT64_MODIFIER "u\n"
+                              "STAT failed_small_allocates %" PRINTF_INT64_MODIFIER "u\n"
+                              "STAT promotions %" PRINTF_INT64_MODIFIER "u\n",
                               num_free_buffers,
                               total_rsize,
                               total_rsize_in_freelist,
@@ -668,7 +825,12 @@ char* conn_buffer_stats(size_t* result_size) {
                               stats.frees,
                               stats.allocs_failed,
                               stats.destroys,
-                              stats.reclamations_started);
+                              stats.reclamations_started,
+                              (uint64_t) num_small_free,
+                              stats.small_allocs,
+                              stats.small_frees,
+                              stats.small_allocs_failed,
+                              stats.promotions);
 
     offset = append_to_buffer(buffer, bufsize, offset, 0, terminator);
 
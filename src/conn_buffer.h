@@ -32,6 +32,14 @@
 #define CONN_BUFFER_SIZE (16 * 1024 * 1024)
 #define CONN_BUFFER_SIGNATURE  (0xbeadbeef)
 
+#define CONN_BUFFER_SMALL_SIZE (16 * 1024)      /* small buffers are malloc'ed,
+                                                 * and a connection's reads go
+                                                 * into one until they outgrow
+                                                 * it. */
+#define CONN_BUFFER_SMALL_SIGNATURE (0xbeadbee5)
+#define CONN_BUFFER_SMALL_FREE_MAX (64)         /* small buffers each group
+                                                 * keeps for reuse. */
+
 #define CONN_BUFFER_HEADER_CONTENTS             \
     uint32_t signature;                         \
     uint32_t prev_rusage;                       \
@@ -51,6 +59,13 @@ struct conn_buffer_s {
     unsigned char data[CONN_BUFFER_DATA_SZ];
 };
 
+#define CONN_BUFFER_SMALL_DATA_SZ (CONN_BUFFER_SMALL_SIZE - CONN_BUFFER_HEADER_SZ)
+typedef struct conn_buffer_small_s conn_buffer_small_t;
+struct conn_buffer_small_s {
+    CONN_BUFFER_HEADER_CONTENTS;
+    unsigned char data[CONN_BUFFER_SMALL_DATA_SZ];
+};
+
 
 typedef struct conn_buffer_stats_s conn_buffer_stats_t;
 struct conn_buffer_stats_s {
@@ -59,6 +74,12 @@ struct conn_buffer_stats_s {
     uint64_t destroys;
     uint64_t reclamations_started;
     uint64_t allocs_failed;
+    uint64_t small_allocs;
+    uint64_t small_frees;               /* small buffers given back without
+                                         * having been promoted, each of which
+                                         * saved checking out a big buffer. */
+    uint64_t small_allocs_failed;
+    uint64_t promotions;                /* small buffers that were outgrown. */
 };
 
 
@@ -93,12 +114,18 @@ struct conn_buffer_group_s {
         size_t page_size;               /* page size on the OS. */
     } settings;
 
+    conn_buffer_small_t* small_free[CONN_BUFFER_SMALL_FREE_MAX];
+    size_t num_small_free;
+
     conn_buffer_stats_t stats;
     pthread_mutex_t lock;               /* lock for this connection buffer group. */
 };
 
 
 extern void* alloc_conn_buffer(conn_buffer_group_t* cbg, size_t max_rusage_hint);
+extern void* alloc_small_conn_buffer(conn_buffer_group_t* cbg);
+extern void* promote_conn_buffer(conn_buffer_group_t* cbg, void* ptr, size_t used);
+extern bool is_small_conn_buffer(const void* ptr);
 extern void free_conn_buffer(conn_buffer_group_t* cbg, void* ptr, ssize_t max_rusage);
 extern void report_max_rusage(conn_buffer_group_t* cbg, void* ptr, size_t max_rusage);
 extern char* conn_buffer_stats(size_t* result_size);
@@ -0,0 +1,212 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Expiration index.
+ *
+ * Items that carry an expiration time are threaded onto a calendar queue when
+ * they are linked and taken off when they are unlinked.  The queue is a wheel
+ * of EXPIRY_WHEEL_SZ one-second buckets; an item lives in the bucket for
+ * (exptime % EXPIRY_WHEEL_SZ).  Items that expire more than a lap in the
+ * future share a bucket with nearer items and are simply skipped by the reaper
+ * until the lap in which they come due.
+ *
+ * Once per clock tick the reaper walks the buckets between the last second it
+ * processed and now, unlinking expired items.  Without it, an expired item
+ * only goes away when it is fetched or drifts to the tail of the LRU, and in
+ * the meantime it pushes out items that are still live.  The work done per
+ * tick is bounded; if the reaper runs out of budget, it picks up where it
+ * left off on the next tick.
+ *
+ * The index works on item_ptr_t so that it is agnostic to the allocator in
+ * use.
+ */
+
+#include "generic.h"
+
+#include <assert.h>
+
+#include "memcached.h"
+#include "expiry.h"
+
+static item_ptr_t wheel[EXPIRY_WHEEL_SZ];
+
+static rel_time_t reap_time;            /* the next second to be reaped. */
+static bool       reap_in_bucket;       /* true if the reaper stopped partway
+                                         * through the bucket for reap_time. */
+static item_ptr_t reap_next;            /* if reap_in_bucket, the next item the
+                                         * reaper will examine. */
+
+
+static inline unsigned expiry_bucket(rel_time_t exptime) {
+    return exptime % EXPIRY_WHEEL_SZ;
+}
+
+
+void expiry_init(void) {
+    unsigned i;
+
+    for (i = 0; i < EXPIRY_WHEEL_SZ; i ++) {
+        wheel[i] = NULL_ITEM_PTR;
+    }
+    reap_time = current_time;
+    reap_in_bucket = false;
+    reap_next = NULL_ITEM_PTR;
+}
+
+
+/*
+ * adds an item to the expiration index.  items that never expire are not
+ * indexed.
+ */
+void expiry_index_add(item* it) {
+    rel_time_t exptime = ITEM_exptime(it);
+    item_ptr_t* head;
+
+    assert(! ITEM_is_expiry_indexed(it));
+    if (exptime == 0) {
+        return;
+    }
+
+    head = &wheel[expiry_bucket(exptime)];
+    ITEM_set_exp_prev(it, NULL_ITEM_PTR);
+    ITEM_set_exp_next(it, *head);
+    if (*head != NULL_ITEM_PTR) {
+        ITEM_set_exp_prev(ITEM(*head), ITEM_PTR(it));
+    }
+    *head = ITEM_PTR(it);
+    ITEM_set_expiry_indexed(it);
+}
+
+
+/*
+ * removes an item from the expiration index, if it is there.  the item's
+ * exptime must not have changed since it was indexed.
+ */
+void expiry_index_remove(item* it) {
+    item_ptr_t next, prev;
+
+    if (! ITEM_is_expiry_indexed(it)) {
+        return;
+    }
+
+    next = ITEM_exp_next(it);
+    prev = ITEM_exp_prev(it);
+
+    if (reap_in_bucket && reap_next == ITEM_PTR(it)) {
+        reap_next = next;
+    }
+
+    if (prev != NULL_ITEM_PTR) {
+        ITEM_set_exp_next(ITEM(prev), next);
+    } else {
+        item_ptr_t* head = &wheel[expiry_bucket(ITEM_exptime(it))];
+        assert(*head == ITEM_PTR(it));
+        *head = next;
+    }
+    if (next != NULL_ITEM_PTR) {
+        ITEM_set_exp_prev(ITEM(next), prev);
+    }
+
+    ITEM_set_exp_next(it, NULL_ITEM_PTR);
+    ITEM_set_exp_prev(it, NULL_ITEM_PTR);
+    ITEM_clear_expiry_indexed(it);
+}
+
+
+/*
+ * an item's header has been copied from old_it to new_it (i.e., the allocator
+ * moved it).  fix up the links that point at the old location.
+ */
+void expiry_index_relocate(item* old_it, item* new_it) {
+    item_ptr_t next, prev;
+
+    if (! ITEM_is_expiry_indexed(new_it)) {
+        return;
+    }
+
+    next = ITEM_exp_next(new_it);
+    prev = ITEM_exp_prev(new_it);
+
+    if (reap_in_bucket && reap_next == ITEM_PTR(old_it)) {
+        reap_next = ITEM_PTR(new_it);
+    }
+
+    if (prev != NULL_ITEM_PTR) {
+        ITEM_set_exp_next(ITEM(prev), ITEM_PTR(new_it));
+    } else {
+        item_ptr_t* head = &wheel[expiry_bucket(ITEM_exptime(new_it))];
+        assert(*head == ITEM_PTR(old_it));
+        *head = ITEM_PTR(new_it);
+    }
+    if (next != NULL_ITEM_PTR) {
+        ITEM_set_exp_prev(ITEM(next), ITEM_PTR(new_it));
+    }
+}
+
+
+/*
+ * changes the expiration time of a linked item, moving it to the bucket for
+ * the new time.
+ */
+void expiry_index_set_exptime(item* it, rel_time_t exptime) {
+    expiry_index_remove(it);
+    ITEM_set_exptime(it, exptime);
+    expiry_index_add(it);
+}
+
+
+/*
+ * unlinks expired items from the buckets that have come due since the last
+ * call.  returns the number of items unlinked.
+ */
+int do_expiry_reap(void) {
+    stats_t *stats = STATS_GET_TLS();
+    rel_time_t now = current_time;
+    unsigned examined = 0;
+    int reaped = 0;
+
+    if (reap_time + EXPIRY_WHEEL_SZ <= now) {
+        /* we're more than a lap behind.  one lap visits every bucket. */
+        reap_time = now - EXPIRY_WHEEL_SZ + 1;
+        reap_in_bucket = false;
+    }
+
+    while (reap_time <= now) {
+        if (! reap_in_bucket) {
+            reap_next = wheel[expiry_bucket(reap_time)];
+            reap_in_bucket = true;
+        }
+
+        while (reap_next != NULL_ITEM_PTR) {
+            item* it;
+
+            if (examined >= EXPIRY_REAP_SEARCH_DEPTH ||
+                reaped >= EXPIRY_REAP_BATCH) {
+                goto done;
+            }
+
+            /* advance the cursor before unlinking.  any other item the unlink
+             * disturbs will fix up reap_next through expiry_index_remove(..) or
+             * expiry_index_relocate(..). */
+            it = ITEM(reap_next);
+            reap_next = ITEM_exp_next(it);
+            examined ++;
+
+            if (ITEM_exptime(it) <= now) {
+                do_item_unlink(it, UNLINK_IS_EXPIRED, NULL);
+                reaped ++;
+            }
+        }
+
+        reap_in_bucket = false;
+        reap_time ++;
+    }
+
+ done:
+    if (reaped != 0) {
+        STATS_LOCK(stats);
+        stats->reaped_items += reaped;
+        STATS_UNLOCK(stats);
+    }
+
+    return reaped;
+}
@@ -0,0 +1,24 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+#if !defined(_expiry_h_)
+#define _expiry_h_
+
+#include "items.h"
+
+#define EXPIRY_WHEEL_SZ            4096 /* number of one-second buckets in the
+                                         * calendar queue. */
+#define EXPIRY_REAP_BATCH          5000 /* max number of items the reaper will
+                                         * unlink per clock tick. */
+#define EXPIRY_REAP_SEARCH_DEPTH  20000 /* max number of items the reaper will
+                                         * examine per clock tick. */
+
+/* expiration index.  all of these must be called with the cache lock held. */
+extern void expiry_init(void);
+extern void expiry_index_add(item* it);
+extern void expiry_index_remove(item* it);
+extern void expiry_index_relocate(item* old_it, item* new_it);
+extern void expiry_index_set_exptime(item* it, rel_time_t exptime);
+
+extern int  do_expiry_reap(void);
+
+#endif /* #if !defined(_expiry_h_) */
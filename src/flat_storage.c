@@ -17,7 +17,9 @@
 
 #define FLAT_STORAGE_MODULE
 
+#include "admission.h"
 #include "assoc.h"
+#include "expiry.h"
 #include "flat_storage.h"
 #include "memcached.h"
 #include "stats.h"
@@ -39,6 +41,8 @@ static chunk_t* free_list_pop(chunk_type_t chunk_type);
 static void break_large_chunk(chunk_t* chunk);
 static void unbreak_large_chunk(large_chunk_t* lc, bool mandatory);
 static void item_free(item *it);
+static void item_link_q(item *it);
+static void item_unlink_q(item* it);
 
 
 /**
@@ -74,8 +78,17 @@ void flat_storage_init(size_t maxbytes) {
     fsi.large_free_list_sz = 0;
     fsi.small_free_list = NULL_CHUNKPTR;
     fsi.small_free_list_sz = 0;
+#if defined(USE_CLOCK_EVICTION)
+    fsi.clock_hand = fsi.flat_storage_start;
+    fsi.clock_hand_small = 0;
+#else
     fsi.lru_head = NULL_CHUNKPTR;
     fsi.lru_tail = NULL_CHUNKPTR;
+    fsi.lru_probation_head = NULL_CHUNKPTR;
+    fsi.lru_protected_sz = 0;
+#endif /* #if defined(USE_CLOCK_EVICTION) */
+    fsi.lru_sz = 0;
+    memset(&fsi.lru_stats, 0, sizeof(fsi.lru_stats));
 
     /* shouldn't fail here.... right? */
     flat_storage_alloc();
@@ -106,10 +119,12 @@ void item_init(void) {
     /* make sure that the fields line up in item */
     always_assert( &(((item*) 0)->empty_header.h_next) == &(((item*) 0)->large_title.h_next) );
     always_assert( &(((item*) 0)->empty_header.h_next) == &(((item*) 0)->small_title.h_next) );
+#if !defined(USE_CLOCK_EVICTION)
     always_assert( &(((item*) 0)->empty_header.next) == &(((item*) 0)->large_title.next) );
     always_assert( &(((item*) 0)->empty_header.next) == &(((item*) 0)->small_title.next) );
     always_assert( &(((item*) 0)->empty_header.prev) == &(((item*) 0)->large_title.prev) );
     always_assert( &(((item*) 0)->empty_header.prev) == &(((item*) 0)->small_title.prev) );
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
     always_assert( &(((item*) 0)->empty_header.next_chunk) == &(((item*) 0)->large_title.next_chunk) );
     always_assert( &(((item*) 0)->empty_header.next_chunk) == &(((item*) 0)->small_title.next_chunk) );
     always_assert( &(((item*) 0)->empty_header.time) == &(((item*) 0)->large_title.time) );
@@ -392,6 +407,105 @@ static void unbreak_large_chunk(large_chunk_t* lc, bool mandatory) {
 }
 
 
+#if defined(USE_CLOCK_EVICTION)
+/*
+ * steps a cursor over the storage region by one chunk.  a broken large chunk
+ * is stepped over one small chunk at a time.  returns false if the cursor is
+ * at the end of the initialized region.  otherwise, sets *it to the item whose
+ * title is in the chunk, or NULL if the chunk is not a title, and returns
+ * true.
+ */
+static bool chunk_cursor_step(large_chunk_t** lc_p, unsigned* sc_p, item** it) {
+    large_chunk_t* lc = *lc_p;
+
+    if (lc >= fsi.uninitialized_start) {
+        return false;
+    }
+
+    *it = NULL;
+    if (lc->flags & LARGE_CHUNK_BROKEN) {
+        small_chunk_t* sc = &(lc->lc_broken.lbc[*sc_p]);
+
+        if ((sc->flags & (SMALL_CHUNK_USED | SMALL_CHUNK_TITLE)) ==
+            (SMALL_CHUNK_USED | SMALL_CHUNK_TITLE)) {
+            *it = get_item_from_small_title(&(sc->sc_title));
+        }
+
+        (*sc_p) ++;
+        if (*sc_p < SMALL_CHUNKS_PER_LARGE_CHUNK) {
+            return true;
+        }
+    } else if ((lc->flags & (LARGE_CHUNK_USED | LARGE_CHUNK_TITLE)) ==
+               (LARGE_CHUNK_USED | LARGE_CHUNK_TITLE)) {
+        *it = get_item_from_large_title(&(lc->lc_title));
+    }
+
+    *lc_p = lc + 1;
+    *sc_p = 0;
+    return true;
+}
+
+
+/*
+ * advances a cursor to the next linked item in the storage region.  returns
+ * NULL at the end of the region.
+ */
+static item* next_linked_item(large_chunk_t** lc_p, unsigned* sc_p) {
+    item* it;
+
+    while (chunk_cursor_step(lc_p, sc_p, &it)) {
+        if (it != NULL && (it->empty_header.it_flags & ITEM_LINKED)) {
+            return it;
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * advances the clock hand until it reaches an unreferenced item with refcount
+ * == 0, clearing the reference bits it passes over.  gives up after
+ * CLOCK_SEARCH_DEPTH chunks and settles for the first referenced item it
+ * spared.
+ */
+FA_STATIC item* get_lru_item(void) {
+    item* fallback = NULL;
+    item* it;
+    int i;
+
+    if (fsi.lru_sz == 0) {
+        return NULL;
+    }
+
+    for (i = 0; i < CLOCK_SEARCH_DEPTH; i ++) {
+        if (! chunk_cursor_step(&fsi.clock_hand, &fsi.clock_hand_small, &it)) {
+            /* ran off the end; wrap around. */
+            fsi.clock_hand = fsi.flat_storage_start;
+            fsi.clock_hand_small = 0;
+            continue;
+        }
+        fsi.lru_stats.clock_steps ++;
+
+        if (it == NULL ||
+            (it->empty_header.it_flags & ITEM_LINKED) == 0 ||
+            it->empty_header.refcount != 0) {
+            continue;
+        }
+        if (it->empty_header.it_flags & ITEM_REFERENCED) {
+            it->empty_header.it_flags &= ~(ITEM_REFERENCED);
+            fsi.lru_stats.clock_second_chances ++;
+            if (fallback == NULL) {
+                fallback = it;
+            }
+            continue;
+        }
+        return it;
+    }
+
+    return fallback;
+}
+#else
 /*
  * gets the oldest item on the LRU with refcount == 0.
  */
@@ -415,6 +529,54 @@ FA_STATIC item* get_lru_item(void) {
 }
 
 
+/*
+ * with size-aware eviction, every item with refcount == 0 within
+ * LRU_SEARCH_DEPTH of the LRU tail is a candidate, and the one that earns the
+ * fewest hits per byte is chosen.  expired items cost nothing to drop and go
+ * first.  without it, this is the same as get_lru_item().
+ */
+static item* get_victim_item(void) {
+    int i;
+    item* iter, * prev, * oldest = NULL, * victim = NULL;
+    double victim_priority = 0;
+
+    if (! settings.size_aware_eviction) {
+        return get_lru_item();
+    }
+
+    for (i = 0,
+             iter = fsi.lru_tail;
+         i < LRU_SEARCH_DEPTH && iter != NULL;
+         i ++, iter = prev) {
+        prev = get_item_from_chunk(get_chunk_address(iter->empty_header.prev));
+
+        if (iter->empty_header.refcount == 0) {
+            double priority;
+
+            if (iter->empty_header.exptime != 0 &&
+                iter->empty_header.exptime <= current_time) {
+                priority = 0;
+            } else {
+                priority = stats_size_priority(ITEM_nkey(iter) + ITEM_nbytes(iter));
+            }
+            if (oldest == NULL) {
+                oldest = victim = iter;
+                victim_priority = priority;
+            } else if (priority < victim_priority) {
+                victim = iter;
+                victim_priority = priority;
+            }
+        }
+    }
+
+    if (victim != oldest) {
+        fsi.lru_stats.size_aware_picks ++;
+    }
+    return victim;
+}
+#endif /* #if defined(USE_CLOCK_EVICTION) */
+
+
 static bool small_chunk_referenced(const small_chunk_t* sc) {
     assert((sc->flags & SMALL_CHUNK_INITIALIZED) != 0);
     if (sc->flags & SMALL_CHUNK_FREE) {
@@ -555,12 +717,15 @@ static coalesce_progress_t coalesce_free_small_chunks(void) {
 
                     if (iter->flags & SMALL_CHUNK_TITLE) {
                         item* new_it, * old_it;
+#if !defined(USE_CLOCK_EVICTION)
                         chunk_t* next, * prev;
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
                         small_chunk_t* next_chunk;
 
                         new_it = get_item_from_small_title(&(replacement->sc_title));
                         old_it = get_item_from_small_title(&(iter->sc_title));
 
+#if !defined(USE_CLOCK_EVICTION)
                         /* edit the forward and backward links. */
                         if (replacement->sc_title.next != NULL_CHUNKPTR) {
                             next = get_chunk_address(replacement->sc_title.next);
@@ -579,6 +744,7 @@ static coalesce_progress_t coalesce_free_small_chunks(void) {
                             assert(fsi.lru_head == get_item_from_small_title(&old_chunk->sc.sc_title));
                             fsi.lru_head = get_item_from_small_title(&replacement->sc_title);
                         }
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
 
                         /* edit the next_chunk's prev_chunk link */
                         next_chunk = &(get_chunk_address(replacement->sc_title.next_chunk))->sc;
@@ -590,8 +756,15 @@ static coalesce_progress_t coalesce_free_small_chunks(void) {
                         /* update flags */
                         replacement->flags |= (SMALL_CHUNK_USED | SMALL_CHUNK_TITLE);
 
+#if !defined(USE_CLOCK_EVICTION)
+                        if (fsi.lru_probation_head == old_it) {
+                            fsi.lru_probation_head = new_it;
+                        }
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
+
                         /* do the replacement in the mapping. */
                         assoc_update(old_it, new_it);
+                        expiry_index_relocate(old_it, new_it);
                     } else {
                         /* body block.  this is more straightforward */
                         small_chunk_t* prev_chunk = &(get_chunk_address(replacement->sc_body.prev_chunk))->sc;
@@ -637,16 +810,43 @@ static coalesce_progress_t coalesce_free_small_chunks(void) {
 }
 
 
-static bool flat_storage_lru_evict(chunk_type_t chunk_type, size_t nchunks) {
+/*
+ * evicts items until there are nchunks free chunks of the given type.  key is
+ * the key of the item being allocated; if the admission filter turns it away
+ * in favor of an eviction victim, the eviction fails.
+ */
+static bool flat_storage_lru_evict(chunk_type_t chunk_type, size_t nchunks,
+                                   const char* key, const size_t nkey) {
     while (1) {
         /* release one item from the LRU... */
         item* lru_item;
 
+#if defined(USE_CLOCK_EVICTION)
         lru_item = get_lru_item();
+#else
+        lru_item = get_victim_item();
+#endif /* #if defined(USE_CLOCK_EVICTION) */
         if (lru_item == NULL) {
             /* nothing to release, so we just fail. */
             return false;
         }
+        if (lru_item->empty_header.exptime == 0 ||
+            lru_item->empty_header.exptime > current_time) {
+            char victim_key[KEY_MAX_LENGTH];
+
+            if (! do_admission_admit(key, nkey,
+                                     item_key_copy(lru_item, victim_key),
+                                     ITEM_nkey(lru_item))) {
+                /* the victim is fetched more often than the new item.  send it
+                 * around again so that the next store faces a different
+                 * victim. */
+#if !defined(USE_CLOCK_EVICTION)
+                item_unlink_q(lru_item);
+                item_link_q(lru_item);
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
+                return false;
+            }
+        }
         do_item_unlink(lru_item, UNLINK_MAYBE_EVICT, NULL);
 
         /* do we have enough free chunks to leave this loop? */
@@ -834,7 +1034,7 @@ item* do_item_alloc(const char *key, const size_t nkey, const int flags, const r
                 continue;
             }
 
-            if (flat_storage_lru_evict(LARGE_CHUNK, needed)) {
+            if (flat_storage_lru_evict(LARGE_CHUNK, needed, key, nkey)) {
                 continue;
             }
 
@@ -849,7 +1049,10 @@ item* do_item_alloc(const char *key, const size_t nkey, const int flags, const r
         assert(temp != NULL);
         title = &(temp->lc.lc_title);
         title->h_next = NULL_ITEM_PTR;
-        title->next = title->prev = title->next_chunk = NULL_CHUNKPTR;
+#if !defined(USE_CLOCK_EVICTION)
+        title->next = title->prev = NULL_CHUNKPTR;
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
+        title->next_chunk = NULL_CHUNKPTR;
         title->refcount = 1;            /* the caller will have a reference */
         title->it_flags = ITEM_VALID;
         title->nkey = nkey;
@@ -874,6 +1077,7 @@ item* do_item_alloc(const char *key, const size_t nkey, const int flags, const r
         /* STATS: update */
         fsi.stats.large_title_chunks ++;
         fsi.stats.large_body_chunks += needed;
+        fsi.stats.large_requested_bytes += nkey + nbytes;
 
         while (needed > 0) {
             temp = free_list_pop(LARGE_CHUNK);
@@ -937,7 +1141,7 @@ item* do_item_alloc(const char *key, const size_t nkey, const int flags, const r
                 continue;
             }
 
-            if (flat_storage_lru_evict(SMALL_CHUNK, needed)) {
+            if (flat_storage_lru_evict(SMALL_CHUNK, needed, key, nkey)) {
                 continue;
             }
 
@@ -952,7 +1156,10 @@ item* do_item_alloc(const char *key, const size_t nkey, const int flags, const r
         assert(temp != NULL);
         title = &(temp->sc.sc_title);
         title->h_next = NULL_ITEM_PTR;
-        title->next = title->prev = title->next_chunk = NULL_CHUNKPTR;
+#if !defined(USE_CLOCK_EVICTION)
+        title->next = title->prev = NULL_CHUNKPTR;
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
+        title->next_chunk = NULL_CHUNKPTR;
         title->refcount = 1;            /* the caller will have a reference */
         title->it_flags = ITEM_VALID;
         title->nkey = nkey;
@@ -978,6 +1185,7 @@ item* do_item_alloc(const char *key, const size_t nkey, const int flags, const r
         /* STATS: update */
         fsi.stats.small_title_chunks ++;
         fsi.stats.small_body_chunks += needed;
+        fsi.stats.small_requested_bytes += nkey + nbytes;
 
         while (needed > 0) {
             chunkptr_t current_chunkptr;
@@ -1021,11 +1229,17 @@ static void item_free(item *it) {
     size_t expected_chunks_freed = chunks_in_item(it);
 #endif /* #if !defined(NDEBUG) */
     bool is_large_chunks = is_item_large_chunk(it);
+    size_t requested_bytes = ITEM_nkey(it) + ITEM_nbytes(it);
 
-    assert((it->empty_header.it_flags & ~(ITEM_HAS_TIMESTAMP | ITEM_HAS_IP_ADDRESS))== ITEM_VALID);
+#if defined(USE_CLOCK_EVICTION)
+    assert((it->empty_header.it_flags & ~(ITEM_HAS_TIMESTAMP | ITEM_HAS_IP_ADDRESS | ITEM_REFERENCED | ITEM_COMPRESSED))== ITEM_VALID);
+    assert(it->empty_header.refcount == 0);
+#else
+    assert((it->empty_header.it_flags & ~(ITEM_HAS_TIMESTAMP | ITEM_HAS_IP_ADDRESS | ITEM_PROTECTED | ITEM_COMPRESSED))== ITEM_VALID);
     assert(it->empty_header.refcount == 0);
     assert(it->empty_header.next == NULL_CHUNKPTR);
     assert(it->empty_header.prev == NULL_CHUNKPTR);
+#endif /* #if defined(USE_CLOCK_EVICTION) */
     assert(it->empty_header.h_next == NULL_ITEM_PTR);
 
     /* find all the chunks and liberate them. */
@@ -1064,6 +1278,7 @@ static void item_free(item *it) {
 
         /* STATS: update */
         fsi.stats.large_title_chunks --;
+        fsi.stats.large_requested_bytes -= requested_bytes;
     } else {
         chunk_t* chunk;
 
@@ -1099,6 +1314,7 @@ static void item_free(item *it) {
 
         /* STATS: update */
         fsi.stats.small_title_chunks --;
+        fsi.stats.small_requested_bytes -= requested_bytes;
     }
 
     assert(chunks_freed == expected_chunks_freed);
@@ -1110,7 +1326,7 @@ static void item_free(item *it) {
  * the maximum for a cache entry.)
  */
 bool item_size_ok(const size_t nkey, const int flags, const int nbytes) {
-    return (nkey <= KEY_MAX_LENGTH) && (nbytes <= MAX_ITEM_SIZE);
+    return (nkey <= KEY_MAX_LENGTH) && (nbytes <= settings.item_size_max);
 }
 
 
@@ -1121,19 +1337,82 @@ bool item_need_realloc(const item* it,
 }
 
 
+#if defined(USE_CLOCK_EVICTION)
+static void item_link_q(item *it) {
+    fsi.lru_sz ++;
+}
+
+
+static void item_unlink_q(item* it) {
+    fsi.lru_sz --;
+}
+#else
+/*
+ * moves protected items to the probationary segment until the protected
+ * segment is within its share of the LRU.
+ */
+static void item_demote_protected(void) {
+    while (fsi.lru_protected_sz * 100 > fsi.lru_sz * settings.lru_protected_pct) {
+        item* it;
+
+        if (fsi.lru_probation_head != NULL) {
+            it = get_item_from_chunk(get_chunk_address(fsi.lru_probation_head->empty_header.prev));
+        } else {
+            it = fsi.lru_tail;
+        }
+
+        assert(it != NULL && (it->empty_header.it_flags & ITEM_PROTECTED));
+        it->empty_header.it_flags &= ~(ITEM_PROTECTED);
+        fsi.lru_protected_sz --;
+        fsi.lru_probation_head = it;
+        fsi.lru_stats.demotions ++;
+    }
+}
+
+
 static void item_link_q(item *it) {
     assert(it->empty_header.next == NULL_CHUNKPTR);
     assert(it->empty_header.prev == NULL_CHUNKPTR);
 
     assert( ((fsi.lru_head == NULL) ^ (fsi.lru_head == NULL)) == 0 );
-    if (fsi.lru_head != NULL) {
-        it->empty_header.next = get_chunkptr((chunk_t*) fsi.lru_head);
-        fsi.lru_head->empty_header.prev = get_chunkptr((chunk_t*) it);
+    if (it->empty_header.it_flags & ITEM_PROTECTED) {
+        if (fsi.lru_head != NULL) {
+            it->empty_header.next = get_chunkptr((chunk_t*) fsi.lru_head);
+            fsi.lru_head->empty_header.prev = get_chunkptr((chunk_t*) it);
+        }
+        fsi.lru_head = it;
+
+        if (fsi.lru_tail == NULL) {
+            fsi.lru_tail = it;
+        }
+        fsi.lru_protected_sz ++;
+    } else {
+        /* insert in front of the probationary segment, which is the very head
+         * of the LRU if nothing is protected. */
+        item* next = fsi.lru_probation_head;
+        item* prev;
+
+        if (next != NULL) {
+            prev = get_item_from_chunk(get_chunk_address(next->empty_header.prev));
+            it->empty_header.next = get_chunkptr((chunk_t*) next);
+            next->empty_header.prev = get_chunkptr((chunk_t*) it);
+        } else {
+            prev = fsi.lru_tail;
+            fsi.lru_tail = it;
+        }
+
+        if (prev != NULL) {
+            it->empty_header.prev = get_chunkptr((chunk_t*) prev);
+            prev->empty_header.next = get_chunkptr((chunk_t*) it);
+        } else {
+            fsi.lru_head = it;
+        }
+        fsi.lru_probation_head = it;
     }
-    fsi.lru_head = it;
+    fsi.lru_sz ++;
 
-    if (fsi.lru_tail == NULL) {
-        fsi.lru_tail = it;
+    if (it->empty_header.it_flags & ITEM_PROTECTED) {
+        item_demote_protected();
     }
 }
 
@@ -1144,6 +1423,14 @@ static void item_unlink_q(item* it) {
     next = get_item_from_chunk(get_chunk_address(it->empty_header.next));
     prev = get_item_from_chunk(get_chunk_address(it->empty_header.prev));
 
+    if (it == fsi.lru_probation_head) {
+        fsi.lru_probation_head = next;
+    }
+    if (it->empty_header.it_flags & ITEM_PROTECTED) {
+        fsi.lru_protected_sz --;
+    }
+    fsi.lru_sz --;
+
     if (it == fsi.lru_head) {
         assert(prev == NULL);
         fsi.lru_head = next;
@@ -1163,6 +1450,7 @@ static void item_unlink_q(item* it) {
     it->empty_header.prev = NULL_CHUNKPTR;
     it->empty_header.next = NULL_CHUNKPTR;
 }
+#endif /* #if defined(USE_CLOCK_EVICTION) */
 
 
 /**
@@ -1176,6 +1464,7 @@ int do_item_link(item* it, const char* key) {
     it->empty_header.it_flags |= ITEM_LINKED;
     it->empty_header.time = current_time;
     assoc_insert(it, key);
+    expiry_index_add(it);
 
     STATS_LOCK(stats);
     stats->item_total_size += ITEM_nkey(it) + ITEM_nbytes(it);
@@ -1232,14 +1521,30 @@ void do_item_unlink(item* it, long flags, const char* key) {
             STATS_LOCK(stats);
             stats->evictions ++;
             STATS_UNLOCK(stats);
+            if (is_item_large_chunk(it)) {
+                fsi.stats.large_evicted_ages[item_age_bucket(current_time - it->empty_header.time)] ++;
+            } else {
+                fsi.stats.small_evicted_ages[item_age_bucket(current_time - it->empty_header.time)] ++;
+            }
+#if !defined(USE_CLOCK_EVICTION)
+            if (it->empty_header.it_flags & ITEM_PROTECTED) {
+                fsi.lru_stats.protected_evictions ++;
+            } else {
+                fsi.lru_stats.probation_evictions ++;
+            }
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
         } else if (flags & UNLINK_IS_EXPIRED) {
             stats_expire(ITEM_nkey(it) + ITEM_nbytes(it));
+            STATS_LOCK(stats);
+            stats->expired_items ++;
+            STATS_UNLOCK(stats);
         }
         if (settings.detail_enabled) {
             stats_prefix_record_removal(key, ITEM_nkey(it), ITEM_nkey(it) + ITEM_nbytes(it), it->empty_header.time, flags);
         }
         assoc_delete(key, ITEM_nkey(it));
         it->empty_header.h_next = NULL_ITEM_PTR;
+        expiry_index_remove(it);
         item_unlink_q(it);
         if (it->empty_header.refcount == 0) {
             item_free(it);
@@ -1267,6 +1572,31 @@ void do_item_deref(item* it) {
 
 /** update LRU time to current and reposition */
 void do_item_update(item* it) {
+#if defined(USE_CLOCK_EVICTION)
+    /* no relinking; the hit only has to be visible to the clock hand. */
+    if ((it->empty_header.it_flags & ITEM_REFERENCED) == 0) {
+        it->empty_header.it_flags |= ITEM_REFERENCED;
+    }
+    if (it->empty_header.time < current_time - ITEM_UPDATE_INTERVAL) {
+        assert(it->empty_header.it_flags & ITEM_VALID);
+        it->empty_header.time = current_time;
+    }
+#else
+    if (settings.lru_protected_pct != 0 &&
+        (it->empty_header.it_flags & (ITEM_LINKED | ITEM_PROTECTED)) == ITEM_LINKED) {
+        /* second hit; promote to the protected segment right away. */
+        fsi.lru_stats.probation_hits ++;
+        fsi.lru_stats.promotions ++;
+        item_unlink_q(it);
+        it->empty_header.it_flags |= ITEM_PROTECTED;
+        it->empty_header.time = current_time;
+        item_link_q(it);
+        return;
+    }
+    if (it->empty_header.it_flags & ITEM_PROTECTED) {
+        fsi.lru_stats.protected_hits ++;
+    }
+
     if (it->empty_header.time < current_time - ITEM_UPDATE_INTERVAL) {
         assert(it->empty_header.it_flags & ITEM_VALID);
 
@@ -1276,6 +1606,7 @@ void do_item_update(item* it) {
             item_link_q(it);
         }
     }
+#endif /* #if defined(USE_CLOCK_EVICTION) */
 }
 
 int do_item_replace(item* it, item* new_it, const char* key) {
@@ -1284,6 +1615,17 @@ int do_item_replace(item* it, item* new_it, const char* key) {
     assert((it->empty_header.it_flags & (ITEM_VALID | ITEM_LINKED)) ==
            (ITEM_VALID | ITEM_LINKED));
     do_item_unlink(it, UNLINK_NORMAL, key);
+#if defined(USE_CLOCK_EVICTION)
+    /* an overwrite keeps the key's reference bit. */
+    if (it->empty_header.it_flags & ITEM_REFERENCED) {
+        new_it->empty_header.it_flags |= ITEM_REFERENCED;
+    }
+#else
+    /* an overwrite keeps the key's place in the protected segment. */
+    if (it->empty_header.it_flags & ITEM_PROTECTED) {
+        new_it->empty_header.it_flags |= ITEM_PROTECTED;
+    }
+#endif /* #if defined(USE_CLOCK_EVICTION) */
 
     assert(new_it->empty_header.it_flags & ITEM_VALID);
     retval = do_item_link(new_it, key);
@@ -1291,6 +1633,15 @@ int do_item_replace(item* it, item* new_it, const char* key) {
 }
 
 
+void do_item_lru_stats(lru_stats_t* out) {
+    *out = fsi.lru_stats;
+#if !defined(USE_CLOCK_EVICTION)
+    out->protected_items = fsi.lru_protected_sz;
+    out->probation_items = fsi.lru_sz - fsi.lru_protected_sz;
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
+}
+
+
 char* do_item_cachedump(const chunk_type_t type, const unsigned int limit, unsigned int* bytes) {
     unsigned int memlimit = ITEM_CACHEDUMP_LIMIT;   /* 2MB max response size */
     char *buffer;
@@ -1301,12 +1652,21 @@ char* do_item_cachedump(const chunk_type_t type, const unsigned int limit, unsig
     char temp[512];
     char key_temp[KEY_MAX_LENGTH];
     const char* key;
+#if defined(USE_CLOCK_EVICTION)
+    large_chunk_t* lc = fsi.flat_storage_start;
+    unsigned sc = 0;
+#endif /* #if defined(USE_CLOCK_EVICTION) */
 
     buffer = malloc((size_t)memlimit);
     if (buffer == 0) return NULL;
     bufcurr = 0;
 
+#if defined(USE_CLOCK_EVICTION)
+    /* without an LRU, dump the items in memory order. */
+    it = next_linked_item(&lc, &sc);
+#else
     it = fsi.lru_head;
+#endif /* #if defined(USE_CLOCK_EVICTION) */
 
     while (it != NULL && (limit == 0 || shown < limit)) {
         key = item_key_copy(it, key_temp);
@@ -1318,7 +1678,11 @@ char* do_item_cachedump(const chunk_type_t type, const unsigned int limit, unsig
         strcpy(buffer + bufcurr, temp);
         bufcurr += len;
         shown++;
+#if defined(USE_CLOCK_EVICTION)
+        it = next_linked_item(&lc, &sc);
+#else
         it = get_item_from_chunk(get_chunk_address(it->empty_header.next));
+#endif /* #if defined(USE_CLOCK_EVICTION) */
     }
 
     memcpy(buffer + bufcurr, "END\r\n", 6);
@@ -1345,6 +1709,18 @@ char* do_item_stats_sizes(int* bytes) {
     /* build the histogram */
     memset(histogram, 0, (size_t)num_buckets * sizeof(int));
 
+#if defined(USE_CLOCK_EVICTION)
+    large_chunk_t* lc = fsi.flat_storage_start;
+    unsigned sc = 0;
+    item* iter;
+
+    while ((iter = next_linked_item(&lc, &sc)) != NULL) {
+        int ntotal = ITEM_ntotal(iter);
+        int bucket = ntotal / 32;
+        if ((ntotal % 32) != 0) bucket++;
+        if (bucket < num_buckets) histogram[bucket]++;
+    }
+#else
     item* iter = fsi.lru_head;
     while (iter) {
         int ntotal = ITEM_ntotal(iter);
@@ -1362,6 +1738,7 @@ char* do_item_stats_sizes(int* bytes) {
         if (bucket < num_buckets) histogram[bucket]++;
         iter = get_item_from_chunk(get_chunk_address(iter->large_title.next));
     }
+#endif /* #if defined(USE_CLOCK_EVICTION) */
 
     /* write the buffer */
     *bytes = 0;
@@ -1377,6 +1754,21 @@ char* do_item_stats_sizes(int* bytes) {
 
 
 void do_item_flush_expired(void) {
+#if defined(USE_CLOCK_EVICTION)
+    large_chunk_t* lc = fsi.flat_storage_start;
+    unsigned sc = 0;
+    item* iter;
+
+    if (settings.oldest_live == 0)
+        return;
+
+    /* without an LRU ordering to stop early on, look at every item. */
+    while ((iter = next_linked_item(&lc, &sc)) != NULL) {
+        if (iter->empty_header.time >= settings.oldest_live) {
+            do_item_unlink(iter, UNLINK_IS_EXPIRED, NULL);
+        }
+    }
+#else
     item *iter, *next;
     if (settings.oldest_live == 0)
         return;
@@ -1408,6 +1800,7 @@ void do_item_flush_expired(void) {
             break;
         }
     }
+#endif /* #if defined(USE_CLOCK_EVICTION) */
 }
 
 
@@ -1492,10 +1885,16 @@ const char* item_key_copy(const item* it, char* keyptr) {
 
 
 char* do_flat_allocator_stats(size_t* result_size) {
-    size_t bufsize = 2048, offset = 0, i;
+    size_t bufsize = 4096, offset = 0, i;
     char* buffer = malloc(bufsize);
     char terminator[] = "END\r\n";
+#if defined(USE_CLOCK_EVICTION)
+    large_chunk_t* lc = fsi.flat_storage_start;
+    unsigned sc = 0;
+    item* iter;
+#else
     item* lru_item = NULL;
+#endif /* #if defined(USE_CLOCK_EVICTION) */
     rel_time_t oldest_item_lifetime;
 
     if (buffer == NULL) {
@@ -1503,6 +1902,16 @@ char* do_flat_allocator_stats(size_t* result_size) {
         return NULL;
     }
 
+#if defined(USE_CLOCK_EVICTION)
+    /* there's no LRU tail, and moving the clock hand would disturb eviction,
+     * so find the oldest item the long way. */
+    oldest_item_lifetime = 0;
+    while ((iter = next_linked_item(&lc, &sc)) != NULL) {
+        if (current_time - iter->empty_header.time > oldest_item_lifetime) {
+            oldest_item_lifetime = current_time - iter->empty_header.time;
+        }
+    }
+#else
     /* get the LRU items */
     lru_item = get_lru_item();
     if (lru_item == NULL) {
@@ -1510,6 +1919,7 @@ char* do_flat_allocator_stats(size_t* result_size) {
     } else {
         oldest_item_lifetime = current_time - lru_item->empty_header.time;
     }
+#endif /* #if defined(USE_CLOCK_EVICTION) */
 
     offset = append_to_buffer(buffer, bufsize, offset, sizeof(terminator),
                               "STAT large_chunk_sz %d\n"
@@ -1548,6 +1958,33 @@ char* do_flat_allocator_stats(size_t* result_size) {
                               fsi.small_free_list_sz,
                               oldest_item_lifetime);
 
+    offset = append_to_buffer(buffer, bufsize, offset, sizeof(terminator),
+                              "STAT large_requested_bytes %" PRINTF_INT64_MODIFIER "u\n"
+                              "STAT large_wasted_bytes %" PRINTF_INT64_MODIFIER "u\n"
+                              "STAT small_requested_bytes %" PRINTF_INT64_MODIFIER "u\n"
+                              "STAT small_wasted_bytes %" PRINTF_INT64_MODIFIER "u\n",
+                              fsi.stats.large_requested_bytes,
+                              (fsi.stats.large_title_chunks + fsi.stats.large_body_chunks) * LARGE_CHUNK_SZ -
+                              fsi.stats.large_requested_bytes,
+                              fsi.stats.small_requested_bytes,
+                              (fsi.stats.small_title_chunks + fsi.stats.small_body_chunks) * SMALL_CHUNK_SZ -
+                              fsi.stats.small_requested_bytes);
+
+    for (i = 0; i < ITEM_AGE_BUCKETS; i ++) {
+        if (fsi.stats.large_evicted_ages[i] != 0) {
+            offset = append_to_buffer(buffer, bufsize, offset, sizeof(terminator),
+                                      "STAT large_evicted_age_%u %" PRINTF_INT64_MODIFIER "u\n",
+                                      item_age_bucket_start(i), fsi.stats.large_evicted_ages[i]);
+        }
+    }
+    for (i = 0; i < ITEM_AGE_BUCKETS; i ++) {
+        if (fsi.stats.small_evicted_ages[i] != 0) {
+            offset = append_to_buffer(buffer, bufsize, offset, sizeof(terminator),
+                                      "STAT small_evicted_age_%u %" PRINTF_INT64_MODIFIER "u\n",
+                                      item_age_bucket_start(i), fsi.stats.small_evicted_ages[i]);
+        }
+    }
+
     offset = append_to_buffer(buffer, bufsize, offset, 0, terminator);
 
     *result_size = offset;
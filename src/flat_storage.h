@@ -63,8 +63,8 @@
  *
  *
  * title chunks also contain:
- *     next                    # LRU next
- *     prev                    # LRU prev
+ *     next                    # LRU next (not with CLOCK eviction)
+ *     prev                    # LRU prev (not with CLOCK eviction)
  *     h_next                  # hash next
  *     chunk_next              # chunk next
  *     rel_time_t time
@@ -146,6 +146,15 @@ typedef enum it_flags_e {
     ITEM_DELETED = 0x4,                 /* deferred delete. */
     ITEM_HAS_IP_ADDRESS = 0x10,
     ITEM_HAS_TIMESTAMP = 0x20,
+    ITEM_EXPIRY_INDEXED = 0x40,         /* in the expiration index. */
+#if defined(USE_CLOCK_EVICTION)
+    ITEM_REFERENCED = 0x8,              /* hit since the clock hand last
+                                         * passed. */
+    ITEM_COMPRESSED = 0x80,             /* value is LZ4 compressed. */
+#else
+    ITEM_PROTECTED = 0x80,              /* in the protected segment of the LRU. */
+    ITEM_COMPRESSED = 0x8,              /* value is LZ4 compressed. */
+#endif /* #if defined(USE_CLOCK_EVICTION) */
 } it_flags_t;
 
 
@@ -183,6 +192,9 @@ typedef enum chunk_type_e {
 
 #define LRU_SEARCH_DEPTH   50           /* number of items we'll check in the
                                          * LRU to find items to evict. */
+#define CLOCK_SEARCH_DEPTH 4096         /* number of chunks the clock hand
+                                         * will pass to find an item to
+                                         * evict. */
 
 /**
  * data types and structures
@@ -201,10 +213,20 @@ typedef union item_u item;
 typedef struct large_chunk_s large_chunk_t;
 typedef struct small_chunk_s small_chunk_t;
 
+/* with CLOCK eviction, there is no LRU to link into. */
+#if defined(USE_CLOCK_EVICTION)
+#define TITLE_CHUNK_LRU_LINKS
+#else
+#define TITLE_CHUNK_LRU_LINKS                                           \
+    chunkptr_t next;                        /* LRU next */              \
+    chunkptr_t prev;                        /* LRU prev */
+#endif /* #if defined(USE_CLOCK_EVICTION) */
+
 #define TITLE_CHUNK_HEADER_CONTENTS                                     \
     item_ptr_t h_next;                      /* hash next */             \
-    chunkptr_t next;                        /* LRU next */              \
-    chunkptr_t prev;                        /* LRU prev */              \
+    TITLE_CHUNK_LRU_LINKS                                               \
+    item_ptr_t exp_next;                    /* expiration index next */ \
+    item_ptr_t exp_prev;                    /* expiration index prev */ \
     chunkptr_t next_chunk;                  /* next chunk */            \
     rel_time_t time;                        /* most recent access */    \
     rel_time_t exptime;                     /* expire time */           \
@@ -356,10 +378,26 @@ struct flat_storage_info_s {
     small_chunk_t* small_free_list;     // free list head.
     size_t small_free_list_sz;          // number of small free list chunks.
 
+#if defined(USE_CLOCK_EVICTION)
+    // CLOCK.  the hand sweeps over the storage region one chunk at a time,
+    // visiting each small chunk of a broken large chunk in turn.
+    large_chunk_t* clock_hand;          // large chunk under the hand.
+    unsigned clock_hand_small;          // small chunk under the hand, if the
+                                        // large chunk is broken.
+#else
     // LRU.
     item* lru_head;
     item* lru_tail;
 
+    // segmented LRU.  the protected segment runs from lru_head up to
+    // lru_probation_head, the probationary segment from lru_probation_head to
+    // lru_tail.
+    item* lru_probation_head;           // first probationary item.
+    size_t lru_protected_sz;            // number of protected items.
+#endif /* #if defined(USE_CLOCK_EVICTION) */
+    size_t lru_sz;                      // number of linked items.
+    lru_stats_t lru_stats;
+
     bool initialized;
 
     struct {
@@ -374,6 +412,15 @@ struct flat_storage_info_s {
         uint64_t unbreak_events;
 
         uint64_t migrates;
+
+        // bytes asked for by the items stored in each kind of chunk; the rest
+        // of the chunks is wasted.
+        uint64_t large_requested_bytes;
+        uint64_t small_requested_bytes;
+
+        // evictions by how long the item had gone unused.
+        uint64_t large_evicted_ages[ITEM_AGE_BUCKETS];
+        uint64_t small_evicted_ages[ITEM_AGE_BUCKETS];
     } stats;
 };
 
@@ -660,6 +707,11 @@ static inline item_ptr_t* ITEM_h_next_p(item* it)               { return &it->em
 
 static inline void   ITEM_set_h_next(item* it, item_ptr_t next) { it->empty_header.h_next = next; }
 
+static inline item_ptr_t ITEM_exp_next(item* it)                  { return it->empty_header.exp_next; }
+static inline item_ptr_t ITEM_exp_prev(item* it)                  { return it->empty_header.exp_prev; }
+static inline void ITEM_set_exp_next(item* it, item_ptr_t next)   { it->empty_header.exp_next = next; }
+static inline void ITEM_set_exp_prev(item* it, item_ptr_t prev)   { it->empty_header.exp_prev = prev; }
+
 static inline bool ITEM_is_valid(item* it)        { return it->empty_header.it_flags & ITEM_VALID; }
 static inline bool ITEM_has_timestamp(item* it)   { return it->empty_header.it_flags & ITEM_HAS_TIMESTAMP; }
 static inline bool ITEM_has_ip_address(item* it)  { return it->empty_header.it_flags & ITEM_HAS_IP_ADDRESS; }
@@ -670,6 +722,15 @@ static inline void ITEM_set_has_timestamp(item* it)      { it->empty_header.it_f
 static inline void ITEM_clear_has_timestamp(item* it)    { it->empty_header.it_flags &= ~(ITEM_HAS_TIMESTAMP); }
 static inline void ITEM_set_has_ip_address(item* it)     { it->empty_header.it_flags |= ITEM_HAS_IP_ADDRESS; }
 static inline void ITEM_clear_has_ip_address(item* it)   { it->empty_header.it_flags &= ~(ITEM_HAS_IP_ADDRESS); }
+static inline bool ITEM_is_expiry_indexed(item* it)      { return it->empty_header.it_flags & ITEM_EXPIRY_INDEXED; }
+static inline void ITEM_set_expiry_indexed(item* it)     { it->empty_header.it_flags |= ITEM_EXPIRY_INDEXED; }
+static inline void ITEM_clear_expiry_indexed(item* it)   { it->empty_header.it_flags &= ~(ITEM_EXPIRY_INDEXED); }
+static inline bool ITEM_is_compressed(item* it)         { return it->empty_header.it_flags & ITEM_COMPRESSED; }
+static inline void ITEM_set_compressed(item* it)        { it->empty_header.it_flags |= ITEM_COMPRESSED; }
+static inline void ITEM_clear_compressed(item* it)      { it->empty_header.it_flags &= ~(ITEM_COMPRESSED); }
+/* the flat allocator has no extension tier. */
+static inline bool ITEM_is_tiered(item* it)             { return false; }
+static inline void ITEM_clear_tiered(item* it)          { }
 
 extern void flat_storage_init(size_t maxbytes);
 extern char* do_item_cachedump(const chunk_type_t type, const unsigned int limit, unsigned int *bytes);
@@ -22,22 +22,25 @@
 #include "conn_buffer.h"
 
 static inline int add_item_value_to_iov(conn *c, const item* it, bool send_cr_lf) {
-    int retval;
+    int retval = 0;
+
+    zerocopy_value_start(c, it->empty_header.nbytes);
 
 #define ADD_ITEM_TO_IOV_APPLIER(it, ptr, bytes)                 \
-    if ((retval = add_iov(c, (ptr), (bytes), false)) != 0) {    \
-        return retval;                                          \
+    if (retval == 0) {                                          \
+        retval = add_iov(c, (ptr), (bytes), false);             \
     }
 
     ITEM_WALK(it, it->empty_header.nkey, it->empty_header.nbytes, false, ADD_ITEM_TO_IOV_APPLIER, const);
 
 #undef ADD_ITEM_TO_IOV_APPLIER
 
-    if (send_cr_lf) {
-        return add_iov(c, "\r\n", 2, false);
-    } else {
-        return 0;
+    if (send_cr_lf && retval == 0) {
+        retval = add_iov(c, "\r\n", 2, false);
     }
+
+    zerocopy_value_end(c);
+    return retval;
 }
 
 
@@ -72,9 +75,16 @@ static inline size_t item_setup_receive(item* it, conn* c) {
         if (c->riov == NULL) {
             return false;
         }
+    } else if (sizeof(struct iovec) * iov_len_required > CONN_BUFFER_SMALL_DATA_SZ &&
+               is_small_conn_buffer(c->riov)) {
+        /* in binary protocol, receiving the key already requires the riov to
+         * be set up, but it may be too small for the value. */
+        struct iovec* riov = (struct iovec*) promote_conn_buffer(c->cbg, c->riov, 0);
+        if (riov == NULL) {
+            return false;
+        }
+        c->riov = riov;
     }
-    /* in binary protocol, receiving the key already requires the riov to be set
-     * up. */
 
     report_max_rusage(c->cbg, c->riov, sizeof(struct iovec) * iov_len_required);
     c->riov_size = iov_len_required;
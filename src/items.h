@@ -14,6 +14,44 @@
                                             * expiration.  need to check the
                                             * expiration time. */
 
+/* replacement policy counters.  the segmented LRU counters are only kept with
+ * LRU lists, the clock counters only with CLOCK eviction. */
+typedef struct lru_stats_s lru_stats_t;
+struct lru_stats_s {
+    uint64_t probation_items;
+    uint64_t protected_items;
+    uint64_t probation_hits;
+    uint64_t protected_hits;
+    uint64_t promotions;
+    uint64_t demotions;
+    uint64_t probation_evictions;
+    uint64_t protected_evictions;
+    uint64_t clock_steps;               /* chunks examined by the clock hand. */
+    uint64_t clock_second_chances;      /* referenced items the hand spared. */
+    uint64_t size_aware_picks;          /* size-aware evictions that passed over
+                                         * the oldest candidate. */
+};
+
+/* eviction age histograms.  bucket 0 counts items evicted less than a second
+ * after they were last used, and bucket b > 0 those evicted between 2^(b-1)
+ * and 2^b seconds after, except that the last bucket is open-ended. */
+#define ITEM_AGE_BUCKETS 20
+
+static inline unsigned int item_age_bucket(rel_time_t age) {
+    unsigned int bucket = 0;
+
+    while (age != 0 && bucket < ITEM_AGE_BUCKETS - 1) {
+        age >>= 1;
+        bucket ++;
+    }
+    return bucket;
+}
+
+/* the smallest age, in seconds, counted by a bucket. */
+static inline rel_time_t item_age_bucket_start(unsigned int bucket) {
+    return (bucket == 0) ? 0 : ((rel_time_t) 1 << (bucket - 1));
+}
+
 #if defined(USE_SLAB_ALLOCATOR)
 #include "slabs.h"
 #include "slabs_items.h"
@@ -41,6 +79,7 @@ extern int   do_item_replace(item *it, item *new_it, const char* key);
 
 /*@null@*/
 extern char* do_item_stats_sizes(int *bytes);
+extern void  do_item_lru_stats(lru_stats_t *lru_stats);
 extern void  do_item_flush_expired(void);
 extern item* item_get(const char *key, const size_t nkey);
 
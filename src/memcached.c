@@ -15,6 +15,7 @@
  *
  *  $Id$
  */
+#define _GNU_SOURCE 1
 #include "generic.h"
 
 #include <signal.h>
@@ -49,11 +50,15 @@
 
 #include "assoc.h"
 #include "binary_sm.h"
+#include "expiry.h"
 #include "items.h"
 #include "memcached.h"
 #include "stats.h"
 #include "sigseg.h"
 #include "conn_buffer.h"
+#include "compress.h"
+#include "tier.h"
+#include "udp_reassembly.h"
 
 #if defined(USE_SLAB_ALLOCATOR)
 #include "slabs_items_support.h"
@@ -78,14 +83,19 @@ static void maximize_socket_buffer(const int sfd, int optname);
 static void settings_init(void);
 
 /* event handling, network IO */
-static void event_handler(const int fd, const short which, void *arg);
 static void conn_init(void);
 static void complete_nread(conn* c);
 static void process_command(conn* c, char *command);
 static int ensure_iov_space(conn* c);
+static int ensure_wbuf(conn* const c, const size_t req_bytes);
+static void udp_batch_free(conn* c);
+static inline bool udp_batch_pending(const conn* c);
+static void udp_batch_hold_reply(conn* c);
 
 void pre_gdb(void);
 static void conn_free(conn* c);
+static void conn_free_buffers(conn* c);
+static void conn_link(conn* c, conn** list);
 
 /** exported globals **/
 settings_t settings;
@@ -158,6 +168,7 @@ static void settings_init(void) {
     settings.binary_udpport = 0;
     settings.interf.s_addr = htonl(INADDR_ANY);
     settings.maxbytes = 64 * 1024 * 1024; /* default is 64MB */
+    settings.item_size_max = MAX_ITEM_SIZE;
     settings.maxconns = 1024;         /* to limit connections-related memory to about 5MB */
     settings.verbose = 0;
     settings.oldest_live = 0;
@@ -169,6 +180,28 @@ static void settings_init(void) {
     settings.prefix_delimiter = ':';
     settings.detail_enabled = 0;
     settings.reqs_per_event = 1;
+    settings.lru_protected_pct = 0;   /* plain LRU */
+    settings.admission_items = 0;     /* admit everything */
+    settings.size_aware_eviction = false;
+    settings.slab_automove_interval = 0; /* off */
+    settings.slab_profile = NULL;
+    settings.compress_threshold = 0;   /* don't compress */
+    settings.tier_path = NULL;         /* no tier */
+    settings.tier_size = 1024 * 1024 * 1024;
+    settings.tier_threshold = 16 * 1024;
+    settings.udp_batch_size = 32;
+    settings.udp_reassembly_limit = 4 * 1024 * 1024;
+    settings.reuseport = false;
+    settings.edge_triggered = false;
+    settings.uring = false;
+    settings.reply_batch_size = 64;
+    settings.zerocopy_min = 0;
+    settings.busy_poll_usec = 0;
+    settings.socket_busy_poll_usec = 0;
+    settings.idle_timeout = 0;         /* never close idle connections */
+    settings.idle_slim_timeout = 0;
+    settings.conn_memory_max = 0;      /* no limit */
+    settings.direct_read_min = 16 * 1024;
 
 #ifdef HAVE__SC_NPROCESSORS_ONLN
     /*
@@ -181,6 +214,172 @@ static void settings_init(void) {
 #endif
 }
 
+/*
+ * Grows one of a connection's buffers, ptr, from old_size to new_size bytes.
+ * The bigger buffer comes from the thread's scratch arena (or, if that is
+ * held and full, one of the connection's own), which the connection then
+ * holds until its response has been sent.
+ *
+ * Returns the new buffer, or NULL on out-of-memory.
+ */
+void* conn_scratch_grow(conn* c, void* ptr, const size_t old_size, const size_t new_size) {
+    size_t more = new_size;
+
+    assert(c != NULL);
+
+    /* a buffer of the connection's own stays with it. */
+    if (ptr != c->own_wbuf &&
+        ptr != c->own_ilist &&
+        ptr != c->own_msglist) {
+        more -= old_size;
+    }
+    if (! conn_memory_allows(c, more)) {
+        return NULL;
+    }
+
+    if (c->arena == NULL &&
+        (c->arena = conn_arena_hold(thread_conn_arena(c->event.ev_base))) == NULL) {
+        return NULL;
+    }
+    return conn_arena_realloc(c->arena, ptr, old_size, new_size);
+}
+
+/*
+ * Decompresses the value of a compressed item into the connection's scratch
+ * memory, which it holds until its response has been sent, so that the value
+ * can go out from there.  Returns the value, and its length in *len, or NULL
+ * if there is no memory or the value is corrupt.
+ */
+char* conn_decompress(conn* c, item* it, size_t* len) {
+    ssize_t plain_len = item_decompressed_len(it);
+    char* plain;
+
+    if (plain_len < 0 ||
+        (plain = conn_scratch_grow(c, NULL, 0, plain_len)) == NULL ||
+        ! item_decompress(it, plain, plain_len)) {
+        return NULL;
+    }
+    *len = plain_len;
+    return plain;
+}
+
+/*
+ * Roughly the memory a connection holds.  A big connection buffer is address
+ * space that is only backed as far as it is used, so it counts for what is
+ * in it.
+ */
+size_t conn_memory(const conn* c) {
+    size_t bytes = sizeof(conn);
+    const bp_hdr_pool_t* bph;
+
+    if (c->own_wbuf != NULL) {
+        bytes += DATA_BUFFER_SIZE;
+    }
+    if (c->wbuf != c->own_wbuf) {
+        bytes += c->wsize;
+    }
+    if (c->own_ilist != NULL) {
+        bytes += sizeof(item*) * ITEM_LIST_INITIAL;
+    }
+    if (c->ilist != c->own_ilist) {
+        bytes += sizeof(item*) * c->isize;
+    }
+    if (c->own_msglist != NULL) {
+        bytes += sizeof(struct msghdr) * MSG_LIST_INITIAL;
+    }
+    if (c->msglist != c->own_msglist) {
+        bytes += sizeof(struct msghdr) * c->msgsize;
+    }
+    bytes += UDP_HEADER_SIZE * c->hdrsize;
+
+    if (c->rbuf != NULL) {
+        bytes += is_small_conn_buffer(c->rbuf) ? CONN_BUFFER_SMALL_SIZE :
+            (size_t) (c->rcurr - c->rbuf) + c->rbytes;
+    }
+    if (c->iov != NULL) {
+        bytes += is_small_conn_buffer(c->iov) ? CONN_BUFFER_SMALL_SIZE :
+            sizeof(struct iovec) * c->iovused;
+    }
+    if (c->riov != NULL) {
+        bytes += is_small_conn_buffer(c->riov) ? CONN_BUFFER_SMALL_SIZE :
+            sizeof(struct iovec) * c->riov_size;
+    }
+
+    if (c->bp_key != NULL) {
+        bytes += KEY_MAX_LENGTH + 1;
+    }
+    for (bph = c->bp_hdr_pool; bph != NULL; bph = bph->next) {
+        bytes += sizeof(bp_hdr_pool_t) + BP_HDR_POOL_INIT_SIZE;
+    }
+    return bytes;
+}
+
+/*
+ * Returns true if a tcp connection may take on another more bytes without
+ * going over settings.conn_memory_max.
+ */
+bool conn_memory_allows(conn* c, const size_t more) {
+    stats_t *stats;
+
+    if (settings.conn_memory_max == 0 ||
+        c->udp ||
+        conn_memory(c) + more <= settings.conn_memory_max) {
+        return true;
+    }
+
+    if (settings.verbose > 0) {
+        fprintf(stderr, "<%d would go over its memory cap\n", c->sfd);
+    }
+    stats = STATS_GET_TLS();
+    STATS_LOCK(stats);
+    stats->conn_memory_capped++;
+    STATS_UNLOCK(stats);
+    return false;
+}
+
+/*
+ * Returns how much of avail bytes a connection may read into its big read
+ * buffer; reading is what grows it.
+ */
+static int conn_read_room(conn* c, const int avail) {
+    size_t held;
+
+    if (settings.conn_memory_max == 0) {
+        return avail;
+    }
+
+    held = conn_memory(c);
+    if (held + avail <= settings.conn_memory_max) {
+        return avail;
+    }
+    if (held < settings.conn_memory_max) {
+        return (int) (settings.conn_memory_max - held);
+    }
+    return conn_memory_allows(c, 1) ? avail : 0;
+}
+
+/*
+ * Puts a connection back on its own buffers, and lets go of the scratch
+ * arena.  Nothing in the buffers is kept.
+ */
+static void conn_scratch_release(conn* c) {
+    if (c->arena == NULL) {
+        return;
+    }
+
+    c->wbuf = c->own_wbuf;
+    c->wsize = DATA_BUFFER_SIZE;
+    c->ilist = c->own_ilist;
+    c->isize = ITEM_LIST_INITIAL;
+    c->msglist = c->own_msglist;
+    c->msgsize = MSG_LIST_INITIAL;
+    c->hdrbuf = NULL;
+    c->hdrsize = 0;
+
+    conn_arena_release(c->arena);
+    c->arena = NULL;
+}
+
 /*
  * Adds a message header to a connection.
  *
@@ -193,8 +392,8 @@ int add_msghdr(conn* c)
     assert(c != NULL);
 
     if (c->msgsize == c->msgused) {
-        msg = pool_realloc(c->msglist, c->msgsize * 2 * sizeof(struct msghdr),
-                           c->msgsize * sizeof(struct msghdr), CONN_BUFFER_MSGLIST_POOL);
+        msg = conn_scratch_grow(c, c->msglist, c->msgsize * sizeof(struct msghdr),
+                                c->msgsize * 2 * sizeof(struct msghdr));
         if (! msg)
             return -1;
         c->msglist = msg;
@@ -359,12 +558,81 @@ static int allocate_udp_reply_port(int sfd, int tries) {
 }
 #endif
 
+/*
+ * Allocates the buffers a connection keeps between requests.  Returns false,
+ * with none of them allocated, on out-of-memory.
+ */
+static bool conn_alloc_buffers(conn* c, const bool is_binary) {
+    c->wsize = DATA_BUFFER_SIZE;
+    c->isize = ITEM_LIST_INITIAL;
+    c->msgsize = MSG_LIST_INITIAL;
+
+    c->wbuf = (char *)pool_malloc((size_t)c->wsize, CONN_BUFFER_WBUF_POOL);
+    c->ilist = (item **)pool_malloc(sizeof(item *) * c->isize, CONN_BUFFER_ILIST_POOL);
+    c->msglist = (struct msghdr *)pool_malloc(sizeof(struct msghdr) * c->msgsize, CONN_BUFFER_MSGLIST_POOL);
+
+    if (is_binary) {
+        // because existing functions expects the key to be null-terminated,
+        // we must do so as well.
+        c->bp_key = (char*)pool_malloc(sizeof(char) * KEY_MAX_LENGTH + 1, CONN_BUFFER_BP_KEY_POOL);
+
+        c->bp_hdr_pool = bp_allocate_hdr_pool(NULL);
+    } else {
+        c->bp_key = NULL;
+        c->bp_hdr_pool = NULL;
+    }
+
+    c->own_wbuf = c->wbuf;
+    c->own_ilist = c->ilist;
+    c->own_msglist = c->msglist;
+
+    if (c->wbuf == 0 ||
+        c->ilist == 0 ||
+        c->msglist == 0 ||
+        (is_binary && (c->bp_key == 0 || c->bp_hdr_pool == NULL))) {
+        conn_free_buffers(c);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Frees the buffers of conn_alloc_buffers(..).  The connection must be on
+ * its own buffers.
+ */
+static void conn_free_buffers(conn* c) {
+    assert(c->arena == NULL);
+
+    if (c->msglist)
+        pool_free(c->msglist, sizeof(struct msghdr) * c->msgsize, CONN_BUFFER_MSGLIST_POOL);
+    if (c->wbuf)
+        pool_free(c->wbuf, c->wsize, CONN_BUFFER_WBUF_POOL);
+    if (c->ilist)
+        pool_free(c->ilist, sizeof(item*) * c->isize, CONN_BUFFER_ILIST_POOL);
+    if (c->bp_key)
+        pool_free(c->bp_key, sizeof(char) * KEY_MAX_LENGTH + 1, CONN_BUFFER_BP_KEY_POOL);
+    if (c->bp_hdr_pool)
+        bp_release_hdr_pool(c);
+
+    c->wbuf = c->wcurr = c->own_wbuf = NULL;
+    c->wsize = 0;
+    c->ilist = c->icurr = c->own_ilist = NULL;
+    c->isize = 0;
+    c->msglist = c->own_msglist = NULL;
+    c->msgsize = 0;
+    c->bp_key = NULL;
+}
+
 conn *conn_new(const int sfd, const int init_state, const int event_flags,
                conn_buffer_group_t* cbg, const bool is_udp, const bool is_binary,
                const struct sockaddr* const addr, const socklen_t addrlen,
                struct event_base *base) {
     stats_t *stats = STATS_GET_TLS();
     conn* c = conn_from_freelist();
+    int ev_flags = event_flags;
+#if defined(USE_URING)
+    uring_t* ring;
+#endif /* #if defined(USE_URING) */
 
     if (NULL == c) {
         if (!(c = (conn*)pool_calloc(1, sizeof(conn), CONN_POOL))) {
@@ -373,41 +641,17 @@ conn *conn_new(const int sfd, const int init_state, const int event_flags,
         }
 
         c->rsize = 0;
-        c->wsize = DATA_BUFFER_SIZE;
-        c->isize = ITEM_LIST_INITIAL;
         c->iovsize = 0;
-        c->msgsize = MSG_LIST_INITIAL;
         c->hdrsize = 0;
         c->riov_size = 0;
 
         c->rbuf = NULL;
-        c->wbuf = (char *)pool_malloc((size_t)c->wsize, CONN_BUFFER_WBUF_POOL);
-        c->ilist = (item **)pool_malloc(sizeof(item *) * c->isize, CONN_BUFFER_ILIST_POOL);
         c->iov = NULL;
-        c->msglist = (struct msghdr *)pool_malloc(sizeof(struct msghdr) * c->msgsize, CONN_BUFFER_MSGLIST_POOL);
         c->hdrbuf = NULL;
         c->riov = NULL;
+        c->arena = NULL;
 
-        if (is_binary) {
-            // because existing functions expects the key to be null-terminated,
-            // we must do so as well.
-            c->bp_key = (char*)pool_malloc(sizeof(char) * KEY_MAX_LENGTH + 1, CONN_BUFFER_BP_KEY_POOL);
-
-            c->bp_hdr_pool = bp_allocate_hdr_pool(NULL);
-        } else {
-            c->bp_key = NULL;
-            c->bp_hdr_pool = NULL;
-        }
-
-        if (c->wbuf == 0 ||
-            c->ilist == 0 ||
-            c->msglist == 0 ||
-            (is_binary && c->bp_key == 0)) {
-            if (c->wbuf != 0) pool_free(c->wbuf, c->wsize, CONN_BUFFER_WBUF_POOL);
-            if (c->ilist !=0) pool_free(c->ilist, sizeof(item*) * c->isize, CONN_BUFFER_ILIST_POOL);
-            if (c->msglist != 0) pool_free(c->msglist, sizeof(struct msghdr) * c->msgsize, CONN_BUFFER_MSGLIST_POOL);
-            if (c->bp_key != 0) pool_free(c->bp_key, sizeof(char) * KEY_MAX_LENGTH + 1, CONN_BUFFER_BP_KEY_POOL);
-            if (c->bp_hdr_pool != NULL) bp_release_hdr_pool(c);
+        if (! conn_alloc_buffers(c, is_binary)) {
             pool_free(c, 1 * sizeof(conn), CONN_POOL);
             perror("malloc()");
             return NULL;
@@ -463,6 +707,7 @@ conn *conn_new(const int sfd, const int init_state, const int event_flags,
     c->iovused = 0;
     c->msgcurr = 0;
     c->msgused = 0;
+    c->held = 0;
     c->riov_curr = 0;
     c->riov_left = 0;
 
@@ -471,11 +716,40 @@ conn *conn_new(const int sfd, const int init_state, const int event_flags,
     c->item = 0;
     c->bucket = -1;
     c->gen = 0;
-
-    event_set(&c->event, sfd, event_flags, event_handler, (void *)c);
+    c->accept_compressed = false;
+    c->direct_read = false;
+    c->tier_pending = 0;
+    c->tier_failed = false;
+    c->tier_resume = init_state;
+    c->slim = false;
+    c->conn_list = NULL;
+    c->active = true;
+
+#if defined(EV_ET)
+    if (settings.edge_triggered &&
+        ! is_udp &&
+        init_state != conn_listening) {
+        /* the state machine only waits once a read or a write comes up
+           short, so the edges are all it needs, whichever it's waiting for;
+           update_event(..) leaves these be. */
+        ev_flags = EV_READ | EV_WRITE | EV_PERSIST | EV_ET;
+    }
+#endif /* #if defined(EV_ET) */
+
+    event_set(&c->event, sfd, ev_flags, event_handler, (void *)c);
     event_base_set(base, &c->event);
-    c->ev_flags = event_flags;
-
+    c->ev_flags = ev_flags;
+
+#if defined(USE_URING)
+    c->uring.ring = NULL;
+    if (settings.uring &&
+        ! is_udp &&
+        init_state != conn_listening &&
+        (ring = thread_uring(base)) != NULL) {
+        /* its socket i/o goes through the ring; the event is never added. */
+        uring_conn_init(ring, c);
+    } else
+#endif /* #if defined(USE_URING) */
     if (event_add(&c->event, 0) == -1) {
         if (conn_add_to_freelist(c)) {
             conn_free(c);
@@ -483,6 +757,25 @@ conn *conn_new(const int sfd, const int init_state, const int event_flags,
         return NULL;
     }
 
+#if defined(USE_ZEROCOPY)
+    zerocopy_conn_init(c);
+#endif /* #if defined(USE_ZEROCOPY) */
+#if defined(SO_BUSY_POLL)
+    if (settings.socket_busy_poll_usec > 0 &&
+        ! is_udp &&
+        init_state != conn_listening &&
+        setsockopt(sfd, SOL_SOCKET, SO_BUSY_POLL, &settings.socket_busy_poll_usec,
+                   sizeof(settings.socket_busy_poll_usec)) != 0 &&
+        settings.verbose > 0) {
+        perror("setsockopt(SO_BUSY_POLL)");
+    }
+#endif /* #if defined(SO_BUSY_POLL) */
+
+    if (! is_udp &&
+        init_state != conn_listening) {
+        conn_link(c, thread_conn_list(base));
+    }
+
     STATS_LOCK(stats);
     stats->curr_conns++;
     stats->total_conns++;
@@ -510,6 +803,11 @@ void conn_cleanup(conn* c) {
         c->write_and_free = 0;
     }
 
+    conn_scratch_release(c);
+
+    /* datagrams not yet served are in the read buffer. */
+    udp_batch_free(c);
+
     if (c->rbuf) {
         free_conn_buffer(c->cbg, c->rbuf, 0);   /* no idea how much was used... */
         c->rbuf = NULL;
@@ -533,32 +831,71 @@ void conn_cleanup(conn* c) {
  */
 void conn_free(conn* c) {
     if (c) {
-        if (c->hdrbuf)
-            pool_free(c->hdrbuf, c->hdrsize * UDP_HEADER_SIZE, CONN_BUFFER_HDRBUF_POOL);
-        if (c->msglist)
-            pool_free(c->msglist, sizeof(struct msghdr) * c->msgsize, CONN_BUFFER_MSGLIST_POOL);
+        conn_scratch_release(c);
+        udp_batch_free(c);
         if (c->rbuf)
             free_conn_buffer(c->cbg, c->rbuf, 0);
-        if (c->wbuf)
-            pool_free(c->wbuf, c->wsize, CONN_BUFFER_WBUF_POOL);
-        if (c->ilist)
-            pool_free(c->ilist, sizeof(item*) * c->isize, CONN_BUFFER_ILIST_POOL);
         if (c->iov)
             free_conn_buffer(c->cbg, c->iov, c->iovused * sizeof(struct iovec));
         if (c->riov)
             free_conn_buffer(c->cbg, c->riov, 0);
-        if (c->bp_key)
-            pool_free(c->bp_key, sizeof(char) * KEY_MAX_LENGTH + 1, CONN_BUFFER_BP_KEY_POOL);
-        if (c->bp_hdr_pool)
-            bp_release_hdr_pool(c);
+        conn_free_buffers(c);
         pool_free(c, 1 * sizeof(conn), CONN_POOL);
     }
 }
 
+/*
+ * Puts a worker thread's tcp connection on its list, if there is one.
+ */
+static void conn_link(conn* c, conn** list) {
+    if (list == NULL) {
+        return;
+    }
+
+    c->conn_list = list;
+    c->prev_conn = NULL;
+    c->next_conn = *list;
+    if (*list != NULL) {
+        (*list)->prev_conn = c;
+    }
+    *list = c;
+}
+
+static void conn_unlink(conn* c) {
+    if (c->conn_list == NULL) {
+        return;
+    }
+
+    if (c->prev_conn != NULL) {
+        c->prev_conn->next_conn = c->next_conn;
+    } else {
+        *c->conn_list = c->next_conn;
+    }
+    if (c->next_conn != NULL) {
+        c->next_conn->prev_conn = c->prev_conn;
+    }
+    c->conn_list = NULL;
+    c->next_conn = c->prev_conn = NULL;
+}
+
 void conn_close(conn* c) {
     stats_t *stats = STATS_GET_TLS();
     assert(c != NULL);
 
+#if defined(USE_URING)
+    /* the ring calls us again once the kernel is done with the socket. */
+    if (c->uring.ring != NULL &&
+        ! uring_conn_close(c)) {
+        return;
+    }
+#endif /* #if defined(USE_URING) */
+#if defined(USE_ZEROCOPY)
+    /* the kernel may still be sending from items the connection holds. */
+    if (! zerocopy_conn_close(c)) {
+        return;
+    }
+#endif /* #if defined(USE_ZEROCOPY) */
+
     /* delete the event, the socket and the conn */
     event_del(&c->event);
 
@@ -567,10 +904,12 @@ void conn_close(conn* c) {
 
     close(c->sfd);
     accept_new_conns(true, c->binary);
+    conn_unlink(c);
     conn_cleanup(c);
 
-    /* if the connection has big buffers, just free it */
-    if (c->rsize > READ_BUFFER_HIGHWAT ||
+    /* if the connection has big buffers, or none, just free it */
+    if (c->slim ||
+        c->rsize > READ_BUFFER_HIGHWAT ||
         c->wsize > WRITE_BUFFER_HIGHWAT ||
         conn_add_to_freelist(c)) {
         conn_free(c);
@@ -595,6 +934,8 @@ void conn_close(conn* c) {
 void conn_shrink(conn* c) {
     assert(c != NULL);
 
+    conn_scratch_release(c);
+
     if (c->udp)
         return;
 
@@ -609,54 +950,139 @@ void conn_shrink(conn* c) {
         c->rcurr = c->rbuf;
     }
 
-    if (c->wsize > WRITE_BUFFER_HIGHWAT) {
-        char *newbuf;
-
-        newbuf = (char*) pool_realloc((void*) c->wbuf, DATA_BUFFER_SIZE,
-                                      c->wsize, CONN_BUFFER_WBUF_POOL);
-
-        if (newbuf) {
-            c->wbuf = newbuf;
-            c->wsize = DATA_BUFFER_SIZE;
-        }
+    if (c->riov) {
+        free_conn_buffer(c->cbg, c->riov, 0);
+        c->riov = NULL;
+        c->riov_size = 0;
     }
 
-    if (c->isize > ITEM_LIST_HIGHWAT) {
-        item **newbuf = (item**) pool_realloc((void *)c->ilist, ITEM_LIST_INITIAL * sizeof(c->ilist[0]),
-                                              c->isize * sizeof(c->ilist[0]), CONN_BUFFER_ILIST_POOL);
-        if (newbuf) {
-            c->ilist = newbuf;
-            c->isize = ITEM_LIST_INITIAL;
-        }
-    /* TODO check error condition? */
+    if (c->iov != NULL) {
+        free_conn_buffer(c->cbg, c->iov, 0);
+        c->iov = NULL;
+        c->iovsize = 0;
     }
 
-    if (c->msgsize > MSG_LIST_HIGHWAT) {
-        struct msghdr *newbuf = (struct msghdr *) pool_realloc((void *)c->msglist,
-                                                               MSG_LIST_INITIAL * sizeof(c->msglist[0]),
-                                                               c->msgsize * sizeof(c->msglist[0]),
-                                                               CONN_BUFFER_MSGLIST_POOL);
-        if (newbuf) {
-            c->msglist = newbuf;
-            c->msgsize = MSG_LIST_INITIAL;
-        }
-    /* TODO check error condition? */
+    if (c->binary) {
+        bp_shrink_hdr_pool(c);
     }
+}
 
-    if (c->riov) {
+/*
+ * Returns true if a connection is waiting for a request, with nothing of the
+ * last one left over.
+ */
+static bool conn_between_requests(const conn* c) {
+    return (c->binary ? c->state == conn_bp_header_size_unknown : c->state == conn_read) &&
+        c->rbytes == 0 &&
+        c->msgused == 0 &&
+        c->held == 0 &&
+        c->ileft == 0 &&
+        c->item == NULL &&
+        c->write_and_free == NULL &&
+        c->arena == NULL &&
+        c->tier_pending == 0;
+}
+
+/*
+ * Lets go of all the buffers of a connection that sits idle between
+ * requests.  It gets new ones when it is next heard from.
+ */
+static void conn_slim(conn* c) {
+    assert(conn_between_requests(c));
+
+    if (c->rbuf != NULL) {
+        free_conn_buffer(c->cbg, c->rbuf, 0);
+        c->rbuf = NULL;
+        c->rcurr = NULL;
+        c->rsize = 0;
+    }
+    if (c->riov != NULL) {
         free_conn_buffer(c->cbg, c->riov, 0);
         c->riov = NULL;
         c->riov_size = 0;
     }
-
     if (c->iov != NULL) {
         free_conn_buffer(c->cbg, c->iov, 0);
         c->iov = NULL;
         c->iovsize = 0;
     }
+    conn_free_buffers(c);
+    c->slim = true;
+}
 
-    if (c->binary) {
-        bp_shrink_hdr_pool(c);
+static bool conn_unslim(conn* c) {
+    if (! conn_alloc_buffers(c, c->binary)) {
+        return false;
+    }
+    c->wcurr = c->wbuf;
+    c->icurr = c->ilist;
+    c->slim = false;
+    return true;
+}
+
+/*
+ * Called by its worker thread every second for each of its tcp connections.
+ * Closes the connection, or slims it, once it has been idle long enough, and
+ * adds what it holds to the sweep.
+ */
+void conn_sweep(conn* c, conn_sweep_t* sweep) {
+    stats_t *stats = STATS_GET_TLS();
+    size_t bytes;
+    rel_time_t idle;
+
+    /* on its way out, or waiting on a read from the tier. */
+    if (c->state == conn_closing ||
+        c->tier_pending > 0) {
+        return;
+    }
+#if defined(USE_URING)
+    if (c->uring.ring != NULL && c->uring.closing) {
+        return;
+    }
+#endif /* #if defined(USE_URING) */
+#if defined(USE_ZEROCOPY)
+    if (c->zerocopy.closing) {
+        return;
+    }
+#endif /* #if defined(USE_ZEROCOPY) */
+
+    if (c->active) {
+        c->active = false;
+        c->idle_since = current_time;
+    }
+    idle = current_time - c->idle_since;
+
+    if (settings.idle_timeout > 0 &&
+        idle >= (rel_time_t) settings.idle_timeout) {
+        if (settings.verbose > 1) {
+            fprintf(stderr, "<%d idle for %u seconds\n", c->sfd, idle);
+        }
+        conn_close(c);
+        STATS_LOCK(stats);
+        stats->idle_conns_closed++;
+        STATS_UNLOCK(stats);
+        return;
+    }
+
+    if (settings.idle_slim_timeout > 0 &&
+        idle >= (rel_time_t) settings.idle_slim_timeout &&
+        ! c->slim &&
+        conn_between_requests(c)) {
+        conn_slim(c);
+        STATS_LOCK(stats);
+        stats->idle_conns_slimmed++;
+        STATS_UNLOCK(stats);
+    }
+
+    bytes = conn_memory(c);
+    sweep->conns++;
+    sweep->bytes += bytes;
+    if (idle > 0) {
+        sweep->idle_conns++;
+        sweep->idle_bytes += bytes;
+        if (c->slim) {
+            sweep->slim_conns++;
+        }
     }
 }
 
@@ -692,8 +1118,26 @@ static int ensure_iov_space(conn* c) {
     assert(c != NULL);
 
     if (c->iovsize == 0) {
-        c->iov = (struct iovec *)alloc_conn_buffer(c->cbg, 0);
+        c->iov = (struct iovec *)alloc_small_conn_buffer(c->cbg);
         if (c->iov != NULL) {
+            c->iovsize = CONN_BUFFER_SMALL_DATA_SZ / sizeof(struct iovec);
+        }
+    }
+
+    if (c->iovused >= c->iovsize &&
+        c->iov != NULL &&
+        is_small_conn_buffer(c->iov)) {
+        /* outgrew the small buffer.  move to a big one, and point the
+         * messages built so far at it. */
+        struct iovec *new_iov = (struct iovec *)promote_conn_buffer(c->cbg, c->iov,
+                                                                    c->iovused * sizeof(struct iovec));
+        int i;
+
+        if (new_iov != NULL) {
+            for (i = 0; i < c->msgused; i++) {
+                c->msglist[i].msg_iov = new_iov + (c->msglist[i].msg_iov - c->iov);
+            }
+            c->iov = new_iov;
             c->iovsize = CONN_BUFFER_DATA_SZ / sizeof(struct iovec);
         }
     }
@@ -742,6 +1186,17 @@ int add_iov(conn* c, const void *buf, int len, bool is_start) {
             m = &c->msglist[c->msgused - 1];
         }
 
+#if defined(USE_ZEROCOPY)
+        /* a value sent without a copy goes in messages of its own. */
+        if ((m->msg_flags & MSG_ZEROCOPY) != c->zerocopy.flags) {
+            if (m->msg_iovlen > 0) {
+                add_msghdr(c);
+                m = &c->msglist[c->msgused - 1];
+            }
+            m->msg_flags = c->zerocopy.flags;
+        }
+#endif /* #if defined(USE_ZEROCOPY) */
+
         if (ensure_iov_space(c) != 0)
             return -1;
 
@@ -781,29 +1236,139 @@ int add_iov(conn* c, const void *buf, int len, bool is_start) {
 
 
 /*
- * Constructs a set of UDP headers and attaches them to the outgoing messages.
+ * Drops what has been added to the response being built.  Replies held back
+ * before it are kept.
+ */
+static void conn_drop_response(conn* c) {
+    struct msghdr *m;
+
+    assert(c != NULL);
+
+    if (c->held == 0) {
+        c->msgused = 0;
+        c->iovused = 0;
+        return;
+    }
+
+    m = &c->msglist[c->msgresp];
+    m->msg_iovlen = c->iovresp - (m->msg_iov - c->iov);
+    c->msgused = c->msgresp + 1;
+    c->iovused = c->iovresp;
+}
+
+
+/*
+ * Called once a reply has been built, before it is sent.  If the next request
+ * is already in the read buffer, as next_buffered says, the reply can wait to
+ * go out with the reply to that one, so that replies to pipelined requests
+ * share a sendmsg(..).  Only so many wait, and no more than fill IOV_MAX
+ * iovecs.  A text reply to a datagram likewise waits for the other datagrams
+ * of the batched receive, so that their replies share a sendmmsg(..).
+ *
+ * Returns true if the reply is held back; the caller moves on to the next
+ * request without sending it.
+ */
+bool conn_hold_reply(conn* c, const bool next_buffered) {
+    assert(c != NULL);
+
+    if ((c->udp && c->binary) ||
+        ! next_buffered ||
+        c->held + 1 >= settings.reply_batch_size ||
+        c->iovused >= IOV_MAX) {
+        return false;
+    }
+
+    /* the request is done with; conn_shrink(..) isn't called in between. */
+    if (c->riov != NULL) {
+        free_conn_buffer(c->cbg, c->riov, 0);
+        c->riov = NULL;
+        c->riov_size = 0;
+    }
+
+    if (c->udp) {
+        udp_batch_hold_reply(c);
+    }
+    c->held++;
+    return true;
+}
+
+
+/*
+ * Called when the connection is about to wait for the rest of a request's
+ * data.  Replies held back for it go out first, since the client may be
+ * waiting for them before it sends any more; the connection comes back to
+ * its state once they are written.
+ *
+ * Returns true if there were replies to send.
+ */
+static bool conn_flush_held(conn* c) {
+    assert(c != NULL);
+
+    if (c->held == 0) {
+        return false;
+    }
+
+    /* the request being read has no reply yet; the last one held is what
+     * goes out. */
+    c->held--;
+    c->write_and_go = c->state;
+    conn_set_state(c, conn_write);
+    return true;
+}
+
+
+/*
+ * Joins the messages left to send into as few as IOV_MAX allows.  The
+ * messages of replies held back may have been split by add_iov(..), but the
+ * iovecs of every message follow those of the one before it in c->iov.
+ */
+static void conn_join_replies(conn* c) {
+    struct msghdr *m, *next;
+    int i;
+
+    assert(c != NULL);
+    assert(! c->udp);
+
+    m = &c->msglist[c->msgcurr];
+    for (i = c->msgcurr + 1; i < c->msgused; i++) {
+        next = &c->msglist[i];
+        if (m->msg_iovlen + next->msg_iovlen <= IOV_MAX &&
+            m->msg_flags == next->msg_flags) {
+            assert(m->msg_iov + m->msg_iovlen == next->msg_iov);
+            m->msg_iovlen += next->msg_iovlen;
+        } else {
+            *(++m) = *next;
+        }
+    }
+    c->msgused = m - c->msglist + 1;
+}
+
+
+/*
+ * Constructs a set of UDP headers and attaches them to the outgoing messages
+ * of the reply being built.  Replies held back, which start the list, already
+ * have theirs.
  */
 int build_udp_headers(conn* c) {
-    int i, j, offset;
+    int i, j, offset, first;
     unsigned char *hdr;
 
     assert(c != NULL);
 
+    first = (c->held > 0) ? c->msgresp : 0;
+
     if (c->msgused > c->hdrsize) {
         void *new_hdrbuf;
-        if (c->hdrbuf)
-            new_hdrbuf = pool_realloc(c->hdrbuf, c->msgused * 2 * UDP_HEADER_SIZE,
-                                      c->hdrsize * UDP_HEADER_SIZE, CONN_BUFFER_HDRBUF_POOL);
-        else
-            new_hdrbuf = pool_malloc(c->msgused * 2 * UDP_HEADER_SIZE, CONN_BUFFER_HDRBUF_POOL);
+        new_hdrbuf = conn_scratch_grow(c, c->hdrbuf, c->hdrsize * UDP_HEADER_SIZE,
+                                       c->msgused * 2 * UDP_HEADER_SIZE);
         if (! new_hdrbuf)
             return -1;
         c->hdrbuf = (unsigned char *)new_hdrbuf;
         c->hdrsize = c->msgused * 2;
     }
 
-    hdr = c->hdrbuf;
-    for (i = 0; i < c->msgused; i++) {
+    hdr = c->hdrbuf + first * UDP_HEADER_SIZE;
+    for (i = first; i < c->msgused; i++) {
         c->msglist[i].msg_iov[0].iov_base = hdr;
         c->msglist[i].msg_iov[0].iov_len = UDP_HEADER_SIZE;
 
@@ -819,10 +1384,10 @@ int build_udp_headers(conn* c) {
 
         *hdr++ = c->request_id / 256;
         *hdr++ = c->request_id % 256;
-        *hdr++ = i / 256;
-        *hdr++ = i % 256;
-        *hdr++ = c->msgused / 256;
-        *hdr++ = c->msgused % 256;
+        *hdr++ = (i - first) / 256;
+        *hdr++ = (i - first) % 256;
+        *hdr++ = (c->msgused - first) / 256;
+        *hdr++ = (c->msgused - first) % 256;
         *hdr++ = offset / 256;
         *hdr++ = offset % 256;
         assert((void *) hdr == (void *)c->msglist[i].msg_iov[0].iov_base + UDP_HEADER_SIZE);
@@ -837,8 +1402,7 @@ static void out_string(conn* c, const char *str) {
 
     assert(c != NULL);
     assert(c->msgcurr == 0);
-    c->msgused = 0;
-    c->iovused = 0;
+    conn_drop_response(c);
 
     if (settings.verbose > 1)
         fprintf(stderr, ">%d %s\n", c->sfd, str);
@@ -850,10 +1414,21 @@ static void out_string(conn* c, const char *str) {
         len = strlen(str);
     }
 
-    memcpy(c->wbuf, str, len);
-    memcpy(c->wbuf + len, "\r\n", 2);
-    c->wbytes = len + 2;
-    c->wcurr = c->wbuf;
+    /* the line goes after what replies held back have in wbuf. */
+    if (ensure_wbuf(c, len + 2) != 0 ||
+        (c->msgused == 0 && add_msghdr(c) != 0) ||
+        add_iov(c, c->wcurr, len + 2, true) != 0 ||
+        (c->udp && build_udp_headers(c) != 0)) {
+        if (settings.verbose > 0)
+            fprintf(stderr, "Couldn't build response\n");
+        conn_set_state(c, conn_closing);
+        return;
+    }
+
+    memcpy(c->wcurr, str, len);
+    memcpy(c->wcurr + len, "\r\n", 2);
+    c->wcurr += len + 2;
+    c->wbytes += len + 2;
 
     conn_set_state(c, conn_write);
     c->write_and_go = conn_read;
@@ -879,6 +1454,16 @@ static void complete_nread(conn* c) {
     if (memcmp("\r\n", c->crlf, 2) != 0) {
         out_string(c, "CLIENT_ERROR bad data chunk");
     } else {
+        if (settings.compress_threshold != 0 &&
+            ITEM_nbytes(it) >= settings.compress_threshold) {
+            item* packed = item_compress(it, c->update_key, ITEM_nkey(it),
+                                         get_request_addr(c));
+            if (packed != NULL) {
+                item_deref(c->item);
+                c->item = it = packed;
+            }
+        }
+
         if (store_item(it, comm, c->update_key)) {
             out_string(c, "STORED");
         } else {
@@ -1016,13 +1601,18 @@ static size_t tokenize_command(char *command, token_t *tokens, const size_t max_
 /* set up a connection to write a buffer then free it, used for stats */
 static void write_and_free(conn* c, char *buf, int bytes) {
     assert(c->msgcurr == 0);
-    c->msgused = 0;
-    c->iovused = 0;
+    conn_drop_response(c);
 
     if (buf) {
         c->write_and_free = buf;
-        c->wcurr = buf;
-        c->wbytes = bytes;
+        if ((c->msgused == 0 && add_msghdr(c) != 0) ||
+            add_iov(c, buf, bytes, true) != 0 ||
+            (c->udp && build_udp_headers(c) != 0)) {
+            if (settings.verbose > 0)
+                fprintf(stderr, "Couldn't build response\n");
+            conn_set_state(c, conn_closing);
+            return;
+        }
         conn_set_state(c, conn_write);
         c->write_and_go = conn_read;
     } else {
@@ -1109,6 +1699,8 @@ static void process_stat(conn* c, token_t *tokens, const size_t ntokens) {
         offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT arith_hits %" PRINTF_INT64_MODIFIER "u\r\n", stats.arith_hits);
         offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT hit_rate %g%%\r\n", (stats.get_hits + stats.get_misses) == 0 ? 0.0 : (double)stats.get_hits * 100 / (stats.get_hits + stats.get_misses));
         offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT evictions %" PRINTF_INT64_MODIFIER "u\r\n", stats.evictions);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT expired_items %" PRINTF_INT64_MODIFIER "u\r\n", stats.expired_items);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT reaped_items %" PRINTF_INT64_MODIFIER "u\r\n", stats.reaped_items);
         offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT bytes_read %" PRINTF_INT64_MODIFIER "u\r\n", stats.bytes_read);
         offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT bytes_written %" PRINTF_INT64_MODIFIER "u\r\n", stats.bytes_written);
         offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT limit_maxbytes %lu\r\n", settings.maxbytes);
@@ -1329,6 +1921,116 @@ static void process_stat(conn* c, token_t *tokens, const size_t ntokens) {
         return;
     }
 
+    if (strcmp(subcommand, "lru") == 0) {
+        size_t bufsize = 1024, offset = 0;
+        char temp[bufsize];
+        char terminator[] = "END";
+        lru_stats_t lru_stats;
+
+        item_lru_stats(&lru_stats);
+#if defined(USE_CLOCK_EVICTION)
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT clock_steps %" PRINTF_INT64_MODIFIER "u\r\n", lru_stats.clock_steps);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT clock_second_chances %" PRINTF_INT64_MODIFIER "u\r\n", lru_stats.clock_second_chances);
+#else
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT protected_pct %d\r\n", settings.lru_protected_pct);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT probation_items %" PRINTF_INT64_MODIFIER "u\r\n", lru_stats.probation_items);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT protected_items %" PRINTF_INT64_MODIFIER "u\r\n", lru_stats.protected_items);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT probation_hits %" PRINTF_INT64_MODIFIER "u\r\n", lru_stats.probation_hits);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT protected_hits %" PRINTF_INT64_MODIFIER "u\r\n", lru_stats.protected_hits);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT promotions %" PRINTF_INT64_MODIFIER "u\r\n", lru_stats.promotions);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT demotions %" PRINTF_INT64_MODIFIER "u\r\n", lru_stats.demotions);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT probation_evictions %" PRINTF_INT64_MODIFIER "u\r\n", lru_stats.probation_evictions);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT protected_evictions %" PRINTF_INT64_MODIFIER "u\r\n", lru_stats.protected_evictions);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT size_aware %d\r\n", settings.size_aware_eviction ? 1 : 0);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT size_aware_picks %" PRINTF_INT64_MODIFIER "u\r\n", lru_stats.size_aware_picks);
+#endif /* #if defined(USE_CLOCK_EVICTION) */
+        offset = append_to_buffer(temp, bufsize, offset, 0, terminator);
+        out_string(c, temp);
+        return;
+    }
+
+    if (strcmp(subcommand, "compression") == 0) {
+        size_t bufsize = 1024, offset = 0;
+        char temp[bufsize];
+        char terminator[] = "END";
+
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT threshold %lu\r\n", (unsigned long) settings.compress_threshold);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT compressed_items %" PRINTF_INT64_MODIFIER "u\r\n", stats.compressed_items);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT skipped_items %" PRINTF_INT64_MODIFIER "u\r\n", stats.compress_skipped);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT bytes_in %" PRINTF_INT64_MODIFIER "u\r\n", stats.compress_bytes_in);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT bytes_out %" PRINTF_INT64_MODIFIER "u\r\n", stats.compress_bytes_out);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT ratio %.2f\r\n",
+                                  (stats.compress_bytes_out == 0) ? 0.0 :
+                                  (double) stats.compress_bytes_in / stats.compress_bytes_out);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT compress_usec %" PRINTF_INT64_MODIFIER "u\r\n", stats.compress_ns / 1000);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT decompressed_items %" PRINTF_INT64_MODIFIER "u\r\n", stats.decompressed_items);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT decompress_failures %" PRINTF_INT64_MODIFIER "u\r\n", stats.decompress_failures);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT decompress_usec %" PRINTF_INT64_MODIFIER "u\r\n", stats.decompress_ns / 1000);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT compressed_sent %" PRINTF_INT64_MODIFIER "u\r\n", stats.compressed_sent);
+        offset = append_to_buffer(temp, bufsize, offset, 0, terminator);
+        out_string(c, temp);
+        return;
+    }
+
+#if defined(USE_SLAB_ALLOCATOR)
+    if (strcmp(subcommand, "tier") == 0 && settings.tier_path != NULL) {
+        size_t bufsize = 1024, offset = 0;
+        char temp[bufsize];
+        char terminator[] = "END";
+        tier_stats_t tier;
+
+        tier_stats(&tier);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT threshold %lu\r\n", (unsigned long) settings.tier_threshold);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT capacity %" PRINTF_INT64_MODIFIER "u\r\n", tier.capacity);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT written %" PRINTF_INT64_MODIFIER "u\r\n", tier.head);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT flushed %" PRINTF_INT64_MODIFIER "u\r\n", tier.flushed);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT spilled_items %" PRINTF_INT64_MODIFIER "u\r\n", tier.spilled);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT spilled_bytes %" PRINTF_INT64_MODIFIER "u\r\n", tier.spilled_bytes);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT spill_skipped %" PRINTF_INT64_MODIFIER "u\r\n", tier.spill_skipped);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT reads %" PRINTF_INT64_MODIFIER "u\r\n", tier.reads);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT buffer_reads %" PRINTF_INT64_MODIFIER "u\r\n", tier.buffer_reads);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT read_failures %" PRINTF_INT64_MODIFIER "u\r\n", tier.read_failures);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT lost_items %" PRINTF_INT64_MODIFIER "u\r\n", tier.lost);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT promotions %" PRINTF_INT64_MODIFIER "u\r\n", tier.promotions);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT udp_misses %" PRINTF_INT64_MODIFIER "u\r\n", tier.udp_misses);
+        offset = append_to_buffer(temp, bufsize, offset, 0, terminator);
+        out_string(c, temp);
+        return;
+    }
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
+
+    if (strcmp(subcommand, "admission") == 0) {
+        size_t bufsize = 1024, offset = 0;
+        char temp[bufsize];
+        char terminator[] = "END";
+        admission_stats_t admission;
+
+        admission_stats(&admission);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT sketch_width %" PRINTF_INT64_MODIFIER "u\r\n", admission.sketch_width);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT admitted %" PRINTF_INT64_MODIFIER "u\r\n", admission.admitted);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT rejected %" PRINTF_INT64_MODIFIER "u\r\n", admission.rejected);
+        offset = append_to_buffer(temp, bufsize, offset, sizeof(terminator), "STAT agings %" PRINTF_INT64_MODIFIER "u\r\n", admission.agings);
+        offset = append_to_buffer(temp, bufsize, offset, 0, terminator);
+        out_string(c, temp);
+        return;
+    }
+
+#if defined(USE_SLAB_ALLOCATOR)
+    if (strcmp(subcommand, "slabs_rebalance") == 0) {
+        int bytes = 0;
+        char *buf = slabs_rebalance_stats(&bytes);
+        write_and_free(c, buf, bytes);
+        return;
+    }
+
+    if (strcmp(subcommand, "slabs_plan") == 0) {
+        int bytes = 0;
+        char *buf = item_slabs_plan(&bytes);
+        write_and_free(c, buf, bytes);
+        return;
+    }
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
+
     if (strcmp(subcommand, "cost-benefit") == 0) {
         int bytes = 0;
         char *buf = cost_benefit_stats(&bytes);
@@ -1344,6 +2046,114 @@ static void process_stat(conn* c, token_t *tokens, const size_t ntokens) {
         return;
     }
 
+    if (strcmp(subcommand, "arena") == 0) {
+        size_t bufsize = 512 * settings.num_threads, offset = 0;
+        char* buf = malloc(bufsize);
+        char terminator[] = "END\r\n";
+
+        if (buf == NULL) {
+            out_string(c, "SERVER_ERROR out of memory");
+            return;
+        }
+        offset = append_arena_stats(buf, bufsize, offset, sizeof(terminator));
+        offset = append_to_buffer(buf, bufsize, offset, 0, terminator);
+        write_and_free(c, buf, offset);
+        return;
+    }
+
+    if (strcmp(subcommand, "uring") == 0) {
+        size_t bufsize = 512 * settings.num_threads, offset = 0;
+        char* buf = malloc(bufsize);
+        char terminator[] = "END\r\n";
+
+        if (buf == NULL) {
+            out_string(c, "SERVER_ERROR out of memory");
+            return;
+        }
+        offset = append_uring_stats(buf, bufsize, offset, sizeof(terminator));
+        offset = append_to_buffer(buf, bufsize, offset, 0, terminator);
+        write_and_free(c, buf, offset);
+        return;
+    }
+
+    if (strcmp(subcommand, "poll") == 0) {
+        size_t bufsize = 512 * settings.num_threads + 128, offset = 0;
+        char* buf = malloc(bufsize);
+        char terminator[] = "END\r\n";
+
+        if (buf == NULL) {
+            out_string(c, "SERVER_ERROR out of memory");
+            return;
+        }
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT busy_poll_usec %d\r\n", settings.busy_poll_usec);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT socket_busy_poll_usec %d\r\n", settings.socket_busy_poll_usec);
+        offset = append_poll_stats(buf, bufsize, offset, sizeof(terminator));
+        offset = append_to_buffer(buf, bufsize, offset, 0, terminator);
+        write_and_free(c, buf, offset);
+        return;
+    }
+
+    if (strcmp(subcommand, "conns") == 0) {
+        size_t bufsize = 512 * settings.num_threads + 512, offset = 0;
+        char* buf = malloc(bufsize);
+        char terminator[] = "END\r\n";
+
+        if (buf == NULL) {
+            out_string(c, "SERVER_ERROR out of memory");
+            return;
+        }
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT idle_timeout %d\r\n", settings.idle_timeout);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT idle_slim_timeout %d\r\n", settings.idle_slim_timeout);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT conn_memory_max %lu\r\n", (unsigned long) settings.conn_memory_max);
+        offset = append_conn_stats(buf, bufsize, offset, sizeof(terminator));
+        offset = append_to_buffer(buf, bufsize, offset, 0, terminator);
+        write_and_free(c, buf, offset);
+        return;
+    }
+
+    if (strcmp(subcommand, "tcp") == 0) {
+        size_t bufsize = 1024 * settings.num_threads + 128, offset = 0;
+        char* buf = malloc(bufsize);
+        char terminator[] = "END\r\n";
+
+        if (buf == NULL) {
+            out_string(c, "SERVER_ERROR out of memory");
+            return;
+        }
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT reply_batch_size %d\r\n", settings.reply_batch_size);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT zerocopy_min %lu\r\n", (unsigned long) settings.zerocopy_min);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT direct_read_min %lu\r\n", (unsigned long) settings.direct_read_min);
+        offset = append_tcp_stats(buf, bufsize, offset, sizeof(terminator));
+        offset = append_to_buffer(buf, bufsize, offset, 0, terminator);
+        write_and_free(c, buf, offset);
+        return;
+    }
+
+    if (strcmp(subcommand, "udp") == 0) {
+        size_t bufsize = 512 * settings.num_threads + 1024, offset = 0;
+        char* buf = malloc(bufsize);
+        char terminator[] = "END\r\n";
+        udp_reassembly_stats_t reassembly;
+
+        if (buf == NULL) {
+            out_string(c, "SERVER_ERROR out of memory");
+            return;
+        }
+        offset = append_udp_stats(buf, bufsize, offset, sizeof(terminator));
+        udp_reassembly_stats(&reassembly);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT reassembly_limit %lu\r\n", (unsigned long) settings.udp_reassembly_limit);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT reassembly_pending %" PRINTF_INT64_MODIFIER "u\r\n", reassembly.pending);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT reassembly_bytes %" PRINTF_INT64_MODIFIER "u\r\n", reassembly.bytes);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT reassembly_packets %" PRINTF_INT64_MODIFIER "u\r\n", reassembly.packets);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT reassembled_requests %" PRINTF_INT64_MODIFIER "u\r\n", reassembly.reassembled);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT reassembly_timeouts %" PRINTF_INT64_MODIFIER "u\r\n", reassembly.timeouts);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT reassembly_evictions %" PRINTF_INT64_MODIFIER "u\r\n", reassembly.evictions);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT reassembly_dropped %" PRINTF_INT64_MODIFIER "u\r\n", reassembly.dropped);
+        offset = append_to_buffer(buf, bufsize, offset, 0, terminator);
+        write_and_free(c, buf, offset);
+        return;
+    }
+
     out_string(c, "ERROR");
 }
 
@@ -1398,7 +2208,7 @@ static int ensure_wbuf(conn* const c, const size_t req_bytes)
     }
 
     new_size = req_bytes + c->wbytes;
-    if ((newbuf = pool_realloc(c->wbuf, new_size, c->wsize, CONN_BUFFER_WBUF_POOL)) == NULL) {
+    if ((newbuf = conn_scratch_grow(c, c->wbuf, c->wsize, new_size)) == NULL) {
         /* error... */
         return -1;
     }
@@ -1419,21 +2229,87 @@ static int ensure_wbuf(conn* const c, const size_t req_bytes)
 }
 
 
-#define FLAGS_LENGTH_STRING_LEN (sizeof(" 4xxxyyyzzz 1xxxyyy\r\n") - 1)
+#define FLAGS_LENGTH_STRING_LEN (sizeof(" 4xxxyyyzzz 1xxxyyy lz4\r\n") - 1)
+#define METAGET_STRING_LEN (sizeof(" age: 4294967295; exptime: -2147483648; from: 255.255.255.255\r\n") - 1)
+
+
+#if defined(USE_SLAB_ALLOCATOR)
+/*
+ * gets an item to send a stub's value in.  the value is read by the tier i/o
+ * threads: *io is set to the read, which is to be dispatched once the item has
+ * been added to the response.  returns NULL if there is no memory, or if the
+ * connection is UDP: its socket serves every UDP client of the thread, so it
+ * can't wait for the disk, and the value is answered as a miss.
+ */
+item* conn_tier_fetch(conn* c, item* stub, tier_io_t** io) {
+    struct in_addr no_addr = { 0 };
+
+    *io = NULL;
+    if (c->udp) {
+        tier_count_udp_miss();
+        return NULL;
+    }
+    if ((*io = malloc(sizeof(tier_io_t))) == NULL) {
+        return NULL;
+    }
+
+    item_tier_ptr(stub, &(*io)->ptr);
+    (*io)->stub = stub;
+    (*io)->it = item_alloc(ITEM_key(stub), ITEM_nkey(stub), ITEM_flags(stub),
+                           ITEM_exptime(stub), (*io)->ptr.nbytes, no_addr);
+    if ((*io)->it == NULL) {
+        free(*io);
+        *io = NULL;
+    }
+    return (*io) != NULL ? (*io)->it : NULL;
+}
+
+/*
+ * called on the connection's thread when a read from the tier is done.  once
+ * the last one is, the response goes out, unless a read failed: the value is
+ * then missing from the middle of the response, and the connection is closed.
+ */
+void conn_tier_done(conn* c, tier_io_t* io) {
+    if (io->ok) {
+        item_tier_promote(io->stub, io->it);
+    } else {
+        c->tier_failed = true;
+    }
+    item_deref(io->stub);
+    free(io);
 
+    assert(c->tier_pending > 0);
+    if (--c->tier_pending == 0) {
+        conn_set_state(c, c->tier_failed ? conn_closing : c->tier_resume);
+        c->tier_failed = false;
+        if (c->binary) {
+            /* the binary states expect to be listening for reads. */
+            if (!update_event(c, EV_READ | EV_PERSIST)) {
+                conn_set_state(c, conn_closing);
+            }
+            process_binary_protocol(c);
+        } else {
+            drive_machine(c);
+        }
+    }
+}
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
 
 /* ntokens is overwritten here... shrug.. */
 static inline void process_get_command(conn* c, token_t *tokens, size_t ntokens) {
     stats_t *stats = STATS_GET_TLS();
     char *key;
     size_t nkey;
-    int i = 0;
+    int i;
     item *it;
     token_t *key_token = &tokens[KEY_TOKEN];
     size_t token_count;
 
     assert(c != NULL);
 
+    /* the items of replies held back come first. */
+    i = c->ileft;
+
     if (settings.managed) {
         int bucket = c->bucket;
         if (bucket == -1) {
@@ -1449,17 +2325,16 @@ static inline void process_get_command(conn* c, token_t *tokens, size_t ntokens)
 
     /*
      * count the number of tokens, and ensure that we have enough space at
-     * c->wbuf to hold all the " flags length\r\n" that we might transmit.
+     * c->wcurr to hold all the " flags length\r\n" that we might transmit.
      */
     token_count = count_total_tokens(tokens);
-    assert(c->wbytes == 0);             // there should be no one using the wbuf
-                                        // at this point.
 
     /* ensure we have enough spaces for each of the flags + length strings, plus
      * a null terminator at the very end (artifact of using sprintf, we will not
      * send the null) */
     if (ensure_wbuf(c, (token_count * FLAGS_LENGTH_STRING_LEN) + 1)) {
         out_string(c, "SERVER_ERROR cannot allocate sufficient memory");
+        return;
     }
 
     do {
@@ -1473,7 +2348,19 @@ static inline void process_get_command(conn* c, token_t *tokens, size_t ntokens)
                 return;
             }
 
+            if (settings.admission_items != 0) {
+                admission_record(key, nkey);
+            }
             it = item_get(key, nkey);
+#if defined(USE_SLAB_ALLOCATOR)
+            if (settings.slab_automove_interval != 0) {
+                if (it != NULL) {
+                    slabs_model_hit(it);
+                } else {
+                    slabs_model_miss(key, nkey);
+                }
+            }
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
 
             STATS_LOCK(stats);
             stats->get_cmds++;
@@ -1487,10 +2374,43 @@ static inline void process_get_command(conn* c, token_t *tokens, size_t ntokens)
             if (it) {
                 char* flags_len_string_start;
                 ssize_t flags_len_string_len;
+                item* sent = it;   /* the item whose value goes out... */
+                char* plain = NULL;     /* ... unless it was decompressed */
+                size_t plain_len = 0;
+#if defined(USE_SLAB_ALLOCATOR)
+                tier_io_t* io = NULL;
+
+                if (ITEM_is_tiered(it) &&
+                    (sent = conn_tier_fetch(c, it, &io)) == NULL) {
+                    /* the value can't be had.  answer as a miss. */
+                    item_deref(it);
+                    STATS_LOCK(stats);
+                    stats->get_misses++;
+                    STATS_UNLOCK(stats);
+                    key_token++;
+                    continue;
+                }
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
+
+                if (ITEM_is_compressed(it)) {
+                    if (c->accept_compressed) {
+                        STATS_LOCK(stats);
+                        stats->compressed_sent++;
+                        STATS_UNLOCK(stats);
+                    } else if ((plain = conn_decompress(c, it, &plain_len)) == NULL) {
+                        /* no memory for the value.  answer as a miss. */
+                        item_deref(it);
+                        STATS_LOCK(stats);
+                        stats->get_misses++;
+                        STATS_UNLOCK(stats);
+                        key_token++;
+                        continue;
+                    }
+                }
 
                 if (i >= c->isize) {
-                    item **new_list = pool_realloc(c->ilist, sizeof(item *) * c->isize * 2,
-                                                   sizeof(item*) * c->isize, CONN_BUFFER_ILIST_POOL);
+                    item **new_list = conn_scratch_grow(c, c->ilist, sizeof(item*) * c->isize,
+                                                        sizeof(item *) * c->isize * 2);
                     if (new_list) {
                         c->isize *= 2;
                         c->ilist = new_list;
@@ -1502,8 +2422,9 @@ static inline void process_get_command(conn* c, token_t *tokens, size_t ntokens)
 
                 flags_len_string_start = c->wcurr;
                 flags_len_string_len = snprintf(c->wcurr, FLAGS_LENGTH_STRING_LEN + 1,
-                                                " %u %u\r\n", ITEM_flags(it),
-                                                (unsigned int) (ITEM_nbytes(it)));
+                                                " %u %u%s\r\n", ITEM_flags(sent),
+                                                (unsigned int) (plain != NULL ? plain_len : ITEM_nbytes(sent)),
+                                                (ITEM_is_compressed(sent) && plain == NULL) ? " lz4" : "");
                 c->wcurr += flags_len_string_len;
                 c->wbytes += flags_len_string_len;
 
@@ -1515,9 +2436,11 @@ static inline void process_get_command(conn* c, token_t *tokens, size_t ntokens)
                  *   " " + flags + " " + data length + "\r\n" + data (with \r\n)
                  */
                 if (add_iov(c, "VALUE ", 6, true) != 0 ||
-                    add_item_key_to_iov(c, it) != 0 ||
+                    add_item_key_to_iov(c, sent) != 0 ||
                     add_iov(c, flags_len_string_start, flags_len_string_len, false) != 0 ||
-                    add_item_value_to_iov(c, it, true /* send cr-lf */) != 0)
+                    (plain != NULL ?
+                     (add_iov(c, plain, plain_len, false) != 0 || add_iov(c, "\r\n", 2, false) != 0) :
+                     add_item_value_to_iov(c, sent, true /* send cr-lf */) != 0))
                     {
                         break;
                     }
@@ -1535,7 +2458,14 @@ static inline void process_get_command(conn* c, token_t *tokens, size_t ntokens)
 #if defined(USE_SLAB_ALLOCATOR)
                 item_mark_visited(it);
 #endif /* #if defined(USE_SLAB_ALLOCATOR) */
-                *(c->ilist + i) = it;
+#if defined(USE_SLAB_ALLOCATOR)
+                if (io != NULL) {
+                    /* the read holds on to the stub until it is done. */
+                    dispatch_tier_read(c, io);
+                    c->tier_pending++;
+                }
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
+                *(c->ilist + i) = sent;
                 i++;
 
             } else {
@@ -1568,7 +2498,8 @@ static inline void process_get_command(conn* c, token_t *tokens, size_t ntokens)
         out_string(c, "SERVER_ERROR out of memory");
     }
     else {
-        conn_set_state(c, conn_mwrite);
+        c->tier_resume = conn_mwrite;
+        conn_set_state(c, c->tier_pending != 0 ? conn_tier_wait : conn_mwrite);
         c->msgcurr = 0;
     }
     return;
@@ -1593,7 +2524,7 @@ static inline void process_metaget_command(conn *c, token_t *tokens, size_t ntok
 
     it = item_get(key, nkey);
     if (it) {
-        ssize_t written, avail = c->wsize - c->wbytes;
+        ssize_t written, avail;
         char* txstart;
         size_t txcount;
         rel_time_t now = current_time;
@@ -1602,6 +2533,10 @@ static inline void process_metaget_command(conn *c, token_t *tokens, size_t ntok
         char scratch[20];
         size_t offset = 0;
 
+        /* the line goes after what replies held back have in wbuf.  if there
+         * is no room for it, it is cut short. */
+        ensure_wbuf(c, METAGET_STRING_LEN + 1);
+        avail = c->wsize - c->wbytes;
         txstart = c->wcurr;
 
         if (ITEM_has_timestamp(it)) {
@@ -1635,6 +2570,8 @@ static inline void process_metaget_command(conn *c, token_t *tokens, size_t ntok
         } else {
             txcount = written;
         }
+        c->wcurr += txcount;
+        c->wbytes += txcount;
 
         if (add_iov(c, "META ", 5, true) == 0 &&
             add_item_key_to_iov(c, it) == 0 &&
@@ -1728,6 +2665,7 @@ static void process_update_command(conn *c, token_t *tokens, const size_t ntoken
     c->update_key = key;
     c->item_comm = comm;
     c->item = it;
+    c->direct_read = settings.direct_read_min > 0 && (size_t) vlen >= settings.direct_read_min;
     conn_set_state(c, conn_nread);
 }
 
@@ -1807,7 +2745,9 @@ char *do_add_delta(const char* key, const size_t nkey, const int incr, const uns
     /* the opengroup spec says that if we care about errno after strtol/strtoul, we have to zero it
      * out beforehard.  see http://www.opengroup.org/onlinepubs/000095399/functions/strtoul.html */
     errno = 0;
-    value = item_strtoul(it, 10);
+    /* neither a compressed value nor a stub for one in the tier is a
+     * number. */
+    value = (ITEM_is_compressed(it) || ITEM_is_tiered(it)) ? 0 : item_strtoul(it, 10);
 
     if (incr != 0)
         value += delta;
@@ -1861,6 +2801,8 @@ char *do_add_delta(const char* key, const size_t nkey, const int incr, const uns
         do_item_deref(new_it);       /* release our reference */
     } else { /* replace in-place */
         ITEM_set_nbytes(it, res);               /* update the length field. */
+        ITEM_clear_compressed(it);
+        ITEM_clear_tiered(it);
         item_memcpy_to(it, 0, buf, res, false);
         do_item_update(it);
 
@@ -1968,7 +2910,9 @@ int do_defer_delete(item *it, time_t exptime)
         }
     }
 
-    /* use its expiration time as its deletion time now */
+    /* use its expiration time as its deletion time now.  the deferred delete
+     * queue takes over, so it comes out of the expiration index. */
+    expiry_index_remove(it);
     ITEM_set_exptime(it, realtime(exptime));
     ITEM_mark_deleted(it);
     todelete[delcurr++] = it;
@@ -1995,21 +2939,32 @@ static void process_command(conn* c, char *command) {
 
     assert(c != NULL);
 
+    /* unless this turns out to be an update with a large value. */
+    c->direct_read = false;
+
     if (settings.verbose > 1)
         fprintf(stderr, "<%d %s\n", c->sfd, command);
 
     /* ensure that conn_set_state going into the conn_read state cleared the
-     * c->msg* and c->iov* counters.
+     * c->msg* and c->iov* counters, unless replies were held back.
      */
     assert(c->msgcurr == 0);
-    assert(c->msgused == 0);
-    assert(c->iovused == 0);
-
-    if (add_msghdr(c) != 0) {
+    assert(c->held > 0 || c->msgused == 0);
+    assert(c->held > 0 || c->iovused == 0);
+
+    /* a reply held back leaves its message open for the next one, unless
+     * they are datagrams, which each start with a header of their own. */
+    if (c->held > 0 && ! c->udp) {
+        c->msgresp = c->msgused - 1;
+        c->iovresp = c->iovused;
+    } else if (add_msghdr(c) != 0) {
         /* if we can't allocate the msghdr, we can't really send the error
          * message.  so just close the connection. */
         conn_set_state(c, conn_closing);
         return;
+    } else if (c->held > 0) {
+        c->msgresp = c->msgused - 1;
+        c->iovresp = c->iovused;
     }
 
     ntokens = tokenize_command(command, tokens, MAX_TOKENS);
@@ -2203,6 +3158,19 @@ static void process_command(conn* c, char *command) {
         }
     } else if (ntokens == 3 && (strcmp(tokens[COMMAND_TOKEN].value, "verbosity") == 0)) {
         process_verbosity_command(c, tokens, ntokens);
+    } else if (ntokens == 3 && (strcmp(tokens[COMMAND_TOKEN].value, "accept") == 0)) {
+        /* "accept lz4" makes gets on this connection return compressed values
+         * as they are stored, marked with "lz4" after the length; "accept
+         * none" goes back to decompressing them. */
+        if (strcmp(tokens[1].value, "lz4") == 0) {
+            c->accept_compressed = true;
+            out_string(c, "OK");
+        } else if (strcmp(tokens[1].value, "none") == 0) {
+            c->accept_compressed = false;
+            out_string(c, "OK");
+        } else {
+            out_string(c, "CLIENT_ERROR unknown encoding");
+        }
     } else {
         out_string(c, "ERROR");
     }
@@ -2249,16 +3217,140 @@ static int try_read_command(conn* c) {
     return 1;
 }
 
+#if !defined(HAVE_RECVMMSG) && !defined(HAVE_SENDMMSG)
+/* what recvmmsg(..) takes, on systems that don't have it. */
+struct mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int  msg_len;
+};
+#endif /* #if !defined(HAVE_RECVMMSG) && !defined(HAVE_SENDMMSG) */
+
+/*
+ * Datagrams read from a UDP socket by one receive call.  Each lands in its own
+ * UDP_DATAGRAM_SLOT_SIZE slot of the connection's read buffer, and they are
+ * served one at a time before the socket is read again.  Their text replies
+ * are held back until the last has been served, and the packets of them all
+ * are handed to the kernel batch_size at a time.
+ */
+struct udp_batch_s {
+    int    size;                /* datagrams per receive, packets per send */
+    int    count;               /* datagrams read by the last receive... */
+    int    next;                /* ... and the next of them to serve */
+    struct mmsghdr *recv_hdrs;
+    struct iovec *recv_iovs;
+    struct sockaddr *addrs;
+    struct mmsghdr *send_hdrs;
+};
+
+#define UDP_BATCH_BYTES(size)   (sizeof(udp_batch_t) +                  \
+                                 (size) * (2 * sizeof(struct mmsghdr) + \
+                                           sizeof(struct iovec) +      \
+                                           sizeof(struct sockaddr)))
+
+static udp_batch_t* udp_batch_new(void) {
+    udp_batch_t* batch;
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+    int size = settings.udp_batch_size;
+#else
+    int size = 1;
+#endif /* #if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) */
+
+    if ((batch = pool_malloc(UDP_BATCH_BYTES(size), CONN_BUFFER_UDP_BATCH_POOL)) == NULL) {
+        return NULL;
+    }
+
+    batch->size = size;
+    batch->count = batch->next = 0;
+    batch->recv_hdrs = (struct mmsghdr*) (batch + 1);
+    batch->send_hdrs = batch->recv_hdrs + size;
+    batch->recv_iovs = (struct iovec*) (batch->send_hdrs + size);
+    batch->addrs = (struct sockaddr*) (batch->recv_iovs + size);
+
+    return batch;
+}
+
+static void udp_batch_free(conn* c) {
+    if (c->udp_batch != NULL) {
+        pool_free(c->udp_batch, UDP_BATCH_BYTES(c->udp_batch->size), CONN_BUFFER_UDP_BATCH_POOL);
+        c->udp_batch = NULL;
+    }
+}
+
+/* true if a batched receive read datagrams that haven't been served yet. */
+static inline bool udp_batch_pending(const conn* c) {
+    return (c->udp_batch != NULL &&
+            c->udp_batch->next < c->udp_batch->count);
+}
+
+/*
+ * points the messages of a reply being held back at the address its datagram
+ * came from, which the batch keeps until the socket is read again;
+ * c->request_addr will be the next datagram's by the time it is sent.
+ */
+static void udp_batch_hold_reply(conn* c) {
+    struct sockaddr* name = c->udp_batch->recv_hdrs[c->udp_batch->next - 1].msg_hdr.msg_name;
+    int i;
+
+    for (i = (c->held > 0) ? c->msgresp : 0; i < c->msgused; i++) {
+        c->msglist[i].msg_name = name;
+    }
+}
+
+/*
+ * reads as many datagrams as there are, up to the size of the batch, into the
+ * slots of the read buffer.  returns the number read, or -1 if none were.
+ */
+static int udp_receive_batch(conn* c) {
+    udp_batch_t* batch = c->udp_batch;
+    int i;
+#if !defined(HAVE_RECVMMSG) || !defined(HAVE_SENDMMSG)
+    ssize_t res;
+#endif /* #if !defined(HAVE_RECVMMSG) || !defined(HAVE_SENDMMSG) */
+
+    for (i = 0; i < batch->size; i++) {
+        struct msghdr* m = &batch->recv_hdrs[i].msg_hdr;
+
+        batch->recv_iovs[i].iov_base = c->rbuf + (i * UDP_DATAGRAM_SLOT_SIZE);
+        batch->recv_iovs[i].iov_len = UDP_DATAGRAM_SLOT_SIZE;
+
+        memset(m, 0, sizeof(struct msghdr));
+        m->msg_iov = &batch->recv_iovs[i];
+        m->msg_iovlen = 1;
+        m->msg_name = &batch->addrs[i];
+        m->msg_namelen = sizeof(struct sockaddr);
+    }
+
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+    return recvmmsg(c->sfd, batch->recv_hdrs, batch->size, 0, NULL);
+#else
+    if ((res = recvmsg(c->sfd, &batch->recv_hdrs[0].msg_hdr, 0)) == -1) {
+        return -1;
+    }
+    batch->recv_hdrs[0].msg_len = res;
+    return 1;
+#endif /* #if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) */
+}
+
 /*
- * read a UDP request.
+ * read a UDP request, from the datagrams of the last batched receive or, once
+ * they have all been served, from the socket.  a request that spans several
+ * packets is read once its last packet is in.
  * return 0 if there's nothing to read.
  */
 int try_read_udp(conn* c) {
     stats_t *stats = STATS_GET_TLS();
+    struct mmsghdr* hdr;
+    unsigned char *buf;
     int res;
+#if defined(HAVE_UDP_REPLY_PORTS)
+    uint16_t reply_ports;
+#endif
 
     assert(c != NULL);
-    assert(c->rbytes == 0);
+
+    /* a datagram is a request of its own; whatever of the last one wasn't
+     * parsed can't be completed by the next. */
+    c->rbytes = 0;
 
     if (c->rbuf == NULL) {
         /* no idea how big the buffer will need to be. */
@@ -2277,23 +3369,71 @@ int try_read_udp(conn* c) {
         }
     }
 
-    c->request_addr_size = sizeof(c->request_addr);
-    res = recvfrom(c->sfd, c->rbuf, c->rsize,
-                   0, &c->request_addr, &c->request_addr_size);
-    if (res > 8) {
-        unsigned char *buf = (unsigned char *)c->rbuf;
-#if defined(HAVE_UDP_REPLY_PORTS)
-        uint16_t reply_ports;
-#endif
-        STATS_LOCK(stats);
-        stats->bytes_read += res;
-        STATS_UNLOCK(stats);
+    if (c->udp_batch == NULL &&
+        (c->udp_batch = udp_batch_new()) == NULL) {
+        if (c->binary) {
+            bp_write_err_msg(c, "out of memory");
+        } else {
+            out_string(c, "SERVER_ERROR out of memory");
+        }
+        return 0;
+    }
+
+    for (;;) {
+        udp_batch_t* batch = c->udp_batch;
+        char* assembled = c->rbuf + (batch->size * UDP_DATAGRAM_SLOT_SIZE);
+        size_t len;
+
+        if (batch->next == batch->count) {
+            uint64_t bytes = 0;
+            int i;
+
+            batch->next = batch->count = 0;
+
+            if ((res = udp_receive_batch(c)) <= 0) {
+                /* return the conn buffer. */
+                free_conn_buffer(c->cbg, c->rbuf, 8 - 1 /* worst case for memory usage */);
+                c->rbuf = NULL;
+                c->rcurr = NULL;
+                c->rsize = 0;
+                return 0;
+            }
+            batch->count = res;
+
+            for (i = 0; i < batch->count; i++) {
+                bytes += batch->recv_hdrs[i].msg_len;
+            }
+
+            STATS_LOCK(stats);
+            stats->bytes_read += bytes;
+            stats->udp_recv_calls ++;
+            stats->udp_datagrams_received += res;
+            STATS_UNLOCK(stats);
+        }
+
+        hdr = &batch->recv_hdrs[batch->next ++];
+        res = hdr->msg_len;
+        buf = (unsigned char *) hdr->msg_hdr.msg_iov->iov_base;
+
+        /* anything too short for the header is dropped. */
+        if (res <= 8) {
+            continue;
+        }
 
-        /* Beginning of UDP packet is the request ID; save it. */
-        c->request_id = buf[0] * 256 + buf[1];
+        /* Don't care about any of the rest of the header.  a single-packet
+         * request is parsed where it landed, in its slot. */
+        if (buf[4] == 0 && buf[5] == 1) {
+            c->rcurr = (char*) buf + 8;
+            c->rbytes = res - 8;
+            break;
+        }
 
-        /* If this is a multi-packet request, drop it. */
-        if (buf[4] != 0 || buf[5] != 1) {
+        /* If this is a multi-packet request and we can't reassemble, drop
+         * it. */
+        if (settings.udp_reassembly_limit == 0) {
+            memcpy(&c->request_addr, hdr->msg_hdr.msg_name, hdr->msg_hdr.msg_namelen);
+            c->request_addr_size = hdr->msg_hdr.msg_namelen;
+            c->request_id = buf[0] * 256 + buf[1];
             if (c->binary) {
                 bp_write_err_msg(c, "multi-packet request not supported");
             } else {
@@ -2302,37 +3442,43 @@ int try_read_udp(conn* c) {
             return 0;
         }
 
-        /* report peak usage here */
-        report_max_rusage(c->cbg, c->rbuf, res);
-
-#if defined(HAVE_UDP_REPLY_PORTS)
-        reply_ports = ntohs(*((uint16_t*)(buf + 6)));
-        c->xfd = c->ufd;
-        /* If the client cannot support the number of reply sockets
-           use the receive socket instead.  We check against num_threads
-           to account for the entire range of ports in use, including the
-           receive port. */
-        if (reply_ports < settings.num_threads) {
-            c->xfd = c->sfd;
+        /* a request whose last packet this is is put together past the
+         * batch's slots.  (one byte is left over so that the parser never
+         * runs off the end of the buffer.) */
+        if (udp_reassemble(hdr->msg_hdr.msg_name, hdr->msg_hdr.msg_namelen,
+                           buf[0] * 256 + buf[1],
+                           buf[2] * 256 + buf[3], buf[4] * 256 + buf[5],
+                           (char*) buf + 8, res - 8,
+                           assembled, c->rsize - (assembled - c->rbuf) - 1,
+                           &len) == UDP_REASSEMBLY_COMPLETE) {
+            c->rcurr = assembled;
+            c->rbytes = len;
+            break;
         }
-#endif /* defined(HAVE_UDP_REPLY_PORTS) */
-
-        /* Don't care about any of the rest of the header. */
-        res -= 8;
-        memmove(c->rbuf, c->rbuf + 8, res);
-
-        c->rbytes += res;
-        c->rcurr = c->rbuf;
-        return 1;
-    } else {
-        /* return the conn buffer. */
-        free_conn_buffer(c->cbg, c->rbuf, 8 - 1 /* worst case for memory usage */);
-        c->rbuf = NULL;
-        c->rcurr = NULL;
-        c->rsize = 0;
     }
 
-    return 0;
+    memcpy(&c->request_addr, hdr->msg_hdr.msg_name, hdr->msg_hdr.msg_namelen);
+    c->request_addr_size = hdr->msg_hdr.msg_namelen;
+
+    /* Beginning of UDP packet is the request ID; save it. */
+    c->request_id = buf[0] * 256 + buf[1];
+
+    /* report peak usage here */
+    report_max_rusage(c->cbg, c->rbuf, c->rcurr + c->rbytes - c->rbuf);
+
+#if defined(HAVE_UDP_REPLY_PORTS)
+    reply_ports = ntohs(*((uint16_t*)(buf + 6)));
+    c->xfd = c->ufd;
+    /* If the client cannot support the number of reply sockets
+       use the receive socket instead.  We check against num_threads
+       to account for the entire range of ports in use, including the
+       receive port. */
+    if (reply_ports < settings.num_threads) {
+        c->xfd = c->sfd;
+    }
+#endif /* defined(HAVE_UDP_REPLY_PORTS) */
+
+    return 1;
 }
 
 /*
@@ -2342,11 +3488,42 @@ int try_read_udp(conn* c) {
  * (if any) to the beginning of the buffer.
  * return 0 if there's nothing to read on the first read.
  */
+/*
+ * readv(..) from a connection's socket, or from what its ring has received.
+ */
+ssize_t conn_readv(conn* c, const struct iovec* iov, const int iovcnt) {
+#if defined(USE_URING)
+    if (c->uring.ring != NULL) {
+        return uring_conn_readv(c, iov, iovcnt);
+    }
+#endif /* #if defined(USE_URING) */
+    return readv(c->sfd, iov, iovcnt);
+}
+
+/*
+ * sendmsg(..) on a connection's socket, or through its ring.
+ */
+static ssize_t conn_sendmsg(conn* c, struct msghdr* m) {
+#if defined(USE_URING)
+    if (c->uring.ring != NULL) {
+        return uring_conn_sendmsg(c, m);
+    }
+#endif /* #if defined(USE_URING) */
+#if defined(USE_ZEROCOPY)
+    if (m->msg_flags & MSG_ZEROCOPY) {
+        return zerocopy_sendmsg(c, m);
+    }
+#endif /* #if defined(USE_ZEROCOPY) */
+    return sendmsg(c->xfd, m, 0);
+}
+
 int try_read_network(conn* c) {
     stats_t *stats = STATS_GET_TLS();
     int gotdata = 0;
     int res;
     int avail;
+    bool capped;
+    struct iovec iov;
 
     assert(c != NULL);
 
@@ -2357,10 +3534,11 @@ int try_read_network(conn* c) {
             c->rcurr = c->rbuf;
         }
     } else {
-        c->rbuf = (char*) alloc_conn_buffer(c->cbg, 0);
+        /* most requests are short, so start out with a small buffer. */
+        c->rbuf = (char*) alloc_small_conn_buffer(c->cbg);
         if (c->rbuf != NULL) {
             c->rcurr = c->rbuf;
-            c->rsize = CONN_BUFFER_DATA_SZ;
+            c->rsize = CONN_BUFFER_SMALL_DATA_SZ;
         } else {
             if (c->binary) {
                 bp_write_err_msg(c, "out of memory");
@@ -2373,8 +3551,56 @@ int try_read_network(conn* c) {
 
     while (1) {
         avail = c->rsize - c->rbytes;
+        capped = false;
+
+        if (avail == 0 &&
+            is_small_conn_buffer(c->rbuf) &&
+            (c->binary ||
+             memchr(c->rbuf, '\n', c->rbytes) != NULL)) {
+            /* a request is in, and whatever value follows it is better read
+             * straight into its item than into a bigger buffer.  binary
+             * headers always fit; keys and values are read into place. */
+            break;
+        }
+
+        if (avail == 0 && is_small_conn_buffer(c->rbuf)) {
+            /* outgrew the small buffer.  move to a big one. */
+            char* newbuf = (char*) promote_conn_buffer(c->cbg, c->rbuf, c->rbytes);
+
+            if (newbuf != NULL) {
+                c->rbuf = c->rcurr = newbuf;
+                c->rsize = CONN_BUFFER_DATA_SZ;
+                avail = c->rsize - c->rbytes;
+            }
+        }
+        if (avail > 0 && ! is_small_conn_buffer(c->rbuf)) {
+            avail = conn_read_room(c, avail);
+        }
+
+        if (avail == 0) {
+            if (settings.verbose > 0) {
+                fprintf(stderr, "Couldn't grow the read buffer of fd %d\n", c->sfd);
+            }
+            if (c->binary) {
+                c->state = conn_closing;
+            } else {
+                conn_set_state(c, conn_closing);
+            }
+            return 1;
+        }
 
-        res = read(c->sfd, c->rbuf + c->rbytes, avail);
+        if (c->direct_read &&
+            c->rbytes == 0 &&
+            avail > REQUEST_HEAD_SIZE) {
+            /* the last request had a large value, and so may this one.  the
+             * value is read into its item once the head has been parsed. */
+            avail = REQUEST_HEAD_SIZE;
+            capped = true;
+        }
+
+        iov.iov_base = c->rbuf + c->rbytes;
+        iov.iov_len = avail;
+        res = conn_readv(c, &iov, 1);
         if (res > 0) {
             STATS_LOCK(stats);
             stats->bytes_read += res;
@@ -2385,7 +3611,7 @@ int try_read_network(conn* c) {
             /* report peak usage here */
             report_max_rusage(c->cbg, c->rbuf, c->rbytes);
 
-            if (res < avail) {
+            if (res < avail || capped) {
                 break;
             }
         }
@@ -2419,8 +3645,19 @@ bool update_event(conn* c, const int new_flags) {
     assert(c != NULL);
 
     struct event_base *base = c->event.ev_base;
+#if defined(USE_URING)
+    if (c->uring.ring != NULL) {
+        uring_conn_wait(c, new_flags);
+        return true;
+    }
+#endif /* #if defined(USE_URING) */
     if (c->ev_flags == new_flags)
         return true;
+#if defined(EV_ET)
+    /* registered for both, edge-triggered; nothing to change. */
+    if (c->ev_flags & EV_ET)
+        return true;
+#endif /* #if defined(EV_ET) */
     if (event_del(&c->event) == -1) return false;
     event_set(&c->event, c->sfd, new_flags, event_handler, (void *)c);
     event_base_set(base, &c->event);
@@ -2429,18 +3666,47 @@ bool update_event(conn* c, const int new_flags) {
     return true;
 }
 
+/*
+ * Hands a connection that a listener accepted to a worker thread.  The
+ * dispatcher's listeners pass it on to the workers in turn; a worker's own
+ * listener (with -S) keeps it.
+ */
+void dispatch_accepted_conn(conn* listener, const int sfd, const int init_state,
+                            const struct sockaddr* addr, const socklen_t addrlen) {
+    if (is_listen_thread()) {
+        dispatch_conn_new(sfd, init_state, EV_READ | EV_PERSIST,
+                          NULL, false, listener->binary,
+                          addr, addrlen);
+    } else if (conn_new(sfd, init_state, EV_READ | EV_PERSIST,
+                        listener->cbg, false, listener->binary,
+                        addr, addrlen, listener->event.ev_base) == NULL) {
+        if (settings.verbose > 0) {
+            fprintf(stderr, "Can't listen for events on fd %d\n", sfd);
+        }
+        close(sfd);
+    }
+}
+
 /*
  * Sets whether we are listening for new connections or not.
  */
 void accept_new_conns(const bool do_accept, const bool binary) {
     conn* conn;
-    if (! is_listen_thread())
+    if (is_listen_thread()) {
+        if (binary) {
+            conn = listen_binary_conn;
+        } else {
+            conn = listen_conn;
+        }
+    } else if (! settings.reuseport ||
+               (conn = thread_listen_conn(binary)) == NULL) {
+        /* with -S, every worker throttles its own listener. */
         return;
+    }
 
-    if (binary) {
-        conn = listen_binary_conn;
-    } else {
-        conn = listen_conn;
+    if (conn == NULL ||
+        (conn->ev_flags != 0) == do_accept) {
+        return;
     }
 
     if (do_accept) {
@@ -2467,6 +3733,47 @@ void accept_new_conns(const bool do_accept, const bool binary) {
  *   TRANSMIT_SOFT_ERROR Can't write any more right now.
  *   TRANSMIT_HARD_ERROR Can't write (c->state is set to conn_closing)
  */
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+/*
+ * sends as many of the replies' packets as the batch holds with one call.
+ * returns the number of bytes sent, or -1 if nothing was.
+ */
+static ssize_t udp_send_batch(conn* c) {
+    stats_t *stats = STATS_GET_TLS();
+    udp_batch_t* batch = c->udp_batch;
+    uint64_t bytes = 0;
+    int i, count, res;
+
+    count = c->msgused - c->msgcurr;
+    if (count > batch->size) {
+        count = batch->size;
+    }
+    for (i = 0; i < count; i++) {
+        batch->send_hdrs[i].msg_hdr = c->msglist[c->msgcurr + i];
+        batch->send_hdrs[i].msg_len = 0;
+    }
+
+    if ((res = sendmmsg(c->xfd, batch->send_hdrs, count, 0)) <= 0) {
+        return res;
+    }
+
+    /* a datagram goes out whole or not at all. */
+    for (i = 0; i < res; i++) {
+        bytes += batch->send_hdrs[i].msg_len;
+        c->msglist[c->msgcurr + i].msg_iovlen = 0;
+    }
+    c->msgcurr += res;
+
+    STATS_LOCK(stats);
+    stats->bytes_written += bytes;
+    stats->udp_send_calls ++;
+    stats->udp_packets_sent += res;
+    STATS_UNLOCK(stats);
+
+    return bytes;
+}
+#endif /* #if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) */
+
 int transmit(conn* c) {
     stats_t *stats = STATS_GET_TLS();
     assert(c != NULL);
@@ -2476,14 +3783,31 @@ int transmit(conn* c) {
         /* Finished writing the current msg; advance to the next. */
         c->msgcurr++;
     }
+    if (c->held > 0 &&
+        ! c->udp &&
+        c->msgcurr < c->msgused) {
+        conn_join_replies(c);
+    }
     if (c->msgcurr < c->msgused) {
         ssize_t res;
         struct msghdr *m = &c->msglist[c->msgcurr];
 
-        res = sendmsg(c->xfd, m, 0);
-        if (res > 0) {
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+        if (c->udp && c->udp_batch != NULL) {
+            if ((res = udp_send_batch(c)) > 0) {
+                return TRANSMIT_INCOMPLETE;
+            }
+        } else
+#endif /* #if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) */
+        if ((res = conn_sendmsg(c, m)) > 0) {
             STATS_LOCK(stats);
             stats->bytes_written += res;
+            if (c->udp) {
+                stats->udp_send_calls ++;
+                stats->udp_packets_sent ++;
+            } else {
+                stats->tcp_send_calls ++;
+            }
             STATS_UNLOCK(stats);
 
             /* We've written some of the data. Remove the completed
@@ -2527,13 +3851,28 @@ int transmit(conn* c) {
                 c->state = conn_closing;
             }
         } else {
-            if (c->udp)
+            if (c->udp) {
+                /* the rest of the replies is dropped, and with it the items
+                 * of any held back. */
+                while (c->ileft > 0) {
+                    item_deref(*(c->icurr));
+                    c->icurr++;
+                    c->ileft--;
+                }
+                c->held = 0;
                 conn_set_state(c, conn_read);
-            else
+            } else {
                 conn_set_state(c, conn_closing);
+            }
         }
         return TRANSMIT_HARD_ERROR;
     } else {
+        if (! c->udp) {
+            STATS_LOCK(stats);
+            stats->tcp_replies_sent += c->held + 1;
+            STATS_UNLOCK(stats);
+        }
+        c->held = 0;
         return TRANSMIT_COMPLETE;
     }
 }
@@ -2546,6 +3885,7 @@ static void drive_machine(conn* c) {
     struct sockaddr addr;
     int nreqs = settings.reqs_per_event;
     ssize_t res;
+    struct iovec iov;
 
     assert(c != NULL);
 
@@ -2576,9 +3916,7 @@ static void drive_machine(conn* c) {
                 close(sfd);
                 break;
             }
-            dispatch_conn_new(sfd, conn_read, EV_READ | EV_PERSIST,
-                              NULL, false, c->binary,
-                              &addr, addrlen);
+            dispatch_accepted_conn(c, sfd, conn_read, &addr, addrlen);
 
             break;
 
@@ -2586,6 +3924,19 @@ static void drive_machine(conn* c) {
             if (try_read_command(c) != 0) {
                 continue;
             }
+            /* replies held back go out before anything more is read.  the
+               datagrams of a batched receive already are. */
+            if (c->held > 0 &&
+                ! (c->udp && udp_batch_pending(c))) {
+                conn_set_state(c, conn_mwrite);
+                break;
+            }
+            /* Datagrams a batched receive already read are served whatever
+               the limit; the socket won't signal them again. */
+            if (c->udp && udp_batch_pending(c)) {
+                try_read_udp(c);
+                continue;
+            }
             /* If we haven't exhausted our request-per-event limit and there's more
                to read, keep going, otherwise stop to give another conn a
                chance or wait */
@@ -2593,6 +3944,28 @@ static void drive_machine(conn* c) {
                 nreqs--;
                 continue;
             }
+            /* a request that couldn't be read may still have left an error
+               to send. */
+            if (c->state != conn_read) {
+                break;
+            }
+#if defined(EV_ET)
+            /* out of requests for this event, but not necessarily of data,
+               which no edge would tell us about: a read stops at the head of
+               a large update, or at a full small buffer with a request in
+               it.  come back once the other connections have had their
+               turn. */
+            if (nreqs == 0 &&
+                (c->ev_flags & EV_ET)
+#if defined(USE_URING)
+                && c->uring.ring == NULL
+#endif /* #if defined(USE_URING) */
+                ) {
+                event_active(&c->event, EV_READ, 0);
+                stop = true;
+                break;
+            }
+#endif /* #if defined(EV_ET) */
             /* we have no command line and no data to read from network */
             if (!update_event(c, EV_READ | EV_PERSIST)) {
                 if (settings.verbose > 0)
@@ -2611,6 +3984,8 @@ static void drive_machine(conn* c) {
             }
             /* first check if we have leftovers in the conn_read buffer */
             if (c->rbytes > 0) {
+                int copied = 0;
+
                 while (c->rbytes > 0 &&
                        c->riov_left > 0) {
                     struct iovec* current_iov = &c->riov[c->riov_curr];
@@ -2620,6 +3995,7 @@ static void drive_machine(conn* c) {
                     memcpy(current_iov->iov_base, c->rcurr, tocopy);
                     c->rcurr += tocopy;
                     c->rbytes -= tocopy;
+                    copied += tocopy;
                     current_iov->iov_base += tocopy;
                     current_iov->iov_len -= tocopy;
 
@@ -2629,15 +4005,19 @@ static void drive_machine(conn* c) {
                         c->riov_left --;
                     }
                 }
+                STATS_LOCK(stats);
+                stats->value_bytes_copied += copied;
+                STATS_UNLOCK(stats);
                 break;
             }
 
             /*  now try reading from the socket */
-            res = readv(c->sfd, &c->riov[c->riov_curr],
-                        c->riov_left <= IOV_MAX ? c->riov_left : IOV_MAX);
+            res = conn_readv(c, &c->riov[c->riov_curr],
+                             c->riov_left <= IOV_MAX ? c->riov_left : IOV_MAX);
             if (res > 0) {
                 STATS_LOCK(stats);
                 stats->bytes_read += res;
+                stats->value_bytes_direct += res;
                 STATS_UNLOCK(stats);
 
                 while (res > 0) {
@@ -2661,6 +4041,9 @@ static void drive_machine(conn* c) {
                 break;
             }
             if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (conn_flush_held(c)) {
+                    break;
+                }
                 if (!update_event(c, EV_READ | EV_PERSIST)) {
                     if (settings.verbose > 0)
                         fprintf(stderr, "Couldn't update event\n");
@@ -2695,7 +4078,9 @@ static void drive_machine(conn* c) {
             assert(c->rbuf != NULL);
 
             /*  now try reading from the socket */
-            res = read(c->sfd, c->rbuf, c->rsize > c->sbytes ? c->sbytes : c->rsize);
+            iov.iov_base = c->rbuf;
+            iov.iov_len = c->rsize > c->sbytes ? c->sbytes : c->rsize;
+            res = conn_readv(c, &iov, 1);
             if (res > 0) {
                 STATS_LOCK(stats);
                 stats->bytes_read += res;
@@ -2712,6 +4097,9 @@ static void drive_machine(conn* c) {
                 break;
             }
             if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (conn_flush_held(c)) {
+                    break;
+                }
                 if (!update_event(c, EV_READ | EV_PERSIST)) {
                     if (settings.verbose > 0)
                         fprintf(stderr, "Couldn't update event\n");
@@ -2729,42 +4117,53 @@ static void drive_machine(conn* c) {
 
         case conn_write:
             /*
-             * We want to write out a simple response.  If we haven't already,
-             * assemble it into a msgbuf list (this will be a single-entry list
-             * for TCP or a two-entry list for UDP).
+             * out_string(..) and write_and_free(..) have already built a
+             * simple response, so it is sent like any other.
              */
 
-            if (c->iovused == 0) {
-                assert(c->msgused == 0);
-                if (add_msghdr(c) != 0 ||
-                    add_iov(c, c->wcurr, c->wbytes, true) != 0 ||
-                    (c->udp && build_udp_headers(c) != 0)) {
-                    if (settings.verbose > 0)
-                        fprintf(stderr, "Couldn't build response\n");
-                    conn_set_state(c, conn_closing);
-                    break;
-                }
-            }
-
             /* fall through... */
 
         case conn_mwrite:
+            /*
+             * if the next request is already in the read buffer, the reply
+             * can wait to go out with the one to it.  a simple response waits
+             * only if there is no buffer to free and nowhere to go but the
+             * next request.  the connection keeps what it has built, so it
+             * doesn't go through conn_set_state(..).
+             */
+            if ((c->state == conn_mwrite ||
+                 (c->write_and_free == NULL && c->write_and_go == conn_read)) &&
+                conn_hold_reply(c, c->udp ? udp_batch_pending(c) :
+                                (c->rbytes > 0 && memchr(c->rcurr, '\n', c->rbytes) != NULL))) {
+                c->state = conn_read;
+                break;
+            }
+
             switch (transmit(c)) {
             case TRANSMIT_COMPLETE:
+#if defined(USE_ZEROCOPY)
+                zerocopy_pin_items(c);
+#endif /* #if defined(USE_ZEROCOPY) */
+                /* the items of every reply that went out. */
+                while (c->ileft > 0) {
+                    item *it = *(c->icurr);
+                    assert(ITEM_is_valid(it));
+                    item_deref(it);
+                    c->icurr++;
+                    c->ileft--;
+                }
+
                 if (c->state == conn_mwrite) {
-                    while (c->ileft > 0) {
-                        item *it = *(c->icurr);
-                        assert(ITEM_is_valid(it));
-                        item_deref(it);
-                        c->icurr++;
-                        c->ileft--;
-                    }
                     conn_set_state(c, conn_read);
                 } else if (c->state == conn_write) {
                     if (c->write_and_free) {
                         free(c->write_and_free);
                         c->write_and_free = 0;
                     }
+                    /* everything went out, whatever state comes next. */
+                    c->msgcurr = 0;
+                    c->msgused = 0;
+                    c->iovused = 0;
                     conn_set_state(c, c->write_and_go);
                 } else {
                     if (settings.verbose > 0)
@@ -2788,6 +4187,12 @@ static void drive_machine(conn* c) {
             }
             break;
 
+        case conn_tier_wait:
+            /* conn_tier_done(..) picks the connection back up. */
+            update_event(c, 0);
+            stop = true;
+            break;
+
         case conn_closing:
             if (c->udp)
                 conn_cleanup(c);
@@ -2820,6 +4225,23 @@ void event_handler(const int fd, const short which, void *arg) {
         return;
     }
 
+    thread_event_handled();
+    c->active = true;
+
+    if (c->slim &&
+        ! conn_unslim(c)) {
+        if (settings.verbose > 0) {
+            fprintf(stderr, "Couldn't give fd %d its buffers back\n", c->sfd);
+        }
+        conn_close(c);
+        return;
+    }
+
+#if defined(USE_ZEROCOPY)
+    /* the completions of sends made without a copy wake us up too. */
+    zerocopy_reap(c);
+#endif /* #if defined(USE_ZEROCOPY) */
+
     if (c->binary) {
         process_binary_protocol(c);
     } else {
@@ -2935,6 +4357,14 @@ static int server_socket(const int port, const bool is_udp) {
     }
 
     setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, (void *)&flags, sizeof(flags));
+#if defined(SO_REUSEPORT)
+    if (settings.reuseport &&
+        setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, (void *)&flags, sizeof(flags)) != 0) {
+        perror("setsockopt(SO_REUSEPORT)");
+        close(sfd);
+        return -1;
+    }
+#endif /* #if defined(SO_REUSEPORT) */
     if (is_udp) {
         maximize_socket_buffer(sfd, SO_SNDBUF);
         maximize_socket_buffer(sfd, SO_RCVBUF);
@@ -2966,6 +4396,45 @@ static int server_socket(const int port, const bool is_udp) {
     return sfd;
 }
 
+/*
+ * Opens a socket bound to the port, with SO_REUSEPORT, for each worker
+ * thread.
+ */
+static int* server_sockets(const int port, const bool is_udp) {
+    int* sfds;
+    int i;
+
+    if ((sfds = malloc(sizeof(int) * (settings.num_threads - 1))) == NULL) {
+        perror("malloc()");
+        return NULL;
+    }
+    for (i = 0; i < settings.num_threads - 1; i++) {
+        if ((sfds[i] = server_socket(port, is_udp)) == -1) {
+            while (i-- > 0) {
+                close(sfds[i]);
+            }
+            free(sfds);
+            return NULL;
+        }
+    }
+    return sfds;
+}
+
+/*
+ * Gives each worker thread one of the sockets from server_sockets(..), and a
+ * connection in init_state to listen on it with.
+ */
+static void dispatch_server_sockets(const int* sfds, const int init_state,
+                                    const bool is_udp, const bool is_binary) {
+    int i;
+
+    /* this is guaranteed to hit all threads because we round-robin */
+    for (i = 0; i < settings.num_threads - 1; i++) {
+        dispatch_conn_new(sfds[i], init_state, EV_READ | EV_PERSIST,
+                          NULL, is_udp, is_binary, NULL, 0);
+    }
+}
+
 static int new_socket_unix(void) {
     int sfd;
     int flags;
@@ -3044,6 +4513,13 @@ static int b_socket = 0;
 /* binary udp socket */
 static int bu_socket = -1;
 
+/* with -S, each worker thread's sockets for the ports above, by worker, in
+ * their stead. */
+static int *l_sockets = NULL;
+static int *u_sockets = NULL;
+static int *b_sockets = NULL;
+static int *bu_sockets = NULL;
+
 
 /* invoke right before gdb is called, on assert */
 void pre_gdb(void) {
@@ -3144,8 +4620,81 @@ static void usage(void) {
     printf("-R            Maximum number of requests per event\n"
            "              limits the number of requests process for a given connection\n"
            "              to prevent starvation.  default 1\n");
+    printf("-g <num>      replies to pipelined requests on a tcp connection that\n"
+           "              are sent together, at most; 1 sends each one as soon as\n"
+           "              it is ready.  default 64\n");
+    printf("-W <bytes>    send values of at least <bytes> with MSG_ZEROCOPY, holding\n"
+           "              their items until the kernel is done with them.  default\n"
+           "              0 (off)\n");
+    printf("-j <bytes>    after a value of at least <bytes>, a tcp connection reads\n"
+           "              just the head of its next request into its buffer, so\n"
+           "              that another large value is read straight into its\n"
+           "              item.  0 turns this off.  default 16384\n");
+    printf("-y <usec>     worker threads look for events without waiting, until\n"
+           "              none has come for <usec> microseconds; trades cpu for\n"
+           "              wakeup latency.  default 0 (off)\n");
+    printf("-Y <usec>     set SO_BUSY_POLL to <usec> on tcp connections.  default 0\n"
+           "              (off)\n");
+    printf("-o <secs>     close tcp connections idle for <secs> seconds.  default 0\n"
+           "              (never)\n");
+    printf("-O <secs>     tcp connections idle for <secs> seconds between requests\n"
+           "              let go of their buffers until they are next used.\n"
+           "              default 0 (never)\n");
+    printf("-H <bytes>    memory a tcp connection may hold for its buffers; a\n"
+           "              request that needs more fails.  default 0 (no limit)\n");
+    printf("-B <num>      UDP datagrams to read with each receive call, and reply\n"
+           "              packets to send with each send call; at most %d, or %d\n"
+           "              with -K 0.  default 32\n",
+           (int) ((CONN_BUFFER_DATA_SZ - UDP_REASSEMBLED_SIZE) / UDP_DATAGRAM_SLOT_SIZE),
+           (int) (CONN_BUFFER_DATA_SZ / UDP_DATAGRAM_SLOT_SIZE));
+    printf("-K <num>      memory for reassembling UDP requests that span several\n"
+           "              packets, in megabytes; 0 rejects them.  default 4\n");
+    printf("-S            each worker thread listens on every port itself, with\n"
+           "              SO_REUSEPORT, and the kernel spreads connections and\n"
+           "              datagrams across them\n");
+    printf("-T            register each tcp connection for reads and writes once,\n"
+           "              edge-triggered, rather than each time it switches\n");
+    printf("-q            do the socket i/o of tcp connections through an io_uring\n"
+           "              on each worker thread, where the kernel allows\n");
     printf("-C            Maximum bytes used for connection buffers\n"
            "              default 16MB\n");
+#if defined(USE_SLAB_ALLOCATOR)
+    printf("-I <size>     largest value to store, in bytes or with a k or m suffix;\n"
+           "              values over 1MB are chained across slab chunks.  default 1m\n");
+#else
+    printf("-I <size>     largest value to store, in bytes or with a k or m suffix;\n"
+           "              at most 1m, which is the default\n");
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
+#if !defined(USE_CLOCK_EVICTION)
+    printf("-L <pct>      segmented LRU: percent of each LRU reserved for items\n"
+           "              that have been hit since they were stored.  default 0 (off)\n");
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
+    printf("-F <num>      TinyLFU admission filter sized for about <num> keys; when\n"
+           "              the cache is full, a new item only displaces the item\n"
+           "              chosen for eviction if its key is fetched at least as\n"
+           "              often.  default 0 (off)\n");
+#if defined(USE_SLAB_ALLOCATOR)
+    printf("-A <sec>      run the background slab rebalancer, moving at most one page\n"
+           "              every <sec> seconds toward the allocation that its model of\n"
+           "              each class's hit rate favors.  default 0 (off)\n");
+    printf("-z <file>     plan the slab classes to fit an item size profile, the saved\n"
+           "              output of \"stats sizes\"; see \"stats slabs_plan\"\n");
+    printf("-e <file>     spill evicted values to a log in <file>, and read them back\n"
+           "              into memory when they are hit over TCP (a hit over UDP\n"
+           "              counts as a miss); see \"stats tier\"\n");
+    printf("-E <bytes>    smallest value to spill to the tier.  default 16384\n");
+    printf("-x <num>      size of the tier log in megabytes.  default 1024\n");
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
+    printf("-Z <bytes>    store values of at least <bytes> bytes LZ4 compressed,\n"
+           "              if that saves at least an eighth of them.  default 0 (off)\n");
+#if defined(COST_BENEFIT_STATS) && !defined(USE_CLOCK_EVICTION)
+    printf("-G            size-aware eviction: of the items near the LRU tail, evict\n"
+           "              the one whose size bucket earns the fewest hits per byte\n");
+#if defined(USE_SLAB_ALLOCATOR)
+    printf("              (only among the items of the slab class being allocated\n"
+           "              from, which are of much the same size)\n");
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
+#endif /* #if defined(COST_BENEFIT_STATS) && !defined(USE_CLOCK_EVICTION) */
     return;
 }
 
@@ -3275,7 +4824,7 @@ int main (int argc, char **argv) {
     setbuf(stderr, NULL);
 
     /* process arguments */
-    while ((c = getopt(argc, argv, "bp:s:U:m:Mc:khirvdl:u:P:f:s:n:t:D:n:N:R:C:")) != -1) {
+    while ((c = getopt(argc, argv, "bp:s:U:m:Mc:khirvdl:u:P:f:s:n:t:D:n:N:R:g:W:j:y:Y:o:O:H:B:C:L:F:GA:z:I:Z:e:E:x:K:STq")) != -1) {
         switch (c) {
         case 'U':
             settings.udpport = atoi(optarg);
@@ -3332,6 +4881,69 @@ int main (int argc, char **argv) {
                 return 1;
             }
             break;
+        case 'g':
+            settings.reply_batch_size = atoi(optarg);
+            if (settings.reply_batch_size <= 0) {
+                fprintf(stderr, "Reply batch size must be greater than 0\n");
+                return 1;
+            }
+            break;
+        case 'W':
+#if defined(USE_ZEROCOPY)
+            settings.zerocopy_min = strtoul(optarg, NULL, 10);
+            break;
+#else
+            fprintf(stderr, "MSG_ZEROCOPY is not supported by this build\n");
+            return 1;
+#endif /* #if defined(USE_ZEROCOPY) */
+        case 'j':
+            settings.direct_read_min = strtoul(optarg, NULL, 10);
+            break;
+        case 'y':
+            settings.busy_poll_usec = atoi(optarg);
+            if (settings.busy_poll_usec < 0) {
+                fprintf(stderr, "Busy poll time must not be negative\n");
+                return 1;
+            }
+            break;
+        case 'Y':
+#if defined(SO_BUSY_POLL)
+            settings.socket_busy_poll_usec = atoi(optarg);
+            if (settings.socket_busy_poll_usec < 0) {
+                fprintf(stderr, "Socket busy poll time must not be negative\n");
+                return 1;
+            }
+            break;
+#else
+            fprintf(stderr, "SO_BUSY_POLL is not supported by this build\n");
+            return 1;
+#endif /* #if defined(SO_BUSY_POLL) */
+        case 'o':
+            settings.idle_timeout = atoi(optarg);
+            if (settings.idle_timeout < 0) {
+                fprintf(stderr, "Idle timeout must not be negative\n");
+                return 1;
+            }
+            break;
+        case 'O':
+            settings.idle_slim_timeout = atoi(optarg);
+            if (settings.idle_slim_timeout < 0) {
+                fprintf(stderr, "Idle slim timeout must not be negative\n");
+                return 1;
+            }
+            break;
+        case 'H':
+            settings.conn_memory_max = strtoul(optarg, NULL, 10);
+            break;
+        case 'B':
+            settings.udp_batch_size = atoi(optarg);
+            if (settings.udp_batch_size <= 0 ||
+                settings.udp_batch_size > CONN_BUFFER_DATA_SZ / UDP_DATAGRAM_SLOT_SIZE) {
+                fprintf(stderr, "UDP batch size must be between 1 and %d\n",
+                        (int) (CONN_BUFFER_DATA_SZ / UDP_DATAGRAM_SLOT_SIZE));
+                return 1;
+            }
+            break;
         case 'u':
             username = optarg;
             break;
@@ -3371,12 +4983,157 @@ int main (int argc, char **argv) {
             settings.max_conn_buffer_bytes = atoi(optarg);
             break;
 
+        case 'L':
+#if defined(USE_CLOCK_EVICTION)
+            fprintf(stderr, "Segmented LRU is not available with CLOCK eviction\n");
+            return 1;
+#endif /* #if defined(USE_CLOCK_EVICTION) */
+            settings.lru_protected_pct = atoi(optarg);
+            if (settings.lru_protected_pct < 0 || settings.lru_protected_pct > 99) {
+                fprintf(stderr, "Protected LRU segment must be between 0 and 99 percent\n");
+                return 1;
+            }
+            break;
+
+        case 'F':
+            settings.admission_items = strtoul(optarg, NULL, 10);
+            break;
+
+        case 'G':
+#if !defined(COST_BENEFIT_STATS)
+            fprintf(stderr, "Size-aware eviction requires cost-benefit stats\n");
+            return 1;
+#endif /* #if !defined(COST_BENEFIT_STATS) */
+#if defined(USE_CLOCK_EVICTION)
+            fprintf(stderr, "Size-aware eviction is not available with CLOCK eviction\n");
+            return 1;
+#endif /* #if defined(USE_CLOCK_EVICTION) */
+            settings.size_aware_eviction = true;
+            break;
+
+        case 'A':
+#if !defined(USE_SLAB_ALLOCATOR)
+            fprintf(stderr, "The slab rebalancer is only available with the slab allocator\n");
+            return 1;
+#endif /* #if !defined(USE_SLAB_ALLOCATOR) */
+            settings.slab_automove_interval = atoi(optarg);
+            if (settings.slab_automove_interval < 0) {
+                fprintf(stderr, "Slab rebalancer interval must not be negative\n");
+                return 1;
+            }
+            break;
+
+        case 'I': {
+            char *end;
+            unsigned long size = strtoul(optarg, &end, 10);
+
+            if (*end == 'k' || *end == 'K') {
+                size *= 1024;
+                end++;
+            } else if (*end == 'm' || *end == 'M') {
+                size *= 1024 * 1024;
+                end++;
+            }
+            if (*end != '\0' || size == 0) {
+                fprintf(stderr, "Item size limit must be a positive number of bytes\n");
+                return 1;
+            }
+#if !defined(USE_SLAB_ALLOCATOR)
+            if (size > MAX_ITEM_SIZE) {
+                fprintf(stderr, "Items larger than %d bytes need the slab allocator\n", MAX_ITEM_SIZE);
+                return 1;
+            }
+#endif /* #if !defined(USE_SLAB_ALLOCATOR) */
+            settings.item_size_max = size;
+            break;
+        }
+
+        case 'z':
+#if !defined(USE_SLAB_ALLOCATOR)
+            fprintf(stderr, "Slab profiles are only available with the slab allocator\n");
+            return 1;
+#endif /* #if !defined(USE_SLAB_ALLOCATOR) */
+            settings.slab_profile = optarg;
+            break;
+
+        case 'e':
+#if !defined(USE_SLAB_ALLOCATOR)
+            fprintf(stderr, "The tier is only available with the slab allocator\n");
+            return 1;
+#endif /* #if !defined(USE_SLAB_ALLOCATOR) */
+            settings.tier_path = optarg;
+            break;
+
+        case 'E':
+            settings.tier_threshold = strtoul(optarg, NULL, 10);
+            if (settings.tier_threshold < TIER_MIN_THRESHOLD) {
+                fprintf(stderr, "Tier threshold must be at least %d bytes\n",
+                        TIER_MIN_THRESHOLD);
+                return 1;
+            }
+            break;
+
+        case 'x':
+            settings.tier_size = (size_t) strtoul(optarg, NULL, 10) * 1024 * 1024;
+            break;
+
+        case 'K':
+            settings.udp_reassembly_limit = (size_t) strtoul(optarg, NULL, 10) * 1024 * 1024;
+            break;
+
+        case 'S':
+#if defined(SO_REUSEPORT)
+            settings.reuseport = true;
+            break;
+#else
+            fprintf(stderr, "SO_REUSEPORT is not supported on this platform\n");
+            return 1;
+#endif /* #if defined(SO_REUSEPORT) */
+
+        case 'T':
+#if defined(EV_ET)
+            settings.edge_triggered = true;
+            break;
+#else
+            fprintf(stderr, "edge-triggered events are not supported by this libevent\n");
+            return 1;
+#endif /* #if defined(EV_ET) */
+
+        case 'q':
+#if defined(USE_URING)
+            settings.uring = true;
+            break;
+#else
+            fprintf(stderr, "io_uring is not supported by this build\n");
+            return 1;
+#endif /* #if defined(USE_URING) */
+
+        case 'Z':
+            settings.compress_threshold = strtoul(optarg, NULL, 10);
+            if (settings.compress_threshold != 0 &&
+                settings.compress_threshold < COMPRESS_MIN_THRESHOLD) {
+                fprintf(stderr, "Compression threshold must be 0 or at least %d bytes\n",
+                        COMPRESS_MIN_THRESHOLD);
+                return 1;
+            }
+            break;
+
         default:
             fprintf(stderr, "Illegal argument \"%c\"\n", c);
             return 1;
         }
     }
 
+    /* a batch's datagrams share the read buffer with the request that
+     * reassembly puts together after them. */
+    if (settings.udp_reassembly_limit > 0 &&
+        (size_t) settings.udp_batch_size * UDP_DATAGRAM_SLOT_SIZE + UDP_REASSEMBLED_SIZE >
+        CONN_BUFFER_DATA_SZ) {
+        fprintf(stderr, "UDP batch size must be at most %d with UDP reassembly on (-K)\n",
+                (int) ((CONN_BUFFER_DATA_SZ - UDP_REASSEMBLED_SIZE) / UDP_DATAGRAM_SLOT_SIZE));
+        return 1;
+    }
+
     if (maxcore != 0) {
         struct rlimit rlim_new;
         /*
@@ -3438,14 +5195,26 @@ int main (int argc, char **argv) {
         }
 
         if (settings.port > 0) {
-            l_socket = server_socket(settings.port, 0);
-            if (l_socket == -1) {
-                fprintf(stderr, "failed to listen\n");
-                exit(1);
+            if (settings.reuseport) {
+                if ((l_sockets = server_sockets(settings.port, false)) == NULL) {
+                    fprintf(stderr, "failed to listen\n");
+                    exit(1);
+                }
+            } else {
+                l_socket = server_socket(settings.port, 0);
+                if (l_socket == -1) {
+                    fprintf(stderr, "failed to listen\n");
+                    exit(1);
+                }
             }
         }
         if (settings.binary_port > 0) {
-            if ((b_socket = server_socket(settings.binary_port, 0)) == -1) {
+            if (settings.reuseport) {
+                if ((b_sockets = server_sockets(settings.binary_port, false)) == NULL) {
+                    fprintf(stderr, "bp failed to listen\n");
+                    exit(1);
+                }
+            } else if ((b_socket = server_socket(settings.binary_port, 0)) == -1) {
                 fprintf(stderr, "bp failed to listen\n");
                 exit(1);
             }
@@ -3454,15 +5223,27 @@ int main (int argc, char **argv) {
 
     if (settings.udpport > 0 && settings.socketpath == NULL) {
         /* create the UDP listening socket and bind it */
-        u_socket = server_socket(settings.udpport, 1);
-        if (u_socket == -1) {
-            fprintf(stderr, "failed to listen on UDP port %d\n", settings.udpport);
-            exit(EXIT_FAILURE);
+        if (settings.reuseport) {
+            if ((u_sockets = server_sockets(settings.udpport, true)) == NULL) {
+                fprintf(stderr, "failed to listen on UDP port %d\n", settings.udpport);
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            u_socket = server_socket(settings.udpport, 1);
+            if (u_socket == -1) {
+                fprintf(stderr, "failed to listen on UDP port %d\n", settings.udpport);
+                exit(EXIT_FAILURE);
+            }
         }
     }
     if (settings.binary_udpport > 0 && ! settings.socketpath) {
         /* create the UDP listening socket and bind it */
-        if ((bu_socket = server_socket(settings.binary_udpport, 1)) == -1) {
+        if (settings.reuseport) {
+            if ((bu_sockets = server_sockets(settings.binary_udpport, true)) == NULL) {
+                fprintf(stderr, "failed to listen on UDP port %d\n", settings.binary_udpport);
+                exit(1);
+            }
+        } else if ((bu_socket = server_socket(settings.binary_udpport, 1)) == -1) {
             fprintf(stderr, "failed to listen on UDP port %d\n", settings.binary_udpport);
             exit(1);
         }
@@ -3541,6 +5322,8 @@ int main (int argc, char **argv) {
     stats_init(settings.num_threads);
     STATS_SET_TLS(0);
     assoc_init();
+    expiry_init();
+    admission_init(settings.admission_items);
     conn_init();
 #if defined(USE_SLAB_ALLOCATOR)
     slabs_init(settings.maxbytes, settings.factor);
@@ -3548,7 +5331,13 @@ int main (int argc, char **argv) {
 #if defined(USE_FLAT_ALLOCATOR)
     flat_storage_init(settings.maxbytes);
 #endif /* #if defined(USE_FLAT_ALLOCATOR) */
+#if defined(USE_SLAB_ALLOCATOR)
+    if (settings.tier_path != NULL) {
+        tier_init(settings.tier_path, settings.tier_size);
+    }
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
     conn_buffer_init(settings.num_threads - 1, 0, 0, settings.max_conn_buffer_bytes / 2, settings.max_conn_buffer_bytes);
+    udp_reassembly_init(settings.udp_reassembly_limit);
 
     /* managed instance? alloc and zero a bucket array */
     if (settings.managed) {
@@ -3590,7 +5379,7 @@ int main (int argc, char **argv) {
             exit(1);
         }
     }
-    if ((settings.binary_port != 0) &&
+    if ((b_socket != 0) &&
         (listen_binary_conn = conn_new(b_socket, conn_listening,
                                        EV_READ | EV_PERSIST, NULL, false, true,
                                        NULL, 0,
@@ -3634,6 +5423,19 @@ int main (int argc, char **argv) {
                               get_conn_buffer_group(c - 1), true, true, NULL, 0);
         }
     }
+    /* with -S, each worker thread listens on sockets of its own instead */
+    if (l_sockets != NULL) {
+        dispatch_server_sockets(l_sockets, conn_listening, false, false);
+    }
+    if (b_sockets != NULL) {
+        dispatch_server_sockets(b_sockets, conn_listening, false, true);
+    }
+    if (u_sockets != NULL) {
+        dispatch_server_sockets(u_sockets, conn_read, true, false);
+    }
+    if (bu_sockets != NULL) {
+        dispatch_server_sockets(bu_sockets, conn_bp_header_size_unknown, true, true);
+    }
     /* enter the event loop */
     event_base_loop(main_base, 0);
     /* remove the PID file if we're a daemon */
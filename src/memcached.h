@@ -32,15 +32,26 @@
 /** High water marks for buffer shrinking */
 #define READ_BUFFER_HIGHWAT 8192
 #define WRITE_BUFFER_HIGHWAT 8192
-#define ITEM_LIST_HIGHWAT 400
 #define IOV_LIST_HIGHWAT 600
-#define MSG_LIST_HIGHWAT 100
 
 /** other useful constants. */
 #define BUFFER_ALIGNMENT (sizeof(uint32_t))
 #define KEY_MAX_LENGTH 255
 #define MAX_ITEM_SIZE  (1024 * 1024)
 #define UDP_HEADER_SIZE 8
+#define REQUEST_HEAD_SIZE (KEY_MAX_LENGTH + 64) /* the most a request line
+                                                 * or binary header with its
+                                                 * key takes, before the
+                                                 * value. */
+#define UDP_DATAGRAM_SLOT_SIZE (64 * 1024) /* room in the read buffer for each
+                                            * datagram of a batched receive;
+                                            * fits the largest there is. */
+#define UDP_REASSEMBLED_SIZE (REQUEST_HEAD_SIZE + MAX_ITEM_SIZE + 3)
+                                           /* room past the slots for a
+                                            * request put together from
+                                            * several datagrams: a set of the
+                                            * largest value, its \r\n, and a
+                                            * byte for the parser. */
 
 /* number of virtual buckets for a managed instance */
 #define MAX_BUCKETS 32768
@@ -67,6 +78,7 @@
 typedef struct stats_s       stats_t;
 typedef struct settings_s    settings_t;
 typedef struct conn_s        conn;
+typedef struct udp_batch_s   udp_batch_t;
 
 
 /**
@@ -81,6 +93,7 @@ typedef enum conn_states_e {
     conn_swallow,    /** swallowing unnecessary bytes w/o storing */
     conn_closing,    /** closing this connection */
     conn_mwrite,     /** writing out many items sequentially */
+    conn_tier_wait,  /** waiting for values to be read from the tier */
 
     conn_bp_header_size_unknown,        /** waiting for enough data to determine
                                             the size of the header. */
@@ -134,12 +147,53 @@ struct stats_s {
     uint64_t      arith_cmds;
     uint64_t      arith_hits;
     uint64_t      evictions;
+    uint64_t      expired_items;        /* items unlinked because they expired */
+    uint64_t      reaped_items;         /* ... of which were found by the reaper */
     uint64_t      bytes_read;
     uint64_t      bytes_written;
 
     uint64_t      get_bytes;
     uint64_t      byte_seconds;
 
+    uint64_t      compressed_items;     /* values stored compressed */
+    uint64_t      compress_skipped;     /* values that didn't compress well
+                                         * enough to keep compressed */
+    uint64_t      compress_bytes_in;    /* ... sizes of the compressed values */
+    uint64_t      compress_bytes_out;   /* ... before and after compression */
+    uint64_t      compress_ns;          /* thread cpu time spent compressing */
+    uint64_t      decompressed_items;
+    uint64_t      decompress_failures;
+    uint64_t      decompress_ns;        /* thread cpu time spent decompressing */
+    uint64_t      compressed_sent;      /* values sent to clients compressed */
+
+    uint64_t      udp_recv_calls;       /* batched receives that returned
+                                         * datagrams... */
+    uint64_t      udp_datagrams_received; /* ... and how many they did */
+    uint64_t      udp_send_calls;       /* batched sends of reply packets... */
+    uint64_t      udp_packets_sent;     /* ... and how many they sent */
+    uint64_t      tcp_send_calls;       /* writes of replies to tcp
+                                         * connections... */
+    uint64_t      tcp_replies_sent;     /* ... and how many replies they
+                                         * finished */
+    uint64_t      zerocopy_sends;       /* writes with MSG_ZEROCOPY... */
+    uint64_t      zerocopy_bytes;       /* ... the bytes they sent... */
+    uint64_t      zerocopy_copied;      /* ... and how many of them the kernel
+                                         * copied anyway */
+    uint64_t      zerocopy_fallbacks;   /* writes of large values that were
+                                         * copied instead */
+    uint64_t      zerocopy_pinned;      /* items held until the kernel is done
+                                         * sending them */
+    uint64_t      value_bytes_direct;   /* bytes of values read from the
+                                         * socket straight into their items,
+                                         * and... */
+    uint64_t      value_bytes_copied;   /* ... copied out of the read buffer */
+    uint64_t      idle_conns_closed;    /* tcp connections closed for being
+                                         * idle too long... */
+    uint64_t      idle_conns_slimmed;   /* ... or that let go of their
+                                         * buffers */
+    uint64_t      conn_memory_capped;   /* buffers that couldn't grow without
+                                         * a connection going over its cap */
+
 #define MEMORY_POOL(pool_enum, pool_counter, pool_string) uint64_t pool_counter;
 #include "memory_pool_classes.h"
 
@@ -162,6 +216,7 @@ struct stats_s {
 #define MAX_VERBOSITY_LEVEL 2
 struct settings_s {
     size_t maxbytes;
+    size_t item_size_max;   /* largest value that can be stored */
     int maxconns;
     int port;
     int udpport;
@@ -182,16 +237,76 @@ struct settings_s {
                                io-event. */
     size_t max_conn_buffer_bytes;       /* high-water mark for memory taken by
                                          * connection buffers. */
+    int lru_protected_pct;  /* share of each LRU held by the protected
+                               segment; 0 means a plain LRU. */
+    size_t admission_items; /* number of keys the admission filter is sized
+                               for; 0 means every item is admitted. */
+    bool size_aware_eviction; /* if true, pick eviction victims among the LRU
+                                 tail candidates by hits per byte. */
+    int slab_automove_interval; /* seconds between runs of the background slab
+                                   rebalancer; 0 means it doesn't run. */
+    char *slab_profile;     /* item size profile that the slab classes are
+                               planned from; NULL for a geometric table. */
+    size_t compress_threshold; /* values this large or larger are stored
+                                  compressed; 0 means never. */
+    char *tier_path;        /* log file that large evicted values are
+                               spilled to; NULL for none. */
+    size_t tier_size;       /* size of the tier log, in bytes. */
+    size_t tier_threshold;  /* smallest value that is spilled. */
+    int udp_batch_size;     /* datagrams read by each receive on a UDP
+                               socket, and reply packets sent by each send. */
+    size_t udp_reassembly_limit; /* memory for requests that span several
+                                    UDP packets; 0 means they're rejected. */
+    bool reuseport;         /* if true, each worker thread listens on ports of
+                               its own, bound with SO_REUSEPORT. */
+    bool edge_triggered;    /* if true, tcp connections are registered for
+                               reads and writes once, edge-triggered. */
+    bool uring;             /* if true, the socket i/o of tcp connections goes
+                               through a ring on each worker thread. */
+    int reply_batch_size;   /* replies to pipelined requests on a tcp
+                               connection that go out together, at most. */
+    size_t zerocopy_min;    /* values at least this big are sent with
+                               MSG_ZEROCOPY; 0 means none are. */
+    int busy_poll_usec;     /* worker threads look for events without
+                               waiting until none came for this long; 0
+                               means they always wait. */
+    int socket_busy_poll_usec; /* SO_BUSY_POLL of tcp connections; 0 leaves
+                                  it alone. */
+    int idle_timeout;       /* tcp connections idle for this many seconds are
+                               closed; 0 means never. */
+    int idle_slim_timeout;  /* ... and this many let go of their buffers; 0
+                               means never. */
+    size_t conn_memory_max; /* memory a tcp connection may hold; 0 means no
+                               limit. */
+    size_t direct_read_min; /* after a value at least this big, a tcp
+                               connection reads only the head of its next
+                               request into the read buffer; 0 means never. */
 };
 
+/*
+ * What a worker thread's tcp connections hold, as of its last sweep over
+ * them.  A connection is idle if it had no event since the sweep before.
+ */
+typedef struct {
+    unsigned int conns;
+    unsigned int idle_conns;
+    unsigned int slim_conns;            /* idle ones without their buffers */
+    uint64_t bytes;
+    uint64_t idle_bytes;
+} conn_sweep_t;
+
 
 /**
  * bring in other modules that we depend on for structure definitions.
  */
+#include "admission.h"
 #include "binary_protocol.h"
 #include "binary_sm.h"
+#include "conn_arena.h"
 #include "conn_buffer.h"
 #include "items.h"
+#include "uring.h"
+#include "zerocopy.h"
 
 
 /**
@@ -250,6 +365,10 @@ struct conn_s {
     int    msgused;   /* number of elements used in msglist[] */
     int    msgcurr;   /* element in msglist[] being transmitted now */
     int    msgbytes;  /* number of bytes in current msg */
+    int    held;      /* replies held back to go out with the response
+                       * being built... */
+    int    msgresp;   /* ... which starts in this element of msglist[]... */
+    int    iovresp;   /* ... at this element of iov[]. */
 
     item   **ilist;   /* list of items to write out */
     int    isize;
@@ -265,11 +384,40 @@ struct conn_s {
     socklen_t request_addr_size;
     unsigned char *hdrbuf; /* udp packet headers */
     int    hdrsize;   /* number of headers' worth of space is allocated */
+    udp_batch_t *udp_batch; /* datagrams received but not yet served */
+
+    /* the buffers the connection owns.  wbuf, ilist and msglist are these
+     * unless the request outgrew them, in which case they (and hdrbuf) are in
+     * the thread's scratch arena until the response has been sent. */
+    char   *own_wbuf;
+    item   **own_ilist;
+    struct msghdr *own_msglist;
+    conn_arena_t *arena; /* the arena, while the connection holds it */
+    bool   slim;      /* idle, and without any of those buffers */
+
+    /* the tcp connections of a worker thread are on a list of its own, which
+     * it sweeps for idle ones every second. */
+    conn   **conn_list; /* the head of the list, or NULL if not on one */
+    conn   *next_conn;
+    conn   *prev_conn;
+    bool   active;    /* had an event since the last sweep */
+    rel_time_t idle_since;
 
     bool   binary;    /* are we in binary mode */
     int    bucket;    /* bucket number for the next command, if running as
                          a managed instance. -1 (_not_ 0) means invalid. */
     int    gen;       /* generation requested for the bucket */
+    bool   accept_compressed; /* send compressed values as they are stored */
+    bool   direct_read; /* the last request had a large value */
+    int    tier_pending; /* reads from the tier the response waits for */
+    bool   tier_failed;  /* one of them failed */
+    conn_states_t tier_resume; /* the state to go on in once they are done */
+#if defined(USE_URING)
+    uring_conn_t uring;  /* the socket i/o, if it goes through a ring */
+#endif /* #if defined(USE_URING) */
+#if defined(USE_ZEROCOPY)
+    zerocopy_conn_t zerocopy; /* large values sent without a copy */
+#endif /* #if defined(USE_ZEROCOPY) */
 
     conn_buffer_group_t* cbg;
 
@@ -317,10 +465,19 @@ conn* conn_new(const int sfd, const int init_state, const int event_flags, conn_
 void conn_cleanup(conn* c);
 void conn_close(conn* c);
 void conn_shrink(conn* c);
+void* conn_scratch_grow(conn* c, void* ptr, const size_t old_size, const size_t new_size);
+char* conn_decompress(conn* c, item* it, size_t* len);
+size_t conn_memory(const conn* c);
+bool conn_memory_allows(conn* c, const size_t more);
+void conn_sweep(conn* c, conn_sweep_t* sweep);
 void accept_new_conns(const bool do_accept, const bool is_binary);
+void dispatch_accepted_conn(conn* listener, const int sfd, const int init_state,
+                            const struct sockaddr* addr, const socklen_t addrlen);
 bool update_event(conn* c, const int new_flags);
+void event_handler(const int fd, const short which, void *arg);
 int add_iov(conn* c, const void *buf, int len, bool is_start);
 int add_msghdr(conn* c);
+bool conn_hold_reply(conn* c, const bool next_buffered);
 rel_time_t realtime(const time_t exptime);
 int build_udp_headers(conn* c);
 size_t append_to_buffer(char* const buffer_start,
@@ -335,6 +492,7 @@ void set_current_time(void); /* update the global variable holding
 
 void update_stats(void);
 extern int try_read_network(conn *c);
+extern ssize_t conn_readv(conn* c, const struct iovec* iov, const int iovcnt);
 extern int try_read_udp(conn *c);
 extern int transmit(conn *c);
 
@@ -344,31 +502,56 @@ void dispatch_conn_new(int sfd, int init_state, int event_flags,
                        conn_buffer_group_t* cbg,
                        const bool is_udp, const bool is_binary,
                        const struct sockaddr* addr, socklen_t addrlen);
+conn* thread_listen_conn(const bool binary);
+conn_arena_t* thread_conn_arena(struct event_base* base);
+conn** thread_conn_list(struct event_base* base);
+uring_t* thread_uring(struct event_base* base);
+void thread_event_handled(void);
+#if defined(USE_SLAB_ALLOCATOR)
+struct tier_io_s;
+item* conn_tier_fetch(conn* c, item* stub, struct tier_io_s** io);
+void dispatch_tier_read(conn* c, struct tier_io_s* io);
+void conn_tier_done(conn* c, struct tier_io_s* io);
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
 
 /* Lock wrappers for cache functions that are called from main loop. */
 char *mt_add_delta(const char* key, const size_t nkey, const int incr, const unsigned int delta,
                    char *buf, uint32_t *res, const struct in_addr addr);
+void  mt_admission_record(const char* key, const size_t nkey);
+void  mt_admission_stats(admission_stats_t* out);
+size_t mt_append_arena_stats(char* const buf, const size_t size, const size_t offset, const size_t reserved);
+size_t mt_append_uring_stats(char* const buf, const size_t size, const size_t offset, const size_t reserved);
+size_t mt_append_poll_stats(char* const buf, const size_t size, const size_t offset, const size_t reserved);
+size_t mt_append_conn_stats(char* const buf, const size_t size, const size_t offset, const size_t reserved);
 size_t mt_append_thread_stats(char* const buf, const size_t size, const size_t offset, const size_t reserved);
 int   mt_assoc_expire_regex(char *pattern);
 void  mt_assoc_move_next_bucket(void);
 conn* mt_conn_from_freelist(void);
 bool  mt_conn_add_to_freelist(conn* c);
 int   mt_defer_delete(item *it, time_t exptime);
+int   mt_expiry_reap(void);
 int   mt_is_listen_thread(void);
 item *mt_item_alloc(char *key, size_t nkey, int flags, rel_time_t exptime, int nbytes, const struct in_addr addr);
 char *mt_item_cachedump(const unsigned int slabs_clsid, const unsigned int limit, unsigned int *bytes);
 void  mt_item_flush_expired(void);
+void  mt_item_lru_stats(lru_stats_t *lru_stats);
 item *mt_item_get_notedeleted(const char *key, const size_t nkey, bool *delete_locked);
 void  mt_item_deref(item *it);
 char *mt_item_stats(int *bytes);
 char *mt_item_stats_sizes(int *bytes);
+char *mt_item_slabs_plan(int *bytes);
+void  mt_item_tier_promote(item *stub, item *it);
 void  mt_item_unlink(item *it, long flags, const char* key);
 void  mt_item_update(item *it);
 void  mt_run_deferred_deletes(void);
 void *mt_slabs_alloc(size_t size);
 void  mt_slabs_free(void *ptr, size_t size);
+void *mt_slabs_chunk(unsigned int id, unsigned int pos);
+void  mt_slabs_model_hit(item *it);
+void  mt_slabs_model_miss(const char *key, const size_t nkey);
 int   mt_slabs_reassign(unsigned char srcid, unsigned char dstid);
 void  mt_slabs_rebalance();
+char *mt_slabs_rebalance_stats(int *buflen);
 char *mt_slabs_stats(int *buflen);
 void  mt_stats_lock(stats_t *stats);
 void  mt_global_stats_lock(void);
@@ -380,10 +563,20 @@ void  mt_stats_reset(void);
 stats_t *mt_stats_get_tls(void);
 void mt_stats_set_tls(int ix);
 void mt_stats_aggregate(stats_t *accum);
+size_t mt_append_udp_stats(char* const buf, const size_t size, const size_t offset, const size_t reserved);
+size_t mt_append_tcp_stats(char* const buf, const size_t size, const size_t offset, const size_t reserved);
 void mt_clock_handler(const int fd, const short which, void *arg);
 
 
 # define add_delta                   mt_add_delta
+# define admission_record            mt_admission_record
+# define admission_stats             mt_admission_stats
+# define append_arena_stats          mt_append_arena_stats
+# define append_uring_stats          mt_append_uring_stats
+# define append_poll_stats           mt_append_poll_stats
+# define append_conn_stats           mt_append_conn_stats
+# define append_udp_stats            mt_append_udp_stats
+# define append_tcp_stats            mt_append_tcp_stats
 # define append_thread_stats         mt_append_thread_stats
 # define assoc_expire_regex          mt_assoc_expire_regex
 # define assoc_move_next_bucket      mt_assoc_move_next_bucket
@@ -391,21 +584,29 @@ void mt_clock_handler(const int fd, const short which, void *arg);
 # define conn_from_freelist          mt_conn_from_freelist
 # define conn_add_to_freelist        mt_conn_add_to_freelist
 # define defer_delete                mt_defer_delete
+# define expiry_reap                 mt_expiry_reap
 # define is_listen_thread            mt_is_listen_thread
 # define item_alloc                  mt_item_alloc
 # define item_cachedump              mt_item_cachedump
 # define item_flush_expired          mt_item_flush_expired
+# define item_lru_stats              mt_item_lru_stats
 # define item_get_notedeleted        mt_item_get_notedeleted
 # define item_deref                  mt_item_deref
 # define item_stats                  mt_item_stats
 # define item_stats_sizes            mt_item_stats_sizes
+# define item_slabs_plan             mt_item_slabs_plan
+# define item_tier_promote           mt_item_tier_promote
 # define item_update                 mt_item_update
 # define item_unlink                 mt_item_unlink
 # define run_deferred_deletes        mt_run_deferred_deletes
 # define slabs_alloc                 mt_slabs_alloc
 # define slabs_free                  mt_slabs_free
+# define slabs_chunk                 mt_slabs_chunk
+# define slabs_model_hit             mt_slabs_model_hit
+# define slabs_model_miss            mt_slabs_model_miss
 # define slabs_reassign              mt_slabs_reassign
 # define slabs_rebalance             mt_slabs_rebalance
+# define slabs_rebalance_stats       mt_slabs_rebalance_stats
 # define slabs_stats                 mt_slabs_stats
 # define store_item                  mt_store_item
 # define stats_init                  mt_stats_init
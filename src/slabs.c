@@ -16,6 +16,7 @@
 #include <sys/socket.h>
 #include <sys/signal.h>
 #include <sys/resource.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <netinet/in.h>
 #include <errno.h>
@@ -25,12 +26,30 @@
 #include <assert.h>
 
 #include "memcached.h"
+#include "assoc.h"
 #include "items.h"
 
 #define POWER_SMALLEST 1
 #define POWER_LARGEST  200
-#define POWER_BLOCK 1048576
+#if defined(COMPACT_ITEMS)
+#define CHUNK_ALIGN_BYTES SLABS_ARENA_ALIGN
+#if defined(USE_SYSTEM_MALLOC)
+#error "Compact items need the slab arena; they can't use the system malloc."
+#endif /* #if defined(USE_SYSTEM_MALLOC) */
+#else
 #define CHUNK_ALIGN_BYTES (sizeof(void *))
+#endif /* #if defined(COMPACT_ITEMS) */
+#define SLABS_REASSIGN_CANDIDATES 16    /* max number of pages examined to find
+                                         * the one to give up in a reassign. */
+#define SLABS_MODEL_PAGES 4             /* number of pages either side of its
+                                         * current allocation for which the
+                                         * background rebalancer models a
+                                         * class's hits. */
+#define SLABS_GHOST_SZ (1 << 18)        /* number of entries in the table of
+                                         * recently evicted keys. */
+#define SLABS_PLAN_MAX_BINS 1024        /* size histograms with more bins than
+                                         * this are coarsened before a class
+                                         * table is planned from them. */
 //#define DONT_PREALLOC_SLABS
 
 /* powers-of-N allocation structures */
@@ -54,16 +73,50 @@ typedef struct {
     unsigned int total_hits;  /* total number of get hits for items in this slab class */
     unsigned int unique_hits; /* total number of get hits for unique items in this slab class */
     unsigned int evictions;   /* total number of evictions from this class */
+    uint64_t evicted_ages[ITEM_AGE_BUCKETS]; /* evictions by how long the
+                                               * item had gone unused */
+    uint64_t requested;       /* bytes asked for by the items in this class;
+                               * the rest of their chunks is wasted */
     unsigned int rebalanced_to;
     unsigned int rebalanced_from;
     unsigned int rebalance_wait;
+
+    /* the background rebalancer's model of the class.  these are guarded by
+     * the cache lock rather than the slabs lock, since they are updated on
+     * the get and eviction paths. */
+    uint32_t evict_seq;         /* number of evictions, ever */
+    rel_time_t eviction_age;    /* moving average of the age of evicted items */
+    uint64_t ghost_hits[SLABS_MODEL_PAGES]; /* ghost_hits[k]: misses that k+1
+                                             * more pages would have turned
+                                             * into hits */
+    uint64_t tail_hits[SLABS_MODEL_PAGES];  /* tail_hits[k]: hits that would
+                                             * have been lost with k+1 fewer
+                                             * pages */
+    unsigned int target_pages;  /* the number of pages the model wants */
 } slabclass_t;
 
+/* a recently evicted key, kept so that a miss on it can be charged to the
+ * class that evicted it. */
+typedef struct {
+    uint32_t hv;                /* hash of the key; 0 if the entry is empty */
+    uint32_t evict_seq;         /* the class's evict_seq at the eviction */
+    uint8_t  id;                /* the class that evicted it */
+} slabs_ghost_t;
+
 static slabclass_t slabclass[POWER_LARGEST + 1];
 static size_t mem_limit = 0;
+#if defined(COMPACT_ITEMS)
+char* slabs_arena = NULL;
+static size_t arena_size = 0;
+static size_t arena_used = 0;
+#endif /* #if defined(COMPACT_ITEMS) */
 static int power_largest;
 static int slab_rebalanced_count = 0;
 static int slab_rebalanced_reversed = 0;
+static uint64_t slab_rebalanced_moved = 0;
+static uint64_t slab_rebalanced_evicted = 0;
+static slabs_ghost_t *ghosts = NULL;
+static uint64_t slab_automoves = 0;
 
 /*
  * Forward Declarations
@@ -109,14 +162,250 @@ unsigned int slabs_chunksize(const unsigned int clsid) {
     return 0;
 }
 
+/*
+ * Plans a table of chunk sizes for a histogram of item sizes.  sizes[] must
+ * be ascending multiples of CHUNK_ALIGN_BYTES, and counts[] the number of
+ * items of each size.  Sizes over POWER_BLOCK / 2 are left out, as they only
+ * ever fit the largest class.  Up to nclasses chunk sizes are picked from
+ * sizes[], always including the largest one left, so as to minimize
+ * the memory lost to internal fragmentation, sum(count * (chunk - size)).
+ * This is done by dynamic programming over the bins; histograms with more
+ * than SLABS_PLAN_MAX_BINS bins are first coarsened by merging neighboring
+ * bins into the largest of them.
+ *
+ * Writes the chunk sizes to chunk_sizes[] in ascending order and returns how
+ * many there are, or 0 if memory ran out.
+ */
+int slabs_plan_classes(const unsigned int *sizes, const uint64_t *counts,
+                       int nbins, int nclasses, unsigned int *chunk_sizes) {
+    unsigned int *bin_size;
+    uint64_t *bin_count, *cum_count, *cum_bytes, *cost;
+    int *choice;
+    int i, j, k, b, n, group;
+
+    while (nbins > 0 && sizes[nbins - 1] > POWER_BLOCK / 2) {
+        nbins--;
+    }
+    if (nbins == 0 || nclasses <= 0) {
+        return 0;
+    }
+
+    /* coarsen the histogram. */
+    group = (nbins + SLABS_PLAN_MAX_BINS - 1) / SLABS_PLAN_MAX_BINS;
+    n = (nbins + group - 1) / group;
+    if (nclasses > n) {
+        nclasses = n;
+    }
+
+    bin_size = malloc(n * sizeof(unsigned int));
+    bin_count = malloc(n * sizeof(uint64_t));
+    cum_count = malloc((n + 1) * sizeof(uint64_t));
+    cum_bytes = malloc((n + 1) * sizeof(uint64_t));
+    cost = malloc((size_t) nclasses * n * sizeof(uint64_t));
+    choice = malloc((size_t) nclasses * n * sizeof(int));
+    if (bin_size == NULL || bin_count == NULL || cum_count == NULL ||
+        cum_bytes == NULL || cost == NULL || choice == NULL) {
+        n = 0;
+        goto done;
+    }
+
+    cum_count[0] = cum_bytes[0] = 0;
+    for (b = 0; b < n; b++) {
+        uint64_t bytes = 0;
+
+        bin_count[b] = 0;
+        for (i = b * group; i < (b + 1) * group && i < nbins; i++) {
+            bin_size[b] = sizes[i];
+            bin_count[b] += counts[i];
+            bytes += counts[i] * sizes[i];
+        }
+        cum_count[b + 1] = cum_count[b] + bin_count[b];
+        cum_bytes[b + 1] = cum_bytes[b] + bytes;
+    }
+
+    /* cost[k * n + i]: the least waste for bins 0..i using k + 1 chunk sizes,
+     * the largest of which is bin_size[i].  choice[] records the first bin
+     * that the largest chunk size covers. */
+#define WASTE(first, last) (bin_size[last] * (cum_count[(last) + 1] - cum_count[first]) - \
+                            (cum_bytes[(last) + 1] - cum_bytes[first]))
+    for (i = 0; i < n; i++) {
+        cost[i] = WASTE(0, i);
+        choice[i] = 0;
+    }
+    for (k = 1; k < nclasses; k++) {
+        for (i = 0; i < n; i++) {
+            uint64_t best = cost[(k - 1) * n + i];
+            int best_first = -1;
+
+            for (j = 1; j <= i; j++) {
+                uint64_t c = cost[(k - 1) * n + j - 1] + WASTE(j, i);
+                if (c < best) {
+                    best = c;
+                    best_first = j;
+                }
+            }
+            cost[k * n + i] = best;
+            choice[k * n + i] = best_first;
+        }
+    }
+#undef WASTE
+
+    /* walk back from the largest bin.  a choice of -1 means that the plan
+     * with one fewer chunk size was just as good. */
+    j = 0;
+    for (k = nclasses - 1, i = n - 1; i >= 0 && k >= 0; k--) {
+        if (choice[k * n + i] == -1) {
+            continue;
+        }
+        chunk_sizes[j++] = bin_size[i];
+        i = choice[k * n + i] - 1;
+    }
+    /* reverse into ascending order. */
+    for (i = 0; i < j / 2; i++) {
+        unsigned int t = chunk_sizes[i];
+        chunk_sizes[i] = chunk_sizes[j - 1 - i];
+        chunk_sizes[j - 1 - i] = t;
+    }
+    n = j;
+
+ done:
+    free(bin_size);
+    free(bin_count);
+    free(cum_count);
+    free(cum_bytes);
+    free(cost);
+    free(choice);
+    return n;
+}
+
+/*
+ * Returns the memory that items with the given size histogram would take up
+ * under a class table planned by slabs_plan_classes.
+ */
+uint64_t slabs_plan_bytes(const unsigned int *chunk_sizes, int nclasses,
+                          const unsigned int *sizes, const uint64_t *counts,
+                          int nbins) {
+    uint64_t total = 0;
+    int i, cls = 0;
+
+    for (i = 0; i < nbins; i++) {
+        while (cls < nclasses && chunk_sizes[cls] < sizes[i]) {
+            cls++;
+        }
+        total += (uint64_t) (cls < nclasses ? chunk_sizes[cls] : POWER_BLOCK) * counts[i];
+    }
+    return total;
+}
+
+static int slabs_compare_bins(const void *a, const void *b) {
+    const unsigned int *x = a, *y = b;
+    return (x[0] > y[0]) - (x[0] < y[0]);
+}
+
+/*
+ * Reads an item size profile, i.e., the output of "stats sizes": one
+ * "<size> <count>" line per size, optionally prefixed with "STAT".  Plans a
+ * class table for it with as many classes as the geometric table starting
+ * at first_size would need to cover the profile.  Exits if the profile can't
+ * be used.  Returns the number of chunk sizes written to chunk_sizes.
+ */
+static int slabs_profile_classes(const char *path, unsigned int first_size,
+                                 const double factor, unsigned int *chunk_sizes,
+                                 int max_classes) {
+    FILE *f = fopen(path, "r");
+    unsigned int (*bins)[2] = NULL;     /* {size, count} pairs */
+    unsigned int *sizes;
+    uint64_t *counts;
+    int nbins = 0, bins_total = 0, nclasses, n, i;
+    char line[256];
+    double size;
+
+    if (f == NULL) {
+        fprintf(stderr, "Can't open slab profile %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned int item_size, count;
+        char *start = line;
+
+        if (strncmp(start, "STAT ", 5) == 0) start += 5;
+        if (sscanf(start, "%u %u", &item_size, &count) != 2 || count == 0) continue;
+
+        /* round up to the alignment, and leave anything too large for all
+         * but the last class out of the plan. */
+        if (item_size % CHUNK_ALIGN_BYTES)
+            item_size += CHUNK_ALIGN_BYTES - (item_size % CHUNK_ALIGN_BYTES);
+        if (item_size == 0 || item_size > POWER_BLOCK / 2) continue;
+
+        if (nbins == bins_total) {
+            void *new_bins;
+            bins_total = (bins_total != 0) ? bins_total * 2 : 256;
+            new_bins = realloc(bins, bins_total * sizeof(*bins));
+            if (new_bins == NULL) {
+                fprintf(stderr, "Failed to allocate memory for the slab profile\n");
+                exit(EXIT_FAILURE);
+            }
+            bins = new_bins;
+        }
+        bins[nbins][0] = item_size;
+        bins[nbins][1] = count;
+        nbins++;
+    }
+    fclose(f);
+
+    if (nbins == 0) {
+        fprintf(stderr, "Slab profile %s has no item sizes\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    /* sort, and fold together sizes that rounded to the same value. */
+    qsort(bins, nbins, sizeof(*bins), slabs_compare_bins);
+    sizes = malloc(nbins * sizeof(unsigned int));
+    counts = malloc(nbins * sizeof(uint64_t));
+    if (sizes == NULL || counts == NULL) {
+        fprintf(stderr, "Failed to allocate memory for the slab profile\n");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0, n = 0; i < nbins; i++) {
+        if (n != 0 && sizes[n - 1] == bins[i][0]) {
+            counts[n - 1] += bins[i][1];
+        } else {
+            sizes[n] = bins[i][0];
+            counts[n] = bins[i][1];
+            n++;
+        }
+    }
+    free(bins);
+
+    /* as many classes as the geometric table would spend on these sizes. */
+    for (nclasses = 1, size = first_size;
+         size < sizes[n - 1] && nclasses < max_classes;
+         nclasses++, size *= factor)
+        ;
+
+    n = slabs_plan_classes(sizes, counts, n, nclasses, chunk_sizes);
+    free(sizes);
+    free(counts);
+    if (n == 0) {
+        fprintf(stderr, "Failed to plan slab classes from %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    return n;
+}
+
 /**
  * Determines the chunk sizes and initializes the slab class descriptors
- * accordingly.
+ * accordingly.  The sizes grow geometrically by factor, unless a size profile
+ * was given, in which case the sizes that the profile needs are planned to fit
+ * it and the geometric series only takes over above them.
  */
 void slabs_init(const size_t limit, const double factor) {
     stats_t *stats = STATS_GET_TLS();
     int i = POWER_SMALLEST - 1;
     unsigned int size = stritem_length + settings.chunk_size;
+    unsigned int planned[POWER_LARGEST];
+    int nplanned = 0;
 
     /* Factor of 2.0 means use the default memcached behavior */
     if (factor == 2.0 && size < 128)
@@ -125,6 +414,29 @@ void slabs_init(const size_t limit, const double factor) {
     mem_limit = limit;
     memset(slabclass, 0, sizeof(slabclass));
 
+#if defined(COMPACT_ITEMS)
+    /* the first page of each class is allowed over the limit.  the mapping
+     * only reserves address space; pages are backed as they are touched. */
+    if (limit > SLABS_ARENA_MAX - POWER_LARGEST * POWER_BLOCK) {
+        fprintf(stderr, "Compact items can address at most %lu MB of memory\n",
+                (unsigned long) ((SLABS_ARENA_MAX - POWER_LARGEST * POWER_BLOCK) / (1024 * 1024)));
+        exit(1);
+    }
+    arena_size = (limit == 0) ? SLABS_ARENA_MAX : limit + POWER_LARGEST * POWER_BLOCK;
+    slabs_arena = mmap(NULL, arena_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+    if (slabs_arena == MAP_FAILED) {
+        fprintf(stderr, "Failed to map the slab arena\n");
+        exit(1);
+    }
+#endif /* #if defined(COMPACT_ITEMS) */
+
+    if (settings.slab_profile != NULL) {
+        nplanned = slabs_profile_classes(settings.slab_profile, size, factor,
+                                         planned, POWER_LARGEST - 1);
+        size = planned[0];
+    }
+
     while (++i < POWER_LARGEST && size <= POWER_BLOCK / 2) {
         /* Make sure items are always n-byte aligned */
         if (size % CHUNK_ALIGN_BYTES)
@@ -132,7 +444,10 @@ void slabs_init(const size_t limit, const double factor) {
 
         slabclass[i].size = size;
         slabclass[i].perslab = POWER_BLOCK / slabclass[i].size;
-        size *= factor;
+        if (i + 1 - POWER_SMALLEST < nplanned)
+            size = planned[i + 1 - POWER_SMALLEST];
+        else
+            size *= factor;
         if (settings.verbose > 1) {
             fprintf(stderr, "slab class %3d: chunk size %6u perslab %5u\n",
                     i, slabclass[i].size, slabclass[i].perslab);
@@ -154,6 +469,14 @@ void slabs_init(const size_t limit, const double factor) {
 
     }
 
+    if (settings.slab_automove_interval != 0) {
+        ghosts = calloc(SLABS_GHOST_SZ, sizeof(slabs_ghost_t));
+        if (ghosts == NULL) {
+            fprintf(stderr, "Failed to allocate the slab rebalancer's ghost table\n");
+            exit(1);
+        }
+    }
+
 #ifndef DONT_PREALLOC_SLABS
     {
         char *pre_alloc = getenv("T_MEMD_SLABS_ALLOC");
@@ -210,8 +533,14 @@ static int do_slabs_newslab(const unsigned int id) {
 
     if (grow_slab_list(id) == 0) return 0;
 
+#if defined(COMPACT_ITEMS)
+    if (arena_used + len > arena_size) return 0;
+    ptr = slabs_arena + arena_used;
+    arena_used += len;
+#else
     ptr = malloc((size_t)len);
     if (ptr == 0) return 0;
+#endif /* #if defined(COMPACT_ITEMS) */
 
     memset(ptr, 0, (size_t)len);
     p->end_page_ptr = ptr;
@@ -257,6 +586,8 @@ void *do_slabs_alloc(const size_t size) {
     if (! (p->end_page_ptr != 0 || p->sl_curr != 0 || do_slabs_newslab(id) != 0))
         return 0;
 
+    p->requested += size;
+
     /* return off our freelist, if we have one */
     if (p->sl_curr != 0)
         return p->slots[--p->sl_curr];
@@ -298,6 +629,7 @@ void do_slabs_free(void *ptr, const size_t size) {
     (void)stats;
 #endif
 
+    p->requested -= size;
     if (p->sl_curr == p->sl_total) { /* need more space on the free list */
         int new_size = (p->sl_total != 0) ? p->sl_total * 2 : 16;  /* 16 is arbitrary */
         void **new_slots = realloc(p->slots, new_size * sizeof(void *));
@@ -314,7 +646,8 @@ void do_slabs_free(void *ptr, const size_t size) {
 char* do_slabs_stats(int *buflen) {
     stats_t stats;
     int i, total;
-    size_t bufsize = power_largest * 1024 + 100, offset = 0;
+    uint64_t total_requested = 0, total_wasted = 0;
+    size_t bufsize = power_largest * 2048 + 200, offset = 0;
     char *buf = (char *)malloc(bufsize);
     char terminator[] = "END\r\n";
 
@@ -326,13 +659,15 @@ char* do_slabs_stats(int *buflen) {
     for(i = POWER_SMALLEST; i <= power_largest; i++) {
         slabclass_t *p = &slabclass[i];
         if (p->slabs != 0) {
-            unsigned int perslab, slabs, used_chunks;
+            unsigned int perslab, slabs, used_chunks, b;
+            uint64_t wasted;
 
             slabs = p->slabs;
             perslab = p->perslab;
             used_chunks = slabs*perslab - p->sl_curr;
             double uhit = (double)p->unique_hits / slabs;
             double miss = (double)p->evictions * perslab;
+            wasted = (uint64_t) (used_chunks - p->end_page_free) * p->size - p->requested;
 
             offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT %d:chunk_size %u\r\n", i, p->size);
             offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT %d:chunks_per_page %u\r\n", i, perslab);
@@ -350,26 +685,93 @@ char* do_slabs_stats(int *buflen) {
             offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT %d:rebalanced_to %u\r\n", i, p->rebalanced_to);
             offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT %d:rebalanced_from %u\r\n", i, p->rebalanced_from);
             offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT %d:rebalance_wait %u\r\n", i, p->rebalance_wait);
+            offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT %d:requested_bytes %" PRINTF_INT64_MODIFIER "u\r\n", i, p->requested);
+            offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT %d:wasted_bytes %" PRINTF_INT64_MODIFIER "u\r\n", i, wasted);
+            offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT %d:tail_age %u\r\n", i, do_item_tail_age(i));
+            for (b = 0; b < ITEM_AGE_BUCKETS; b++) {
+                if (p->evicted_ages[b] != 0) {
+                    offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT %d:evicted_age_%u %" PRINTF_INT64_MODIFIER "u\r\n",
+                                              i, item_age_bucket_start(b), p->evicted_ages[b]);
+                }
+            }
+            total_requested += p->requested;
+            total_wasted += wasted;
             total++;
         }
     }
     offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT active_slabs %d\r\nSTAT total_malloced %llu\r\nSTAT total_rebalanced %d\r\nSTAT total_rebalance_reversed %d\r\n", total, (unsigned long long)stats.item_storage_allocated, slab_rebalanced_count, slab_rebalanced_reversed);
+    offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT total_rebalance_moved %" PRINTF_INT64_MODIFIER "u\r\nSTAT total_rebalance_evicted %" PRINTF_INT64_MODIFIER "u\r\n", slab_rebalanced_moved, slab_rebalanced_evicted);
+    offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT total_requested_bytes %" PRINTF_INT64_MODIFIER "u\r\nSTAT total_wasted_bytes %" PRINTF_INT64_MODIFIER "u\r\n", total_requested, total_wasted);
+    offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT item_header_bytes %d\r\n", (int) stritem_length);
     offset = append_to_buffer(buf, bufsize, offset, 0, terminator);
     *buflen = (int) offset;
     return buf;
 }
 
-/* Blows away all the items in a slab class and moves its slabs to another
-   class. This is only used by the "slabs reassign" command, for manual tweaking
-   of memory allocation.
+/*
+ * Picks the page of a slab class that is cheapest to give up: the one holding
+ * the fewest live items, breaking ties in favor of the page whose items were
+ * used least recently.  Pages holding an item that is in use are passed over.
+ * At most SLABS_REASSIGN_CANDIDATES pages are examined, starting where the last
+ * search left off, so that the cost of a search doesn't grow with the class.
+ * Returns the page's index in slab_list, or -1 if every page examined is busy.
+ */
+static int slabs_pick_victim_page(const unsigned int id) {
+    static unsigned int next_candidate[POWER_LARGEST + 1];
+    slabclass_t *p = &slabclass[id];
+    int victim = -1;
+    unsigned int victim_live = 0;
+    uint64_t victim_recency = 0;
+    unsigned int i;
+
+    for (i = 0; i < p->slabs && i < SLABS_REASSIGN_CANDIDATES; i++) {
+        unsigned int page = (next_candidate[id] + i) % p->slabs;
+        char *iter = p->slab_list[page];
+        char *slab_end = iter + POWER_BLOCK - p->size;
+        unsigned int live = 0;
+        uint64_t recency = 0;
+
+        for (; iter <= slab_end; iter += p->size) {
+            item *it = (item *)iter;
+
+            if (it->slabs_clsid == 0) continue;
+            if (it->refcount) break;
+            if (it->exptime == 0 || it->exptime > current_time) {
+                live++;
+                recency += it->time;
+            }
+        }
+        if (iter <= slab_end) {
+            continue;                   /* busy */
+        }
+
+        if (victim == -1 || live < victim_live ||
+            (live == victim_live && recency < victim_recency)) {
+            victim = page;
+            victim_live = live;
+            victim_recency = recency;
+        }
+    }
+
+    if (p->slabs != 0) {
+        next_candidate[id] = (next_candidate[id] + i) % p->slabs;
+    }
+    return victim;
+}
+
+/* Moves a page from one slab class to another.  The page given up is the one
+   slabs_pick_victim_page() picks.  Its live items are moved into free chunks
+   elsewhere in the class; only when the class runs out of free chunks are the
+   rest evicted.  This is used by the "slabs reassign" command, for manual
+   tweaking of memory allocation, and by the automatic rebalancer.
    1 = success
    0 = fail
    -1 = tried. busy. send again shortly. */
 int do_slabs_reassign(unsigned char srcid, unsigned char dstid) {
-    void *slab, *slab_end;
+    char *slab, *slab_end;
     slabclass_t *p, *dp;
-    void *iter;
-    int fi;
+    char *iter;
+    int fi, page;
 
     if (srcid < POWER_SMALLEST || srcid > power_largest ||
         dstid < POWER_SMALLEST || dstid > power_largest ||
@@ -387,37 +789,47 @@ int do_slabs_reassign(unsigned char srcid, unsigned char dstid) {
     if (dp->end_page_ptr || ! grow_slab_list(dstid))
         return 0;
 
-    slab = p->slab_list[0];
-    slab_end = (char*)slab + POWER_BLOCK - p->size; // inclusive!
+    page = slabs_pick_victim_page(srcid);
+    if (page < 0) {
+        /* every page has an item that is in the middle of something */
+        p->rebalance_wait = 20;
+        return -1;
+    }
+
+    slab = p->slab_list[page];
+    slab_end = slab + POWER_BLOCK - p->size; // inclusive!
 
-    /* if there are any items that are in the middle of something, abort */
-    for (iter = slab; iter <= slab_end; iter += p->size) {
-        item *it = (item *)iter;
-        if (it->slabs_clsid && it->refcount) {
-            /* we have picked a busy slab, maybe our decision wasn't right */
-            p->rebalance_wait = 20;
-            return -1;
+    /* go through free list and discard items that were part of this slab, so
+       that nothing is moved within it */
+    for (fi = p->sl_curr - 1; fi >= 0; fi--) {
+        if ((char *)p->slots[fi] >= slab && (char *)p->slots[fi] <= slab_end) {
+            p->sl_curr--;
+            if (p->sl_curr > fi) p->slots[fi] = p->slots[p->sl_curr];
         }
     }
 
-    /* now that all items are owned by me, i can unlink them at will */
+    /* now that all items are owned by me, i can move them at will */
     for (iter = slab; iter <= slab_end; iter += p->size) {
         item *it = (item *)iter;
-        if (it->slabs_clsid) {
-            do_item_unlink_impl(it, UNLINK_IS_EVICT, false);
-        }
-    }
 
-    /* go through free list and discard items that were part of this slab */
-    for (fi = p->sl_curr - 1; fi >= 0; fi--) {
-        if (p->slots[fi] >= slab && p->slots[fi] <= slab_end) {
-            p->sl_curr--;
-            if (p->sl_curr > fi) p->slots[fi] = p->slots[p->sl_curr];
+        if (it->slabs_clsid == 0) continue;
+        if (it->exptime != 0 && it->exptime <= current_time) {
+            p->requested -= ITEM_ntotal(it);
+            do_item_unlink_impl(it, UNLINK_IS_EXPIRED, false);
+        } else if (p->sl_curr != 0) {
+            item *dst = p->slots[--p->sl_curr];
+
+            do_item_relocate(it, dst);
+            slab_rebalanced_moved++;
+        } else {
+            p->requested -= ITEM_ntotal(it);
+            do_item_unlink_impl(it, UNLINK_IS_EVICT, false);
+            slab_rebalanced_evicted++;
         }
     }
 
     /* if good, now move it to the dst slab class */
-    for (fi = 0; fi < p->slabs - 1; fi++) {
+    for (fi = page; fi < p->slabs - 1; fi++) {
         p->slab_list[fi] = p->slab_list[fi + 1];
     }
     p->slabs--;
@@ -432,14 +844,265 @@ int do_slabs_reassign(unsigned char srcid, unsigned char dstid) {
     return 1;
 }
 
+/*
+ * Returns chunk number pos of a slab class, counting across its pages in the
+ * order they were allocated, or NULL if the class has no such chunk.  Chunks
+ * that were never handed out are zeroed, so callers can tell items apart from
+ * unused chunks by their slabs_clsid.
+ */
+void *do_slabs_chunk(const unsigned int id, const unsigned int pos) {
+    slabclass_t *p;
+    unsigned int page;
+
+    if (id < POWER_SMALLEST || id > power_largest)
+        return NULL;
+
+    p = &slabclass[id];
+    page = pos / p->perslab;
+    if (page >= p->slabs)
+        return NULL;
+    return (char *)p->slab_list[page] + (pos % p->perslab) * p->size;
+}
+
 void slabs_add_hit(void *it, int unique) {
     slabclass_t *p = &slabclass[((item *)it)->slabs_clsid];
     p->total_hits++;
     if (unique) p->unique_hits++;
 }
 
-void slabs_add_eviction(unsigned int clsid) {
-    slabclass[clsid].evictions++;
+void slabs_add_eviction(void *it) {
+    slabclass_t *p = &slabclass[((item *)it)->slabs_clsid];
+    p->evictions++;
+    p->evicted_ages[item_age_bucket(current_time - ((item *)it)->time)]++;
+}
+
+/*
+ * The background rebalancer.
+ *
+ * For each class, the rebalancer estimates how many hits the class would
+ * gain with up to SLABS_MODEL_PAGES more pages and lose with up to
+ * SLABS_MODEL_PAGES fewer, i.e., the class's miss-ratio curve around its
+ * current allocation.
+ *
+ * The gains come from ghost entries: when an item is evicted, its key hash is
+ * remembered along with the class's eviction count.  A later miss on that key
+ * would have been a hit with one more page for every perslab items the class
+ * has evicted since.
+ *
+ * The losses come from the ages of the items that are hit.  Taking the age of
+ * the items the class evicts as the age at the tail of its LRU, an item hit at
+ * age a sits about (eviction_age - a) / eviction_age * pages pages from the
+ * tail, and would have been lost with that many fewer pages.
+ *
+ * From these, do_slabs_automove() works out a target number of pages for each
+ * class, greedily moving pages from the class that loses the fewest hits to
+ * the class that gains the most for as long as that pays off, and then moves
+ * at most one page toward the targets.  The counters decay by half every time
+ * the targets are recomputed, so the model follows the workload instead of
+ * being reset by it.
+ */
+
+/* called when it is evicted.  the cache lock must be held. */
+void do_slabs_model_eviction(const void *ptr) {
+    const item *it = ptr;
+    slabclass_t *p = &slabclass[it->slabs_clsid];
+    rel_time_t age = current_time - it->time;
+    slabs_ghost_t *ghost;
+    uint32_t hv;
+
+    p->evict_seq++;
+    p->eviction_age = (p->eviction_age == 0) ? age : (p->eviction_age * 7 + age) / 8;
+
+    if (ghosts == NULL) {
+        return;
+    }
+    hv = hash(ITEM_key_const(it), it->nkey, 0);
+    ghost = &ghosts[hv & (SLABS_GHOST_SZ - 1)];
+    ghost->hv = (hv != 0) ? hv : 1;
+    ghost->evict_seq = p->evict_seq;
+    ghost->id = it->slabs_clsid;
+}
+
+/* called when it is hit, before its access time is updated.  the cache lock
+ * must be held. */
+void do_slabs_model_hit(const void *ptr) {
+    const item *it = ptr;
+    slabclass_t *p = &slabclass[it->slabs_clsid];
+    rel_time_t age = current_time - it->time;
+    unsigned int pages_from_tail;
+
+    if (p->evict_seq == 0) {
+        return;                 /* nothing has been evicted; no tail to model */
+    }
+    if (age >= p->eviction_age) {
+        pages_from_tail = 0;
+    } else {
+        pages_from_tail = (uint64_t) (p->eviction_age - age) * p->slabs / p->eviction_age;
+    }
+    if (pages_from_tail < SLABS_MODEL_PAGES) {
+        p->tail_hits[pages_from_tail]++;
+    }
+}
+
+/* called on a get miss.  the cache lock must be held. */
+void do_slabs_model_miss(const char *key, const size_t nkey) {
+    slabs_ghost_t *ghost;
+    slabclass_t *p;
+    uint32_t hv, pages;
+
+    if (ghosts == NULL) {
+        return;
+    }
+    hv = hash(key, nkey, 0);
+    ghost = &ghosts[hv & (SLABS_GHOST_SZ - 1)];
+    if (ghost->hv != ((hv != 0) ? hv : 1)) {
+        return;
+    }
+
+    p = &slabclass[ghost->id];
+    pages = (p->evict_seq - ghost->evict_seq) / p->perslab;
+    if (pages < SLABS_MODEL_PAGES) {
+        p->ghost_hits[pages]++;
+    }
+    ghost->hv = 0;
+}
+
+/* returns the number of hits the class earns from the page that takes it from
+ * p->slabs + delta pages to p->slabs + delta + 1 pages. */
+static uint64_t slabs_model_page_value(const slabclass_t *p, int delta) {
+    if (delta >= SLABS_MODEL_PAGES || delta < -SLABS_MODEL_PAGES) {
+        return 0;
+    }
+    return (delta >= 0) ? p->ghost_hits[delta] : p->tail_hits[-delta - 1];
+}
+
+/* a class can give up a page, or take part in a move, once it has stopped
+ * growing on its own. */
+static bool slabs_model_eligible(const slabclass_t *p) {
+    return p->slabs != 0 && p->end_page_ptr == 0;
+}
+
+/* recomputes every class's target_pages. */
+static void slabs_model_targets(void) {
+    int delta[POWER_LARGEST + 1];
+    int i, moves;
+
+    memset(delta, 0, sizeof(delta));
+
+    for (moves = 0; moves < SLABS_MODEL_PAGES * (power_largest - POWER_SMALLEST + 1); moves++) {
+        int to = 0, from = 0;
+        uint64_t gain = 0, loss = 0;
+
+        for (i = POWER_SMALLEST; i <= power_largest; i++) {
+            slabclass_t *p = &slabclass[i];
+            uint64_t value;
+
+            if (p->slabs == 0) continue;
+
+            value = slabs_model_page_value(p, delta[i]);
+            if (delta[i] < SLABS_MODEL_PAGES && (to == 0 || value > gain)) {
+                to = i;
+                gain = value;
+            }
+        }
+        for (i = POWER_SMALLEST; i <= power_largest; i++) {
+            slabclass_t *p = &slabclass[i];
+            uint64_t value;
+
+            if (i == to || ! slabs_model_eligible(p) ||
+                (int) p->slabs + delta[i] <= 1 || delta[i] <= -SLABS_MODEL_PAGES) {
+                continue;
+            }
+
+            value = slabs_model_page_value(p, delta[i] - 1);
+            if (from == 0 || value < loss) {
+                from = i;
+                loss = value;
+            }
+        }
+
+        /* demand a clear win so that noise doesn't shuffle pages around. */
+        if (to == 0 || from == 0 || gain <= loss + loss / 8) {
+            break;
+        }
+        delta[to]++;
+        delta[from]--;
+    }
+
+    for (i = POWER_SMALLEST; i <= power_largest; i++) {
+        slabclass_t *p = &slabclass[i];
+        int k;
+
+        p->target_pages = p->slabs + delta[i];
+        for (k = 0; k < SLABS_MODEL_PAGES; k++) {
+            p->ghost_hits[k] /= 2;
+            p->tail_hits[k] /= 2;
+        }
+    }
+}
+
+/*
+ * recomputes the targets and moves at most one page from the class furthest
+ * above its target to the class furthest below.  both the cache lock and the
+ * slabs lock must be held.
+ */
+void do_slabs_automove(void) {
+    int i, from = 0, to = 0;
+    int surplus = 0, deficit = 0;
+
+    slabs_model_targets();
+
+    for (i = POWER_SMALLEST; i <= power_largest; i++) {
+        slabclass_t *p = &slabclass[i];
+        int diff = (int) p->slabs - (int) p->target_pages;
+
+        if (! slabs_model_eligible(p)) continue;
+        if (diff > surplus) {
+            from = i;
+            surplus = diff;
+        } else if (-diff > deficit) {
+            to = i;
+            deficit = -diff;
+        }
+    }
+
+    if (from != 0 && to != 0 && do_slabs_reassign(from, to) == 1) {
+        slab_automoves++;
+    }
+}
+
+/*@null@*/
+char* do_slabs_rebalance_stats(int *buflen) {
+    int i;
+    size_t bufsize = power_largest * 512 + 100, offset = 0;
+    char *buf = (char *)malloc(bufsize);
+    char terminator[] = "END\r\n";
+
+    *buflen = 0;
+    if (buf == NULL) return NULL;
+
+    for (i = POWER_SMALLEST; i <= power_largest; i++) {
+        slabclass_t *p = &slabclass[i];
+        uint64_t ghost_hits = 0, tail_hits = 0;
+        int k;
+
+        if (p->slabs == 0 && p->target_pages == 0) continue;
+
+        for (k = 0; k < SLABS_MODEL_PAGES; k++) {
+            ghost_hits += p->ghost_hits[k];
+            tail_hits += p->tail_hits[k];
+        }
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT %d:pages %u\r\n", i, p->slabs);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT %d:target_pages %u\r\n", i, p->target_pages);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT %d:eviction_age %u\r\n", i, p->eviction_age);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT %d:ghost_hits %" PRINTF_INT64_MODIFIER "u\r\n", i, ghost_hits);
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT %d:tail_hits %" PRINTF_INT64_MODIFIER "u\r\n", i, tail_hits);
+    }
+    offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT automove_interval %d\r\n", settings.slab_automove_interval);
+    offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT automoves %" PRINTF_INT64_MODIFIER "u\r\n", slab_automoves);
+    offset = append_to_buffer(buf, bufsize, offset, 0, terminator);
+    *buflen = (int) offset;
+    return buf;
 }
 
 /**
@@ -5,6 +5,18 @@
 
 /* slabs memory allocation */
 
+/* the size of a slab page, and of the largest chunk.  items that don't fit a
+   chunk this size are chained across several of them. */
+#define POWER_BLOCK 1048576
+
+#if defined(COMPACT_ITEMS)
+/* with compact items, every slab page is carved out of a single mapping, the
+   slab arena, so that an item can be addressed by a 32-bit offset into it. */
+#define SLABS_ARENA_ALIGN   8           /* items are addressed in these units. */
+#define SLABS_ARENA_MAX     ((size_t) UINT32_MAX * SLABS_ARENA_ALIGN)
+extern char* slabs_arena;
+#endif /* #if defined(COMPACT_ITEMS) */
+
 /** Init the subsystem. 1st argument is the limit on no. of bytes to allocate,
     0 if no limit. 2nd argument is the growth factor; each slab will use a chunk
     size equal to the previous slab's chunk size times this factor. */
@@ -19,6 +31,18 @@ void slabs_init(const size_t limit, const double factor);
 unsigned int slabs_clsid(const size_t size);
 unsigned int slabs_chunksize(const unsigned int clsid);
 
+/* Plan up to nclasses chunk sizes that minimize the memory lost to internal
+   fragmentation for a histogram of item sizes; returns how many were planned,
+   in ascending order.  sizes[] must be ascending and 8-byte aligned. */
+int slabs_plan_classes(const unsigned int *sizes, const uint64_t *counts,
+                       int nbins, int nclasses, unsigned int *chunk_sizes);
+
+/* Memory that items with the given size histogram would take up under a
+   planned class table. */
+uint64_t slabs_plan_bytes(const unsigned int *chunk_sizes, int nclasses,
+                          const unsigned int *sizes, const uint64_t *counts,
+                          int nbins);
+
 /** Allocate object of given length. 0 on error */ /*@null@*/
 void *do_slabs_alloc(const size_t size);
 
@@ -34,8 +58,23 @@ char* do_slabs_stats(int *buflen);
    -1 = tried. busy. send again shortly. */
 int do_slabs_reassign(unsigned char srcid, unsigned char dstid);
 
+/* Return chunk number pos of a slab class, or NULL if there is none. */ /*@null@*/
+void *do_slabs_chunk(const unsigned int id, const unsigned int pos);
+
 void slabs_add_hit(void *it, int unique);
-void slabs_add_eviction(unsigned int clsid);
+void slabs_add_eviction(void *it);
+
+/* Feed the background rebalancer's model.  All of these need the cache lock. */
+void do_slabs_model_eviction(const void *it);
+void do_slabs_model_hit(const void *it);
+void do_slabs_model_miss(const char *key, const size_t nkey);
+
+/* Recompute the background rebalancer's targets and move at most one page
+   toward them.  Needs both the cache lock and the slabs lock. */
+void do_slabs_automove(void);
+
+/* Fill buffer with the background rebalancer's targets */ /*@null@*/
+char* do_slabs_rebalance_stats(int *buflen);
 
 /* Find the worst performed slab class to free one slab from it and
 assign it to the best performed slab class. */
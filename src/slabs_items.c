@@ -19,21 +19,48 @@
 #define __need_ITEM_data
 
 #include "memcached.h"
+#include "admission.h"
 #include "assoc.h"
+#include "expiry.h"
 #include "slabs.h"
 #include "stats.h"
 #include "conn_buffer.h"
 #include "slabs_items_support.h"
+#include "tier.h"
 
 /* Forward Declarations */
 static void item_link_q(item *it);
 static void item_unlink_q(item *it);
 static void item_free(item *it, bool to_freelist);
+static void item_free_chained(item *chunk, bool to_freelist);
+static item *item_find_victim(const unsigned int id);
 
 #define LARGEST_ID 255
+static unsigned int sizes[LARGEST_ID];
+static lru_stats_t lru_stats;
+
+#if defined(USE_CLOCK_EVICTION)
+/* CLOCK eviction.  there are no LRU lists; a hit sets ITEM_REFERENCED, and
+ * when a class needs room, its clock hand sweeps over the chunks in the
+ * class's pages.  a referenced item loses its bit and is passed over, and the
+ * first unreferenced item the hand reaches is evicted.  clock_hands[id] is the
+ * chunk number the hand will examine next. */
+#define CLOCK_SEARCH_DEPTH 1024
+static unsigned int clock_hands[LARGEST_ID];
+#else
+#define LRU_SEARCH_DEPTH 50     /* number of items we'll check from the tail of
+                                 * an LRU to find an item to evict. */
 static item *heads[LARGEST_ID];
 static item *tails[LARGEST_ID];
-static unsigned int sizes[LARGEST_ID];
+
+/* segmented LRU.  each class's LRU is split into a protected segment at the
+ * head and a probationary segment at the tail.  probation_heads[id] is the
+ * first probationary item (NULL if the segment is empty).  new items enter at
+ * the head of the probationary segment and move to the protected segment when
+ * they are hit. */
+static item *probation_heads[LARGEST_ID];
+static unsigned int protected_sizes[LARGEST_ID];
+#endif /* #if defined(USE_CLOCK_EVICTION) */
 static time_t last_slab_rebalance = 0;
 static int slab_rebalance_interval = 0; /* off */
 
@@ -52,10 +79,17 @@ int slabs_get_rebalance_interval() {
 void item_init(void) {
     int i;
     for(i = 0; i < LARGEST_ID; i++) {
+        sizes[i] = 0;
+#if defined(USE_CLOCK_EVICTION)
+        clock_hands[i] = 0;
+#else
         heads[i] = NULL;
         tails[i] = NULL;
-        sizes[i] = 0;
+        probation_heads[i] = NULL;
+        protected_sizes[i] = 0;
+#endif /* #if defined(USE_CLOCK_EVICTION) */
     }
+    memset(&lru_stats, 0, sizeof(lru_stats));
 }
 
 /* Enable this for reference-count debugging. */
@@ -73,13 +107,54 @@ void item_init(void) {
 
 void item_memcpy_to(item* it, size_t offset, const void* src, size_t nbytes,
                     bool beyond_item_boundary) {
-    memcpy(ITEM_data(it) + offset, src, nbytes);
+    size_t seg, seg_start, len;
+    char* ptr;
+
+    if (ITEM_chain_length(it) == 0) {
+        memcpy(ITEM_data(it) + offset, src, nbytes);
+        return;
+    }
+
+    /* copy into the part of each segment that the range covers. */
+    assert(offset + nbytes <= it->nbytes);
+    for (seg = 0, seg_start = 0; nbytes != 0; seg++, seg_start += len) {
+        ptr = ITEM_segment(it, seg, &len);
+        if (offset < seg_start + len) {
+            size_t skip = offset - seg_start;
+            size_t bytes = (nbytes < len - skip) ? nbytes : len - skip;
+
+            memcpy(ptr + skip, src, bytes);
+            src = (const char*) src + bytes;
+            offset += bytes;
+            nbytes -= bytes;
+        }
+    }
 }
 
 
 void item_memcpy_from(void* dst, const item* it, size_t offset, size_t nbytes,
                       bool beyond_item_boundary) {
-    memcpy(dst, ITEM_data(it) + offset, nbytes);
+    size_t seg, seg_start, len;
+    char* ptr;
+
+    if (ITEM_chain_length(it) == 0) {
+        memcpy(dst, ITEM_data(it) + offset, nbytes);
+        return;
+    }
+
+    assert(offset + nbytes <= it->nbytes);
+    for (seg = 0, seg_start = 0; nbytes != 0; seg++, seg_start += len) {
+        ptr = ITEM_segment(it, seg, &len);
+        if (offset < seg_start + len) {
+            size_t skip = offset - seg_start;
+            size_t bytes = (nbytes < len - skip) ? nbytes : len - skip;
+
+            memcpy(dst, ptr + skip, bytes);
+            dst = (char*) dst + bytes;
+            offset += bytes;
+            nbytes -= bytes;
+        }
+    }
 }
 
 
@@ -99,6 +174,12 @@ void do_try_item_stamp(item* it, const rel_time_t now, const struct in_addr addr
     /* assume we can't stamp anything */
     it->it_flags &= ~(ITEM_HAS_TIMESTAMP | ITEM_HAS_IP_ADDRESS);
 
+    /* a chained value fills its last chunk up to wherever it ends, so there's
+     * no telling where the slack is. */
+    if (ITEM_chain_length(it) != 0) {
+        return;
+    }
+
     /* then actually try to do the stamp */
     slackspace = slabs_chunksize(it->slabs_clsid) - ITEM_ntotal(it);
     assert(slackspace >= 0);
@@ -124,31 +205,59 @@ void do_try_item_stamp(item* it, const rel_time_t now, const struct in_addr addr
 }
 
 
-/*@null@*/
-item *do_item_alloc(const char *key, const size_t nkey, const int flags, const rel_time_t exptime,
-                    const size_t nbytes, const struct in_addr addr) {
+/*
+ * true if the value of an item about to be evicted should go to the extension
+ * tier, with a stub left in its place.
+ */
+static bool item_spillable(const item *it) {
+    return settings.tier_path != NULL &&
+        it->nbytes >= settings.tier_threshold &&
+        (it->it_flags & (ITEM_COMPRESSED | ITEM_TIERED | ITEM_DELETED)) == 0 &&
+        slabs_clsid(stritem_length + it->nkey + sizeof(tier_ptr_t)) != it->slabs_clsid;
+}
+
+/* unlinks a live item to make room for key. */
+static void item_evict(item *it, const char *key) {
     stats_t *stats = STATS_GET_TLS();
-    item *it;
-    size_t ntotal = stritem_length + nkey + nbytes;
-    rel_time_t now = current_time;
 
-    unsigned int id = slabs_clsid(ntotal);
+    STATS_LOCK(stats);
+    stats->evictions++;
+    STATS_UNLOCK(stats);
 
-    if (id == 0)
-        return 0;
+    slabs_add_eviction(it);
+    do_slabs_model_eviction(it);
+#if !defined(USE_CLOCK_EVICTION)
+    if (it->it_flags & ITEM_PROTECTED) {
+        lru_stats.protected_evictions++;
+    } else {
+        lru_stats.probation_evictions++;
+    }
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
+    do_item_unlink(it, UNLINK_IS_EVICT, key);
+}
 
-    it = slabs_alloc(ntotal);
+/*
+ * gets ntotal bytes from slab class id, evicting an item from the class if
+ * it is full.  returns NULL if that didn't free up a chunk, or if spill isn't
+ * NULL and the victim's value should go to the tier first: the victim is then
+ * held and handed back in *spill instead.
+ */
+static void *item_alloc_chunk(const char *key, const size_t nkey, const size_t ntotal,
+                              const unsigned int id, item **spill) {
+    rel_time_t now = current_time;
+    void *ptr;
+
+    ptr = slabs_alloc(ntotal);
 
     /* try to steal one slab from low-hit class */
-    if (it == 0 && slab_rebalance_interval &&
+    if (ptr == 0 && slab_rebalance_interval &&
         (now - last_slab_rebalance) > slab_rebalance_interval) {
         slabs_rebalance();
         last_slab_rebalance = now;
-        it = slabs_alloc(ntotal); /* there is a slim chance this retry would work */
+        ptr = slabs_alloc(ntotal); /* there is a slim chance this retry would work */
     }
 
-    if (it == 0) {
-        int tries = 50;
+    if (ptr == 0) {
         item *search;
 
         /* If requested to not push old items out of cache when memory runs out,
@@ -157,42 +266,78 @@ item *do_item_alloc(const char *key, const size_t nkey, const int flags, const r
 
         if (settings.evict_to_free == 0) return NULL;
 
-        /*
-         * try to get one off the right LRU
-         * don't necessariuly unlink the tail because it may be locked: refcount>0
-         * search up from tail an item with refcount==0 and unlink it; give up after 50
-         * tries
-         */
-
         if (id > LARGEST_ID) return NULL;
-        if (tails[id] == 0) return NULL;
-
-        for (search = tails[id]; tries > 0 && search != NULL; tries--, search=search->prev) {
-            if (search->refcount == 0) {
-                if (search->exptime == 0 || search->exptime > now) {
-                    STATS_LOCK(stats);
-                    stats->evictions++;
-                    STATS_UNLOCK(stats);
-
-                    slabs_add_eviction(id);
-                    do_item_unlink(search, UNLINK_IS_EVICT, key);
-                } else {
-                    do_item_unlink(search, UNLINK_IS_EXPIRED, key);
+
+        search = item_find_victim(id);
+        if (search != NULL) {
+            if (search->exptime == 0 || search->exptime > now) {
+                if (! do_admission_admit(key, nkey, ITEM_key(search), search->nkey)) {
+                    /* the victim is fetched more often than the new item.
+                     * send it around again so that the next store faces a
+                     * different victim. */
+#if !defined(USE_CLOCK_EVICTION)
+                    item_unlink_q(search);
+                    item_link_q(search);
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
+                    return NULL;
                 }
-                break;
+
+                if (spill != NULL && item_spillable(search)) {
+                    /* the reference keeps anything else from evicting or
+                     * moving it while its value is copied out. */
+                    search->refcount++;
+                    DEBUG_REFCNT(search, '+');
+                    *spill = search;
+                    return NULL;
+                }
+                item_evict(search, key);
+            } else {
+                do_item_unlink(search, UNLINK_IS_EXPIRED, key);
             }
         }
-        it = slabs_alloc(ntotal);
-        if (it == 0) return NULL;
+        ptr = slabs_alloc(ntotal);
     }
 
+    return ptr;
+}
+
+/*@null@*/
+item *do_item_alloc(const char *key, const size_t nkey, const int flags, const rel_time_t exptime,
+                    const size_t nbytes, const struct in_addr addr) {
+    return do_item_alloc_spill(key, nkey, flags, exptime, nbytes, addr, NULL);
+}
+
+/*@null@*/
+item *do_item_alloc_spill(const char *key, const size_t nkey, const int flags,
+                          const rel_time_t exptime, const size_t nbytes,
+                          const struct in_addr addr, item **spill) {
+    item *it;
+    size_t nchained = ITEM_chain_length_for(nkey, nbytes);
+    size_t ntotal = (nchained != 0) ? POWER_BLOCK : stritem_length + nkey + nbytes;
+    rel_time_t now = current_time;
+    size_t i;
+
+    unsigned int id = slabs_clsid(ntotal);
+
+    if (spill != NULL)
+        *spill = NULL;
+
+    if (id == 0 || nbytes > settings.item_size_max)
+        return 0;
+
+    it = item_alloc_chunk(key, nkey, ntotal, id, spill);
+    if (it == 0) return NULL;
+
     assert(it->slabs_clsid == 0);
 
     it->slabs_clsid = id;
 
+#if !defined(USE_CLOCK_EVICTION)
     assert(it != heads[it->slabs_clsid]);
 
-    it->next = it->prev = it->h_next = 0;
+    it->next = it->prev = 0;
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
+    it->h_next = 0;
     it->refcount = 1;     /* the caller will have a reference */
     DEBUG_REFCNT(it, '*');
     it->it_flags = 0;
@@ -202,18 +347,66 @@ item *do_item_alloc(const char *key, const size_t nkey, const int flags, const r
     it->exptime = exptime;
     it->flags = flags;
 
+    /* the rest of a value too large for one chunk goes in chunks of the same
+     * class.  they hold a reference so that nothing mistakes them for items
+     * that can be evicted or moved. */
+    for (i = 0; i < nchained; i++) {
+        item *chunk = item_alloc_chunk(key, nkey, POWER_BLOCK, id, spill);
+
+        if (chunk == NULL) {
+            /* give back what we have so far. */
+            while (i > 0) {
+                item_free_chained(ITEM_chain(it)[--i], true);
+            }
+            it->refcount = 0;
+            it->slabs_clsid = 0;
+            it->it_flags |= ITEM_SLABBED;
+            slabs_free(it, ntotal);
+            return NULL;
+        }
+        assert(chunk->slabs_clsid == 0);
+        memset(chunk, 0, stritem_length);
+        chunk->slabs_clsid = id;
+        chunk->refcount = 1;
+        chunk->time = now;
+        ITEM_chain(it)[i] = chunk;
+    }
+
     do_try_item_stamp(it, now, addr);
 
     return it;
 }
 
+/* returns a chunk holding part of a chained value to the slab allocator.  if
+ * to_freelist is false, the caller holds the slabs lock. */
+static void item_free_chained(item *chunk, bool to_freelist) {
+    assert(chunk->refcount == 1 && (chunk->it_flags & ITEM_LINKED) == 0);
+    chunk->refcount = 0;
+    chunk->slabs_clsid = 0;
+    chunk->it_flags |= ITEM_SLABBED;
+    if (to_freelist) {
+        slabs_free(chunk, POWER_BLOCK);
+    } else {
+        do_slabs_free(chunk, POWER_BLOCK);
+    }
+}
+
 static void item_free(item *it, bool to_freelist) {
     size_t ntotal = ITEM_ntotal(it);
+    size_t i, nchained = ITEM_chain_length(it);
     assert((it->it_flags & ITEM_LINKED) == 0);
+#if !defined(USE_CLOCK_EVICTION)
     assert(it != heads[it->slabs_clsid]);
     assert(it != tails[it->slabs_clsid]);
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
     assert(it->refcount == 0);
 
+    /* the chunks of a chained value are never on a page being reclaimed, so
+     * they always go back to the allocator. */
+    for (i = 0; i < nchained; i++) {
+        item_free_chained(ITEM_chain(it)[i], to_freelist);
+    }
+
     /* so slab size changer can tell later if item is already free or not */
     it->slabs_clsid = 0;
     it->it_flags |= ITEM_SLABBED;
@@ -236,31 +429,167 @@ static unsigned int item_slabs_clsid(const size_t nkey, const int flags,
  * the maximum for a cache entry.)
  */
 bool item_size_ok(const size_t nkey, const int flags, const int nbytes) {
-    return (item_slabs_clsid(nkey, flags, nbytes) != 0);
+    if (nbytes > settings.item_size_max) {
+        return false;
+    }
+    return (ITEM_chain_length_for(nkey + 1, nbytes) != 0 ||
+            item_slabs_clsid(nkey, flags, nbytes) != 0);
 }
 
 
 bool item_need_realloc(const item* it,
                        const size_t new_nkey, const int new_flags, const size_t new_nbytes) {
-    return (it->slabs_clsid != item_slabs_clsid(new_nkey, new_flags, new_nbytes));
+    return (ITEM_chain_length(it) != 0 ||
+            ITEM_chain_length_for(new_nkey, new_nbytes) != 0 ||
+            it->slabs_clsid != item_slabs_clsid(new_nkey, new_flags, new_nbytes));
 }
 
 
-static void item_link_q(item *it) { /* item is the new head */
-    item **head, **tail;
+#if defined(USE_CLOCK_EVICTION)
+/* true if a chunk holds an item that is in the cache. */
+static inline bool item_is_cached(const item *it) {
+    return it->slabs_clsid != 0 && (it->it_flags & ITEM_LINKED) != 0;
+}
+
+/*
+ * advances a class's clock hand until it reaches an unreferenced item nobody
+ * holds a reference to, clearing the reference bits it passes over.  gives up
+ * after CLOCK_SEARCH_DEPTH chunks and settles for the first referenced item
+ * it spared.
+ */
+static item *item_find_victim(const unsigned int id) {
+    item *fallback = NULL;
+    item *it;
+    int tries;
+
+    if (sizes[id] == 0) return NULL;
+
+    for (tries = 0; tries < CLOCK_SEARCH_DEPTH; tries++) {
+        it = slabs_chunk(id, clock_hands[id]);
+        if (it == NULL) {
+            /* ran off the last page; wrap around to the first. */
+            if (clock_hands[id] == 0) break;
+            clock_hands[id] = 0;
+            continue;
+        }
+        clock_hands[id]++;
+        lru_stats.clock_steps++;
+
+        if (! item_is_cached(it) || it->refcount != 0) continue;
+        if (it->it_flags & ITEM_REFERENCED) {
+            it->it_flags &= ~ITEM_REFERENCED;
+            lru_stats.clock_second_chances++;
+            if (fallback == NULL) fallback = it;
+            continue;
+        }
+        return it;
+    }
+    return fallback;
+}
+
+static void item_link_q(item *it) {
+    assert((it->it_flags & ITEM_SLABBED) == 0);
+    sizes[it->slabs_clsid]++;
+}
+
+static void item_unlink_q(item *it) {
+    sizes[it->slabs_clsid]--;
+}
+#else
+/*
+ * returns the item to evict from a class.  don't necessarily take the tail
+ * because it may be locked: refcount>0.  search up from the tail for an item
+ * with refcount==0; give up after LRU_SEARCH_DEPTH tries.
+ *
+ * with size-aware eviction, every unlocked item within LRU_SEARCH_DEPTH of the
+ * tail is a candidate, and the one that earns the fewest hits per byte loses.
+ * expired items cost nothing to drop and go first.  the candidates are all of
+ * the one class, whose sizes differ by no more than the growth factor, so
+ * this mostly comes down to which size bucket gets the fewest hits.
+ */
+static item *item_find_victim(const unsigned int id) {
+    int tries = LRU_SEARCH_DEPTH;
+    item *search, *oldest = NULL, *victim = NULL;
+    double victim_priority = 0;
+
+    for (search = tails[id]; tries > 0 && search != NULL; tries--, search = ITEM_prev(search)) {
+        double priority;
+
+        if (search->refcount != 0) {
+            continue;
+        }
+        if (! settings.size_aware_eviction) {
+            return search;
+        }
+
+        if (search->exptime != 0 && search->exptime <= current_time) {
+            priority = 0;
+        } else {
+            priority = stats_size_priority(search->nkey + search->nbytes);
+        }
+        if (oldest == NULL) {
+            oldest = victim = search;
+            victim_priority = priority;
+        } else if (priority < victim_priority) {
+            victim = search;
+            victim_priority = priority;
+        }
+    }
+
+    if (victim != oldest) {
+        lru_stats.size_aware_picks++;
+    }
+    return victim;
+}
+
+/* moves protected items to the probationary segment until the protected
+ * segment is within its share of the LRU. */
+static void item_demote_protected(const unsigned int id) {
+    while (protected_sizes[id] * 100 > sizes[id] * settings.lru_protected_pct) {
+        item *it = probation_heads[id] ? ITEM_prev(probation_heads[id]) : tails[id];
+
+        assert(it != NULL && (it->it_flags & ITEM_PROTECTED) != 0);
+        it->it_flags &= ~ITEM_PROTECTED;
+        protected_sizes[id]--;
+        probation_heads[id] = it;
+        lru_stats.demotions++;
+    }
+}
+
+static void item_link_q(item *it) { /* item is the new head of its segment */
+    item **head, **tail, **probation_head;
     /* always true, warns: assert(it->slabs_clsid <= LARGEST_ID); */
     assert((it->it_flags & ITEM_SLABBED) == 0);
 
     head = &heads[it->slabs_clsid];
     tail = &tails[it->slabs_clsid];
+    probation_head = &probation_heads[it->slabs_clsid];
     assert(it != *head);
     assert((*head && *tail) || (*head == 0 && *tail == 0));
-    it->prev = 0;
-    it->next = *head;
-    if (it->next) it->next->prev = it;
-    *head = it;
-    if (*tail == 0) *tail = it;
+
+    if (it->it_flags & ITEM_PROTECTED) {
+        ITEM_set_prev(it, NULL);
+        ITEM_set_next(it, *head);
+        if (ITEM_next(it)) ITEM_set_prev(ITEM_next(it), it);
+        *head = it;
+        if (*tail == 0) *tail = it;
+        protected_sizes[it->slabs_clsid]++;
+    } else {
+        /* insert in front of the probationary segment, which is the very head
+         * of the LRU if nothing is protected. */
+        ITEM_set_next(it, *probation_head);
+        ITEM_set_prev(it, *probation_head ? ITEM_prev(*probation_head) : *tail);
+        if (ITEM_next(it)) ITEM_set_prev(ITEM_next(it), it);
+        else *tail = it;
+        if (ITEM_prev(it)) ITEM_set_next(ITEM_prev(it), it);
+        else *head = it;
+        *probation_head = it;
+    }
     sizes[it->slabs_clsid]++;
+
+    if (it->it_flags & ITEM_PROTECTED) {
+        item_demote_protected(it->slabs_clsid);
+    }
     return;
 }
 
@@ -270,32 +599,41 @@ static void item_unlink_q(item *it) {
     head = &heads[it->slabs_clsid];
     tail = &tails[it->slabs_clsid];
 
+    if (probation_heads[it->slabs_clsid] == it) {
+        probation_heads[it->slabs_clsid] = ITEM_next(it);
+    }
+    if (it->it_flags & ITEM_PROTECTED) {
+        protected_sizes[it->slabs_clsid]--;
+    }
+
     if (*head == it) {
-        assert(it->prev == 0);
-        *head = it->next;
+        assert(ITEM_prev(it) == NULL);
+        *head = ITEM_next(it);
     }
     if (*tail == it) {
-        assert(it->next == 0);
-        *tail = it->prev;
+        assert(ITEM_next(it) == NULL);
+        *tail = ITEM_prev(it);
     }
-    assert(it->next != it);
-    assert(it->prev != it);
+    assert(ITEM_next(it) != it);
+    assert(ITEM_prev(it) != it);
 
-    if (it->next) it->next->prev = it->prev;
-    if (it->prev) it->prev->next = it->next;
+    if (ITEM_next(it)) ITEM_set_prev(ITEM_next(it), ITEM_prev(it));
+    if (ITEM_prev(it)) ITEM_set_next(ITEM_prev(it), ITEM_next(it));
     sizes[it->slabs_clsid]--;
     return;
 }
+#endif /* #if defined(USE_CLOCK_EVICTION) */
 
 int do_item_link(item *it, const char* key) {
     stats_t *stats = STATS_GET_TLS();
 
     assert((it->it_flags & (ITEM_LINKED|ITEM_SLABBED)) == 0);
-    assert(it->nbytes < (1024 * 1024));  /* 1MB max size */
+    assert(it->nbytes <= settings.item_size_max);
     it->it_flags |= ITEM_LINKED;
     it->it_flags &= ~ITEM_VISITED;
     it->time = current_time;
     assoc_insert(it, key);
+    expiry_index_add(it);
 
     STATS_LOCK(stats);
     stats->item_total_size += it->nkey + it->nbytes; /* cr-lf shouldn't count */
@@ -328,8 +666,12 @@ void do_item_unlink_impl(item *it, long flags, bool to_freelist) {
             stats_evict(it->nkey + it->nbytes);
         } else if (flags & UNLINK_IS_EXPIRED) {
             stats_expire(it->nkey + it->nbytes);
+            STATS_LOCK(stats);
+            stats->expired_items++;
+            STATS_UNLOCK(stats);
         }
         assoc_delete(ITEM_key(it), it->nkey);
+        expiry_index_remove(it);
         item_unlink_q(it);
         if (it->refcount == 0) {
             item_free(it, to_freelist);
@@ -337,6 +679,81 @@ void do_item_unlink_impl(item *it, long flags, bool to_freelist) {
     }
 }
 
+void item_tier_ptr(const item *stub, tier_ptr_t *ptr) {
+    assert((stub->it_flags & ITEM_TIERED) != 0);
+    item_memcpy_from(ptr, stub, 0, sizeof(*ptr), false);
+}
+
+/*
+ * puts a value read back from the tier in place of its stub, unless the key
+ * has been stored or deleted since.
+ */
+void do_item_tier_promote(item *stub, item *it) {
+    if ((stub->it_flags & (ITEM_LINKED | ITEM_DELETED)) == ITEM_LINKED) {
+        do_item_replace(stub, it, ITEM_key(stub));
+        tier_count_promotion();
+    }
+}
+
+/*
+ * evicts a victim handed back by do_item_alloc_spill(..) for key, now that its
+ * value has been copied to the tier at ptr, or couldn't be if ptr is NULL.  a
+ * stub takes its place, unless the key has been stored or deleted since.
+ * drops the reference the victim was held with.
+ */
+void do_item_spilled(item *it, const tier_ptr_t *ptr, const char *key) {
+    struct in_addr no_addr = { 0 };
+    item *stub = NULL;
+
+    if ((it->it_flags & ITEM_LINKED) != 0) {
+        if (ptr != NULL && (it->it_flags & ITEM_DELETED) == 0 &&
+            (stub = do_item_alloc(ITEM_key(it), it->nkey, it->flags, it->exptime,
+                                  sizeof(*ptr), no_addr)) != NULL) {
+            item_memcpy_to(stub, 0, ptr, sizeof(*ptr), false);
+            stub->it_flags |= ITEM_TIERED;
+        }
+        item_evict(it, key);
+        if (stub != NULL) {
+            do_item_link(stub, ITEM_key(stub));
+            do_item_deref(stub);
+        }
+    }
+    do_item_deref(it);
+}
+
+/*
+ * moves a linked item with refcount == 0 into dst, an unused chunk of the same
+ * slab class, and points the hash table, the LRU and the expiration index at
+ * the copy.  the caller reclaims the old chunk.
+ */
+void do_item_relocate(item *it, item *dst) {
+    assert((it->it_flags & (ITEM_LINKED | ITEM_SLABBED)) == ITEM_LINKED);
+    assert(it->refcount == 0);
+
+    memcpy(dst, it, slabs_chunksize(it->slabs_clsid));
+
+#if !defined(USE_CLOCK_EVICTION)
+    if (ITEM_prev(dst)) {
+        ITEM_set_next(ITEM_prev(dst), dst);
+    } else {
+        assert(heads[dst->slabs_clsid] == it);
+        heads[dst->slabs_clsid] = dst;
+    }
+    if (ITEM_next(dst)) {
+        ITEM_set_prev(ITEM_next(dst), dst);
+    } else {
+        assert(tails[dst->slabs_clsid] == it);
+        tails[dst->slabs_clsid] = dst;
+    }
+    if (probation_heads[dst->slabs_clsid] == it) {
+        probation_heads[dst->slabs_clsid] = dst;
+    }
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
+
+    assoc_update(it, dst);
+    expiry_index_relocate(it, dst);
+}
+
 void do_item_deref(item *it) {
     assert((it->it_flags & ITEM_SLABBED) == 0);
     if (it->refcount != 0) {
@@ -350,6 +767,31 @@ void do_item_deref(item *it) {
 }
 
 void do_item_update(item *it) {
+#if defined(USE_CLOCK_EVICTION)
+    /* no relinking; the hit only has to be visible to the clock hand. */
+    if ((it->it_flags & ITEM_REFERENCED) == 0) {
+        it->it_flags |= ITEM_REFERENCED;
+    }
+    if (it->time < current_time - ITEM_UPDATE_INTERVAL) {
+        assert((it->it_flags & ITEM_SLABBED) == 0);
+        it->time = current_time;
+    }
+#else
+    if (settings.lru_protected_pct != 0 &&
+        (it->it_flags & (ITEM_LINKED | ITEM_PROTECTED)) == ITEM_LINKED) {
+        /* second hit; promote to the protected segment right away. */
+        lru_stats.probation_hits++;
+        lru_stats.promotions++;
+        item_unlink_q(it);
+        it->it_flags |= ITEM_PROTECTED;
+        it->time = current_time;
+        item_link_q(it);
+        return;
+    }
+    if (it->it_flags & ITEM_PROTECTED) {
+        lru_stats.protected_hits++;
+    }
+
     if (it->time < current_time - ITEM_UPDATE_INTERVAL) {
         assert((it->it_flags & ITEM_SLABBED) == 0);
 
@@ -359,12 +801,24 @@ void do_item_update(item *it) {
             item_link_q(it);
         }
     }
+#endif /* #if defined(USE_CLOCK_EVICTION) */
 }
 
 int do_item_replace(item *it, item *new_it, const char* key) {
     assert((it->it_flags & ITEM_SLABBED) == 0);
 
     do_item_unlink(it, UNLINK_NORMAL, key);
+#if defined(USE_CLOCK_EVICTION)
+    /* an overwrite keeps the key's reference bit. */
+    if (it->it_flags & ITEM_REFERENCED) {
+        new_it->it_flags |= ITEM_REFERENCED;
+    }
+#else
+    /* an overwrite keeps the key's place in the protected segment. */
+    if (it->it_flags & ITEM_PROTECTED) {
+        new_it->it_flags |= ITEM_PROTECTED;
+    }
+#endif /* #if defined(USE_CLOCK_EVICTION) */
     return do_item_link(new_it, key);
 }
 
@@ -378,9 +832,17 @@ char *do_item_cachedump(const unsigned int slabs_clsid, const unsigned int limit
     unsigned int shown = 0;
     char temp[512];
     char key_tmp[KEY_MAX_LENGTH + 1 /* for null terminator */];
+#if defined(USE_CLOCK_EVICTION)
+    unsigned int pos = 0;
+#endif /* #if defined(USE_CLOCK_EVICTION) */
 
     if (slabs_clsid > LARGEST_ID) return NULL;
+#if defined(USE_CLOCK_EVICTION)
+    /* without LRU lists, dump the items in memory order. */
+    while ((it = slabs_chunk(slabs_clsid, pos++)) != NULL && ! item_is_cached(it)) ;
+#else
     it = heads[slabs_clsid];
+#endif /* #if defined(USE_CLOCK_EVICTION) */
 
     buffer = malloc((size_t)memlimit);
     if (buffer == 0) return NULL;
@@ -395,7 +857,11 @@ char *do_item_cachedump(const unsigned int slabs_clsid, const unsigned int limit
         strcpy(buffer + bufcurr, temp);
         bufcurr += len;
         shown++;
-        it = it->next;
+#if defined(USE_CLOCK_EVICTION)
+        while ((it = slabs_chunk(slabs_clsid, pos++)) != NULL && ! item_is_cached(it)) ;
+#else
+        it = ITEM_next(it);
+#endif /* #if defined(USE_CLOCK_EVICTION) */
     }
 
     memcpy(buffer + bufcurr, "END\r\n", 6);
@@ -418,9 +884,25 @@ char *do_item_stats(int *bytes) {
     }
 
     for (i = 0; i < LARGEST_ID; i++) {
+#if defined(USE_CLOCK_EVICTION)
+        if (sizes[i] != 0) {
+            /* there's no tail to read the age off; find the oldest item. */
+            rel_time_t oldest = now;
+            unsigned int pos;
+            item *it;
+
+            for (pos = 0; (it = slabs_chunk(i, pos)) != NULL; pos++) {
+                if (item_is_cached(it) && it->time < oldest) {
+                    oldest = it->time;
+                }
+            }
+            linelen = snprintf(bufcurr, bufleft, "STAT items:%d:number %u\r\nSTAT items:%d:age %u\r\n",
+                               i, sizes[i], i, now - oldest);
+#else
         if (tails[i] != NULL) {
             linelen = snprintf(bufcurr, bufleft, "STAT items:%d:number %u\r\nSTAT items:%d:age %u\r\n",
                                i, sizes[i], i, now - tails[i]->time);
+#endif /* #if defined(USE_CLOCK_EVICTION) */
             if (linelen + sizeof("END\r\n") < bufleft) {
                 bufcurr += linelen;
                 bufleft -= linelen;
@@ -438,6 +920,43 @@ char *do_item_stats(int *bytes) {
     return buffer;
 }
 
+void do_item_lru_stats(lru_stats_t *out) {
+    *out = lru_stats;
+#if !defined(USE_CLOCK_EVICTION)
+    int i;
+
+    for (i = 0; i < LARGEST_ID; i++) {
+        out->protected_items += protected_sizes[i];
+        out->probation_items += sizes[i] - protected_sizes[i];
+    }
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
+}
+
+/*
+ * Returns how long the least recently used item of a class has gone unused.
+ * With CLOCK eviction there is no LRU tail, so this finds the oldest item the
+ * long way.  Needs both the cache lock and the slabs lock.
+ */
+rel_time_t do_item_tail_age(const unsigned int clsid) {
+#if defined(USE_CLOCK_EVICTION)
+    rel_time_t oldest = 0;
+    unsigned int pos;
+    item *iter;
+
+    for (pos = 0; (iter = do_slabs_chunk(clsid, pos)) != NULL; pos++) {
+        if (item_is_cached(iter) && current_time - iter->time > oldest) {
+            oldest = current_time - iter->time;
+        }
+    }
+    return oldest;
+#else
+    if (clsid > LARGEST_ID || tails[clsid] == NULL) {
+        return 0;
+    }
+    return current_time - tails[clsid]->time;
+#endif /* #if defined(USE_CLOCK_EVICTION) */
+}
+
 /** dumps out a list of objects of each size, with granularity of 32 bytes */
 /*@null@*/
 char* do_item_stats_sizes(int *bytes) {
@@ -457,14 +976,29 @@ char* do_item_stats_sizes(int *bytes) {
     /* build the histogram */
     memset(histogram, 0, (size_t)num_buckets * sizeof(int));
     for (i = 0; i < LARGEST_ID; i++) {
+#if defined(USE_CLOCK_EVICTION)
+        unsigned int pos;
+        item *iter;
+
+        for (pos = 0; (iter = slabs_chunk(i, pos)) != NULL; pos++) {
+            int ntotal, bucket;
+
+            if (! item_is_cached(iter)) continue;
+            ntotal = ITEM_ntotal(iter);
+            bucket = ntotal / 32;
+            if ((ntotal % 32) != 0) bucket++;
+            if (bucket < num_buckets) histogram[bucket]++;
+        }
+#else
         item *iter = heads[i];
         while (iter) {
             int ntotal = ITEM_ntotal(iter);
             int bucket = ntotal / 32;
             if ((ntotal % 32) != 0) bucket++;
             if (bucket < num_buckets) histogram[bucket]++;
-            iter = iter->next;
+            iter = ITEM_next(iter);
         }
+#endif /* #if defined(USE_CLOCK_EVICTION) */
     }
 
     /* write the buffer */
@@ -480,6 +1014,106 @@ char* do_item_stats_sizes(int *bytes) {
     return buf;
 }
 
+/*
+ * Compares the memory lost to internal fragmentation by the resident items
+ * under the current slab classes with what a class table planned from their
+ * sizes would lose, and lists the planned table.  The plan is the one that a
+ * restart with the output of "stats sizes" as the -z profile would use below
+ * the largest resident item.
+ */
+/*@null@*/
+char* do_item_slabs_plan(int *bytes) {
+    const int bin_bytes = 8;
+    const int num_bins = (1024 * 1024) / bin_bytes + 1;    /* max 1MB object */
+    uint64_t *histogram = calloc(num_bins, sizeof(uint64_t));
+    unsigned int *sizes = malloc(num_bins * sizeof(unsigned int));
+    uint64_t *counts = malloc(num_bins * sizeof(uint64_t));
+    unsigned int planned[LARGEST_ID];
+    size_t bufsize = 256 + 32 * LARGEST_ID, offset = 0;
+    char *buf;
+    char terminator[] = "END\r\n";
+    uint64_t items = 0, requested = 0, actual = 0, projected = 0;
+    int i, nbins = 0, nplanned = 0;
+
+    if (settings.slab_profile != NULL) {
+        bufsize += strlen(settings.slab_profile);
+    }
+    buf = malloc(bufsize);
+    if (histogram == NULL || sizes == NULL || counts == NULL || buf == NULL) {
+        free(histogram);
+        free(sizes);
+        free(counts);
+        free(buf);
+        return NULL;
+    }
+
+    /* build the histogram */
+    for (i = 0; i < LARGEST_ID; i++) {
+        unsigned int chunk_size = slabs_chunksize(i);
+#if defined(USE_CLOCK_EVICTION)
+        unsigned int pos;
+        item *iter;
+
+        for (pos = 0; (iter = slabs_chunk(i, pos)) != NULL; pos++) {
+            int ntotal, bin;
+
+            if (! item_is_cached(iter)) continue;
+#else
+        item *iter;
+
+        for (iter = heads[i]; iter != NULL; iter = ITEM_next(iter)) {
+            int ntotal, bin;
+#endif /* #if defined(USE_CLOCK_EVICTION) */
+            ntotal = ITEM_ntotal(iter);
+            bin = (ntotal + bin_bytes - 1) / bin_bytes;
+            if (bin < num_bins) histogram[bin]++;
+            items++;
+            requested += ntotal;
+            actual += chunk_size;
+        }
+    }
+
+    for (i = 0; i < num_bins; i++) {
+        if (histogram[i] != 0) {
+            sizes[nbins] = i * bin_bytes;
+            counts[nbins] = histogram[i];
+            nbins++;
+        }
+    }
+    if (nbins != 0) {
+        unsigned int clsid = slabs_clsid(sizes[nbins - 1]);
+
+        nplanned = slabs_plan_classes(sizes, counts, nbins, clsid != 0 ? clsid : LARGEST_ID, planned);
+        projected = slabs_plan_bytes(planned, nplanned, sizes, counts, nbins);
+    }
+
+    /* write the buffer */
+    *bytes = 0;
+    if (settings.slab_profile != NULL) {
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT profile %s\r\n", settings.slab_profile);
+    }
+    offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT items %llu\r\n", (unsigned long long) items);
+    offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT requested_bytes %llu\r\n", (unsigned long long) requested);
+    offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT actual_waste %llu\r\n", (unsigned long long) (actual - requested));
+    offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT actual_waste_pct %.2f\r\n",
+                              actual != 0 ? 100.0 * (actual - requested) / actual : 0.0);
+    if (nplanned != 0) {
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT projected_waste %llu\r\n", (unsigned long long) (projected - requested));
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT projected_waste_pct %.2f\r\n",
+                                  projected != 0 ? 100.0 * (projected - requested) / projected : 0.0);
+    }
+    for (i = 0; i < nplanned; i++) {
+        offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator), "STAT %d:chunk_size %u\r\n", i + 1, planned[i]);
+    }
+    offset = append_to_buffer(buf, bufsize, offset, 0, terminator);
+    *bytes = (int) offset;
+
+    free(histogram);
+    free(sizes);
+    free(counts);
+    return buf;
+}
+
 /** returns true if a deleted item's delete-locked-time is over, and it
     should be removed from the namespace */
 bool item_delete_lock_over (item *it) {
@@ -509,6 +1143,17 @@ item *do_item_get_notedeleted(const char *key, const size_t nkey, bool *delete_l
         do_item_unlink(it, UNLINK_IS_EXPIRED, key); /* MTSAFE - cache_lock held */
         it = NULL;
     }
+    if (it != NULL && (it->it_flags & ITEM_TIERED) != 0) {
+        tier_ptr_t ptr;
+
+        item_tier_ptr(it, &ptr);
+        if (! tier_valid(&ptr)) {
+            /* the log has wrapped around over the value. */
+            tier_count_lost();
+            do_item_unlink(it, UNLINK_NORMAL, key);
+            it = NULL;
+        }
+    }
 
     if (it != NULL) {
         if (BUMP(it->refcount)) {
@@ -541,9 +1186,23 @@ item *do_item_get_nocheck(const char *key, const size_t nkey) {
 /* expires items that are more recent than the oldest_live setting. */
 void do_item_flush_expired(void) {
     int i;
-    item *iter, *next;
+    item *iter;
     if (settings.oldest_live == 0)
         return;
+#if defined(USE_CLOCK_EVICTION)
+    for (i = 0; i < LARGEST_ID; i++) {
+        /* Without an LRU ordering to stop early on, look at every item. */
+        unsigned int pos;
+
+        for (pos = 0; (iter = slabs_chunk(i, pos)) != NULL; pos++) {
+            if (item_is_cached(iter) && iter->time >= settings.oldest_live) {
+                do_item_unlink(iter, UNLINK_IS_EXPIRED, NULL);
+            }
+        }
+    }
+#else
+    item *next;
+
     for (i = 0; i < LARGEST_ID; i++) {
         /* The LRU is sorted in decreasing time order, and an item's timestamp
          * is never newer than its last access time, so we only need to walk
@@ -552,7 +1211,7 @@ void do_item_flush_expired(void) {
          */
         for (iter = heads[i]; iter != NULL; iter = next) {
             if (iter->time >= settings.oldest_live) {
-                next = iter->next;
+                next = ITEM_next(iter);
                 if ((iter->it_flags & ITEM_SLABBED) == 0) {
                     do_item_unlink(iter, UNLINK_IS_EXPIRED, NULL);
                 }
@@ -562,6 +1221,7 @@ void do_item_flush_expired(void) {
             }
         }
     }
+#endif /* #if defined(USE_CLOCK_EVICTION) */
 }
 
 
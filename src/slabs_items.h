@@ -8,9 +8,16 @@
 /* forward declare some data types. */
 
 typedef struct _stritem item;
+#if defined(COMPACT_ITEMS)
+/* an item's offset into the slab arena, in SLABS_ARENA_ALIGN units, plus 1 so
+ * that 0 can stand for NULL. */
+typedef uint32_t item_ptr_t;
+#else
 typedef item* item_ptr_t;
+#endif /* #if defined(COMPACT_ITEMS) */
 
 #include "memcached.h"
+#include "slabs.h"
 
 #define ITEM_LINKED 1
 #define ITEM_DELETED 2
@@ -20,17 +27,29 @@ typedef item* item_ptr_t;
 #define ITEM_VISITED 8  /* cache hit */
 #define ITEM_HAS_IP_ADDRESS 0x10
 #define ITEM_HAS_TIMESTAMP  0x20
+#define ITEM_EXPIRY_INDEXED 0x40  /* in the expiration index */
+#if defined(USE_CLOCK_EVICTION)
+#define ITEM_REFERENCED     0x80  /* hit since the clock hand last passed */
+#else
+#define ITEM_PROTECTED      0x80  /* in the protected segment of the LRU */
+#endif /* #if defined(USE_CLOCK_EVICTION) */
+#define ITEM_COMPRESSED     0x100 /* value is LZ4 compressed */
+#define ITEM_TIERED         0x200 /* a stub; the value is in the tier */
 
 struct _stritem {
-    struct _stritem *next;
-    struct _stritem *prev;
-    struct _stritem *h_next;    /* hash chain next */
+#if !defined(USE_CLOCK_EVICTION)
+    item_ptr_t      next;
+    item_ptr_t      prev;
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
+    item_ptr_t      h_next;     /* hash chain next */
+    item_ptr_t      exp_next;   /* expiration index next */
+    item_ptr_t      exp_prev;   /* expiration index prev */
     rel_time_t      time;       /* least recent access */
     rel_time_t      exptime;    /* expire time */
     int             nbytes;     /* size of data */
     unsigned int    flags;      /* flags field */
     unsigned short  refcount;
-    uint8_t         it_flags;   /* ITEM_* above */
+    unsigned short  it_flags;   /* ITEM_* above */
     uint8_t         slabs_clsid;/* which slab class we're in */
     uint8_t         nkey;       /* key length, w/terminating null and padding */
     char            end;
@@ -40,16 +59,94 @@ struct _stritem {
 
 #define stritem_length    ((intptr_t) &(((item*) 0)->end))
 
+#if defined(COMPACT_ITEMS)
+#define NULL_ITEM_PTR     ((item_ptr_t) 0)
+
+static inline item*          ITEM(item_ptr_t iptr)   {
+    if (iptr == NULL_ITEM_PTR) {
+        return NULL;
+    }
+    return (item*) (slabs_arena + (size_t) (iptr - 1) * SLABS_ARENA_ALIGN);
+}
+static inline item_ptr_t     ITEM_PTR(item* it)      {
+    if (it == NULL) {
+        return NULL_ITEM_PTR;
+    }
+    assert(((char*) it - slabs_arena) % SLABS_ARENA_ALIGN == 0);
+    return (item_ptr_t) (((char*) it - slabs_arena) / SLABS_ARENA_ALIGN + 1);
+}
+#else
 #define NULL_ITEM_PTR     ((item_ptr_t) NULL)
 
 static inline item*          ITEM(item_ptr_t iptr)   { return (item*) iptr; }
 static inline item_ptr_t     ITEM_PTR(item* it)      { return (item_ptr_t) it; }
-static inline bool           ITEM_PTR_IS_NULL(item_ptr_t iptr)  { return (iptr != NULL); }
+#endif /* #if defined(COMPACT_ITEMS) */
+static inline bool           ITEM_PTR_IS_NULL(item_ptr_t iptr)  { return (iptr != NULL_ITEM_PTR); }
 static inline char*          ITEM_key(item* it)      { return &(it->end); }
 static inline const char*    ITEM_key_const(const item* it){ return &(it->end); }
 static inline uint8_t        ITEM_nkey(const item* it)     { return it->nkey; }
 static inline int            ITEM_nbytes(const item* it)   { return it->nbytes; }
-static inline size_t         ITEM_ntotal(const item* it)   { return stritem_length + it->nkey + it->nbytes; }
+
+/*
+ * values too large for a chunk of the largest slab class are chained.  the
+ * item itself takes a whole chunk of that class, holding the key, a table of
+ * pointers to the other chunks and as much of the value as still fits.  the
+ * rest of the value fills the other chunks in order, each starting after an
+ * item header that holds a reference so that nothing evicts or moves it.
+ */
+#define ITEM_CHAIN_DATA_SZ          (POWER_BLOCK - stritem_length)
+
+/* offset of the chunk table from the start of a chained item. */
+static inline size_t ITEM_chain_offset(const size_t nkey) {
+    return (stritem_length + nkey + sizeof(item*) - 1) & ~(sizeof(item*) - 1);
+}
+
+/* number of chunks a value is chained across, besides the item's own. */
+static inline size_t ITEM_chain_length_for(const size_t nkey, const size_t nbytes) {
+    size_t first;
+
+    if (stritem_length + nkey + nbytes <= POWER_BLOCK) {
+        return 0;
+    }
+    first = POWER_BLOCK - ITEM_chain_offset(nkey);
+    return (nbytes - first + ITEM_CHAIN_DATA_SZ - sizeof(item*) - 1) / (ITEM_CHAIN_DATA_SZ - sizeof(item*));
+}
+
+static inline size_t ITEM_chain_length(const item* it) {
+    return ITEM_chain_length_for(it->nkey, it->nbytes);
+}
+
+static inline item** ITEM_chain(const item* it) {
+    return (item**) ((char*) it + ITEM_chain_offset(it->nkey));
+}
+
+/* returns the seg'th contiguous piece of an item's value, and its length. */
+static inline char* ITEM_segment(const item* it, const size_t seg, size_t* len) {
+    size_t nchained = ITEM_chain_length(it);
+    size_t first;
+
+    if (nchained == 0) {
+        *len = it->nbytes;
+        return (char*) &(it->end) + it->nkey;
+    }
+
+    first = POWER_BLOCK - ITEM_chain_offset(it->nkey) - nchained * sizeof(item*);
+    if (seg == 0) {
+        *len = first;
+        return (char*) (ITEM_chain(it) + nchained);
+    }
+    *len = it->nbytes - first - (seg - 1) * ITEM_CHAIN_DATA_SZ;
+    if (*len > ITEM_CHAIN_DATA_SZ) {
+        *len = ITEM_CHAIN_DATA_SZ;
+    }
+    return (char*) ITEM_chain(it)[seg - 1] + stritem_length;
+}
+
+static inline size_t ITEM_segments(const item* it)  { return ITEM_chain_length(it) + 1; }
+
+static inline size_t         ITEM_ntotal(const item* it)   {
+    return (ITEM_chain_length(it) != 0) ? POWER_BLOCK : stritem_length + it->nkey + it->nbytes;
+}
 static inline unsigned int   ITEM_flags(const item* it)    { return it->flags; }
 static inline rel_time_t     ITEM_time(const item* it)     { return it->time; }
 static inline rel_time_t     ITEM_exptime(const item* it)  { return it->exptime; }
@@ -59,11 +156,23 @@ static inline unsigned short ITEM_refcount(const item* it) { return it->refcount
 static inline void ITEM_set_nbytes(item* it, int new_nbytes)     { it->nbytes = new_nbytes; }
 static inline void ITEM_set_exptime(item* it, rel_time_t t)      { it->exptime = t; }
 
+#if !defined(USE_CLOCK_EVICTION)
+static inline item*  ITEM_next(const item* it)                   { return ITEM(it->next); }
+static inline item*  ITEM_prev(const item* it)                   { return ITEM(it->prev); }
+static inline void   ITEM_set_next(item* it, item* next)         { it->next = ITEM_PTR(next); }
+static inline void   ITEM_set_prev(item* it, item* prev)         { it->prev = ITEM_PTR(prev); }
+#endif /* #if !defined(USE_CLOCK_EVICTION) */
+
 static inline item_ptr_t  ITEM_PTR_h_next(item_ptr_t iptr)       { return ITEM(iptr)->h_next; }
 static inline item_ptr_t* ITEM_h_next_p(item* it)                { return &it->h_next; }
 
 static inline void   ITEM_set_h_next(item* it, item_ptr_t next) { it->h_next = next; }
 
+static inline item_ptr_t ITEM_exp_next(const item* it)            { return it->exp_next; }
+static inline item_ptr_t ITEM_exp_prev(const item* it)            { return it->exp_prev; }
+static inline void ITEM_set_exp_next(item* it, item_ptr_t next)   { it->exp_next = next; }
+static inline void ITEM_set_exp_prev(item* it, item_ptr_t prev)   { it->exp_prev = prev; }
+
 static inline bool ITEM_is_valid(const item* it)        { return !(it->it_flags & ITEM_SLABBED); }
 static inline bool ITEM_has_timestamp(const item* it)   { return (it->it_flags & ITEM_HAS_TIMESTAMP); }
 static inline bool ITEM_has_ip_address(const item* it)  { return (it->it_flags & ITEM_HAS_IP_ADDRESS); }
@@ -74,11 +183,37 @@ static inline void ITEM_set_has_timestamp(item* it)     { it->it_flags |= ITEM_H
 static inline void ITEM_clear_has_timestamp(item* it)   { it->it_flags &= ~(ITEM_HAS_TIMESTAMP); }
 static inline void ITEM_set_has_ip_address(item* it)    { it->it_flags |= ITEM_HAS_IP_ADDRESS; }
 static inline void ITEM_clear_has_ip_address(item* it)  { it->it_flags &= ~(ITEM_HAS_IP_ADDRESS); }
+static inline bool ITEM_is_expiry_indexed(const item* it)  { return (it->it_flags & ITEM_EXPIRY_INDEXED); }
+static inline void ITEM_set_expiry_indexed(item* it)       { it->it_flags |= ITEM_EXPIRY_INDEXED; }
+static inline void ITEM_clear_expiry_indexed(item* it)     { it->it_flags &= ~(ITEM_EXPIRY_INDEXED); }
+static inline bool ITEM_is_compressed(const item* it)      { return (it->it_flags & ITEM_COMPRESSED); }
+static inline void ITEM_set_compressed(item* it)           { it->it_flags |= ITEM_COMPRESSED; }
+static inline void ITEM_clear_compressed(item* it)         { it->it_flags &= ~(ITEM_COMPRESSED); }
+static inline bool ITEM_is_tiered(const item* it)          { return (it->it_flags & ITEM_TIERED); }
+static inline void ITEM_clear_tiered(item* it)             { it->it_flags &= ~(ITEM_TIERED); }
 
 extern char* do_item_cachedump(const unsigned int slabs_clsid, const unsigned int limit, unsigned int *bytes);
 
 extern char* do_item_stats(int *bytes);
+extern char* do_item_slabs_plan(int *bytes);
+extern rel_time_t do_item_tail_age(const unsigned int clsid);
+
+extern void  do_item_relocate(item *it, item *dst);
 
 extern void  item_mark_visited(item* it);
 
+/* extension tier.  a stub's value is a tier_ptr_t. */
+struct tier_ptr_s;
+extern void  item_tier_ptr(const item* stub, struct tier_ptr_s* ptr);
+extern void  do_item_tier_promote(item* stub, item* it);
+
+/* do_item_alloc(..), except that if the victim's value should go to the tier,
+ * the victim is handed back held in *spill and NULL is returned.  the caller
+ * copies the value out with tier_write(..), without the cache lock, and then
+ * calls do_item_spilled(..) before trying again. */
+extern item* do_item_alloc_spill(const char *key, const size_t nkey, const int flags,
+                                 const rel_time_t exptime, const size_t nbytes,
+                                 const struct in_addr addr, item **spill);
+extern void  do_item_spilled(item* it, const struct tier_ptr_s* ptr, const char* key);
+
 #endif /* #if !defined(_slabs_items_h_) */
@@ -30,20 +30,34 @@ static inline int add_item_key_to_iov(conn *c, const item* it) {
 
 
 static inline int add_item_value_to_iov(conn *c, const item* it, bool send_cr_lf) {
-    if (send_cr_lf) {
-        return (add_iov(c, ITEM_data(it), it->nbytes, false) ||
-                add_iov(c, "\r\n", 2, false));
-    } else {
-        return add_iov(c, ITEM_data(it), it->nbytes, false);
+    size_t seg, segments = ITEM_segments(it);
+    int retval = 0;
+
+    zerocopy_value_start(c, ITEM_nbytes(it));
+
+    /* one iovec for each chunk of a chained value. */
+    for (seg = 0; seg < segments && retval == 0; seg ++) {
+        size_t len;
+        char* ptr = ITEM_segment(it, seg, &len);
+
+        retval = add_iov(c, ptr, len, false);
+    }
+
+    if (send_cr_lf && retval == 0) {
+        retval = add_iov(c, "\r\n", 2, false);
     }
+
+    zerocopy_value_end(c);
+    return retval;
 }
 
 
 static inline bool item_setup_receive(item* it, conn* c) {
-    size_t iov_len_required;
+    size_t iov_len_required = ITEM_segments(it);
+    size_t seg;
 
     if (c->binary == false) {
-        iov_len_required = 2;
+        iov_len_required ++;            /* to accomodate the cr-lf */
 
         assert(c->riov == NULL);
         assert(c->riov_size == 0);
@@ -51,8 +65,15 @@ static inline bool item_setup_receive(item* it, conn* c) {
         if (c->riov == NULL) {
             return false;
         }
-    } else {
-        iov_len_required = 1;
+    } else if (sizeof(struct iovec) * iov_len_required > CONN_BUFFER_SMALL_DATA_SZ &&
+               is_small_conn_buffer(c->riov)) {
+        /* in binary protocol, receiving the key already requires the riov to
+         * be set up, but it may be too small for the value. */
+        struct iovec* riov = (struct iovec*) promote_conn_buffer(c->cbg, c->riov, 0);
+        if (riov == NULL) {
+            return false;
+        }
+        c->riov = riov;
     }
 
     report_max_rusage(c->cbg, c->riov, sizeof(struct iovec) * iov_len_required);
@@ -60,17 +81,19 @@ static inline bool item_setup_receive(item* it, conn* c) {
     c->riov_left = iov_len_required;
     c->riov_curr = 0;
 
-    c->riov[0].iov_base = ITEM_data(it);
-    c->riov[0].iov_len = it->nbytes;
+    for (seg = 0; seg < ITEM_segments(it); seg ++) {
+        size_t len;
 
-    if (c->binary) {
-        return true;
-    } else {
-        c->riov[1].iov_base = c->crlf;
-        c->riov[1].iov_len = 2;
+        c->riov[seg].iov_base = ITEM_segment(it, seg, &len);
+        c->riov[seg].iov_len = len;
+    }
 
-        return true;
+    if (c->binary == false) {
+        c->riov[seg].iov_base = c->crlf;
+        c->riov[seg].iov_len = 2;
     }
+
+    return true;
 }
 
 static inline int item_strtoul(const item* it, int base) {
@@ -78,6 +101,11 @@ static inline int item_strtoul(const item* it, int base) {
     char* src;
     int i;
 
+    /* a number never needs to be chained. */
+    if (ITEM_chain_length(it) != 0) {
+        return 0;
+    }
+
     for (i = 0, src = ITEM_data(it);
          i < ITEM_nbytes(it);
          i ++, src ++) {
@@ -100,7 +128,20 @@ static inline int item_strtoul(const item* it, int base) {
 
 
 static inline void item_memset(item* it, size_t offset, int c, size_t nbytes) {
-    memset(ITEM_data(it) + offset, c, nbytes);
+    size_t seg, seg_start, len;
+    char* ptr;
+
+    for (seg = 0, seg_start = 0; nbytes != 0 && seg < ITEM_segments(it); seg ++, seg_start += len) {
+        ptr = ITEM_segment(it, seg, &len);
+        if (offset < seg_start + len) {
+            size_t skip = offset - seg_start;
+            size_t bytes = (nbytes < len - skip) ? nbytes : len - skip;
+
+            memset(ptr + skip, c, bytes);
+            offset += bytes;
+            nbytes -= bytes;
+        }
+    }
 }
 
 
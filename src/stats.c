@@ -434,6 +434,8 @@ char* cost_benefit_stats(int *bytes) {
     int i, j;
     char terminator[] = "END\r\n";
     rel_time_t now = current_time;
+    uint64_t total_hits = 0;
+    double total_byte_seconds = 0;
     (void) now;                                   /* if we're not dumping any stats, we need to
                                                    * consume the now variable. */
 
@@ -444,7 +446,9 @@ char* cost_benefit_stats(int *bytes) {
 
 #if defined(COST_BENEFIT_STATS)
     GLOBAL_STATS_LOCK();
-    /* flush pending stats and write the buffer */
+    /* flush pending stats and write the buffer.  the density is the number of
+     * hits per megabyte-hour of storage, taking each item in a bucket to be
+     * the size of the bucket's midpoint. */
 #define BUCKETS_RANGE(start, end, skip)                                 \
     for (i = start, j = 0;                                              \
          i < end;                                                       \
@@ -455,23 +459,40 @@ char* cost_benefit_stats(int *bytes) {
         cb_buckets.last_update_ ## start ## _ ## end [j] = now;         \
         if (cb_buckets.slot_seconds_ ## start ## _ ## end[j] != 0 ||    \
             cb_buckets.hits_ ## start ## _ ## end[j] != 0) {            \
+            double byte_seconds = (double) cb_buckets.slot_seconds_ ## start ## _ ## end[j] * \
+                (i + skip / 2.0);                                       \
+            total_hits += cb_buckets.hits_ ## start ## _ ## end[j];     \
+            total_byte_seconds += byte_seconds;                         \
             offset = append_to_buffer(buf, bufsize, offset,             \
                                       sizeof(terminator),               \
                                       "%8d-%-8d:"                       \
                                       " cost: %16" PRINTF_INT64_MODIFIER "u" \
                                       " hits: %16" PRINTF_INT64_MODIFIER "u" \
+                                      " density: %16.3f"                \
                                       "\r\n",               \
                                       i, i + skip - 1,                  \
                                       cb_buckets.slot_seconds_ ## start ## _ ## end[j], \
-                                      cb_buckets.hits_ ## start ## _ ## end[j]); \
+                                      cb_buckets.hits_ ## start ## _ ## end[j], \
+                                      byte_seconds == 0 ? 0.0 :         \
+                                      cb_buckets.hits_ ## start ## _ ## end[j] * \
+                                      (3600.0 * 1024 * 1024) / byte_seconds); \
         }                                                               \
     }
 #include "buckets.h"
     GLOBAL_STATS_UNLOCK();
+
+    offset = append_to_buffer(buf, bufsize, offset, sizeof(terminator),
+                              "%17s: hits: %16" PRINTF_INT64_MODIFIER "u"
+                              " density: %16.3f\r\n",
+                              "total", total_hits,
+                              total_byte_seconds == 0 ? 0.0 :
+                              total_hits * (3600.0 * 1024 * 1024) / total_byte_seconds);
 #else
     (void) i;
     (void) j;
     (void) now;
+    (void) total_hits;
+    (void) total_byte_seconds;
 #endif /* #if defined(COST_BENEFIT_STATS) */
 
     offset = append_to_buffer(buf, bufsize, offset, 0, terminator);
@@ -480,6 +501,40 @@ char* cost_benefit_stats(int *bytes) {
 }
 
 
+/*
+ * returns the GreedyDual-Size-Frequency priority of an item sz bytes long: the
+ * hit density of its size bucket (hits per item-second of residency) divided
+ * by its size.  of a set of eviction candidates, the one with the lowest
+ * priority returns the fewest hits for the memory it holds.  buckets that have
+ * seen neither hits nor residency are treated as one hit per item-second so
+ * that they don't all look worthless.
+ */
+double stats_size_priority(size_t sz) {
+    double density = 0;
+#if defined(COST_BENEFIT_STATS)
+    rel_time_t now = current_time;
+
+    GLOBAL_STATS_LOCK();
+#define BUCKETS_RANGE(start, end, skip)                                 \
+    do {                                                                \
+        if (sz >= start && sz < end) {                                  \
+            unsigned slot = (sz - start) / skip;                        \
+            uint64_t slot_seconds = cb_buckets.slot_seconds_ ## start ## _ ## end[slot] + \
+                (now - cb_buckets.last_update_ ## start ## _ ## end[slot]) * \
+                cb_buckets.slots_ ## start ## _ ## end[slot];           \
+            density = (cb_buckets.hits_ ## start ## _ ## end[slot] + 1.0) / \
+                (slot_seconds + 1.0);                                   \
+            break;                                                      \
+        }                                                               \
+    } while (0);
+#include "buckets.h"
+    GLOBAL_STATS_UNLOCK();
+#endif /* #if defined(COST_BENEFIT_STATS) */
+
+    return (sz == 0) ? density : density / sz;
+}
+
+
 #ifdef UNIT_TEST
 
 /****************************************************************************
@@ -285,5 +285,6 @@ static inline void stats_expire(size_t sz) {
 
 extern char* item_stats_buckets(int *bytes);
 extern char* cost_benefit_stats(int *bytes);
+extern double stats_size_priority(size_t sz);
 
 #endif /* #if !defined(_stats_h_) */
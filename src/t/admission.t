@@ -0,0 +1,56 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 16;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+my $stats = mem_stats($sock, "admission");
+is($stats->{sketch_width}, 0, "filter is off by default");
+
+$server = new_memcached("-m 2 -F 4096");
+$sock = $server->sock;
+my $value = "x" x 1000;
+
+$stats = mem_stats($sock, "admission");
+is($stats->{sketch_width}, 4096, "sketch width");
+
+for my $i (1..10) {
+    print $sock "set hot$i 0 0 1000\r\n$value\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored hot$i");
+}
+
+# make the hot keys popular.
+for my $round (1..5) {
+    for my $i (1..10) {
+        print $sock "get hot$i\r\n";
+        while (scalar <$sock> ne "END\r\n") { }
+    }
+}
+
+# a scan of keys that are never fetched can't push the hot keys out.
+my $refused = 0;
+for my $i (1..5000) {
+    print $sock "set scan$i 0 0 1000\r\n$value\r\n";
+    $refused++ if scalar <$sock> =~ /^SERVER_ERROR/;
+}
+
+my $found = 0;
+for my $i (1..10) {
+    print $sock "get hot$i\r\n";
+    my $line = <$sock>;
+    if ($line =~ /^VALUE/) {
+        $found++;
+        scalar <$sock>;
+        scalar <$sock>;
+    }
+}
+is($found, 10, "hot keys survived the scan");
+
+$stats = mem_stats($sock, "admission");
+ok($stats->{rejected} > 0, "scan items were turned away");
+is($stats->{rejected}, $refused, "every rejection refused a store");
+ok($stats->{admitted} > 0, "scan items displaced each other");
@@ -0,0 +1,92 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 20;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use IO::Socket::INET;
+use Socket qw(SOL_SOCKET SO_RCVBUF);
+use MemcachedTest;
+
+# one worker, so every request uses the same arena.
+my $server = new_memcached("-t 1");
+my $sock = $server->sock;
+
+my $count = 1000;
+
+for my $i (1..$count) {
+    printf $sock "set key%d 0 0 6\r\nv%05d\r\n", $i, $i;
+}
+my $stored = 0;
+for my $i (1..$count) {
+    $stored++ if scalar <$sock> eq "STORED\r\n";
+}
+is($stored, $count, "stored the keys");
+
+# fits the connection's own buffers.
+mem_get_is($sock, "key1", "v00001");
+my $stats = mem_stats($sock, "arena");
+is($stats->{thread_1_allocs}, 0, "a small get doesn't touch the arena");
+
+# far more keys than the connection's item list and write buffer hold.
+sub multiget {
+    my @keys = map { "key$_" } (1..$count);
+    my $got = 0;
+
+    print $sock "get @keys\r\n";
+    while (my $line = <$sock>) {
+        last if $line eq "END\r\n";
+        my ($key) = $line =~ /^VALUE key(\d+) 0 6\r\n$/;
+        my $value = <$sock>;
+        $got++ if defined $key && $value eq sprintf("v%05d\r\n", $key);
+    }
+    return $got;
+}
+
+is(multiget(), $count, "large multiget");
+$stats = mem_stats($sock, "arena");
+ok($stats->{thread_1_allocs} > 0, "it was carved from the arena");
+ok($stats->{thread_1_high_water} >= $count * 8, "high water covers the item list");
+is($stats->{thread_1_in_use}, 0, "nothing in use once the response is sent");
+is($stats->{thread_1_holders}, 0, "no one holds the arena");
+is($stats->{thread_1_resets}, 1, "reset once");
+my $blocks = $stats->{thread_1_block_allocs};
+ok($blocks > 0, "blocks allocated");
+
+is(multiget(), $count, "large multiget again");
+$stats = mem_stats($sock, "arena");
+is($stats->{thread_1_resets}, 2, "reset again");
+is($stats->{thread_1_block_allocs}, $blocks, "the blocks were reused");
+ok($stats->{thread_1_grown_in_place} > 0, "buffers were grown in place");
+
+# a client that doesn't read its responses holds the arena; the connections
+# after it get arenas of their own rather than piling up in it.
+my $big = "x" x 4096;
+for my $i (1..400) {
+    print $sock "set big$i 0 0 4096\r\n$big\r\n";
+}
+$stored = 0;
+for my $i (1..400) {
+    $stored++ if scalar <$sock> eq "STORED\r\n";
+}
+is($stored, 400, "stored the big values");
+my $slow = IO::Socket::INET->new(PeerAddr => "127.0.0.1:$server->{port}")
+    or die "can't connect: $!\n";
+setsockopt($slow, SOL_SOCKET, SO_RCVBUF, 4096);
+# more than the socket buffers hold.
+syswrite($slow, ("get " . join(" ", map { "big$_" } (1..400)) . "\r\n") x 4);
+sleep(1);
+my $got = 0;
+for (1..30) {
+    $got++ if multiget() == $count;
+}
+is($got, 30, "large multigets beside a client that doesn't read");
+$stats = mem_stats($sock, "arena");
+is($stats->{thread_1_holders}, 1, "the slow client holds the arena");
+ok($stats->{thread_1_own_arenas} > 0, "the others used arenas of their own");
+ok($stats->{thread_1_in_use} < 512 * 1024, "the held arena stayed small");
+
+close($slow);
+sleep(1);
+$stats = mem_stats($sock, "arena");
+is($stats->{thread_1_holders}, 0, "let go once the slow client is gone");
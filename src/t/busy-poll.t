@@ -0,0 +1,53 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 13;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached("-y 2000 -Y 50 -t 1");
+my $sock = $server->sock;
+
+print $sock "set foo 0 0 3\r\nbar\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored");
+my $hits = 0;
+for (1..100) {
+    print $sock "get foo\r\n";
+    $hits++ if scalar <$sock> eq "VALUE foo 0 3\r\n" &&
+        scalar <$sock> eq "bar\r\n" &&
+        scalar <$sock> eq "END\r\n";
+}
+is($hits, 100, "gets while spinning");
+
+my $stats = mem_stats($sock, "poll");
+is($stats->{busy_poll_usec}, 2000, "busy_poll_usec");
+is($stats->{socket_busy_poll_usec}, 50, "socket_busy_poll_usec");
+ok($stats->{thread_1_polls} > 0, "polled without waiting");
+
+# left alone, the thread spins out its budget and goes to sleep.
+sub idle {
+    my ($sock, $how) = @_;
+    my $before = mem_stats($sock, "poll");
+
+    select(undef, undef, undef, 0.2);
+    # the sleep is counted by the time the request that ends it is handled.
+    my $stats = mem_stats($sock, "poll");
+    ok($stats->{thread_1_spin_usec} >= 2000, "spun$how");
+    ok($stats->{thread_1_sleeps} > $before->{thread_1_sleeps}, "slept once idle$how");
+    ok($stats->{thread_1_sleep_usec} > $before->{thread_1_sleep_usec} + 100000,
+       "slept through the idle time$how");
+}
+idle($sock, "");
+
+# edge-triggered events wake the thread the same way.
+my $server_et = new_memcached("-y 2000 -Y 50 -t 1 -T");
+idle($server_et->sock, " with -T");
+
+# without -y, the threads always wait.
+my $server2 = new_memcached("-t 1");
+my $sock2 = $server2->sock;
+print $sock2 "get foo\r\n";
+is(scalar <$sock2>, "END\r\n", "get without -y");
+$stats = mem_stats($sock2, "poll");
+is($stats->{thread_1_polls}, 0, "no polls without -y");
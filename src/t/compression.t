@@ -0,0 +1,134 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 26;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use IO::Socket::INET;
+use MemcachedTest;
+
+my $bport = free_port();
+my $server = new_memcached("-Z 1024 -n $bport");
+my $sock = $server->sock;
+
+# compresses well.
+my $text = join(" ", map { "field$_=value" . ($_ % 7) } (1..1000));
+my $len = length($text);
+
+print $sock "set text 5 0 $len\r\n$text\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored a compressible value");
+mem_get_is({ sock => $sock, flags => 5 }, "text", $text);
+
+my $stats = mem_stats($sock, "compression");
+is($stats->{threshold}, 1024, "threshold");
+is($stats->{compressed_items}, 1, "value was compressed");
+is($stats->{bytes_in}, $len, "uncompressed size");
+ok($stats->{bytes_out} < $len / 2, "compressed to under half");
+ok($stats->{ratio} > 2, "ratio");
+is($stats->{decompressed_items}, 1, "decompressed on get");
+
+# doesn't compress at all.
+srand(1);
+my $noise = join("", map { chr(33 + int(rand(90))) } (1..4000));
+print $sock "set noise 0 0 4000\r\n$noise\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored an incompressible value");
+mem_get_is($sock, "noise", $noise);
+
+# under the threshold.
+my $short = "y" x 1000;
+print $sock "set short 0 0 1000\r\n$short\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored a short value");
+mem_get_is($sock, "short", $short);
+
+$stats = mem_stats($sock, "compression");
+is($stats->{compressed_items}, 1, "nothing else was compressed");
+is($stats->{skipped_items}, 1, "the incompressible value was skipped");
+
+# clients that ask for it get the compressed form as it is stored.
+print $sock "accept lz4\r\n";
+is(scalar <$sock>, "OK\r\n", "accept lz4");
+
+print $sock "get text short\r\n";
+my $line = <$sock>;
+like($line, qr/^VALUE text 5 (\d+) lz4\r\n$/, "compressed value is marked");
+$line =~ /^VALUE text 5 (\d+)/;
+my $packed;
+read($sock, $packed, $1 + 2);
+is(lz4_unpack(substr($packed, 0, -2)), $text, "compressed value decodes");
+is(scalar <$sock>, "VALUE short 0 1000\r\n", "uncompressed value is not marked");
+scalar <$sock>;
+is(scalar <$sock>, "END\r\n", "end of get");
+
+$stats = mem_stats($sock, "compression");
+is($stats->{compressed_sent}, 1, "sent one value compressed");
+
+print $sock "accept none\r\n";
+is(scalar <$sock>, "OK\r\n", "accept none");
+mem_get_is({ sock => $sock, flags => 5 }, "text", $text);
+
+# the binary protocol always gets the value decompressed.
+my $bsock = IO::Socket::INET->new(PeerAddr => "127.0.0.1:$bport")
+    or die "can't connect to the binary port: $!\n";
+print $bsock pack("CCCCNN", 0x50, 0x20, 4, 0, 1, 4) . "text";
+my ($header, $body) = ("", "");
+read($bsock, $header, 12);
+my $blen = (unpack("CCCCNN", $header))[5];
+while (length($body) < $blen) {
+    read($bsock, $body, $blen - length($body), length($body)) or last;
+}
+is(substr($body, 4), $text, "decompressed over the binary protocol");
+
+# a value is decompressed into the connection's memory, not the cache's, so
+# reading it back evicts nothing, even with the cache full.
+my $server2 = new_memcached("-m 2 -Z 100");
+my $sock2 = $server2->sock;
+my $filler = join("", map { chr(33 + int(rand(90))) } (1..$len));
+for my $i (1..200) {
+    print $sock2 "set filler$i 0 0 $len\r\n$filler\r\n";
+    scalar <$sock2>;
+}
+print $sock2 "set text 0 0 $len\r\n$text\r\n";
+is(scalar <$sock2>, "STORED\r\n", "stored a compressible value in a full cache");
+my $evictions = mem_stats($sock2)->{evictions};
+# each key in a get is decompressed on its own, and held until it is sent.
+print $sock2 "get text text text text\r\n";
+my $copies = 0;
+while ((my $line = <$sock2>) =~ /^VALUE text 0 $len\r\n$/) {
+    my $data;
+    read($sock2, $data, $len + 2);
+    $copies++ if $data eq "$text\r\n";
+}
+is($copies, 4, "decompressed with the cache full");
+is(mem_stats($sock2)->{evictions}, $evictions, "without evicting anything");
+
+# decode the stored form: a 4 byte little endian length and an LZ4 block.
+sub lz4_unpack {
+    my $in = shift;
+    my $size = unpack("V", substr($in, 0, 4));
+    my $pos = 4;
+    my $out = "";
+
+    while ($pos < length($in)) {
+        my $token = ord(substr($in, $pos++, 1));
+        my $nlit = $token >> 4;
+        if ($nlit == 15) {
+            my $b;
+            do { $b = ord(substr($in, $pos++, 1)); $nlit += $b; } while ($b == 255);
+        }
+        $out .= substr($in, $pos, $nlit);
+        $pos += $nlit;
+        last if $pos >= length($in);
+
+        my $offset = unpack("v", substr($in, $pos, 2));
+        $pos += 2;
+        my $nmatch = $token & 15;
+        if ($nmatch == 15) {
+            my $b;
+            do { $b = ord(substr($in, $pos++, 1)); $nmatch += $b; } while ($b == 255);
+        }
+        $nmatch += 4;
+        my $start = length($out) - $offset;
+        $out .= substr($out, $start + $_, 1) for (0 .. $nmatch - 1);
+    }
+    return length($out) == $size ? $out : undef;
+}
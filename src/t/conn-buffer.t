@@ -0,0 +1,56 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 12;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# one worker, so every connection uses the same buffer group.
+my $server = new_memcached("-t 1");
+my $sock = $server->sock;
+
+# short requests are served from small buffers alone.
+print $sock "set foo 0 0 6\r\nfooval\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored foo");
+mem_get_is($sock, "foo", "fooval");
+
+my $stats = mem_stats($sock, "conn_buffer");
+ok($stats->{small_allocates} > 0, "small buffers were used");
+is($stats->{allocates}, 0, "no big buffers were needed");
+is($stats->{promotions}, 0, "nothing was promoted");
+
+# a command line longer than a small buffer.
+my @keys = map { "missing_key_$_" } (1..2000);
+print $sock "get foo @keys\r\n";
+is(scalar <$sock>, "VALUE foo 0 6\r\n", "long multiget");
+is(scalar <$sock>, "fooval\r\n", "... value");
+is(scalar <$sock>, "END\r\n", "... end");
+
+$stats = mem_stats($sock, "conn_buffer");
+ok($stats->{promotions} > 0, "the read buffer was promoted");
+
+# a response with more pieces than a small buffer has iovecs for.
+my $count = 1000;
+for my $i (1..$count) {
+    printf $sock "set key%d 0 0 6\r\nv%05d\r\n", $i, $i;
+}
+my $stored = 0;
+for my $i (1..$count) {
+    $stored++ if scalar <$sock> eq "STORED\r\n";
+}
+is($stored, $count, "stored the keys");
+my $promotions = mem_stats($sock, "conn_buffer")->{promotions};
+
+print $sock "get " . join(" ", map { "key$_" } (1..$count)) . "\r\n";
+my $got = 0;
+while (my $line = <$sock>) {
+    last if $line eq "END\r\n";
+    my ($key) = $line =~ /^VALUE key(\d+) 0 6\r\n$/;
+    my $value = <$sock>;
+    $got++ if defined $key && $value eq sprintf("v%05d\r\n", $key);
+}
+is($got, $count, "large response");
+
+$stats = mem_stats($sock, "conn_buffer");
+ok($stats->{promotions} > $promotions, "the iov list was promoted");
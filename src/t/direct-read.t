@@ -0,0 +1,94 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 14;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use IO::Socket::INET;
+use MemcachedTest;
+
+my $bport = free_port();
+my $server = new_memcached("-t 1 -n $bport");
+my $sock = $server->sock;
+my $stats_sock = $server->new_sock;
+my $bsock = IO::Socket::INET->new(PeerAddr => "127.0.0.1:$bport")
+    or die "can't connect to the binary port: $!\n";
+
+my $len = 200 * 1024;
+my $big = "a" x $len;
+
+# the first large value of a connection comes in after whatever the first read
+# took; the values after it are read straight into their items.
+my ($copied, $direct) = value_bytes(sub {
+    print $sock "set big1 0 0 $len\r\n$big\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored first large value");
+});
+ok($copied <= 16384 + 2, "first large value copied at most a buffer");
+
+($copied, $direct) = value_bytes(sub {
+    print $sock "set big2 0 0 $len\r\n$big\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored second large value");
+});
+ok($copied <= 320, "second large value copied at most a request head");
+ok($direct >= $len - 320, "second large value read directly");
+mem_get_is($sock, "big1", $big);
+mem_get_is($sock, "big2", $big);
+
+# small requests after a large one are still read in batches.
+print $sock "set big3 0 0 $len\r\n$big\r\n";
+print $sock join("", map { "set small$_ 0 0 1\r\nx\r\n" } (1..50));
+my $stored = 0;
+for (0..50) {
+    $stored++ if scalar <$sock> eq "STORED\r\n";
+}
+is($stored, 51, "pipelined sets after a large one");
+
+# a request in the same write as a large value.
+print $sock "set big4 0 0 $len\r\n${big}\r\nget small7\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored large value with a request behind it");
+is(scalar <$sock> . scalar <$sock> . scalar <$sock>,
+   "VALUE small7 0 1\r\nx\r\nEND\r\n", "and answered the request");
+
+# binary sets.
+print $bsock bp_set(1, "bbig", $big) . bp_set(2, "bbig2", $big);
+is(bp_read_status($bsock) . bp_read_status($bsock), "66", "binary large sets stored");
+mem_get_is($sock, "bbig2", $big);
+
+# -j 0 reads large values through the read buffer like any other.
+my $server2 = new_memcached("-t 1 -j 0");
+$sock = $server2->sock;
+$stats_sock = $server2->new_sock;
+print $sock "set big1 0 0 $len\r\n$big\r\n";
+scalar <$sock>;
+($copied, $direct) = value_bytes(sub {
+    print $sock "set big2 0 0 $len\r\n$big\r\n";
+    scalar <$sock>;
+});
+ok($copied > 320, "-j 0 copies the start of a large value");
+mem_get_is($sock, "big2", $big);
+
+sub value_bytes {
+    my $run = shift;
+    my $before = mem_stats($stats_sock, "tcp");
+    $run->();
+    my $after = mem_stats($stats_sock, "tcp");
+    return (($after->{thread_1_value_bytes_copied} - $before->{thread_1_value_bytes_copied}),
+            ($after->{thread_1_value_bytes_direct} - $before->{thread_1_value_bytes_direct}));
+}
+
+sub bp_set {
+    my ($opaque, $key, $value) = @_;
+    return pack("CCCCNN", 0x50, 0x30, length($key), 0, $opaque,
+                8 + length($key) + length($value)) .
+        pack("NN", 0, 0) . $key . $value;
+}
+
+sub bp_read_status {
+    my $sock = shift;
+    my ($header, $body);
+
+    read($sock, $header, 12) == 12 or return;
+    my ($magic, $cmd, $status, $reserved, $opaque, $length) = unpack("CCCCNN", $header);
+    read($sock, $body, $length) if $length > 0;
+    return $status;
+}
@@ -0,0 +1,57 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 6;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# one read per event, so a big pipeline makes the connection give way to
+# the socket's next event in between.
+my $server = new_memcached("-T -R 1");
+my $sock = $server->sock;
+
+my $count = 200;
+my $value = "x" x 1000;
+my $req = "";
+for my $i (1..$count) {
+    $req .= "set key$i 0 0 " . length($value) . "\r\n$value\r\n";
+}
+print $sock $req;
+my $stored = 0;
+for my $i (1..$count) {
+    $stored++ if scalar <$sock> eq "STORED\r\n";
+}
+is($stored, $count, "pipelined sets, more than one read's worth");
+
+print $sock join("", map { "get key$_\r\n" } (1..$count));
+my $hits = 0;
+for my $i (1..$count) {
+    $hits++ if scalar <$sock> eq "VALUE key$i 0 1000\r\n" &&
+        scalar <$sock> eq "$value\r\n" &&
+        scalar <$sock> eq "END\r\n";
+}
+is($hits, $count, "pipelined gets");
+
+# a reply bigger than the socket buffers, read only after a while, so the
+# server has to wait to write.
+my $big = "abcdefgh" x (100 * 1024);
+print $sock "set big 0 0 " . length($big) . "\r\n$big\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored big");
+
+my $sock2 = $server->new_sock;
+print $sock2 "get big big\r\n";
+sleep(0.5);
+my $got = 0;
+for (1..2) {
+    my $line = <$sock2>;
+    my $data;
+    read($sock2, $data, length($big) + 2);
+    $got++ if $line eq "VALUE big 0 " . length($big) . "\r\n" && $data eq "$big\r\n";
+}
+is($got, 2, "big reply arrived whole");
+is(scalar <$sock2>, "END\r\n", "and ended");
+
+# the connection is still served after waiting to write.
+print $sock2 "get key1\r\n";
+is(scalar <$sock2>, "VALUE key1 0 1000\r\n", "served afterwards");
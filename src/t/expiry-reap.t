@@ -0,0 +1,54 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 27;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+my $stats;
+
+for my $i (1..10) {
+    print $sock "set short$i 0 1 6\r\nfooval\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored short$i");
+}
+
+print $sock "set forever 0 0 6\r\nfooval\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored forever");
+
+# a delete-locked item belongs to the deferred delete queue, not the reaper.
+print $sock "set locked 0 1 6\r\nfooval\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored locked");
+print $sock "delete locked 3\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted locked");
+
+$stats = mem_stats($sock);
+is($stats->{reaped_items}, 0, "nothing reaped yet");
+
+# the expired items are reclaimed without being fetched.
+sleep(3.5);
+$stats = mem_stats($sock);
+is($stats->{reaped_items}, 10, "expired items reaped");
+is($stats->{expired_items}, 10, "expired items counted");
+is($stats->{evictions}, 0, "no evictions");
+mem_get_is($sock, "forever", "fooval");
+
+# flush_regex moves the items it expires to their new bucket, so that they
+# can be replaced and reaped like any other.
+print $sock "set timed 0 100 6\r\nfooval\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored timed");
+print $sock "set untimed 0 0 6\r\nfooval\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored untimed");
+print $sock "flush_regex timed\r\n";
+is(scalar <$sock>, "DELETED\r\n", "flush_regex timed");
+print $sock "flush_regex untimed\r\n";
+is(scalar <$sock>, "DELETED\r\n", "flush_regex untimed");
+mem_get_is($sock, "timed", undef);
+print $sock "set timed 0 100 6\r\nbarval\r\n";
+is(scalar <$sock>, "STORED\r\n", "replaced timed");
+print $sock "set untimed 0 0 6\r\nbarval\r\n";
+is(scalar <$sock>, "STORED\r\n", "replaced untimed");
+mem_get_is($sock, "timed", "barval");
+mem_get_is($sock, "untimed", "barval");
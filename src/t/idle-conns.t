@@ -0,0 +1,106 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 17;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use IO::Socket::INET;
+use MemcachedTest;
+
+# connections idle for a second let go of their buffers, and get them back
+# when they are used again.
+my $bport = free_port();
+my $server = new_memcached("-t 1 -n $bport -O 1");
+my $sock = $server->sock;
+my $idle = $server->new_sock;
+my $bsock = IO::Socket::INET->new(PeerAddr => "127.0.0.1:$bport")
+    or die "can't connect to the binary port: $!\n";
+
+print $sock "set foo 0 0 3\r\nbar\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored");
+mem_get_is($idle, "foo", "bar");
+print $bsock bp_get(0x20, 1, "foo");
+is(bp_read_value($bsock), "bar", "binary get");
+
+# asked on a connection of its own, which isn't idle long enough to count.
+my $stats = wait_for_stats($server->new_sock, sub { $_[0]->{slim_conns} >= 3 });
+is($stats->{idle_slimmed}, 3, "idle connections slimmed");
+is($stats->{slim_conns}, 3, "slim connections");
+ok($stats->{idle_conn_bytes} / $stats->{idle_conns} < 2048, "slim connections are small");
+mem_get_is($idle, "foo", "bar", "get once slimmed");
+print $bsock bp_get(0x20, 2, "foo");
+is(bp_read_value($bsock), "bar", "binary get once slimmed");
+
+# connections idle for two seconds are closed; busy ones are not.
+my $server2 = new_memcached("-t 1 -o 2");
+my $sock2 = $server2->sock;
+my $idle2 = $server2->new_sock;
+my $busy = $server2->new_sock;
+my $busy_hits = 0;
+for (1..8) {
+    select(undef, undef, undef, 0.5);
+    print $busy "version\r\n";
+    $busy_hits++ if scalar <$busy> =~ /^VERSION /;
+}
+is($busy_hits, 8, "busy connection stays open");
+is(scalar <$idle2>, undef, "idle connection closed");
+$stats = wait_for_stats($busy, sub { $_[0]->{idle_closed} >= 2 });
+is($stats->{idle_timeout}, 2, "idle_timeout");
+is($stats->{idle_closed}, 2, "idle connections closed");
+
+# a connection can't grow its buffers past -H.
+my $server3 = new_memcached("-t 1 -H 49152");
+my $sock3 = $server3->sock;
+for my $i (0..999) {
+    print $sock3 "set k$i 0 0 1\r\nx\r\n";
+    scalar <$sock3>;
+}
+is(count_values($sock3, 300), 300, "get within the cap");
+print $sock3 "get " . join(" ", map { "k$_" } (0..999)) . "\r\n";
+like(scalar <$sock3>, qr/^SERVER_ERROR /, "get over the cap fails");
+is(count_values($sock3, 1), 1, "and the connection goes on");
+print $sock3 "get " . join(" ", map { "k" . ($_ % 1000) } (0..19999)) . "\r\n";
+is(scalar <$sock3>, undef, "request line over the cap closes the connection");
+$stats = mem_stats($server3->new_sock, "conns");
+ok($stats->{memory_capped} >= 2, "memory_capped");
+
+# the connections are swept once a second; waits until a sweep has done what
+# done() looks for, or for ten seconds.
+sub wait_for_stats {
+    my ($sock, $done) = @_;
+    my $stats;
+
+    for (1..50) {
+        $stats = mem_stats($sock, "conns");
+        last if $done->($stats);
+        select(undef, undef, undef, 0.2);
+    }
+    return $stats;
+}
+
+sub count_values {
+    my ($sock, $n) = @_;
+    my $values = 0;
+
+    print $sock "get " . join(" ", map { "k$_" } (0..$n - 1)) . "\r\n";
+    while (my $line = <$sock>) {
+        last if $line eq "END\r\n";
+        $values++ if $line =~ /^VALUE /;
+    }
+    return $values;
+}
+
+sub bp_get {
+    my ($cmd, $opaque, $key) = @_;
+    return pack("CCCCNN", 0x50, $cmd, length($key), 0, $opaque, length($key)) . $key;
+}
+
+sub bp_read_value {
+    my $sock = shift;
+    my ($header, $body);
+
+    read($sock, $header, 12) == 12 or return;
+    my ($magic, $cmd, $status, $reserved, $opaque, $length) = unpack("CCCCNN", $header);
+    read($sock, $body, $length) if $length > 0;
+    return substr($body, 4);
+}
@@ -0,0 +1,41 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+$ENV{T_MEMD_SLABS_ALLOC} = 0;  # don't preallocate slabs
+
+my $server = new_memcached();
+my $sock = $server->sock;
+if (mem_stats($sock)->{allocator} ne "slab") {
+    plan skip_all => "Item headers are only reported by the slab allocator.";
+} else {
+    plan tests => 6;
+}
+
+sub set {
+    my ($key, $len) = @_;
+    my $value = "x" x $len;
+    print $sock "set $key 0 0 $len\r\n$value\r\n";
+    return scalar <$sock>;
+}
+
+is(set("a", 1), "STORED\r\n", "stored a tiny item");
+my $stats = mem_stats($sock, "slabs");
+my $header = $stats->{item_header_bytes};
+my $chunk = $stats->{"1:chunk_size"};
+ok($header > 0 && $header < 64, "header is $header bytes");
+ok($chunk > $header, "smallest chunk is $chunk bytes");
+
+# an item takes the header, the key and the value, so this fills a chunk of
+# the smallest class exactly...
+my $fit = $chunk - $header - 1;
+is(set("b", $fit), "STORED\r\n", "stored an item that fills a chunk");
+is(mem_stats($sock, "slabs")->{"1:total_items"}, 2, "in the smallest class");
+
+# ...and one byte more doesn't fit.
+set("c", $fit + 1);
+is(mem_stats($sock, "slabs")->{"1:total_items"}, 2, "one more byte doesn't");
@@ -0,0 +1,83 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+$ENV{T_MEMD_SLABS_ALLOC} = 0;  # don't preallocate slabs
+
+my $server = new_memcached();
+my $sock = $server->sock;
+if (mem_stats($sock)->{allocator} ne "slab") {
+    plan skip_all => "Chained items are only in the slab allocator.";
+} else {
+    plan tests => 14;
+}
+
+# numbered 1KB blocks, so that chunks sent out of order don't go unnoticed.
+sub make_value {
+    my ($kb, $tag) = @_;
+    return join("", map { sprintf("%s%07d", $tag, $_) . ("." x 1016) } (1..$kb));
+}
+
+sub set {
+    my ($sock, $key, $value) = @_;
+    my $len = length($value);
+    print $sock "set $key 0 0 $len\r\n$value\r\n";
+    return scalar <$sock>;
+}
+
+sub get_value {
+    my ($sock, $key) = @_;
+
+    print $sock "get $key\r\n";
+    my $line = <$sock>;
+    return undef unless $line =~ /^VALUE \S+ \d+ (\d+)/;
+    my $len = $1;
+    my $data = "";
+    while (length($data) < $len + 2) {
+        read($sock, $data, $len + 2 - length($data), length($data)) or last;
+    }
+    scalar <$sock>;     # END
+    return substr($data, 0, $len);
+}
+
+my $big = make_value(3 * 1024, "a");
+like(set($sock, "big", $big), qr/^SERVER_ERROR object too large/,
+     "values over 1MB are refused by default");
+
+$server = new_memcached("-I 10m -m 32");
+$sock = $server->sock;
+
+is(set($sock, "big", $big), "STORED\r\n", "stored a 3MB value");
+ok(get_value($sock, "big") eq $big, "got the 3MB value back intact");
+
+# a value that just overflows the first chunk.
+my $edge = "e" x (1024 * 1024);
+is(set($sock, "edge", $edge), "STORED\r\n", "stored a value one chunk can't hold");
+ok(get_value($sock, "edge") eq $edge, "got it back intact");
+
+my $bigger = make_value(9 * 1024, "b");
+is(set($sock, "big", $bigger), "STORED\r\n", "replaced it with a 9MB value");
+ok(get_value($sock, "big") eq $bigger, "got the 9MB value back intact");
+
+my $small = "small";
+is(set($sock, "big", $small), "STORED\r\n", "replaced it with a small value");
+is(get_value($sock, "big"), $small, "got the small value back");
+
+like(set($sock, "huge", make_value(11 * 1024, "c")), qr/^SERVER_ERROR object too large/,
+     "values over the limit are refused");
+
+print $sock "delete edge\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted a chained value");
+
+# chained values are evicted like any other item in the largest class.
+for my $i (1..12) {
+    set($sock, "many$i", make_value(3 * 1024, sprintf("%c", 64 + $i)));
+}
+ok(mem_stats($sock)->{evictions} > 0, "evicted chained values");
+ok(! defined get_value($sock, "many1"), "the oldest one is gone");
+ok(get_value($sock, "many12") eq make_value(3 * 1024, sprintf("%c", 76)),
+   "the newest one is intact");
@@ -0,0 +1,65 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $stats = mem_stats($server->sock, "lru");
+if (exists $stats->{clock_steps}) {
+    plan tests => 19;
+} else {
+    plan skip_all => "Built with LRU lists.";
+}
+
+$server = new_memcached("-m 2");
+my $sock = $server->sock;
+my $value = "x" x 1000;
+my $stored = 0;
+
+for my $i (1..10) {
+    print $sock "set key$i 0 0 1000\r\n$value\r\n";
+    $stored++ if scalar <$sock> eq "STORED\r\n";
+}
+is($stored, 10, "stored ten keys");
+
+# a hit only sets the item's reference bit.
+mem_get_is($sock, "key$_", $value) for (1..3);
+
+$stats = mem_stats($sock, "lru");
+is($stats->{clock_steps}, 0, "hand hasn't moved");
+
+# fill the cache until the hand has to pick a victim.
+my $i = 0;
+do {
+    $i++;
+    print $sock "set scan$i 0 0 1000\r\n$value\r\n";
+    scalar <$sock>;
+    $stats = mem_stats($sock);
+} while ($stats->{evictions} == 0 && $i < 10000);
+is($stats->{evictions}, 1, "evicted one item");
+
+# the referenced items got a second chance.
+mem_get_is($sock, "key$_", $value) for (1..3);
+
+$stats = mem_stats($sock, "lru");
+ok($stats->{clock_steps} > 0, "hand moved");
+
+# a full cache keeps evicting, and every item gets its turn.
+for my $j (1..5000) {
+    print $sock "set more$j 0 0 1000\r\n$value\r\n";
+    scalar <$sock>;
+}
+mem_get_is($sock, "key$_", undef) for (4..10);
+mem_get_is($sock, "more5000", $value);
+
+# the size histogram walks memory instead of the LRU.
+print $sock "stats sizes\r\n";
+my $sizes = 0;
+while (my $line = <$sock>) {
+    last if $line eq "END\r\n";
+    $sizes++;
+}
+ok($sizes > 0, "sizes reported");
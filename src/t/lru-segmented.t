@@ -0,0 +1,48 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $stats = mem_stats($server->sock, "lru");
+if (exists $stats->{clock_steps}) {
+    plan skip_all => "Built with CLOCK eviction.";
+} else {
+    plan tests => 14;
+}
+
+$server = new_memcached("-m 2 -L 50");
+my $sock = $server->sock;
+my $value = "x" x 1000;
+my $stored = 0;
+
+for my $i (1..10) {
+    print $sock "set key$i 0 0 1000\r\n$value\r\n";
+    $stored++ if scalar <$sock> eq "STORED\r\n";
+}
+is($stored, 10, "stored ten keys");
+
+# a second reference promotes the item to the protected segment.
+mem_get_is($sock, "key$_", $value) for (1..3);
+
+$stats = mem_stats($sock, "lru");
+is($stats->{protected_pct}, 50, "protected_pct");
+is($stats->{protected_items}, 3, "three protected items");
+is($stats->{probation_items}, 7, "seven probationary items");
+is($stats->{promotions}, 3, "three promotions");
+
+# a scan of one-hit wonders only churns the probationary segment.
+for my $i (1..5000) {
+    print $sock "set scan$i 0 0 1000\r\n$value\r\n";
+    scalar <$sock>;
+}
+
+mem_get_is($sock, "key$_", $value) for (1..3);
+mem_get_is($sock, "key4", undef);
+
+$stats = mem_stats($sock, "lru");
+ok($stats->{probation_evictions} > 0, "evicted from the probationary segment");
+is($stats->{protected_evictions}, 0, "nothing evicted from the protected segment");
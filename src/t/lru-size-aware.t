@@ -0,0 +1,93 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+sub cost_benefit {
+    my $sock = shift;
+    my %lines;
+
+    print $sock "stats cost-benefit\r\n";
+    while (my $line = <$sock>) {
+        last if $line =~ /^END/;
+        $lines{$1} = $line if $line =~ /^\s*(\S+)\s*:/;
+    }
+    return \%lines;
+}
+
+my $server = new_memcached();
+my $sock = $server->sock;
+my $stats = mem_stats($sock, "lru");
+if (! exists $stats->{size_aware}) {
+    plan skip_all => "Built with CLOCK eviction.";
+} elsif (! exists cost_benefit($sock)->{total}) {
+    plan skip_all => "Built without cost-benefit stats.";
+} else {
+    plan tests => 10;
+}
+
+my $flat = mem_stats($sock)->{allocator} =~ /^flat/;
+is($stats->{size_aware}, 0, "size-aware eviction is off by default");
+
+# twenty small keys that are fetched often, then a stream of large values that
+# are never fetched.
+sub run {
+    my $sock = shift;
+    my $small = "s" x 100;
+    my $large = "l" x 20000;
+    my $survivors = 0;
+
+    for my $i (1..20) {
+        print $sock "set small$i 0 0 100\r\n$small\r\n";
+        scalar <$sock>;
+    }
+    for my $pass (1..3) {
+        for my $i (1..20) {
+            print $sock "get small$i\r\n";
+            scalar <$sock> for (1..3);
+        }
+    }
+    for my $i (1..500) {
+        print $sock "set large$i 0 0 20000\r\n$large\r\n";
+        scalar <$sock>;
+    }
+    for my $i (1..20) {
+        print $sock "get small$i\r\n";
+        my $line = <$sock>;
+        if ($line =~ /^VALUE/) {
+            $survivors++;
+            scalar <$sock>;
+            scalar <$sock>;
+        }
+    }
+    return $survivors;
+}
+
+$server = new_memcached("-m 2 -G");
+$sock = $server->sock;
+is(mem_stats($sock, "lru")->{size_aware}, 1, "size-aware eviction is on");
+
+my $survivors = run($sock);
+ok(mem_stats($sock)->{evictions} > 0, "evicted large values");
+
+my $report = cost_benefit($sock);
+ok($report->{total} =~ /hits:\s+(\d+)\s+density:\s+[0-9.]+/ && $1 >= 60,
+   "report totals hits and density");
+like($report->{"106-106"}, qr/hits:\s+\d+\s+density:\s+[0-9.]+/,
+     "report has a density per bucket");
+
+SKIP: {
+    skip "Slab classes keep small and large items apart.", 5 unless $flat;
+
+    is($survivors, 20, "hot small keys survived with size-aware eviction");
+    ok(mem_stats($sock, "lru")->{size_aware_picks} > 0, "passed over older items");
+
+    $server = new_memcached("-m 2");
+    $sock = $server->sock;
+    ok(run($sock) < 20, "plain LRU evicted hot small keys");
+    is(mem_stats($sock, "lru")->{size_aware_picks}, 0, "no size-aware picks");
+    ok(mem_stats($sock)->{evictions} > 0, "evicted with plain LRU");
+}
@@ -0,0 +1,144 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 18;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use IO::Socket::INET;
+use MemcachedTest;
+
+my $bport = free_port();
+my $server = new_memcached("-t 1 -n $bport");
+my $sock = $server->sock;
+
+# every kind of reply, pipelined in one write.
+print $sock "set foo 0 0 3\r\nbar\r\nget foo\r\nget nothing\r\nset num 0 0 1\r\n5\r\n" .
+    "incr num 2\r\ndelete foo 0\r\nbogus\r\nget foo num\r\n";
+my @expected = ("STORED\r\n", "VALUE foo 0 3\r\n", "bar\r\n", "END\r\n", "END\r\n",
+                "STORED\r\n", "7\r\n", "DELETED\r\n", "ERROR\r\n",
+                "VALUE num 0 1\r\n", "7\r\n", "END\r\n");
+my @got = map { scalar <$sock> } @expected;
+is_deeply(\@got, \@expected, "pipelined replies in order");
+
+# many gets in a row share writes.
+my $count = 200;
+for my $i (1..$count) {
+    print $sock "set key$i 0 0 6\r\nv" . sprintf("%05d", $i) . "\r\n";
+}
+my $stored = 0;
+for my $i (1..$count) {
+    $stored++ if scalar <$sock> eq "STORED\r\n";
+}
+is($stored, $count, "pipelined sets");
+
+sub pipelined_gets {
+    my ($sock, $count) = @_;
+    my $hits = 0;
+
+    print $sock join("", map { "get key$_\r\n" } (1..$count));
+    for my $i (1..$count) {
+        $hits++ if scalar <$sock> eq "VALUE key$i 0 6\r\n" &&
+            scalar <$sock> eq sprintf("v%05d\r\n", $i) &&
+            scalar <$sock> eq "END\r\n";
+    }
+    return $hits;
+}
+
+my $before = mem_stats($sock, "tcp");
+is(pipelined_gets($sock, $count), $count, "pipelined gets");
+my $after = mem_stats($sock, "tcp");
+my $sends = $after->{thread_1_send_calls} - $before->{thread_1_send_calls};
+my $replies = $after->{thread_1_replies_sent} - $before->{thread_1_replies_sent};
+is($replies, $count + 1, "every reply counted");
+ok($sends < $count / 2, "$count replies in $sends writes");
+
+# a stats reply, which is freed once sent, after replies held back.
+print $sock "get key1\r\nstats tcp\r\nget key2\r\n";
+is(scalar <$sock>, "VALUE key1 0 6\r\n", "get before stats");
+<$sock>; <$sock>;
+my $line;
+while (($line = <$sock>) =~ /^STAT /) {}
+is($line, "END\r\n", "stats in between");
+is(scalar <$sock>, "VALUE key2 0 6\r\n", "get after stats");
+<$sock>; <$sock>;
+
+# replies to complete requests don't wait for the rest of the pipeline.
+print $sock "get key1\r\nget key2\r\nget ke";
+my $ok = eval {
+    local $SIG{ALRM} = sub { die "timeout\n" };
+    alarm(3);
+    my @lines = map { scalar <$sock> } (1..6);
+    alarm(0);
+    $lines[0] eq "VALUE key1 0 6\r\n" && $lines[3] eq "VALUE key2 0 6\r\n";
+};
+ok($ok, "complete requests answered before the rest arrives");
+print $sock "y3\r\n";
+is(scalar <$sock>, "VALUE key3 0 6\r\n", "the rest");
+<$sock>; <$sock>;
+
+# nor for the data of an update that follows them.
+print $sock "get key1\r\nset key4 0 0 6\r\n";
+$ok = eval {
+    local $SIG{ALRM} = sub { die "timeout\n" };
+    alarm(3);
+    my @lines = map { scalar <$sock> } (1..3);
+    alarm(0);
+    $lines[0] eq "VALUE key1 0 6\r\n" && $lines[2] eq "END\r\n";
+};
+ok($ok, "replies go out before waiting for an update's data");
+print $sock "v00004\r\n";
+is(scalar <$sock>, "STORED\r\n", "the update");
+mem_get_is($sock, "key4", "v00004");
+
+# more iovecs than one sendmsg takes.
+my $server2 = new_memcached("-g 10000");
+my $sock2 = $server2->sock;
+for my $i (1..$count) {
+    print $sock2 "set key$i 0 0 6\r\nv" . sprintf("%05d", $i) . "\r\n";
+    <$sock2>;
+}
+is(pipelined_gets($sock2, $count), $count, "gets past IOV_MAX");
+
+# -g 1 sends each reply on its own.
+my $server3 = new_memcached("-g 1 -t 1");
+my $sock3 = $server3->sock;
+for my $i (1..10) {
+    print $sock3 "set key$i 0 0 6\r\nv" . sprintf("%05d", $i) . "\r\n";
+    <$sock3>;
+}
+$before = mem_stats($sock3, "tcp");
+is(pipelined_gets($sock3, 10), 10, "gets with -g 1");
+$after = mem_stats($sock3, "tcp");
+is($after->{thread_1_send_calls} - $before->{thread_1_send_calls}, 11, "one write per reply");
+
+# the binary protocol: a get held back for a quiet getq that misses still
+# goes out.
+my $bsock = IO::Socket::INET->new(PeerAddr => "127.0.0.1:$bport")
+    or die "can't connect to the binary port: $!\n";
+print $bsock bp_get(0x20, 1, "key1") . bp_get(0x28, 2, "nothing");
+my ($opaque, $value) = bp_read_value($bsock);
+ok($opaque == 1 && $value eq "v00001", "binary get before a quiet miss");
+
+# a pipeline of gets and getqs, answered in order.
+print $bsock join("", map { bp_get($_ % 2 ? 0x28 : 0x20, $_, "key$_") } (1..20));
+my $inorder = 0;
+for my $i (1..20) {
+    ($opaque, $value) = bp_read_value($bsock);
+    $inorder++ if $opaque == $i && $value eq sprintf("v%05d", $i);
+}
+is($inorder, 20, "binary replies in order");
+
+sub bp_get {
+    my ($cmd, $opaque, $key) = @_;
+    return pack("CCCCNN", 0x50, $cmd, length($key), 0, $opaque, length($key)) . $key;
+}
+
+sub bp_read_value {
+    my $sock = shift;
+    my ($header, $body);
+
+    read($sock, $header, 12) == 12 or return;
+    my ($magic, $cmd, $status, $reserved, $opaque, $length) = unpack("CCCCNN", $header);
+    read($sock, $body, $length) if $length > 0;
+    return ($opaque, substr($body, 4));
+}
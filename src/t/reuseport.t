@@ -0,0 +1,55 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 7;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# every worker listens on sockets of its own.
+my $server = new_memcached("-S -t 4");
+my $sock = $server->sock;
+
+print $sock "set foo 0 0 6\r\nfooval\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored foo");
+
+my @socks = map { $server->new_sock } (1..16);
+is(scalar grep(defined, @socks), 16, "connected many times");
+my $hits = 0;
+for my $s (@socks) {
+    print $s "get foo\r\n";
+}
+for my $s (@socks) {
+    $hits++ if scalar <$s> eq "VALUE foo 0 6\r\n" &&
+        scalar <$s> eq "fooval\r\n" &&
+        scalar <$s> eq "END\r\n";
+}
+is($hits, 16, "every connection is served");
+
+my $stats = mem_stats($sock);
+is($stats->{total_connections} >= 17, 1, "connections were counted");
+
+my $usock = $server->new_udp_sock
+    or die "Can't bind : $@\n";
+my $replies = 0;
+for my $i (1..16) {
+    send($usock, pack("nnnn", $i, 0, 1, 0) . "get foo\r\n", 0);
+    my $rin = '';
+    vec($rin, fileno($usock), 1) = 1;
+    next unless select(my $rout = $rin, undef, undef, 2.0);
+    my $res;
+    $usock->recv($res, 1500, 0);
+    $replies++ if substr($res, 8) eq "VALUE foo 0 6\r\nfooval\r\nEND\r\n";
+}
+is($replies, 16, "udp requests are served");
+
+$stats = mem_stats($sock, "udp");
+my $received = 0;
+$received += $stats->{"thread_${_}_datagrams_received"} for (1..4);
+is($received, 16, "datagrams were read by the workers");
+
+# closing connections leaves the listeners be.
+close($_) for @socks;
+my $s = $server->new_sock;
+print $s "get foo\r\n";
+is(scalar <$s>, "VALUE foo 0 6\r\n", "still listening");
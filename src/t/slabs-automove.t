@@ -0,0 +1,73 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+$ENV{T_MEMD_SLABS_ALLOC} = 0;  # don't preallocate slabs
+
+my $server = new_memcached();
+my $sock = $server->sock;
+if (mem_stats($sock)->{allocator} ne "slab") {
+    plan skip_all => "The slab rebalancer is only in the slab allocator.";
+} else {
+    plan tests => 9;
+}
+
+sub classes {
+    my ($sock, $subcommand) = @_;
+    my %classes;
+
+    my $stats = mem_stats($sock, $subcommand);
+    foreach my $key (keys %$stats) {
+        $classes{$1}{$2} = $stats->{$key} if $key =~ /^(\d+):(\w+)$/;
+    }
+    return (\%classes, $stats);
+}
+
+my ($classes, $stats) = classes($sock, "slabs_rebalance");
+is($stats->{automove_interval}, 0, "rebalancer is off by default");
+is($stats->{automoves}, 0, "no pages moved");
+
+$server = new_memcached("-m 6 -A 1");
+$sock = $server->sock;
+
+# four pages of values that are never read again...
+my $cold = "c" x 400000;
+for my $i (1..8) {
+    print $sock "set cold$i 0 0 400000\r\n$cold\r\n";
+    scalar <$sock>;
+}
+
+# ...leave two pages for values that are read back after they are evicted.
+my $hot = "h" x 180000;
+for my $i (1..30) {
+    print $sock "set hot$i 0 0 180000\r\n$hot\r\n";
+    scalar <$sock>;
+}
+ok(mem_stats($sock)->{evictions} > 0, "evicted hot values");
+
+($classes, $stats) = classes($sock, "slabs");
+my ($cold_id) = grep { $classes->{$_}{chunks_per_page} == 2 } keys %$classes;
+my ($hot_id) = grep { $_ != $cold_id && $classes->{$_}{total_pages} } keys %$classes;
+is($classes->{$cold_id}{total_pages}, 4, "cold values hold four pages");
+is($classes->{$hot_id}{total_pages}, 2, "hot values hold two pages");
+
+for my $i (1..30) {
+    print $sock "get hot$i\r\n";
+    my $line = <$sock>;
+    if ($line =~ /^VALUE/) {
+        scalar <$sock>;
+        scalar <$sock>;
+    }
+}
+
+sleep(2.5);
+($classes, $stats) = classes($sock, "slabs_rebalance");
+ok($stats->{automoves} >= 1, "rebalancer moved a page");
+is($classes->{$hot_id}{pages}, 3, "hot values gained a page");
+is($classes->{$cold_id}{pages}, 3, "cold values gave up a page");
+ok($classes->{$hot_id}{target_pages} >= $classes->{$hot_id}{pages},
+   "hot values are not above their target");
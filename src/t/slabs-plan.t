@@ -0,0 +1,66 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+use File::Temp qw(tempfile);
+
+my $server = new_memcached();
+my $sock = $server->sock;
+if (mem_stats($sock)->{allocator} ne "slab") {
+    plan skip_all => "Slab classes are only in the slab allocator.";
+} else {
+    plan tests => 11;
+}
+
+# three clusters of item sizes, none of which the geometric table fits well.
+sub fill {
+    my $sock = shift;
+    for my $len (240, 2300, 9000) {
+        my $value = "x" x $len;
+        for my $i (1..20) {
+            print $sock "set key$len.$i 0 0 $len\r\n$value\r\n";
+            scalar <$sock>;
+        }
+    }
+}
+
+fill($sock);
+
+my $plan = mem_stats($sock, "slabs_plan");
+is($plan->{items}, 60, "counted the resident items");
+ok(! exists $plan->{profile}, "no profile in use");
+ok($plan->{projected_waste} < $plan->{actual_waste},
+   "planned classes waste less than the geometric table");
+my @planned = map { $plan->{"$_:chunk_size"} } grep { exists $plan->{"$_:chunk_size"} } (1..200);
+ok(scalar(@planned) > 0, "listed the planned classes");
+
+# save the size profile and restart with it.
+my ($fh, $profile) = tempfile(UNLINK => 1);
+print $sock "stats sizes\r\n";
+my %profile_sizes;
+while (my $line = <$sock>) {
+    last if $line =~ /^END/;
+    print $fh $line;
+    $profile_sizes{$1} = 1 if $line =~ /^(\d+) /;
+}
+close($fh);
+is(scalar(keys %profile_sizes), 3, "profile has three sizes");
+
+$server = new_memcached("-z $profile");
+$sock = $server->sock;
+my $stats = mem_stats($sock, "slabs");
+for my $size (sort { $a <=> $b } keys %profile_sizes) {
+    my ($class) = grep { /^(\d+):chunk_size$/ && $stats->{$_} == $size } keys %$stats;
+    ok($class, "a class is sized for $size-byte items");
+}
+
+fill($sock);
+$plan = mem_stats($sock, "slabs_plan");
+is($plan->{profile}, $profile, "reports the profile in use");
+ok($plan->{actual_waste} < 32 * 60, "profiled classes leave little waste");
+
+my $bad = eval { new_memcached("-z /nonexistent/profile") };
+ok(! $bad, "refuses to start without the profile");
@@ -0,0 +1,84 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+$ENV{T_MEMD_SLABS_ALLOC} = 0;  # don't preallocate slabs
+
+my $server = new_memcached("-m 4");
+my $sock = $server->sock;
+my $stats = mem_stats($sock);
+if ($stats->{allocator} ne "slab") {
+    plan skip_all => "Slab reassignment is only in the slab allocator.";
+} else {
+    plan tests => 20;
+}
+
+my $value = "x" x 400000;
+
+sub slabs {
+    my $sock = shift;
+    my %classes;
+
+    my $stats = mem_stats($sock, "slabs");
+    foreach my $key (keys %$stats) {
+        $classes{$1}{$2} = $stats->{$key} if $key =~ /^(\d+):(\w+)$/;
+    }
+    return (\%classes, $stats);
+}
+
+# three pages of two items each.
+for my $i (1..6) {
+    print $sock "set key$i 0 0 400000\r\n$value\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored key$i");
+}
+
+my ($classes) = slabs($sock);
+my ($src) = grep { $classes->{$_}{total_pages} == 3 } keys %$classes;
+ok($src, "found the class holding the items");
+is($classes->{$src}{chunks_per_page}, 2, "two items per page");
+
+# leave one live item on each of the last two pages.  the first page is full,
+# so it is the most valuable one.
+print $sock "delete key3\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted key3");
+print $sock "delete key5\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted key5");
+
+print $sock "slabs reassign $src 1\r\n";
+is(scalar <$sock>, "DONE\r\n", "reassigned a page");
+
+($classes, $stats) = slabs($sock);
+is($classes->{$src}{total_pages}, 2, "source class gave up a page");
+is($stats->{total_rebalance_moved}, 1, "moved the live item");
+is($stats->{total_rebalance_evicted}, 0, "evicted nothing");
+
+my $present = grep { defined(get_value($sock, "key$_")) } (1, 2, 4, 6);
+is($present, 4, "every live item survived");
+
+print $sock "slabs reassign $src 1\r\n";
+is(scalar <$sock>, "CANT\r\n", "destination class is still being filled");
+
+# the source class has no free chunks left, so the next reassign has to evict.
+print $sock "slabs reassign $src 2\r\n";
+is(scalar <$sock>, "DONE\r\n", "reassigned another page");
+
+($classes, $stats) = slabs($sock);
+is($classes->{$src}{total_pages}, 1, "source class gave up another page");
+is($stats->{total_rebalance_evicted}, 2, "evicted the page's items");
+$present = grep { defined(get_value($sock, "key$_")) } (1, 2, 4, 6);
+is($present, 2, "the other page's items survived");
+
+sub get_value {
+    my ($sock, $key) = @_;
+
+    print $sock "get $key\r\n";
+    my $line = <$sock>;
+    return undef unless $line =~ /^VALUE/;
+    my $data = <$sock>;
+    scalar <$sock>;
+    return $data;
+}
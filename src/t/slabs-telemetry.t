@@ -0,0 +1,67 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 9;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+$ENV{T_MEMD_SLABS_ALLOC} = 0;  # don't preallocate slabs
+
+my $server = new_memcached("-m 2");
+my $sock = $server->sock;
+my $flat = mem_stats($sock)->{allocator} ne "slab";
+
+# sums the requested and wasted bytes and the evictions by age over every slab
+# class, or over both kinds of chunk in flat storage.
+sub telemetry {
+    my $sock = shift;
+    my %sum = (requested => 0, wasted => 0, evicted => 0);
+
+    my $stats = mem_stats($sock, $flat ? "flat_allocator" : "slabs");
+    foreach my $key (keys %$stats) {
+        next if $key =~ /^total_/;
+        $sum{requested} += $stats->{$key} if $key =~ /requested_bytes$/;
+        $sum{wasted} += $stats->{$key} if $key =~ /wasted_bytes$/;
+        $sum{evicted} += $stats->{$key} if $key =~ /evicted_age_\d+$/;
+        $sum{tail_age} = $stats->{$key} if $key =~ /:tail_age$|^oldest_item_lifetime$/;
+    }
+    $sum{stats} = $stats;
+    return \%sum;
+}
+
+my $value = "x" x 1000;
+for my $i (10..19) {
+    print $sock "set key$i 0 0 1000\r\n$value\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored key$i") if $i == 10;
+    scalar <$sock> if $i != 10;
+}
+
+my $t = telemetry($sock);
+ok($t->{requested} >= 10 * 1000, "counted the requested bytes");
+ok($t->{wasted} > 0, "counted the wasted bytes");
+ok(defined $t->{tail_age}, "reports the tail age");
+if ($flat) {
+    pass("no per-class totals in flat storage");
+} else {
+    is($t->{stats}{total_requested_bytes}, $t->{requested}, "totals add up the classes");
+}
+
+for my $i (10..14) {
+    print $sock "delete key$i\r\n";
+    scalar <$sock>;
+}
+is(telemetry($sock)->{requested}, $t->{requested} / 2, "deletes give back the requested bytes");
+is($t->{evicted}, 0, "nothing evicted yet");
+
+# overflow the cache.
+$value = "y" x 20000;
+for my $i (1..300) {
+    print $sock "set big$i 0 0 20000\r\n$value\r\n";
+    scalar <$sock>;
+}
+
+my $evictions = mem_stats($sock)->{evictions};
+ok($evictions > 0, "evicted items");
+$t = telemetry($sock);
+is($t->{evicted}, $evictions, "every eviction is in an age histogram");
@@ -30,6 +30,8 @@ my $sock = $server->sock;
 ## STAT get_hits 0
 ## STAT get_misses 0
 ## STAT evictions 0
+## STAT expired_items 0
+## STAT reaped_items 0
 ## STAT bytes_read 7
 ## STAT bytes_written 0
 ## STAT limit_maxbytes 67108864
@@ -37,7 +39,7 @@ my $sock = $server->sock;
 my $stats = mem_stats($sock);
 
 # Test number of keys
-is(scalar(keys(%$stats)), 31, "31 stats values");
+is(scalar(keys(%$stats)), 33, "33 stats values");
 
 # Test initial state
 foreach my $key (qw(curr_items total_items item_total_size cmd_get cmd_set get_hits evictions get_misses bytes_written)) {
@@ -0,0 +1,205 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use IO::Socket::INET;
+use MemcachedTest;
+use File::Temp qw(tempdir);
+
+# world-writable, since the server drops its privileges before it opens the
+# tier file.
+my $dir = tempdir(CLEANUP => 1, DIR => "/tmp");
+chmod 0777, $dir;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+if (mem_stats($sock)->{allocator} ne "slab") {
+    plan skip_all => "The tier is only available with the slab allocator.";
+} else {
+    plan tests => 23;
+}
+my $bport = free_port();
+$server = new_memcached("-m 4 -e $dir/tier -E 4096 -x 64 -n $bport");
+$sock = $server->sock;
+
+my $count = 400;
+my $len = 20000;
+
+sub make_value {
+    my $i = shift;
+    return substr(sprintf("%05d", $i) x ($len / 5 + 1), 0, $len);
+}
+
+sub get_value {
+    my ($sock, $key) = @_;
+
+    print $sock "get $key\r\n";
+    my $line = <$sock>;
+    return undef unless $line =~ /^VALUE \S+ \d+ (\d+)/;
+    my $want = $1;
+    my $data = "";
+    while (length($data) < $want + 2) {
+        read($sock, $data, $want + 2 - length($data), length($data));
+    }
+    scalar <$sock>;
+    return substr($data, 0, $want);
+}
+
+# about twice as much as fits in memory, pipelined.
+for my $i (1..$count) {
+    my $value = make_value($i);
+    print $sock "set key$i 0 0 $len\r\n$value\r\n";
+}
+my $stored = 0;
+for my $i (1..$count) {
+    $stored++ if scalar <$sock> eq "STORED\r\n";
+}
+is($stored, $count, "stored every value");
+
+my $stats = mem_stats($sock, "tier");
+is($stats->{threshold}, 4096, "threshold");
+ok($stats->{spilled_items} > $count / 4, "evicted values were spilled");
+is($stats->{spilled_bytes}, $stats->{spilled_items} * $len, "spilled bytes");
+ok($stats->{flushed} > 0, "some of the log is on disk");
+
+# the oldest values are in the log, and on disk.
+is(get_value($sock, "key1"), make_value(1), "spilled value reads back");
+$stats = mem_stats($sock, "tier");
+is($stats->{reads}, 1, "read from the tier");
+is($stats->{promotions}, 1, "promoted back into memory");
+is(get_value($sock, "key1"), make_value(1), "promoted value reads back");
+is(mem_stats($sock, "tier")->{reads}, 1, "... from memory");
+
+print $sock "delete key2\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted a spilled value");
+is(get_value($sock, "key2"), undef, "it is gone");
+
+print $sock "incr key3 1\r\n";
+is(scalar <$sock>, "1\r\n", "a spilled value counts as 0");
+
+# every value comes back, whether it is in memory or in the tier, several to
+# a request.
+my $bad = 0;
+for (my $i = 4; $i <= $count; $i += 4) {
+    my @keys = map { "key$_" } ($i .. ($i + 3 > $count ? $count : $i + 3));
+    print $sock "get @keys\r\n";
+    for my $key (@keys) {
+        my $line = <$sock>;
+        unless ($line =~ /^VALUE (\S+) \d+ (\d+)/) {
+            $bad++;
+            last;
+        }
+        my ($got_key, $want) = ($1, $2);
+        my $data = "";
+        while (length($data) < $want + 2) {
+            read($sock, $data, $want + 2 - length($data), length($data));
+        }
+        $got_key =~ /^key(\d+)$/;
+        $bad++ unless substr($data, 0, $want) eq make_value($1);
+    }
+    $bad++ unless scalar <$sock> eq "END\r\n";
+}
+is($bad, 0, "every value reads back");
+
+$stats = mem_stats($sock, "tier");
+is($stats->{read_failures}, 0, "no reads failed");
+
+# a udp socket can't wait for a value to be read back, so a hit on a stub
+# there is a miss.
+my $usock = $server->new_udp_sock;
+my $udp_misses = 0;
+for my $i (4..$count) {
+    my $reply = udp_get($usock, $i, "key$i");
+    $udp_misses++ if defined $reply && $reply eq "END\r\n";
+}
+ok($udp_misses > 0, "udp hits on stubs are misses");
+$stats = mem_stats($sock, "tier");
+is($stats->{udp_misses}, $udp_misses, "... and counted");
+my $reads = $stats->{reads};
+
+# the binary protocol reads values back the same way as the text protocol,
+# quiet gets included.
+my $bsock = IO::Socket::INET->new(PeerAddr => "127.0.0.1:$bport")
+    or die "can't connect to the binary port: $!\n";
+$bad = 0;
+for (my $i = 4; $i <= $count; $i += 4) {
+    my @ids = ($i .. ($i + 3 > $count ? $count : $i + 3));
+    print $bsock join("", map { bp_get($_ == $ids[-1] ? 0x20 : 0x28, $_, "key$_") } @ids);
+    for my $id (@ids) {
+        my ($opaque, $value) = bp_read_value($bsock);
+        $bad++ unless defined $opaque && $opaque == $id && $value eq make_value($id);
+    }
+}
+is($bad, 0, "every value reads back over the binary protocol");
+$stats = mem_stats($sock, "tier");
+ok($stats->{reads} > $reads, "... some of them from the tier");
+is($stats->{read_failures}, 0, "no reads failed");
+
+# values are copied to the log without the cache lock.  spill from several
+# connections at once, and make sure no value comes back torn.
+my @socks = map { $server->new_sock } (1..4);
+for my $i (1..$count) {
+    for my $c (0..$#socks) {
+        my $value = make_value($i + $c);
+        print { $socks[$c] } "set par$c.$i 0 0 $len\r\n$value\r\n";
+    }
+}
+$stored = 0;
+for my $c (0..$#socks) {
+    for my $i (1..$count) {
+        $stored++ if readline($socks[$c]) eq "STORED\r\n";
+    }
+}
+is($stored, $count * @socks, "stored every value from every connection");
+
+my ($hits, $torn) = (0, 0);
+for my $c (0..$#socks) {
+    for my $i (1..$count) {
+        my $value = get_value($sock, "par$c.$i");
+        next unless defined $value;
+        $hits++;
+        $torn++ unless $value eq make_value($i + $c);
+    }
+}
+ok($hits > $count * @socks / 2, "most values read back");
+is($torn, 0, "none of them torn");
+
+sub udp_get {
+    my ($sock, $id, $key) = @_;
+    my ($first, $numpkts, $got) = (undef, undef, 0);
+
+    send($sock, pack("nnnn", $id, 0, 1, 0) . "get $key\r\n", 0) or return;
+    while (!defined($numpkts) || $got < $numpkts) {
+        my $rin = '';
+        vec($rin, fileno($sock), 1) = 1;
+        return unless select(my $rout = $rin, undef, undef, 1.5);
+
+        my $res;
+        $sock->recv($res, 1500, 0);
+        my ($resid, $seq, $this_numpkts) = unpack("nnn", substr($res, 0, 6));
+        next unless $resid == $id;
+        $numpkts = $this_numpkts;
+        $first = substr($res, 8) if $seq == 0;
+        $got++;
+    }
+    return $first;
+}
+
+sub bp_get {
+    my ($cmd, $opaque, $key) = @_;
+    return pack("CCCCNN", 0x50, $cmd, length($key), 0, $opaque, length($key)) . $key;
+}
+
+sub bp_read_value {
+    my $sock = shift;
+    my ($header, $body) = ("", "");
+
+    read($sock, $header, 12) == 12 or return;
+    my ($magic, $cmd, $status, $reserved, $opaque, $length) = unpack("CCCCNN", $header);
+    while (length($body) < $length) {
+        read($sock, $body, $length - length($body), length($body)) or return;
+    }
+    return ($opaque, substr($body, 4));
+}
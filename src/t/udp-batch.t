@@ -0,0 +1,106 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 13;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# one worker, so every datagram is read by the same thread.
+my $server = new_memcached("-t 1 -B 16");
+my $sock = $server->sock;
+my $usock = $server->new_udp_sock
+    or die "Can't bind : $@\n";
+
+my $count = 100;
+for my $i (1..$count) {
+    printf $sock "set key%d 0 0 6\r\nv%05d\r\n", $i, $i;
+}
+my $stored = 0;
+for my $i (1..$count) {
+    $stored++ if scalar <$sock> eq "STORED\r\n";
+}
+is($stored, $count, "stored the keys");
+
+# a burst of requests, all sent before any reply is read.
+for my $i (1..$count) {
+    send($usock, pack("nnnn", $i, 0, 1, 0) . "get key$i\r\n", 0);
+}
+
+my %replies;
+while (keys %replies < $count) {
+    my $rin = '';
+    vec($rin, fileno($usock), 1) = 1;
+    last unless select(my $rout = $rin, undef, undef, 2.0);
+
+    my $res;
+    $usock->recv($res, 1500, 0);
+    my ($id) = unpack("n", $res);
+    $replies{$id} = substr($res, 8);
+}
+is(scalar keys %replies, $count, "a reply to every request");
+is(scalar grep({ $replies{$_} eq sprintf("VALUE key%d 0 6\r\nv%05d\r\nEND\r\n", $_, $_) }
+               keys %replies),
+   $count, "each reply answers its own request");
+
+my $stats = mem_stats($sock, "udp");
+is($stats->{thread_1_datagrams_received}, $count, "every datagram was counted");
+ok($stats->{thread_1_recv_calls} > 0 &&
+   $stats->{thread_1_recv_calls} <= $count, "... by no more receives than datagrams");
+ok($stats->{thread_1_recv_batch_avg} >= 1, "average receive batch");
+is($stats->{thread_1_packets_sent}, $count, "one packet per reply");
+is($stats->{thread_1_send_calls}, $stats->{thread_1_recv_calls},
+   "the replies to each receive sent together");
+
+# a reply several packets long is sent with one call.
+my $big = "abcd" x 1024;
+print $sock "set big 0 0 " . length($big) . "\r\n$big\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored big");
+
+send($usock, pack("nnnn", 999, 0, 1, 0) . "get big\r\n", 0);
+my $packets = 0;
+while ($packets < 3) {
+    my $rin = '';
+    vec($rin, fileno($usock), 1) = 1;
+    last unless select(my $rout = $rin, undef, undef, 2.0);
+    my $res;
+    $usock->recv($res, 1500, 0);
+    $packets++;
+}
+is($packets, 3, "three packet response");
+
+$stats = mem_stats($sock, "udp");
+ok($stats->{thread_1_send_batch_avg} > 1, "sent in batches");
+
+# a burst of requests from two clients, some with replies of several packets
+# or errors: each reply goes to its own client, with its own headers.
+my @usocks = ($usock, $server->new_udp_sock);
+my %expect;
+for my $i (1..40) {
+    my $req = ("get key$i\r\n", "get nokey$i\r\n", "bogus\r\n", "get big\r\n")[$i % 4];
+    send($usocks[$i % 2], pack("nnnn", $i, 0, 1, 0) . $req, 0);
+    $expect{$i} = ($i % 4 == 0) ? "VALUE key$i 0 6\r\n" . sprintf("v%05d", $i) . "\r\nEND\r\n" :
+        ($i % 4 == 1) ? "END\r\n" :
+        ($i % 4 == 2) ? "ERROR\r\n" : "VALUE big 0 " . length($big) . "\r\n$big\r\nEND\r\n";
+}
+
+my (%packets, $misrouted);
+for my $s (0, 1) {
+    for (;;) {
+        my $rin = '';
+        vec($rin, fileno($usocks[$s]), 1) = 1;
+        last unless select(my $rout = $rin, undef, undef, 1.0);
+
+        my $res;
+        $usocks[$s]->recv($res, 1500, 0);
+        my ($id, $seq, $total) = unpack("nnn", $res);
+        $misrouted++ if $id % 2 != $s;
+        $packets{$id}[$seq] = substr($res, 8);
+        $#{$packets{$id}} = $total - 1 if $total > @{$packets{$id}};
+    }
+}
+ok(! $misrouted, "each reply went to its own client");
+is(scalar grep({ defined $packets{$_} &&
+                 join("", map { defined $_ ? $_ : "?" } @{$packets{$_}}) eq $expect{$_} }
+               keys %expect),
+   40, "each reply whole, in its own sequence");
@@ -0,0 +1,105 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 16;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+my $usock = $server->new_udp_sock
+    or die "Can't bind : $@\n";
+
+print $sock "set foo 0 0 6\r\nfooval\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored foo");
+
+# a request split in three, sent out of order.
+send_packets($usock, 10, "get f", "o", "o\r\n", [2, 0, 1]);
+is(read_reply($usock, 10), "VALUE foo 0 6\r\nfooval\r\nEND\r\n", "reassembled get");
+
+# a multiget far bigger than a packet.
+my $count = 300;
+for my $i (1..$count) {
+    printf $sock "set key_with_a_long_name_%d 0 0 6\r\nv%05d\r\n", $i, $i;
+}
+my $stored = 0;
+for my $i (1..$count) {
+    $stored++ if scalar <$sock> eq "STORED\r\n";
+}
+is($stored, $count, "stored the keys");
+
+my $req = "get " . join(" ", map { "key_with_a_long_name_$_" } (1..$count)) . "\r\n";
+my @pieces = unpack("(a1000)*", $req);
+ok(@pieces > 5, "request spans " . scalar(@pieces) . " packets");
+send_packets($usock, 11, @pieces, [0..$#pieces]);
+my $expected = join("", map { sprintf("VALUE key_with_a_long_name_%d 0 6\r\nv%05d\r\n", $_, $_) }
+                        (1..$count)) . "END\r\n";
+is(read_reply($usock, 11), $expected, "reassembled multiget");
+
+# a duplicate packet is dropped; the request still completes.
+send_packets($usock, 12, "get f", "oo\r\n", [0, 0, 1]);
+is(read_reply($usock, 12), "VALUE foo 0 6\r\nfooval\r\nEND\r\n", "duplicate packet ignored");
+
+my $stats = mem_stats($sock, "udp");
+is($stats->{reassembled_requests}, 3, "three requests reassembled");
+is($stats->{reassembly_dropped}, 1, "one packet dropped");
+is($stats->{reassembly_pending}, 0, "nothing pending");
+is($stats->{reassembly_bytes}, 0, "no memory held");
+
+# a request that never completes times out.
+send_packets($usock, 13, "get f", "oo\r\n", [0]);
+sleep(4);
+send_packets($usock, 14, "get f", "oo\r\n", [1, 0]);
+is(read_reply($usock, 14), "VALUE foo 0 6\r\nfooval\r\nEND\r\n", "later request");
+$stats = mem_stats($sock, "udp");
+is($stats->{reassembly_timeouts}, 1, "the incomplete request timed out");
+is($stats->{reassembly_pending}, 0, "and was dropped");
+
+# with reassembly off, multi-packet requests are refused.
+my $server2 = new_memcached("-K 0");
+my $usock2 = $server2->new_udp_sock
+    or die "Can't bind : $@\n";
+send_packets($usock2, 15, "get f", "oo\r\n", [0]);
+is(read_reply($usock2, 15), "SERVER_ERROR multi-packet request not supported\r\n",
+   "refused without reassembly");
+
+# the datagrams of the largest batch leave no room to put a request together.
+my $bad = eval { new_memcached("-B 255") };
+ok(! $bad, "refuses a batch that leaves no room for reassembly");
+my $good = eval { new_memcached("-B 255 -K 0") };
+ok($good, "unless reassembly is off");
+
+# sends the pieces of a request as the packets given by the sequence numbers
+# in the trailing array ref.
+sub send_packets {
+    my $sock = shift;
+    my $reqid = shift;
+    my $order = pop;
+    my @pieces = @_;
+
+    for my $seq (@$order) {
+        send($sock, pack("nnnn", $reqid, $seq, scalar(@pieces), 0) . $pieces[$seq], 0);
+    }
+}
+
+# returns the payload of a reply, put back together.
+sub read_reply {
+    my ($sock, $reqid) = @_;
+    my %packets;
+    my $numpkts;
+
+    while (!defined($numpkts) || keys %packets < $numpkts) {
+        my $rin = '';
+        vec($rin, fileno($sock), 1) = 1;
+        return undef unless select(my $rout = $rin, undef, undef, 2.0);
+
+        my $res;
+        $sock->recv($res, 1500, 0);
+        my ($resid, $seq, $this_numpkts) = unpack("nnn", $res);
+        next unless $resid == $reqid;
+        $numpkts = $this_numpkts;
+        $packets{$seq} = substr($res, 8);
+    }
+    return join("", map { $packets{$_} } sort { $a <=> $b } keys %packets);
+}
@@ -0,0 +1,90 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 14;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use IO::Select;
+use MemcachedTest;
+
+my $server = new_memcached("-q -t 2");
+my $sock = $server->sock;
+
+my $stats = mem_stats($sock, "uring");
+ok(defined($stats->{thread_1_enabled}), "uring stats");
+
+SKIP: {
+    skip "io_uring isn't available", 13 unless $stats->{thread_1_enabled};
+
+    print $sock "set foo 0 0 6\r\nfooval\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored foo");
+    mem_get_is($sock, "foo", "fooval");
+
+    # pipelined requests, many receive buffers' worth.
+    my $count = 200;
+    my $value = "x" x 1000;
+    print $sock join("", map { "set key$_ 0 0 " . length($value) . "\r\n$value\r\n" } (1..$count));
+    my $stored = 0;
+    for my $i (1..$count) {
+        $stored++ if scalar <$sock> eq "STORED\r\n";
+    }
+    is($stored, $count, "pipelined sets");
+
+    print $sock join("", map { "get key$_\r\n" } (1..$count));
+    my $hits = 0;
+    for my $i (1..$count) {
+        $hits++ if scalar <$sock> eq "VALUE key$i 0 1000\r\n" &&
+            scalar <$sock> eq "$value\r\n" &&
+            scalar <$sock> eq "END\r\n";
+    }
+    is($hits, $count, "pipelined gets");
+
+    # a value bigger than the socket buffers, both ways.
+    my $big = "abcdefgh" x (100 * 1024);
+    print $sock "set big 0 0 " . length($big) . "\r\n$big\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored big");
+    print $sock "get big\r\n";
+    my $line = <$sock>;
+    my $data;
+    read($sock, $data, length($big) + 2);
+    ok($line eq "VALUE big 0 " . length($big) . "\r\n" && $data eq "$big\r\n", "got big");
+    is(scalar <$sock>, "END\r\n", "and the end");
+
+    # connections on both threads, some dropped with requests outstanding.
+    my @socks = map { $server->new_sock } (1..6);
+    for my $s (@socks[0..2]) {
+        print $s "get big\r\n";
+        close($s);
+    }
+    my $served = 0;
+    for my $s (@socks[3..5]) {
+        print $s "get foo\r\n";
+        $served++ if scalar <$s> eq "VALUE foo 0 6\r\n" &&
+            scalar <$s> eq "fooval\r\n" &&
+            scalar <$s> eq "END\r\n";
+    }
+    is($served, 3, "every connection served");
+
+    $stats = mem_stats($sock, "uring");
+    ok($stats->{thread_1_recvs} + $stats->{thread_2_recvs} > 0, "received through the rings");
+    ok($stats->{thread_1_sends} + $stats->{thread_2_sends} > 0, "sent through the rings");
+
+    # a client that pipelines gets without reading the replies holds only a
+    # few of the thread's receive buffers; the others are still served.
+    my $server2 = new_memcached("-q -t 1");
+    $sock = $server2->sock;
+    print $sock "set big 0 0 " . length($big) . "\r\n$big\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored big");
+    my $hog = $server2->new_sock;
+    $hog->blocking(0);
+    my $gets = "get big\r\n" x 4000;
+    for (1..400) {
+        syswrite($hog, $gets);
+        select(undef, undef, undef, 0.005);
+    }
+    print $sock "version\r\n";
+    my $answered = IO::Select->new($sock)->can_read(5) && scalar <$sock> =~ /^VERSION /;
+    ok($answered, "served beside a client that doesn't read");
+    $stats = $answered ? mem_stats($sock, "uring") : {};
+    ok($stats->{thread_1_recv_pauses} > 0, "receives paused");
+}
@@ -0,0 +1,112 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 15;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use IO::Socket::INET;
+use MemcachedTest;
+
+my $bport = free_port();
+my $server = new_memcached("-W 16384 -t 1 -n $bport");
+my $sock = $server->sock;
+
+my $big = join("", map { chr(ord("a") + $_ % 26) } (1..200000));
+my $big2 = "Z" x 100000;
+
+print $sock "set big 0 0 " . length($big) . "\r\n$big\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored a large value");
+print $sock "set big2 0 0 " . length($big2) . "\r\n$big2\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored another");
+print $sock "set small 0 0 5\r\nhello\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored a small value");
+
+sub read_value {
+    my ($sock, $key, $len) = @_;
+    my ($header, $data);
+
+    $header = <$sock>;
+    return undef unless $header eq "VALUE $key 0 $len\r\n";
+    read($sock, $data, $len + 2);
+    return substr($data, 0, $len);
+}
+
+# the kernel reads a zerocopy send's completion off the socket's error
+# queue some time after the send.
+sub settled_stats {
+    my $sock = shift;
+    my $stats;
+
+    for (1..50) {
+        $stats = mem_stats($sock, "tcp");
+        last if $stats->{thread_1_zerocopy_pinned} == 0;
+        select(undef, undef, undef, 0.1);
+    }
+    return $stats;
+}
+
+print $sock "get big\r\n";
+is(read_value($sock, "big", length($big)), $big, "large value");
+is(scalar <$sock>, "END\r\n", "end");
+
+my $stats = settled_stats($sock);
+is($stats->{zerocopy_min}, 16384, "zerocopy_min");
+ok($stats->{thread_1_zerocopy_sends} > 0, "sent without a copy");
+is($stats->{thread_1_zerocopy_pinned}, 0, "items released");
+
+# on loopback the kernel copies anyway, and says so; the connection stops
+# asking.
+ok($stats->{thread_1_zerocopy_copied} > 0, "the kernel copied");
+my $sends = $stats->{thread_1_zerocopy_sends};
+print $sock "get big\r\n";
+read_value($sock, "big", length($big));
+<$sock>;
+$stats = settled_stats($sock);
+is($stats->{thread_1_zerocopy_sends}, $sends, "copied values go out as usual");
+
+# a fresh connection, with small and large values pipelined together.
+my $sock2 = $server->new_sock;
+print $sock2 "get small big big2\r\nget big2 small\r\nget big\r\n";
+my $ok = read_value($sock2, "small", 5) eq "hello" &&
+    read_value($sock2, "big", length($big)) eq $big &&
+    read_value($sock2, "big2", length($big2)) eq $big2 &&
+    scalar <$sock2> eq "END\r\n" &&
+    read_value($sock2, "big2", length($big2)) eq $big2 &&
+    read_value($sock2, "small", 5) eq "hello" &&
+    scalar <$sock2> eq "END\r\n" &&
+    read_value($sock2, "big", length($big)) eq $big &&
+    scalar <$sock2> eq "END\r\n";
+ok($ok, "pipelined large and small values");
+
+# the binary protocol.
+my $bsock = IO::Socket::INET->new(PeerAddr => "127.0.0.1:$bport")
+    or die "can't connect to the binary port: $!\n";
+print $bsock pack("CCCCNN", 0x50, 0x20, 3, 0, 7, 3) . "big";
+my ($header, $body);
+read($bsock, $header, 12);
+my ($magic, $cmd, $status, $reserved, $opaque, $length) = unpack("CCCCNN", $header);
+my $got = 0;
+while ($got < $length) {
+    my $n = read($bsock, $body, $length - $got, $got);
+    last unless $n;
+    $got += $n;
+}
+is(substr($body, 4), $big, "large value over the binary protocol");
+
+# a connection closed before its reply is read.
+my $sock3 = $server->new_sock;
+print $sock3 "get big big2 big\r\n";
+close($sock3);
+$stats = settled_stats($sock);
+is($stats->{thread_1_zerocopy_pinned}, 0, "items released after a close");
+
+# without -W nothing is sent that way.
+my $server2 = new_memcached("-t 1");
+my $sock4 = $server2->sock;
+print $sock4 "set big 0 0 " . length($big) . "\r\n$big\r\n";
+<$sock4>;
+print $sock4 "get big\r\n";
+is(read_value($sock4, "big", length($big)), $big, "large value without -W");
+<$sock4>;
+$stats = mem_stats($sock4, "tcp");
+is($stats->{thread_1_zerocopy_sends}, 0, "no zerocopy sends without -W");
@@ -14,12 +14,16 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
+#include <time.h>
 
 #include "memcached.h"
 #include "assoc.h"
 #include "items.h"
 #include "stats.h"
 #include "conn_buffer.h"
+#include "expiry.h"
+#include "tier.h"
 
 #define ITEMS_PER_ALLOC 64
 
@@ -73,6 +77,22 @@ static pthread_mutex_t cqi_freelist_lock;
  * Each libevent instance has a wakeup pipe, which other threads
  * can use to signal that they've put a new connection on its queue.
  */
+/*
+ * The busy-polling of a worker thread, with -y.  Only the thread itself
+ * writes these.
+ */
+typedef struct {
+    uint64_t events;            /* events handled, so that a spin can tell
+                                 * whether it found any */
+    uint64_t polls;             /* passes over the events that didn't wait */
+    uint64_t spin_ns;           /* time in those that found nothing */
+    uint64_t sleeps;            /* waits for events once the spin budget ran
+                                 * out... */
+    uint64_t sleep_ns;          /* ... and the time in them */
+    uint64_t sleep_start;       /* when the current wait began; 0 if the
+                                 * thread isn't waiting */
+} busy_poll_t;
+
 typedef struct {
     pthread_t thread_id;        /* unique ID of this thread */
     struct event_base *base;    /* libevent handle this thread uses */
@@ -82,6 +102,21 @@ typedef struct {
     int notify_receive_fd;      /* receiving end of notify pipe */
     int notify_send_fd;         /* sending end of notify pipe */
     CQ  new_conn_queue;         /* queue of new connections to handle */
+    conn_arena_t arena;         /* scratch memory for requests that outgrow
+                                 * their connection's buffers */
+    uring_t *uring;             /* the ring for connections' socket i/o, with
+                                 * -q */
+    conn *listen_conn;          /* the thread's own listeners, with -S */
+    conn *listen_binary_conn;
+    busy_poll_t busy_poll;
+    conn *conns;                /* the thread's tcp connections... */
+    conn_sweep_t conn_sweep;    /* ... and what they held as of the last
+                                 * sweep over them */
+#if defined(USE_SLAB_ALLOCATOR)
+    tier_io_t *tier_done;       /* finished tier reads for this thread's
+                                 * connections */
+    pthread_mutex_t tier_lock;
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
 } LIBEVENT_THREAD;
 
 static LIBEVENT_THREAD *threads;
@@ -278,18 +313,89 @@ static void setup_thread(LIBEVENT_THREAD *me) {
     }
 
     cq_init(&me->new_conn_queue);
+    conn_arena_init(&me->arena);
     me->timer_initialized = false;
+#if defined(USE_SLAB_ALLOCATOR)
+    me->tier_done = NULL;
+    pthread_mutex_init(&me->tier_lock, NULL);
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
 }
 
 /*
  * Worker thread: main event loop
  */
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Counts an event of a busy-polling thread.  A wait that the event ends is
+ * counted before it is handled, so that what the handler reports includes it.
+ */
+static void busy_poll_event(busy_poll_t *bp) {
+    bp->events++;
+    if (bp->sleep_start != 0) {
+        bp->sleep_ns += monotonic_ns() - bp->sleep_start;
+        bp->sleep_start = 0;
+    }
+}
+
+/*
+ * Runs a worker's events, spinning over them without waiting for as long as
+ * they keep coming within settings.busy_poll_usec of each other.  Once they
+ * stop, the thread waits in the kernel for the next one as usual.
+ */
+static int worker_busy_poll(LIBEVENT_THREAD *me) {
+    busy_poll_t *bp = &me->busy_poll;
+    uint64_t budget = (uint64_t) settings.busy_poll_usec * 1000;
+    uint64_t events, start, now, last_event;
+    int rc;
+
+    now = last_event = monotonic_ns();
+    for (;;) {
+        events = bp->events;
+        start = now;
+        if ((rc = event_base_loop(me->base, EVLOOP_NONBLOCK)) != 0) {
+            return rc;
+        }
+        now = monotonic_ns();
+        bp->polls++;
+
+        if (bp->events != events) {
+            last_event = now;
+            continue;
+        }
+        bp->spin_ns += now - start;
+        if (now - last_event < budget) {
+            /* let whatever else wants this cpu have it for a moment. */
+            sched_yield();
+            continue;
+        }
+
+        bp->sleeps++;
+        bp->sleep_start = now;
+        if ((rc = event_base_loop(me->base, EVLOOP_ONCE)) != 0) {
+            return rc;
+        }
+        now = last_event = monotonic_ns();
+        if (bp->sleep_start != 0) {
+            /* woken by the clock, which isn't counted as an event. */
+            bp->sleep_ns += now - bp->sleep_start;
+            bp->sleep_start = 0;
+        }
+    }
+}
+
 static void *worker_libevent(void *arg) {
     LIBEVENT_THREAD *me = arg;
 
     /* Any per-thread setup can happen here; thread_init() will block until
      * all threads have finished initializing.
      */
+    me->thread_id = pthread_self();
 
     pthread_mutex_lock(&init_lock);
     init_count++;
@@ -298,22 +404,46 @@ static void *worker_libevent(void *arg) {
     STATS_SET_TLS(me - threads); /* set thread specific stats structure */
     clock_handler(0, 0, me);
 
+    if (settings.busy_poll_usec > 0) {
+        return (void*) (intptr_t) worker_busy_poll(me);
+    }
     return (void*) (intptr_t) event_base_loop(me->base, 0);
 }
 
 
 /*
- * Processes an incoming "handle a new connection" item. This is called when
- * input arrives on the libevent wakeup pipe.
+ * Processes an incoming "handle a new connection" item, or a "tier reads are
+ * done" notice. This is called when input arrives on the libevent wakeup
+ * pipe.
  */
 static void thread_libevent_process(int fd, short which, void *arg) {
     LIBEVENT_THREAD *me = arg;
     CQ_ITEM *item;
     char buf[1];
 
-    if (read(fd, buf, 1) != 1)
+    if (read(fd, buf, 1) != 1) {
         if (settings.verbose > 0)
             fprintf(stderr, "Can't read from libevent pipe\n");
+        return;
+    }
+    busy_poll_event(&me->busy_poll);
+
+#if defined(USE_SLAB_ALLOCATOR)
+    if (buf[0] == 't') {
+        tier_io_t *io, *next;
+
+        pthread_mutex_lock(&me->tier_lock);
+        io = me->tier_done;
+        me->tier_done = NULL;
+        pthread_mutex_unlock(&me->tier_lock);
+
+        for (; io != NULL; io = next) {
+            next = io->next;
+            conn_tier_done(io->arg, io);
+        }
+        return;
+    }
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
 
     item = cq_peek(&me->new_conn_queue);
 
@@ -323,8 +453,9 @@ static void thread_libevent_process(int fd, short which, void *arg) {
                            item->is_binary, &item->addr, item->addrlen,
                            me->base);
         if (c == NULL) {
-            if (item->is_udp) {
-                fprintf(stderr, "Can't listen for events on UDP socket\n");
+            if (item->is_udp || item->init_state == conn_listening) {
+                fprintf(stderr, "Can't listen for events on %s socket\n",
+                        item->is_udp ? "UDP" : "TCP");
                 exit(1);
             } else {
                 if (settings.verbose > 0) {
@@ -333,6 +464,12 @@ static void thread_libevent_process(int fd, short which, void *arg) {
                 }
                 close(item->sfd);
             }
+        } else if (item->init_state == conn_listening) {
+            if (item->is_binary) {
+                me->listen_binary_conn = c;
+            } else {
+                me->listen_conn = c;
+            }
         }
         cqi_free(item);
     }
@@ -377,6 +514,121 @@ void dispatch_conn_new(int sfd, int init_state, int event_flags,
     }
 }
 
+/*
+ * Returns the calling worker thread's own listening connection, if it has
+ * one.
+ */
+conn* thread_listen_conn(const bool binary) {
+    int i;
+
+    for (i = 1; i < settings.num_threads; i++) {
+        if (pthread_equal(threads[i].thread_id, pthread_self())) {
+            return binary ? threads[i].listen_binary_conn : threads[i].listen_conn;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Returns the scratch arena of the thread that runs an event base.
+ */
+conn_arena_t* thread_conn_arena(struct event_base *base) {
+    int i;
+
+    for (i = 0; i < settings.num_threads; i++) {
+        if (threads[i].base == base) {
+            return &threads[i].arena;
+        }
+    }
+    assert(0);
+    return NULL;
+}
+
+/*
+ * Returns the list of tcp connections of the worker thread that runs an
+ * event base, or NULL if it isn't a worker's.
+ */
+conn** thread_conn_list(struct event_base *base) {
+    int i;
+
+    for (i = 1; i < settings.num_threads; i++) {
+        if (threads[i].base == base) {
+            return &threads[i].conns;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Sweeps a worker thread's tcp connections for idle ones.  Closing one takes
+ * it off the list.
+ */
+static void thread_sweep_conns(LIBEVENT_THREAD *me) {
+    conn_sweep_t sweep;
+    conn *c, *next;
+
+    memset(&sweep, 0, sizeof(sweep));
+    for (c = me->conns; c != NULL; c = next) {
+        next = c->next_conn;
+        conn_sweep(c, &sweep);
+    }
+    me->conn_sweep = sweep;
+}
+
+/*
+ * Returns the ring of the thread that runs an event base, or NULL if it has
+ * none.
+ */
+uring_t* thread_uring(struct event_base *base) {
+    int i;
+
+    for (i = 1; i < settings.num_threads; i++) {
+        if (threads[i].base == base) {
+            return threads[i].uring;
+        }
+    }
+    return NULL;
+}
+
+#if defined(USE_SLAB_ALLOCATOR)
+/*
+ * Called on a tier i/o thread when a read is done.  Hands it back to the
+ * thread that owns the connection.
+ */
+static void tier_read_complete(tier_io_t *io) {
+    LIBEVENT_THREAD *thread = io->owner;
+
+    pthread_mutex_lock(&thread->tier_lock);
+    io->next = thread->tier_done;
+    thread->tier_done = io;
+    pthread_mutex_unlock(&thread->tier_lock);
+
+    if (write(thread->notify_send_fd, "t", 1) != 1) {
+        perror("Writing to thread notify pipe");
+    }
+}
+
+/*
+ * Queues a read from the tier on behalf of a connection.  conn_tier_done(..)
+ * is called on the connection's thread once it is done.
+ */
+void dispatch_tier_read(conn *c, tier_io_t *io) {
+    int i;
+
+    for (i = 0; i < settings.num_threads; i++) {
+        if (threads[i].base == c->event.ev_base) {
+            break;
+        }
+    }
+    assert(i < settings.num_threads);
+
+    io->owner = &threads[i];
+    io->arg = c;
+    io->complete = tier_read_complete;
+    tier_submit(io);
+}
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
+
 /*
  * Returns true if this is the thread that listens for new TCP connections.
  */
@@ -403,9 +655,24 @@ void mt_clock_handler(int fd, short which, void *arg)
     event_base_set(me->base, &me->timer_event);
     evtimer_add(&me->timer_event, &t);
 
-    /* Only update the current time on the main thread */
+    /* Only update the current time and reap expired items on the main
+     * thread */
     if ((me - threads) == 0) {
         set_current_time();
+        expiry_reap();
+    } else {
+        thread_sweep_conns(me);
+        if (settings.reuseport) {
+            /* a listener paused because we ran out of file descriptors may
+             * have no connections of its own whose closing would resume
+             * it. */
+            if (me->listen_conn != NULL) {
+                accept_new_conns(true, false);
+            }
+            if (me->listen_binary_conn != NULL) {
+                accept_new_conns(true, true);
+            }
+        }
     }
     update_stats();
 }
@@ -427,9 +694,27 @@ void mt_run_deferred_deletes() {
  */
 item *mt_item_alloc(char *key, size_t nkey, int flags, rel_time_t exptime, int nbytes, const struct in_addr addr) {
     item *it;
+#if defined(USE_SLAB_ALLOCATOR)
+    item *victim;
+    tier_ptr_t ptr;
+    bool spilled;
+
+    /* the value of a victim that goes to the tier is copied out without the
+     * lock, and then the victim is evicted. */
+    pthread_mutex_lock(&cache_lock);
+    while ((it = do_item_alloc_spill(key, nkey, flags, exptime, nbytes, addr, &victim)) == NULL &&
+           victim != NULL) {
+        pthread_mutex_unlock(&cache_lock);
+        spilled = tier_write(victim, &ptr);
+        pthread_mutex_lock(&cache_lock);
+        do_item_spilled(victim, spilled ? &ptr : NULL, key);
+    }
+    pthread_mutex_unlock(&cache_lock);
+#else
     pthread_mutex_lock(&cache_lock);
     it = do_item_alloc(key, nkey, flags, exptime, nbytes, addr);
     pthread_mutex_unlock(&cache_lock);
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
     return it;
 }
 
@@ -485,6 +770,33 @@ int mt_defer_delete(item *item, time_t exptime) {
     return ret;
 }
 
+/*
+ * Counts a fetch of a key towards its admission filter estimate.
+ */
+void mt_admission_record(const char* key, const size_t nkey) {
+    pthread_mutex_lock(&cache_lock);
+    do_admission_record(key, nkey);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void mt_admission_stats(admission_stats_t* out) {
+    pthread_mutex_lock(&cache_lock);
+    do_admission_stats(out);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+/*
+ * Unlinks items whose expiration time has passed.
+ */
+int mt_expiry_reap() {
+    int ret;
+
+    pthread_mutex_lock(&cache_lock);
+    ret = do_expiry_reap();
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+
 /*
  * Does arithmetic on a numeric item value.
  */
@@ -543,8 +855,29 @@ char *mt_item_stats(int *bytes) {
     pthread_mutex_unlock(&cache_lock);
     return ret;
 }
+
+/*
+ * Compares the current slab classes with ones planned from the resident items
+ */
+char *mt_item_slabs_plan(int *bytes) {
+    char *ret;
+
+    pthread_mutex_lock(&cache_lock);
+    ret = do_item_slabs_plan(bytes);
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
 #endif /* #if defined(USE_SLAB_ALLOCATOR) */
 
+/*
+ * Copies out the segmented LRU counters
+ */
+void mt_item_lru_stats(lru_stats_t *lru_stats) {
+    pthread_mutex_lock(&cache_lock);
+    do_item_lru_stats(lru_stats);
+    pthread_mutex_unlock(&cache_lock);
+}
+
 /*
  * Dumps a list of objects of each size in 32-byte increments
  */
@@ -576,6 +909,117 @@ size_t mt_append_thread_stats(char* const buffer_start,
     return off;
 }
 
+/*
+ * The arena counters are only written by the thread that owns the arena, and
+ * are read here without a lock; they may be a request or so out of date.
+ */
+size_t mt_append_arena_stats(char* const buffer_start,
+                             const size_t buffer_size,
+                             const size_t buffer_off,
+                             const size_t reserved) {
+    int ix;
+    size_t off = buffer_off;
+
+    for (ix = 1; ix < settings.num_threads; ix++) {
+        conn_arena_t *arena = &threads[ix].arena;
+
+        off = append_to_buffer(buffer_start, buffer_size, off, reserved,
+                               "STAT thread_%d_high_water %lu\r\n"
+                               "STAT thread_%d_in_use %lu\r\n"
+                               "STAT thread_%d_capacity %lu\r\n"
+                               "STAT thread_%d_holders %u\r\n"
+                               "STAT thread_%d_allocs %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_grown_in_place %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_resets %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_block_allocs %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_block_frees %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_alloc_failures %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_own_arenas %" PRINTF_INT64_MODIFIER "u\r\n",
+                               ix, (unsigned long) arena->stats.high_water,
+                               ix, (unsigned long) arena->used,
+                               ix, (unsigned long) arena->capacity,
+                               ix, arena->holders,
+                               ix, arena->stats.allocs,
+                               ix, arena->stats.grown_in_place,
+                               ix, arena->stats.resets,
+                               ix, arena->stats.block_allocs,
+                               ix, arena->stats.block_frees,
+                               ix, arena->stats.alloc_failures,
+                               ix, arena->stats.own_arenas);
+    }
+    return off;
+}
+
+/*
+ * The busy-polling counters are read without a lock too.
+ */
+size_t mt_append_poll_stats(char* const buffer_start,
+                            const size_t buffer_size,
+                            const size_t buffer_off,
+                            const size_t reserved) {
+    int ix;
+    size_t off = buffer_off;
+
+    for (ix = 1; ix < settings.num_threads; ix++) {
+        busy_poll_t *bp = &threads[ix].busy_poll;
+
+        off = append_to_buffer(buffer_start, buffer_size, off, reserved,
+                               "STAT thread_%d_polls %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_spin_usec %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_sleeps %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_sleep_usec %" PRINTF_INT64_MODIFIER "u\r\n",
+                               ix, bp->polls,
+                               ix, bp->spin_ns / 1000,
+                               ix, bp->sleeps,
+                               ix, bp->sleep_ns / 1000);
+    }
+    return off;
+}
+
+/*
+ * Like the arena counters, the ring counters are read here without a lock.
+ */
+size_t mt_append_uring_stats(char* const buffer_start,
+                             const size_t buffer_size,
+                             const size_t buffer_off,
+                             const size_t reserved) {
+    int ix;
+    size_t off = buffer_off;
+
+    for (ix = 1; ix < settings.num_threads; ix++) {
+        uring_stats_t none;
+        const uring_stats_t *stats = &none;
+
+        memset(&none, 0, sizeof(none));
+#if defined(USE_URING)
+        if (threads[ix].uring != NULL) {
+            stats = uring_stats(threads[ix].uring);
+        }
+#endif /* #if defined(USE_URING) */
+
+        off = append_to_buffer(buffer_start, buffer_size, off, reserved,
+                               "STAT thread_%d_enabled %d\r\n"
+                               "STAT thread_%d_wakeups %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_enter_calls %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_sqes %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_cqes %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_recvs %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_sends %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_buffer_waits %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_recv_pauses %" PRINTF_INT64_MODIFIER "u\r\n",
+                               ix, threads[ix].uring != NULL,
+                               ix, stats->wakeups,
+                               ix, stats->enter_calls,
+                               ix, stats->sqes,
+                               ix, stats->cqes,
+                               ix, stats->recvs,
+                               ix, stats->sends,
+                               ix, stats->buffer_waits,
+                               ix, stats->recv_pauses);
+    }
+    return off;
+}
+
 /****************************** HASHTABLE MODULE *****************************/
 
 int mt_assoc_expire_regex(char *pattern) {
@@ -614,18 +1058,32 @@ void mt_slabs_free(void *ptr, size_t size) {
 char *mt_slabs_stats(int *buflen) {
     char *ret;
 
+    pthread_mutex_lock(&cache_lock);
     pthread_mutex_lock(&slabs_lock);
     ret = do_slabs_stats(buflen);
     pthread_mutex_unlock(&slabs_lock);
+    pthread_mutex_unlock(&cache_lock);
     return ret;
 }
 
 int mt_slabs_reassign(unsigned char srcid, unsigned char dstid) {
     int ret;
 
+    /* moving and evicting items touches the hash table and the LRU. */
+    pthread_mutex_lock(&cache_lock);
     pthread_mutex_lock(&slabs_lock);
     ret = do_slabs_reassign(srcid, dstid);
     pthread_mutex_unlock(&slabs_lock);
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+
+void *mt_slabs_chunk(unsigned int id, unsigned int pos) {
+    void *ret;
+
+    pthread_mutex_lock(&slabs_lock);
+    ret = do_slabs_chunk(id, pos);
+    pthread_mutex_unlock(&slabs_lock);
     return ret;
 }
 
@@ -634,6 +1092,57 @@ void mt_slabs_rebalance() {
     do_slabs_rebalance();
     pthread_mutex_unlock(&slabs_lock);
 }
+
+void mt_slabs_model_hit(item *it) {
+    pthread_mutex_lock(&cache_lock);
+    do_slabs_model_hit(it);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void mt_slabs_model_miss(const char *key, const size_t nkey) {
+    pthread_mutex_lock(&cache_lock);
+    do_slabs_model_miss(key, nkey);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void mt_item_tier_promote(item *stub, item *it) {
+    pthread_mutex_lock(&cache_lock);
+    do_item_tier_promote(stub, it);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+char *mt_slabs_rebalance_stats(int *buflen) {
+    char *ret;
+
+    pthread_mutex_lock(&cache_lock);
+    pthread_mutex_lock(&slabs_lock);
+    ret = do_slabs_rebalance_stats(buflen);
+    pthread_mutex_unlock(&slabs_lock);
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+
+/*
+ * Background slab rebalancer: wakes up every settings.slab_automove_interval
+ * seconds and moves at most one page toward the model's targets.
+ */
+static void *slabs_automove_thread(void *arg) {
+    /* the rebalancer shares the main thread's stats structure; every update
+     * to it is made under its lock. */
+    STATS_SET_TLS(0);
+
+    while (1) {
+        sleep(settings.slab_automove_interval);
+
+        pthread_mutex_lock(&cache_lock);
+        pthread_mutex_lock(&slabs_lock);
+        do_slabs_automove();
+        pthread_mutex_unlock(&slabs_lock);
+        pthread_mutex_unlock(&cache_lock);
+    }
+
+    return NULL;
+}
 #endif /* #if defined(USE_SLAB_ALLOCATOR) */
 
 #if defined(USE_FLAT_ALLOCATOR)
@@ -696,6 +1205,16 @@ stats_t *mt_stats_get_tls(void) {
     return stats;
 }
 
+/*
+ * The handlers of a thread's events call this, so that a busy-polling thread
+ * knows it found some.
+ */
+void thread_event_handled(void) {
+    if (settings.busy_poll_usec > 0) {
+        busy_poll_event(&threads[STATS_GET_TLS() - l.stats].busy_poll);
+    }
+}
+
 void mt_stats_set_tls(int ix) {
     int rc;
 
@@ -712,8 +1231,21 @@ void mt_stats_reset(void) {
         STATS_LOCK(stats);
         stats->total_items = stats->total_conns = 0;
         stats->get_cmds = stats->set_cmds = stats->get_hits = stats->get_misses = stats->evictions = 0;
+        stats->expired_items = stats->reaped_items = 0;
         stats->arith_cmds = stats->arith_hits = 0;
         stats->bytes_read = stats->bytes_written = 0;
+        stats->compressed_items = stats->compress_skipped = 0;
+        stats->compress_bytes_in = stats->compress_bytes_out = stats->compress_ns = 0;
+        stats->decompressed_items = stats->decompress_failures = stats->decompress_ns = 0;
+        stats->compressed_sent = 0;
+        stats->udp_recv_calls = stats->udp_datagrams_received = 0;
+        stats->udp_send_calls = stats->udp_packets_sent = 0;
+        stats->tcp_send_calls = stats->tcp_replies_sent = 0;
+        stats->zerocopy_sends = stats->zerocopy_bytes = 0;
+        stats->zerocopy_copied = stats->zerocopy_fallbacks = 0;
+        stats->value_bytes_direct = stats->value_bytes_copied = 0;
+        stats->idle_conns_closed = stats->idle_conns_slimmed = 0;
+        stats->conn_memory_capped = 0;
         STATS_UNLOCK(stats);
     }
     stats_prefix_clear();
@@ -743,10 +1275,37 @@ void mt_stats_aggregate(stats_t *accum) {
         _AGGREGATE(arith_cmds);
         _AGGREGATE(arith_hits);
         _AGGREGATE(evictions);
+        _AGGREGATE(expired_items);
+        _AGGREGATE(reaped_items);
         _AGGREGATE(bytes_read);
         _AGGREGATE(bytes_written);
         _AGGREGATE(get_bytes);
         _AGGREGATE(byte_seconds);
+        _AGGREGATE(compressed_items);
+        _AGGREGATE(compress_skipped);
+        _AGGREGATE(compress_bytes_in);
+        _AGGREGATE(compress_bytes_out);
+        _AGGREGATE(compress_ns);
+        _AGGREGATE(decompressed_items);
+        _AGGREGATE(decompress_failures);
+        _AGGREGATE(decompress_ns);
+        _AGGREGATE(compressed_sent);
+        _AGGREGATE(udp_recv_calls);
+        _AGGREGATE(udp_datagrams_received);
+        _AGGREGATE(udp_send_calls);
+        _AGGREGATE(udp_packets_sent);
+        _AGGREGATE(tcp_send_calls);
+        _AGGREGATE(tcp_replies_sent);
+        _AGGREGATE(zerocopy_sends);
+        _AGGREGATE(zerocopy_bytes);
+        _AGGREGATE(zerocopy_copied);
+        _AGGREGATE(zerocopy_fallbacks);
+        _AGGREGATE(zerocopy_pinned);
+        _AGGREGATE(value_bytes_direct);
+        _AGGREGATE(value_bytes_copied);
+        _AGGREGATE(idle_conns_closed);
+        _AGGREGATE(idle_conns_slimmed);
+        _AGGREGATE(conn_memory_capped);
 #define MEMORY_POOL(pool_enum, pool_counter, pool_string) \
             _AGGREGATE(pool_counter);
 #include "memory_pool_classes.h"
@@ -768,6 +1327,179 @@ void mt_stats_aggregate(stats_t *accum) {
 #undef _AGGREGATE
 }
 
+/*
+ * Per-thread counts of the batched UDP receives and sends, and the average
+ * number of datagrams each of them handled.
+ */
+size_t mt_append_udp_stats(char* const buffer_start,
+                           const size_t buffer_size,
+                           const size_t buffer_off,
+                           const size_t reserved) {
+    int ix;
+    size_t off = buffer_off;
+
+    for (ix = 1; ix < l.stats_count; ix++) {
+        stats_t *stats = &l.stats[ix];
+        uint64_t recv_calls, received, send_calls, sent;
+
+        STATS_LOCK(stats);
+        recv_calls = stats->udp_recv_calls;
+        received = stats->udp_datagrams_received;
+        send_calls = stats->udp_send_calls;
+        sent = stats->udp_packets_sent;
+        STATS_UNLOCK(stats);
+
+        off = append_to_buffer(buffer_start, buffer_size, off, reserved,
+                               "STAT thread_%d_recv_calls %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_datagrams_received %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_recv_batch_avg %.2f\r\n"
+                               "STAT thread_%d_send_calls %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_packets_sent %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_send_batch_avg %.2f\r\n",
+                               ix, recv_calls,
+                               ix, received,
+                               ix, recv_calls == 0 ? 0.0 : (double) received / recv_calls,
+                               ix, send_calls,
+                               ix, sent,
+                               ix, send_calls == 0 ? 0.0 : (double) sent / send_calls);
+    }
+    return off;
+}
+
+/*
+ * Per-thread counts of the writes of replies to tcp connections, and the
+ * average number of replies each of them carried.
+ */
+size_t mt_append_tcp_stats(char* const buffer_start,
+                           const size_t buffer_size,
+                           const size_t buffer_off,
+                           const size_t reserved) {
+    int ix;
+    size_t off = buffer_off;
+
+    for (ix = 1; ix < l.stats_count; ix++) {
+        stats_t *stats = &l.stats[ix];
+        uint64_t send_calls, replies;
+        uint64_t zc_sends, zc_bytes, zc_copied, zc_fallbacks, zc_pinned;
+        uint64_t direct, copied;
+
+        STATS_LOCK(stats);
+        send_calls = stats->tcp_send_calls;
+        replies = stats->tcp_replies_sent;
+        zc_sends = stats->zerocopy_sends;
+        zc_bytes = stats->zerocopy_bytes;
+        zc_copied = stats->zerocopy_copied;
+        zc_fallbacks = stats->zerocopy_fallbacks;
+        zc_pinned = stats->zerocopy_pinned;
+        direct = stats->value_bytes_direct;
+        copied = stats->value_bytes_copied;
+        STATS_UNLOCK(stats);
+
+        off = append_to_buffer(buffer_start, buffer_size, off, reserved,
+                               "STAT thread_%d_send_calls %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_replies_sent %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_replies_per_send %.2f\r\n"
+                               "STAT thread_%d_zerocopy_sends %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_zerocopy_bytes %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_zerocopy_copied %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_zerocopy_fallbacks %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_zerocopy_pinned %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_value_bytes_direct %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_value_bytes_copied %" PRINTF_INT64_MODIFIER "u\r\n",
+                               ix, send_calls,
+                               ix, replies,
+                               ix, send_calls == 0 ? 0.0 : (double) replies / send_calls,
+                               ix, zc_sends,
+                               ix, zc_bytes,
+                               ix, zc_copied,
+                               ix, zc_fallbacks,
+                               ix, zc_pinned,
+                               ix, direct,
+                               ix, copied);
+    }
+    return off;
+}
+
+/*
+ * What each worker thread's tcp connections held as of its last sweep, read
+ * without a lock, and the connections its sweeps closed or slimmed.
+ */
+size_t mt_append_conn_stats(char* const buffer_start,
+                            const size_t buffer_size,
+                            const size_t buffer_off,
+                            const size_t reserved) {
+    conn_sweep_t total;
+    uint64_t total_closed = 0, total_slimmed = 0, total_capped = 0;
+    int ix;
+    size_t off = buffer_off;
+
+    memset(&total, 0, sizeof(total));
+    for (ix = 1; ix < settings.num_threads; ix++) {
+        const conn_sweep_t *sweep = &threads[ix].conn_sweep;
+        stats_t *stats = &l.stats[ix];
+
+        STATS_LOCK(stats);
+        total_closed += stats->idle_conns_closed;
+        total_slimmed += stats->idle_conns_slimmed;
+        total_capped += stats->conn_memory_capped;
+        STATS_UNLOCK(stats);
+
+        total.conns += sweep->conns;
+        total.idle_conns += sweep->idle_conns;
+        total.slim_conns += sweep->slim_conns;
+        total.bytes += sweep->bytes;
+        total.idle_bytes += sweep->idle_bytes;
+    }
+    off = append_to_buffer(buffer_start, buffer_size, off, reserved,
+                           "STAT conns %u\r\n"
+                           "STAT conn_bytes %" PRINTF_INT64_MODIFIER "u\r\n"
+                           "STAT idle_conns %u\r\n"
+                           "STAT idle_conn_bytes %" PRINTF_INT64_MODIFIER "u\r\n"
+                           "STAT slim_conns %u\r\n"
+                           "STAT idle_closed %" PRINTF_INT64_MODIFIER "u\r\n"
+                           "STAT idle_slimmed %" PRINTF_INT64_MODIFIER "u\r\n"
+                           "STAT memory_capped %" PRINTF_INT64_MODIFIER "u\r\n",
+                           total.conns,
+                           total.bytes,
+                           total.idle_conns,
+                           total.idle_bytes,
+                           total.slim_conns,
+                           total_closed,
+                           total_slimmed,
+                           total_capped);
+
+    for (ix = 1; ix < settings.num_threads; ix++) {
+        const conn_sweep_t *sweep = &threads[ix].conn_sweep;
+        stats_t *stats = &l.stats[ix];
+        uint64_t closed, slimmed, capped;
+
+        STATS_LOCK(stats);
+        closed = stats->idle_conns_closed;
+        slimmed = stats->idle_conns_slimmed;
+        capped = stats->conn_memory_capped;
+        STATS_UNLOCK(stats);
+
+        off = append_to_buffer(buffer_start, buffer_size, off, reserved,
+                               "STAT thread_%d_conns %u\r\n"
+                               "STAT thread_%d_conn_bytes %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_idle_conns %u\r\n"
+                               "STAT thread_%d_idle_conn_bytes %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_slim_conns %u\r\n"
+                               "STAT thread_%d_idle_closed %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_idle_slimmed %" PRINTF_INT64_MODIFIER "u\r\n"
+                               "STAT thread_%d_memory_capped %" PRINTF_INT64_MODIFIER "u\r\n",
+                               ix, sweep->conns,
+                               ix, sweep->bytes,
+                               ix, sweep->idle_conns,
+                               ix, sweep->idle_bytes,
+                               ix, sweep->slim_conns,
+                               ix, closed,
+                               ix, slimmed,
+                               ix, capped);
+    }
+    return off;
+}
+
 /*
  * Initializes the thread subsystem, creating various worker threads.
  *
@@ -817,6 +1549,20 @@ void thread_init(int nthreads, struct event_base *main_base) {
         setup_thread(&threads[i]);
     }
 
+#if defined(USE_URING)
+    if (settings.uring) {
+        bool warned = false;
+
+        for (i = 1; i < nthreads; i++) {
+            threads[i].uring = uring_new(threads[i].base);
+            if (threads[i].uring == NULL && ! warned) {
+                fprintf(stderr, "Can't set up io_uring; using libevent instead\n");
+                warned = true;
+            }
+        }
+    }
+#endif /* #if defined(USE_URING) */
+
     /* Create threads after we've done all the libevent setup. */
     for (i = 1; i < nthreads; i++) {
         create_worker(i, worker_libevent, &threads[i]);
@@ -829,4 +1575,17 @@ void thread_init(int nthreads, struct event_base *main_base) {
         pthread_cond_wait(&init_cond, &init_lock);
     }
     pthread_mutex_unlock(&init_lock);
+
+#if defined(USE_SLAB_ALLOCATOR)
+    if (settings.slab_automove_interval != 0) {
+        pthread_t thread;
+        int ret;
+
+        if ((ret = pthread_create(&thread, NULL, slabs_automove_thread, NULL)) != 0) {
+            fprintf(stderr, "Can't create slab rebalancer thread: %s\n",
+                    strerror(ret));
+            exit(1);
+        }
+    }
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
 }
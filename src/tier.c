@@ -0,0 +1,383 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Extension tier: a log file that large items go to when they are evicted.
+ *
+ * An evicted value of at least settings.tier_threshold bytes is appended to
+ * the log, and a stub item takes its place in the cache.  The stub holds the
+ * key, the flags, the expiration time and a tier_ptr_t for the value.  A hit
+ * on a stub reads the value back on an i/o thread and promotes it back into
+ * memory.  A UDP socket can't wait for the read, so a hit on it is a miss.
+ *
+ * The log is a circular file of settings.tier_size bytes that is only ever
+ * appended to.  Log positions grow without bound; position p is at offset
+ * p % capacity in the file.  When the log wraps, it overwrites the oldest
+ * records, and the stubs pointing at them are dropped the next time they are
+ * looked up.  So nothing ever has to be compacted or freed.
+ *
+ * Records are staged in TIER_WBUFS write buffers of TIER_WBUF_SIZE bytes,
+ * each of which covers an aligned stretch of the log.  A record never
+ * straddles two buffers.  A writer thread writes each buffer out once it is
+ * full.  Until then, reads of its records are served from memory.  If every
+ * buffer is waiting for the disk, evicted values are dropped instead.
+ */
+
+#include "generic.h"
+
+#if defined(USE_SLAB_ALLOCATOR)
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "items.h"
+#include "memcached.h"
+#include "slabs_items_support.h"
+#include "tier.h"
+
+#define TIER_RECORD_MAGIC   0x74696572  /* "tier" */
+
+/* precedes the key and the value of each record in the log. */
+typedef struct tier_record_s tier_record_t;
+struct tier_record_s {
+    uint32_t magic;
+    uint32_t nbytes;
+    uint8_t  nkey;
+    uint8_t  pad[7];
+};
+
+static struct {
+    int fd;
+    uint64_t capacity;
+    char* bufs[TIER_WBUFS];
+
+    /* everything below this was appended, and everything below flushed is on
+     * disk.  flushed is always at a buffer boundary. */
+    uint64_t head;
+    uint64_t flushed;
+    uint64_t writing_end;               /* end of the buffer being written. */
+    unsigned int copying[TIER_WBUFS];   /* records still being copied into
+                                         * each buffer. */
+
+    pthread_mutex_t lock;
+    pthread_cond_t sealed;              /* a buffer filled up... */
+    pthread_cond_t copied;              /* ... or the last copy into one is
+                                         * done. */
+
+    tier_stats_t stats;
+} tier;
+
+static struct {
+    tier_io_t* head;
+    tier_io_t* tail;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} ioq;
+
+
+static inline size_t tier_record_len(const size_t nkey, const size_t nbytes) {
+    return (sizeof(tier_record_t) + nkey + nbytes + 7) & ~((size_t) 7);
+}
+
+
+static inline char* tier_buffer(const uint64_t pos) {
+    return tier.bufs[(pos / TIER_WBUF_SIZE) % TIER_WBUFS] + pos % TIER_WBUF_SIZE;
+}
+
+
+/* a record is gone once the writer has started on the stretch of the file
+ * that it sat in. */
+static inline bool do_tier_valid(const uint64_t pos) {
+    return pos + tier.capacity >= tier.writing_end;
+}
+
+
+static void* tier_writer(void* arg) {
+    pthread_mutex_lock(&tier.lock);
+    while (1) {
+        uint64_t start;
+        char* buf;
+        size_t done;
+
+        while (tier.flushed / TIER_WBUF_SIZE >= tier.head / TIER_WBUF_SIZE) {
+            pthread_cond_wait(&tier.sealed, &tier.lock);
+        }
+        start = tier.flushed;
+        buf = tier_buffer(start);
+        while (tier.copying[(start / TIER_WBUF_SIZE) % TIER_WBUFS] != 0) {
+            pthread_cond_wait(&tier.copied, &tier.lock);
+        }
+        tier.writing_end = start + TIER_WBUF_SIZE;
+        pthread_mutex_unlock(&tier.lock);
+
+        for (done = 0; done < TIER_WBUF_SIZE; ) {
+            ssize_t res = pwrite(tier.fd, buf + done, TIER_WBUF_SIZE - done,
+                                 (start + done) % tier.capacity);
+            if (res < 0 && errno == EINTR) {
+                continue;
+            }
+            if (res <= 0) {
+                perror("Writing to the tier file");
+                break;
+            }
+            done += res;
+        }
+
+        pthread_mutex_lock(&tier.lock);
+        tier.flushed = start + TIER_WBUF_SIZE;
+    }
+
+    return NULL;
+}
+
+
+static void* tier_io_thread(void* arg) {
+    while (1) {
+        tier_io_t* io;
+
+        pthread_mutex_lock(&ioq.lock);
+        while (ioq.head == NULL) {
+            pthread_cond_wait(&ioq.cond, &ioq.lock);
+        }
+        io = ioq.head;
+        ioq.head = io->next;
+        if (ioq.head == NULL) {
+            ioq.tail = NULL;
+        }
+        pthread_mutex_unlock(&ioq.lock);
+
+        /* the stub's reference keeps its key in place. */
+        io->ok = tier_read(&io->ptr, ITEM_key(io->stub), ITEM_nkey(io->stub), io->it);
+        io->complete(io);
+    }
+
+    return NULL;
+}
+
+
+void tier_init(const char* path, const size_t capacity) {
+    pthread_t thread;
+    int i, ret;
+
+    memset(&tier, 0, sizeof(tier));
+    tier.capacity = capacity - capacity % TIER_WBUF_SIZE;
+    if (tier.capacity < 2 * TIER_WBUF_SIZE) {
+        fprintf(stderr, "The tier file must be at least %d bytes\n", 2 * TIER_WBUF_SIZE);
+        exit(1);
+    }
+    tier.stats.capacity = tier.capacity;
+
+    if ((tier.fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600)) == -1) {
+        fprintf(stderr, "Can't open tier file %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    for (i = 0; i < TIER_WBUFS; i++) {
+        if ((tier.bufs[i] = malloc(TIER_WBUF_SIZE)) == NULL) {
+            fprintf(stderr, "Can't allocate tier write buffers\n");
+            exit(1);
+        }
+    }
+
+    pthread_mutex_init(&tier.lock, NULL);
+    pthread_cond_init(&tier.sealed, NULL);
+    pthread_cond_init(&tier.copied, NULL);
+    pthread_mutex_init(&ioq.lock, NULL);
+    pthread_cond_init(&ioq.cond, NULL);
+    ioq.head = ioq.tail = NULL;
+
+    if ((ret = pthread_create(&thread, NULL, tier_writer, NULL)) != 0) {
+        fprintf(stderr, "Can't create tier writer thread: %s\n", strerror(ret));
+        exit(1);
+    }
+    for (i = 0; i < TIER_IO_THREADS; i++) {
+        if ((ret = pthread_create(&thread, NULL, tier_io_thread, NULL)) != 0) {
+            fprintf(stderr, "Can't create tier i/o thread: %s\n", strerror(ret));
+            exit(1);
+        }
+    }
+}
+
+
+bool tier_write(item* it, tier_ptr_t* ptr) {
+    size_t nkey = ITEM_nkey(it), nbytes = ITEM_nbytes(it);
+    size_t reclen = tier_record_len(nkey, nbytes);
+    uint64_t pos, buffer;
+    tier_record_t record;
+    char* dst;
+
+    if (reclen > TIER_WBUF_SIZE) {
+        return false;
+    }
+
+    pthread_mutex_lock(&tier.lock);
+    pos = tier.head;
+    if (pos % TIER_WBUF_SIZE + reclen > TIER_WBUF_SIZE) {
+        /* leave the rest of this buffer empty. */
+        pos += TIER_WBUF_SIZE - pos % TIER_WBUF_SIZE;
+    }
+
+    /* the buffer may still hold a stretch of the log that isn't on disk. */
+    buffer = pos / TIER_WBUF_SIZE;
+    if (buffer >= TIER_WBUFS &&
+        tier.flushed < (buffer - TIER_WBUFS + 1) * TIER_WBUF_SIZE) {
+        tier.stats.spill_skipped ++;
+        pthread_mutex_unlock(&tier.lock);
+        return false;
+    }
+
+    tier.head = pos + reclen;
+    if (tier.head / TIER_WBUF_SIZE != tier.flushed / TIER_WBUF_SIZE) {
+        pthread_cond_signal(&tier.sealed);
+    }
+    tier.copying[buffer % TIER_WBUFS] ++;
+    tier.stats.spilled ++;
+    tier.stats.spilled_bytes += nbytes;
+    pthread_mutex_unlock(&tier.lock);
+
+    /* the record is ours, and the writer waits for it, so it is copied
+     * without the lock. */
+    memset(&record, 0, sizeof(record));
+    record.magic = TIER_RECORD_MAGIC;
+    record.nbytes = nbytes;
+    record.nkey = nkey;
+    dst = tier_buffer(pos);
+    memcpy(dst, &record, sizeof(record));
+    memcpy(dst + sizeof(record), ITEM_key(it), nkey);
+    item_memcpy_from(dst + sizeof(record) + nkey, it, 0, nbytes, false);
+
+    ptr->pos = pos;
+    ptr->reclen = reclen;
+    ptr->nbytes = nbytes;
+
+    pthread_mutex_lock(&tier.lock);
+    if (-- tier.copying[buffer % TIER_WBUFS] == 0) {
+        pthread_cond_signal(&tier.copied);
+    }
+    pthread_mutex_unlock(&tier.lock);
+
+    return true;
+}
+
+
+bool tier_valid(const tier_ptr_t* ptr) {
+    bool valid;
+
+    pthread_mutex_lock(&tier.lock);
+    valid = do_tier_valid(ptr->pos);
+    pthread_mutex_unlock(&tier.lock);
+    return valid;
+}
+
+
+bool tier_read(const tier_ptr_t* ptr, const char* key, const size_t nkey, item* it) {
+    tier_record_t record;
+    char* buf;
+    bool ok;
+
+    if ((buf = malloc(ptr->reclen)) == NULL) {
+        return false;
+    }
+
+    pthread_mutex_lock(&tier.lock);
+    ok = do_tier_valid(ptr->pos);
+    if (ok && ptr->pos >= tier.flushed) {
+        memcpy(buf, tier_buffer(ptr->pos), ptr->reclen);
+        tier.stats.buffer_reads ++;
+        pthread_mutex_unlock(&tier.lock);
+    } else if (ok) {
+        size_t done;
+
+        pthread_mutex_unlock(&tier.lock);
+        for (done = 0; done < ptr->reclen; ) {
+            ssize_t res = pread(tier.fd, buf + done, ptr->reclen - done,
+                                (ptr->pos + done) % tier.capacity);
+            if (res < 0 && errno == EINTR) {
+                continue;
+            }
+            if (res <= 0) {
+                ok = false;
+                break;
+            }
+            done += res;
+        }
+
+        /* the writer may have come around while we were reading. */
+        pthread_mutex_lock(&tier.lock);
+        ok = ok && do_tier_valid(ptr->pos);
+        pthread_mutex_unlock(&tier.lock);
+    } else {
+        pthread_mutex_unlock(&tier.lock);
+    }
+
+    if (ok) {
+        memcpy(&record, buf, sizeof(record));
+        ok = (record.magic == TIER_RECORD_MAGIC &&
+              record.nbytes == ptr->nbytes &&
+              record.nbytes == ITEM_nbytes(it) &&
+              record.nkey == nkey &&
+              memcmp(buf + sizeof(record), key, nkey) == 0);
+    }
+    if (ok) {
+        item_memcpy_to(it, 0, buf + sizeof(record) + nkey, record.nbytes, false);
+    }
+    free(buf);
+
+    pthread_mutex_lock(&tier.lock);
+    tier.stats.reads ++;
+    if (! ok) {
+        tier.stats.read_failures ++;
+    }
+    pthread_mutex_unlock(&tier.lock);
+
+    return ok;
+}
+
+
+void tier_submit(tier_io_t* io) {
+    io->next = NULL;
+    pthread_mutex_lock(&ioq.lock);
+    if (ioq.tail != NULL) {
+        ioq.tail->next = io;
+    } else {
+        ioq.head = io;
+    }
+    ioq.tail = io;
+    pthread_cond_signal(&ioq.cond);
+    pthread_mutex_unlock(&ioq.lock);
+}
+
+
+void tier_count_lost(void) {
+    pthread_mutex_lock(&tier.lock);
+    tier.stats.lost ++;
+    pthread_mutex_unlock(&tier.lock);
+}
+
+
+void tier_count_udp_miss(void) {
+    pthread_mutex_lock(&tier.lock);
+    tier.stats.udp_misses ++;
+    pthread_mutex_unlock(&tier.lock);
+}
+
+
+void tier_count_promotion(void) {
+    pthread_mutex_lock(&tier.lock);
+    tier.stats.promotions ++;
+    pthread_mutex_unlock(&tier.lock);
+}
+
+
+void tier_stats(tier_stats_t* out) {
+    pthread_mutex_lock(&tier.lock);
+    *out = tier.stats;
+    out->head = tier.head;
+    out->flushed = tier.flushed;
+    pthread_mutex_unlock(&tier.lock);
+}
+
+#endif /* #if defined(USE_SLAB_ALLOCATOR) */
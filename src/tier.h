@@ -0,0 +1,84 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+#if !defined(_tier_h_)
+#define _tier_h_
+
+#include "generic.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "memcached.h"
+
+#define TIER_WBUF_SIZE      (2 * 1024 * 1024) /* log is written this much at a
+                                               * time. */
+#define TIER_WBUFS          4           /* write buffers; spills are dropped
+                                         * while all of them wait for the
+                                         * disk. */
+#define TIER_IO_THREADS     4           /* threads reading values back. */
+#define TIER_MIN_THRESHOLD  1024        /* smallest value worth spilling. */
+
+/* a stub item's value: where its real value is in the log. */
+typedef struct tier_ptr_s tier_ptr_t;
+struct tier_ptr_s {
+    uint64_t pos;                       /* log position of the record. */
+    uint32_t reclen;                    /* length of the record. */
+    uint32_t nbytes;                    /* length of the value. */
+};
+
+typedef struct tier_stats_s tier_stats_t;
+struct tier_stats_s {
+    uint64_t capacity;                  /* size of the log file. */
+    uint64_t head;                      /* bytes ever appended to the log. */
+    uint64_t flushed;                   /* ... of which are on disk. */
+    uint64_t spilled;                   /* values written to the log. */
+    uint64_t spilled_bytes;
+    uint64_t spill_skipped;             /* evicted values dropped because the
+                                         * write buffers were full. */
+    uint64_t reads;                     /* values read back... */
+    uint64_t buffer_reads;              /* ... of which were still in memory. */
+    uint64_t read_failures;             /* reads overtaken by the log. */
+    uint64_t lost;                      /* stubs whose value the log had
+                                         * overwritten. */
+    uint64_t promotions;                /* values moved back into memory. */
+    uint64_t udp_misses;                /* hits on stubs over UDP, answered
+                                         * as misses. */
+};
+
+/* a read of a stub's value into an unlinked item, done by an i/o thread.
+ * complete(..) is called on the i/o thread when it is done. */
+typedef struct tier_io_s tier_io_t;
+struct tier_io_s {
+    tier_io_t* next;
+    tier_ptr_t ptr;
+    item* stub;
+    item* it;
+    bool ok;
+    void (*complete)(tier_io_t* io);
+    void* owner;                        /* for complete(..) */
+    void* arg;                          /* for complete(..) */
+};
+
+/* opens the log and starts the writer and the i/o threads. */
+extern void tier_init(const char* path, const size_t capacity);
+
+/* appends an item's value to the log.  the caller holds a reference to the
+ * item, but not the cache lock, for the copy.  returns false if there is no
+ * room in the write buffers. */
+extern bool tier_write(item* it, tier_ptr_t* ptr);
+
+/* true if the log still holds the record. */
+extern bool tier_valid(const tier_ptr_t* ptr);
+
+/* reads the value of a record, which must be for the given key, into it. */
+extern bool tier_read(const tier_ptr_t* ptr, const char* key, const size_t nkey, item* it);
+
+/* queues a read for the i/o threads. */
+extern void tier_submit(tier_io_t* io);
+
+extern void tier_count_lost(void);
+extern void tier_count_udp_miss(void);
+extern void tier_count_promotion(void);
+extern void tier_stats(tier_stats_t* out);
+
+#endif /* #if !defined(_tier_h_) */
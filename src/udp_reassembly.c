@@ -0,0 +1,283 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Reassembly of UDP requests that span several packets.
+ *
+ * The UDP frame header of each packet carries the request id, the packet's
+ * sequence number and the number of packets in the request.  Packets of a
+ * multi-packet request are kept, keyed by the sender's address and the
+ * request id, until all of them are in.  The request is then put together in
+ * sequence order and served like any other.
+ *
+ * Every worker thread reads the same UDP sockets, so the packets of a request
+ * may be read by different threads; the table is shared, under one lock.  It
+ * holds at most UDP_REASSEMBLY_MAX_REQUESTS requests and the memory limit
+ * given to udp_reassembly_init(..).  A request that hasn't arrived in full
+ * after UDP_REASSEMBLY_TIMEOUT seconds is dropped, and when the table is full
+ * the requests that started the longest ago make room for new packets.
+ */
+
+#include "generic.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assoc.h"
+#include "memcached.h"
+#include "udp_reassembly.h"
+
+typedef struct udp_fragment_s udp_fragment_t;
+struct udp_fragment_s {
+    size_t nbytes;
+    char data[];
+};
+
+typedef struct udp_request_s udp_request_t;
+struct udp_request_s {
+    udp_request_t* next;                /* in the hash bucket. */
+    udp_request_t* older;               /* in the order they started. */
+    udp_request_t* newer;
+    struct sockaddr addr;
+    socklen_t addrlen;
+    uint16_t request_id;
+    uint16_t total;                     /* packets in the request... */
+    uint16_t received;                  /* ... and how many are in. */
+    rel_time_t started;
+    size_t nbytes;                      /* payload received. */
+    size_t memory;                      /* memory held, this included. */
+    udp_fragment_t* fragments[];        /* by sequence number. */
+};
+
+static struct {
+    size_t limit;
+    size_t memory;
+    udp_request_t* buckets[UDP_REASSEMBLY_BUCKETS];
+    udp_request_t* oldest;
+    udp_request_t* newest;
+
+    pthread_mutex_t lock;
+
+    udp_reassembly_stats_t stats;
+} reassembly;
+
+
+void udp_reassembly_init(const size_t limit) {
+    memset(&reassembly, 0, sizeof(reassembly));
+    reassembly.limit = limit;
+    pthread_mutex_init(&reassembly.lock, NULL);
+}
+
+
+static uint32_t udp_request_bucket(const struct sockaddr* addr, const socklen_t addrlen,
+                                   const uint16_t request_id) {
+    return hash(addr, addrlen, request_id) % UDP_REASSEMBLY_BUCKETS;
+}
+
+
+static udp_request_t* udp_request_find(const struct sockaddr* addr, const socklen_t addrlen,
+                                       const uint16_t request_id) {
+    udp_request_t* request;
+
+    for (request = reassembly.buckets[udp_request_bucket(addr, addrlen, request_id)];
+         request != NULL;
+         request = request->next) {
+        if (request->request_id == request_id &&
+            request->addrlen == addrlen &&
+            memcmp(&request->addr, addr, addrlen) == 0) {
+            return request;
+        }
+    }
+    return NULL;
+}
+
+
+static void udp_request_free(udp_request_t* request) {
+    udp_request_t** prev;
+    int i;
+
+    for (prev = &reassembly.buckets[udp_request_bucket(&request->addr, request->addrlen,
+                                                       request->request_id)];
+         *prev != request;
+         prev = &(*prev)->next) {
+        assert(*prev != NULL);
+    }
+    *prev = request->next;
+
+    if (request->older != NULL) {
+        request->older->newer = request->newer;
+    } else {
+        reassembly.oldest = request->newer;
+    }
+    if (request->newer != NULL) {
+        request->newer->older = request->older;
+    } else {
+        reassembly.newest = request->older;
+    }
+
+    for (i = 0; i < request->total; i++) {
+        if (request->fragments[i] != NULL) {
+            pool_free(request->fragments[i], sizeof(udp_fragment_t) + request->fragments[i]->nbytes,
+                      UDP_REASSEMBLY_POOL);
+        }
+    }
+    reassembly.memory -= request->memory;
+    reassembly.stats.pending --;
+    pool_free(request, sizeof(udp_request_t) + request->total * sizeof(udp_fragment_t*),
+              UDP_REASSEMBLY_POOL);
+}
+
+
+/*
+ * drops the requests that have been waiting too long and, while more than
+ * needed is held, the ones that started the longest ago.  keep is never
+ * dropped.
+ */
+static void udp_reassembly_make_room(const size_t needed, const udp_request_t* keep) {
+    udp_request_t* request, * newer;
+
+    for (request = reassembly.oldest; request != NULL; request = newer) {
+        newer = request->newer;
+        if (request == keep) {
+            continue;
+        }
+        if (current_time - request->started > UDP_REASSEMBLY_TIMEOUT) {
+            reassembly.stats.timeouts ++;
+        } else if (reassembly.memory + needed > reassembly.limit ||
+                   (keep == NULL &&
+                    reassembly.stats.pending >= UDP_REASSEMBLY_MAX_REQUESTS)) {
+            reassembly.stats.evictions ++;
+        } else {
+            /* the rest are newer still. */
+            break;
+        }
+        udp_request_free(request);
+    }
+}
+
+
+static udp_request_t* udp_request_new(const struct sockaddr* addr, const socklen_t addrlen,
+                                      const uint16_t request_id, const uint16_t total) {
+    size_t size = sizeof(udp_request_t) + total * sizeof(udp_fragment_t*);
+    udp_request_t* request;
+    uint32_t bucket;
+
+    udp_reassembly_make_room(size, NULL);
+    if (reassembly.memory + size > reassembly.limit ||
+        (request = pool_malloc(size, UDP_REASSEMBLY_POOL)) == NULL) {
+        return NULL;
+    }
+
+    memset(request, 0, size);
+    memcpy(&request->addr, addr, addrlen);
+    request->addrlen = addrlen;
+    request->request_id = request_id;
+    request->total = total;
+    request->started = current_time;
+    request->memory = size;
+
+    bucket = udp_request_bucket(addr, addrlen, request_id);
+    request->next = reassembly.buckets[bucket];
+    reassembly.buckets[bucket] = request;
+
+    request->older = reassembly.newest;
+    if (reassembly.newest != NULL) {
+        reassembly.newest->newer = request;
+    } else {
+        reassembly.oldest = request;
+    }
+    reassembly.newest = request;
+
+    reassembly.memory += size;
+    reassembly.stats.pending ++;
+    return request;
+}
+
+
+static udp_reassembly_result_t do_udp_reassemble(const struct sockaddr* addr, const socklen_t addrlen,
+                                                 const uint16_t request_id,
+                                                 const uint16_t seq, const uint16_t total,
+                                                 const char* data, const size_t nbytes,
+                                                 char* buf, const size_t bufsize, size_t* len) {
+    udp_request_t* request;
+    udp_fragment_t* fragment;
+    size_t size = sizeof(udp_fragment_t) + nbytes;
+    char* out;
+    int i;
+
+    reassembly.stats.packets ++;
+
+    if (addrlen > sizeof(struct sockaddr) ||
+        total < 2 ||
+        seq >= total) {
+        reassembly.stats.dropped ++;
+        return UDP_REASSEMBLY_DROPPED;
+    }
+
+    if ((request = udp_request_find(addr, addrlen, request_id)) == NULL) {
+        if ((request = udp_request_new(addr, addrlen, request_id, total)) == NULL) {
+            reassembly.stats.dropped ++;
+            return UDP_REASSEMBLY_DROPPED;
+        }
+    } else if (request->total != total ||
+               request->fragments[seq] != NULL) {
+        reassembly.stats.dropped ++;
+        return UDP_REASSEMBLY_DROPPED;
+    }
+
+    /* a request that can't fit the buffer will never be served. */
+    udp_reassembly_make_room(size, request);
+    if (request->nbytes + nbytes > bufsize ||
+        reassembly.memory + size > reassembly.limit ||
+        (fragment = pool_malloc(size, UDP_REASSEMBLY_POOL)) == NULL) {
+        udp_request_free(request);
+        reassembly.stats.dropped ++;
+        return UDP_REASSEMBLY_DROPPED;
+    }
+
+    fragment->nbytes = nbytes;
+    memcpy(fragment->data, data, nbytes);
+    request->fragments[seq] = fragment;
+    request->received ++;
+    request->nbytes += nbytes;
+    request->memory += size;
+    reassembly.memory += size;
+
+    if (request->received < request->total) {
+        return UDP_REASSEMBLY_INCOMPLETE;
+    }
+
+    for (i = 0, out = buf; i < request->total; i++) {
+        memcpy(out, request->fragments[i]->data, request->fragments[i]->nbytes);
+        out += request->fragments[i]->nbytes;
+    }
+    *len = request->nbytes;
+
+    udp_request_free(request);
+    reassembly.stats.reassembled ++;
+    return UDP_REASSEMBLY_COMPLETE;
+}
+
+
+udp_reassembly_result_t udp_reassemble(const struct sockaddr* addr, const socklen_t addrlen,
+                                       const uint16_t request_id,
+                                       const uint16_t seq, const uint16_t total,
+                                       const char* data, const size_t nbytes,
+                                       char* buf, const size_t bufsize, size_t* len) {
+    udp_reassembly_result_t ret;
+
+    pthread_mutex_lock(&reassembly.lock);
+    ret = do_udp_reassemble(addr, addrlen, request_id, seq, total, data, nbytes,
+                            buf, bufsize, len);
+    pthread_mutex_unlock(&reassembly.lock);
+
+    return ret;
+}
+
+
+void udp_reassembly_stats(udp_reassembly_stats_t* out) {
+    pthread_mutex_lock(&reassembly.lock);
+    *out = reassembly.stats;
+    out->bytes = reassembly.memory;
+    pthread_mutex_unlock(&reassembly.lock);
+}
@@ -0,0 +1,54 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+#if !defined(_udp_reassembly_h_)
+#define _udp_reassembly_h_
+
+#include "generic.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define UDP_REASSEMBLY_TIMEOUT  2       /* seconds a request has to arrive
+                                         * in full. */
+#define UDP_REASSEMBLY_MAX_REQUESTS 1024 /* requests being reassembled at
+                                          * once. */
+#define UDP_REASSEMBLY_BUCKETS  1024
+
+typedef enum {
+    UDP_REASSEMBLY_INCOMPLETE,          /* the packet was kept. */
+    UDP_REASSEMBLY_COMPLETE,            /* the request is in the buffer. */
+    UDP_REASSEMBLY_DROPPED,             /* the packet, and maybe the request
+                                         * it belongs to, were dropped. */
+} udp_reassembly_result_t;
+
+typedef struct udp_reassembly_stats_s udp_reassembly_stats_t;
+struct udp_reassembly_stats_s {
+    uint64_t pending;                   /* requests being reassembled... */
+    uint64_t bytes;                     /* ... and the memory they hold. */
+    uint64_t packets;                   /* packets of multi-packet requests. */
+    uint64_t reassembled;               /* requests put back together. */
+    uint64_t timeouts;                  /* requests that didn't arrive in
+                                         * time. */
+    uint64_t evictions;                 /* requests dropped to make room. */
+    uint64_t dropped;                   /* packets that were malformed,
+                                         * duplicated or too big to keep. */
+};
+
+/* limit is the memory that requests being reassembled may hold. */
+extern void udp_reassembly_init(const size_t limit);
+
+/*
+ * adds packet seq of the total that make up the request request_id from addr.
+ * once all of them are in, the request's payload is put together into buf,
+ * which holds bufsize bytes, and its length is returned in *len.
+ */
+extern udp_reassembly_result_t udp_reassemble(const struct sockaddr* addr, const socklen_t addrlen,
+                                              const uint16_t request_id,
+                                              const uint16_t seq, const uint16_t total,
+                                              const char* data, const size_t nbytes,
+                                              char* buf, const size_t bufsize, size_t* len);
+
+extern void udp_reassembly_stats(udp_reassembly_stats_t* out);
+
+#endif /* #if !defined(_udp_reassembly_h_) */
@@ -0,0 +1,816 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * io_uring i/o for the sockets of tcp connections.
+ *
+ * Each worker thread may have a ring.  A connection on the ring has one
+ * multishot receive outstanding, which the kernel fills into the thread's
+ * ring of provided buffers as data arrives; reads copy out of those buffers
+ * instead of calling read(..).  A connection that holds its share of the
+ * buffers, or that isn't reading, has its receive cancelled until it reads
+ * again.  Sends are queued as sendmsg requests.  Every request queued while
+ * the ring's completions are being handled goes to the kernel with one
+ * io_uring_enter(..), and sends that can go out at once complete in that
+ * same call, so a busy thread makes one system call for the i/o of all its
+ * connections rather than a read and a sendmsg for each.
+ *
+ * The ring signals an eventfd, which the thread's libevent loop watches;
+ * timers, the notify pipe, listeners and UDP stay on libevent.
+ */
+
+#include "generic.h"
+
+#include "uring.h"
+
+#if defined(USE_URING)
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#include "memcached.h"
+
+#define URING_OP_MASK           ((uint64_t) 3)
+#define URING_OP_PROBE          0
+#define URING_OP_RECV           1
+#define URING_OP_SEND           2
+#define URING_OP_CANCEL         3
+
+#define URING_BUFFER_GROUP      0
+
+#define URING_LOAD(p)           __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define URING_STORE(p, v)       __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+struct uring_s {
+    int fd;
+    int event_fd;
+    struct event event;
+    bool running;                       /* in uring_event_handler(..)... */
+    bool scheduled;                     /* ... or about to be. */
+
+    void* sq_ring;
+    size_t sq_ring_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_flags;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned unsubmitted;
+
+    void* cq_ring;
+    size_t cq_ring_size;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_flags;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+
+    struct io_uring_buf_ring* buf_ring;
+    size_t buf_ring_size;
+    uint16_t buf_tail;
+    char* buffers;
+    int* buf_next;                      /* the next buffer received by the
+                                         * same connection. */
+    uint32_t* buf_len;
+    unsigned free_buffers;
+
+    conn* ready_head;                   /* connections to run. */
+    conn* ready_tail;
+    conn* starved;                      /* connections to receive on again. */
+
+    uring_stats_t stats;
+};
+
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* p) {
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                              unsigned flags) {
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+
+static int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+
+static inline uint64_t uring_user_data(const conn* c, const uint64_t op) {
+    return (uint64_t) (uintptr_t) c | op;
+}
+
+
+/* has the ring's completions handled soon, if they aren't being already. */
+static void uring_schedule(uring_t* ring) {
+    if (! ring->running && ! ring->scheduled) {
+        ring->scheduled = true;
+        event_active(&ring->event, EV_READ, 0);
+    }
+}
+
+
+static void uring_submit(uring_t* ring, const unsigned flags) {
+    int res;
+
+    ring->stats.enter_calls ++;
+    res = sys_io_uring_enter(ring->fd, ring->unsubmitted, 0, flags);
+    if (res > 0) {
+        ring->stats.sqes += res;
+        ring->unsubmitted -= res;
+    } else if (res < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        if (settings.verbose > 0) {
+            perror("io_uring_enter()");
+        }
+    }
+}
+
+
+static int uring_reap(uring_t* ring);
+
+/*
+ * returns a cleared submission queue entry.  if the queue is full, what is in
+ * it goes to the kernel first, and the completions that are in are reaped to
+ * make room for theirs.
+ */
+static struct io_uring_sqe* uring_get_sqe(uring_t* ring) {
+    struct io_uring_sqe* sqe;
+    unsigned tail = *ring->sq_tail;
+
+    while (tail - URING_LOAD(ring->sq_head) >= ring->sq_entries) {
+        uring_submit(ring, IORING_ENTER_GETEVENTS);
+        if (tail - URING_LOAD(ring->sq_head) >= ring->sq_entries &&
+            uring_reap(ring) > 0) {
+            uring_schedule(ring);
+        }
+    }
+
+    sqe = &ring->sqes[tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[tail & ring->sq_mask] = tail & ring->sq_mask;
+    return sqe;
+}
+
+
+static void uring_queue_sqe(uring_t* ring) {
+    URING_STORE(ring->sq_tail, *ring->sq_tail + 1);
+    ring->unsubmitted ++;
+    uring_schedule(ring);
+}
+
+
+static void uring_prep_recv(uring_t* ring, const int fd, const uint64_t user_data) {
+    struct io_uring_sqe* sqe = uring_get_sqe(ring);
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = user_data;
+    uring_queue_sqe(ring);
+}
+
+
+static void uring_buffer_return(uring_t* ring, const int bid) {
+    struct io_uring_buf* buf = &ring->buf_ring->bufs[ring->buf_tail & (URING_RECV_BUFFERS - 1)];
+
+    buf->addr = (uintptr_t) (ring->buffers + (size_t) bid * URING_RECV_BUFFER_SIZE);
+    buf->len = URING_RECV_BUFFER_SIZE;
+    buf->bid = bid;
+    ring->buf_tail ++;
+    URING_STORE(&ring->buf_ring->tail, ring->buf_tail);
+
+    ring->free_buffers ++;
+    if (ring->starved != NULL) {
+        uring_schedule(ring);
+    }
+}
+
+
+static void uring_conn_ready(uring_t* ring, conn* c) {
+    if (c->uring.ready) {
+        return;
+    }
+    c->uring.ready = true;
+    c->uring.next_ready = NULL;
+    if (ring->ready_tail != NULL) {
+        ring->ready_tail->uring.next_ready = c;
+    } else {
+        ring->ready_head = c;
+    }
+    ring->ready_tail = c;
+}
+
+
+static void uring_conn_starve(uring_t* ring, conn* c) {
+    if (c->uring.starved) {
+        return;
+    }
+    c->uring.starved = true;
+    c->uring.next_starved = ring->starved;
+    ring->starved = c;
+}
+
+
+/* starts receiving again on the connections that stopped, while there are
+ * buffers to receive into. */
+static void uring_rearm(uring_t* ring) {
+    conn* c;
+
+    while (ring->starved != NULL && ring->free_buffers > 0) {
+        c = ring->starved;
+        ring->starved = c->uring.next_starved;
+        c->uring.starved = false;
+
+        if (c->uring.closing || c->uring.recv_done || c->uring.recv_armed ||
+            c->uring.recv_paused) {
+            continue;
+        }
+        uring_prep_recv(ring, c->sfd, uring_user_data(c, URING_OP_RECV));
+        c->uring.recv_armed = true;
+        c->uring.inflight ++;
+    }
+}
+
+
+/*
+ * cancels the receive of a connection that holds its share of the buffers, so
+ * the other connections still have some to receive into.  a connection that
+ * waits to send is held to a few; it could wait for as long as its client
+ * doesn't read.  receiving starts again once the connection waits to read.
+ */
+static void uring_conn_pause(uring_t* ring, conn* c) {
+    uring_conn_t* uc = &c->uring;
+    struct io_uring_sqe* sqe;
+
+    if (uc->recv_paused || uc->recv_done || uc->closing ||
+        uc->recv_buffers < (uc->reading ? URING_CONN_RECV_BUFFERS : URING_CONN_WAIT_BUFFERS)) {
+        return;
+    }
+    uc->recv_paused = true;
+    ring->stats.recv_pauses ++;
+    if (! uc->recv_armed) {
+        return;
+    }
+
+    sqe = uring_get_sqe(ring);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = uring_user_data(c, URING_OP_RECV);
+    sqe->user_data = uring_user_data(c, URING_OP_CANCEL);
+    uring_queue_sqe(ring);
+    uc->inflight ++;
+}
+
+
+static void uring_complete(uring_t* ring, const struct io_uring_cqe* cqe) {
+    conn* c = (conn*) (uintptr_t) (cqe->user_data & ~URING_OP_MASK);
+    int bid = -1;
+
+    ring->stats.cqes ++;
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        ring->free_buffers --;
+    }
+
+    switch (cqe->user_data & URING_OP_MASK) {
+        case URING_OP_PROBE:
+            if (bid != -1) {
+                uring_buffer_return(ring, bid);
+            }
+            return;
+
+        case URING_OP_RECV:
+            if (bid != -1) {
+                if (cqe->res > 0 && ! c->uring.closing) {
+                    ring->buf_len[bid] = cqe->res;
+                    ring->buf_next[bid] = -1;
+                    if (c->uring.recv_tail != -1) {
+                        ring->buf_next[c->uring.recv_tail] = bid;
+                    } else {
+                        c->uring.recv_head = bid;
+                        c->uring.recv_off = 0;
+                    }
+                    c->uring.recv_tail = bid;
+                    c->uring.recv_buffers ++;
+                    ring->stats.recvs ++;
+                } else {
+                    uring_buffer_return(ring, bid);
+                }
+            }
+            if ((cqe->flags & IORING_CQE_F_MORE) == 0) {
+                c->uring.recv_armed = false;
+                c->uring.inflight --;
+                if (cqe->res == -ENOBUFS) {
+                    ring->stats.buffer_waits ++;
+                    uring_conn_starve(ring, c);
+                } else if (cqe->res > 0 ||
+                           (cqe->res == -ECANCELED && ! c->uring.closing)) {
+                    /* the kernel stopped the receive early, or it was paused;
+                     * start another once it may. */
+                    uring_conn_starve(ring, c);
+                } else {
+                    c->uring.recv_done = true;
+                    c->uring.recv_err = -cqe->res;
+                }
+            } else {
+                uring_conn_pause(ring, c);
+            }
+            break;
+
+        case URING_OP_SEND:
+            c->uring.send_busy = false;
+            c->uring.send_done = true;
+            c->uring.send_res = cqe->res;
+            c->uring.inflight --;
+            ring->stats.sends ++;
+            break;
+
+        case URING_OP_CANCEL:
+            c->uring.inflight --;
+            break;
+    }
+
+    uring_conn_ready(ring, c);
+}
+
+
+/* returns the number of completions reaped. */
+static int uring_reap(uring_t* ring) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = URING_LOAD(ring->cq_tail);
+    int reaped = 0;
+
+    for (; head != tail; head++, reaped++) {
+        uring_complete(ring, &ring->cqes[head & ring->cq_mask]);
+    }
+    URING_STORE(ring->cq_head, head);
+    return reaped;
+}
+
+
+static void uring_run(uring_t* ring) {
+    conn* c;
+
+    while ((c = ring->ready_head) != NULL) {
+        ring->ready_head = c->uring.next_ready;
+        if (ring->ready_head == NULL) {
+            ring->ready_tail = NULL;
+        }
+        c->uring.ready = false;
+
+        if (c->uring.closing) {
+            if (c->uring.inflight == 0) {
+                conn_close(c);
+            }
+            continue;
+        }
+        event_handler(c->sfd, EV_READ | EV_WRITE, c);
+    }
+}
+
+
+static void uring_event_handler(const int fd, const short which, void* arg) {
+    uring_t* ring = arg;
+    uint64_t count;
+    int rounds;
+
+    thread_event_handled();
+    ring->scheduled = false;
+    ring->running = true;
+    if (read(fd, &count, sizeof(count)) == sizeof(count)) {
+        ring->stats.wakeups ++;
+    }
+
+    /* completions posted from here on are reaped before we're done. */
+    URING_STORE(ring->cq_flags, *ring->cq_flags | IORING_CQ_EVENTFD_DISABLED);
+
+    for (rounds = 0; rounds < URING_ROUNDS; rounds++) {
+        uring_rearm(ring);
+        if (ring->unsubmitted > 0 ||
+            (URING_LOAD(ring->sq_flags) & IORING_SQ_CQ_OVERFLOW)) {
+            uring_submit(ring, (URING_LOAD(ring->sq_flags) & IORING_SQ_CQ_OVERFLOW) ?
+                         IORING_ENTER_GETEVENTS : 0);
+        }
+        if (uring_reap(ring) == 0 &&
+            ring->ready_head == NULL) {
+            break;
+        }
+        uring_run(ring);
+    }
+
+    URING_STORE(ring->cq_flags, *ring->cq_flags & ~IORING_CQ_EVENTFD_DISABLED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    ring->running = false;
+
+    if (ring->unsubmitted > 0 ||
+        ring->ready_head != NULL ||
+        *ring->cq_head != URING_LOAD(ring->cq_tail)) {
+        uring_schedule(ring);
+    }
+}
+
+
+/*
+ * checks that the kernel does multishot receives, which came after the
+ * buffer rings.  the rest of the probe's receive is left to be reaped and
+ * ignored.
+ */
+static bool uring_probe_recv(uring_t* ring) {
+    int sv[2];
+    bool ok = false;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        return false;
+    }
+    if (write(sv[1], "x", 1) == 1) {
+        uring_prep_recv(ring, sv[0], URING_OP_PROBE);
+        ring->stats.enter_calls ++;
+        if (sys_io_uring_enter(ring->fd, ring->unsubmitted, 1, IORING_ENTER_GETEVENTS) > 0) {
+            struct io_uring_cqe* cqe = &ring->cqes[*ring->cq_head & ring->cq_mask];
+
+            ring->unsubmitted = 0;
+            ok = (*ring->cq_head != URING_LOAD(ring->cq_tail) &&
+                  cqe->res == 1 &&
+                  (cqe->flags & IORING_CQE_F_MORE) &&
+                  (cqe->flags & IORING_CQE_F_BUFFER));
+            uring_reap(ring);
+        }
+    }
+    close(sv[0]);
+    close(sv[1]);
+    return ok;
+}
+
+
+static void uring_free(uring_t* ring) {
+    if (ring->buf_ring != NULL) {
+        munmap(ring->buf_ring, ring->buf_ring_size);
+    }
+    if (ring->buffers != NULL) {
+        pool_free(ring->buffers, (size_t) URING_RECV_BUFFERS * URING_RECV_BUFFER_SIZE, URING_POOL);
+    }
+    if (ring->buf_next != NULL) {
+        pool_free(ring->buf_next, URING_RECV_BUFFERS * sizeof(int), URING_POOL);
+    }
+    if (ring->buf_len != NULL) {
+        pool_free(ring->buf_len, URING_RECV_BUFFERS * sizeof(uint32_t), URING_POOL);
+    }
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if (ring->event_fd != -1) {
+        close(ring->event_fd);
+    }
+    if (ring->fd != -1) {
+        close(ring->fd);
+    }
+    pool_free(ring, sizeof(uring_t), URING_POOL);
+}
+
+
+static bool uring_map(uring_t* ring, const struct io_uring_params* p) {
+    char* sq;
+    char* cq;
+
+    ring->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    sq = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+        return false;
+    }
+    ring->sq_ring = sq;
+
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        cq = sq;
+    } else {
+        cq = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) {
+            return false;
+        }
+    }
+    ring->cq_ring = cq;
+
+    ring->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        return false;
+    }
+
+    ring->sq_head = (unsigned*) (sq + p->sq_off.head);
+    ring->sq_tail = (unsigned*) (sq + p->sq_off.tail);
+    ring->sq_flags = (unsigned*) (sq + p->sq_off.flags);
+    ring->sq_array = (unsigned*) (sq + p->sq_off.array);
+    ring->sq_mask = *(unsigned*) (sq + p->sq_off.ring_mask);
+    ring->sq_entries = *(unsigned*) (sq + p->sq_off.ring_entries);
+
+    ring->cq_head = (unsigned*) (cq + p->cq_off.head);
+    ring->cq_tail = (unsigned*) (cq + p->cq_off.tail);
+    ring->cq_flags = (unsigned*) (cq + p->cq_off.flags);
+    ring->cq_mask = *(unsigned*) (cq + p->cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) (cq + p->cq_off.cqes);
+    return true;
+}
+
+
+static bool uring_setup_buffers(uring_t* ring) {
+    struct io_uring_buf_reg reg;
+    int i;
+
+    /* the kernel wants the ring page aligned. */
+    ring->buf_ring_size = URING_RECV_BUFFERS * sizeof(struct io_uring_buf);
+    ring->buf_ring = mmap(NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->buf_ring == MAP_FAILED) {
+        ring->buf_ring = NULL;
+        return false;
+    }
+
+    ring->buffers = pool_malloc((size_t) URING_RECV_BUFFERS * URING_RECV_BUFFER_SIZE, URING_POOL);
+    ring->buf_next = pool_malloc(URING_RECV_BUFFERS * sizeof(int), URING_POOL);
+    ring->buf_len = pool_malloc(URING_RECV_BUFFERS * sizeof(uint32_t), URING_POOL);
+    if (ring->buffers == NULL ||
+        ring->buf_next == NULL ||
+        ring->buf_len == NULL) {
+        return false;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t) ring->buf_ring;
+    reg.ring_entries = URING_RECV_BUFFERS;
+    reg.bgid = URING_BUFFER_GROUP;
+    if (sys_io_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        return false;
+    }
+
+    for (i = 0; i < URING_RECV_BUFFERS; i++) {
+        uring_buffer_return(ring, i);
+    }
+    return true;
+}
+
+
+uring_t* uring_new(struct event_base* base) {
+    struct io_uring_params p;
+    uring_t* ring;
+
+    if ((ring = pool_calloc(1, sizeof(uring_t), URING_POOL)) == NULL) {
+        return NULL;
+    }
+    ring->fd = ring->event_fd = -1;
+    /* nothing to schedule on until the event is set up. */
+    ring->running = true;
+
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = URING_ENTRIES * 4;
+    if ((ring->fd = sys_io_uring_setup(URING_ENTRIES, &p)) < 0) {
+        if (settings.verbose > 0) {
+            perror("io_uring_setup()");
+        }
+        ring->fd = -1;
+        uring_free(ring);
+        return NULL;
+    }
+
+    /* without IORING_FEAT_NODROP, completions could be lost when the
+     * completion queue overflows. */
+    if ((p.features & IORING_FEAT_NODROP) == 0 ||
+        ! uring_map(ring, &p) ||
+        ! uring_setup_buffers(ring) ||
+        ! uring_probe_recv(ring) ||
+        (ring->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1 ||
+        sys_io_uring_register(ring->fd, IORING_REGISTER_EVENTFD, &ring->event_fd, 1) != 0) {
+        if (settings.verbose > 0) {
+            fprintf(stderr, "io_uring lacks what is needed\n");
+        }
+        uring_free(ring);
+        return NULL;
+    }
+
+    event_set(&ring->event, ring->event_fd, EV_READ | EV_PERSIST, uring_event_handler, ring);
+    event_base_set(base, &ring->event);
+    if (event_add(&ring->event, 0) == -1) {
+        uring_free(ring);
+        return NULL;
+    }
+
+    /* what the probe left behind. */
+    ring->running = false;
+    uring_schedule(ring);
+    return ring;
+}
+
+
+void uring_conn_init(uring_t* ring, conn* c) {
+    memset(&c->uring, 0, sizeof(c->uring));
+    c->uring.ring = ring;
+    c->uring.recv_head = c->uring.recv_tail = -1;
+    c->uring.reading = true;
+
+    if (ring->free_buffers > 0) {
+        uring_prep_recv(ring, c->sfd, uring_user_data(c, URING_OP_RECV));
+        c->uring.recv_armed = true;
+        c->uring.inflight ++;
+    } else {
+        uring_conn_starve(ring, c);
+    }
+}
+
+
+ssize_t uring_conn_readv(conn* c, const struct iovec* iov, const int iovcnt) {
+    uring_conn_t* uc = &c->uring;
+    uring_t* ring = uc->ring;
+    size_t copied = 0, iov_off = 0;
+    int i = 0;
+
+    while (uc->recv_head != -1 && i < iovcnt) {
+        int bid = uc->recv_head;
+        size_t avail = ring->buf_len[bid] - uc->recv_off;
+        size_t room = iov[i].iov_len - iov_off;
+        size_t n = avail < room ? avail : room;
+
+        memcpy((char*) iov[i].iov_base + iov_off,
+               ring->buffers + (size_t) bid * URING_RECV_BUFFER_SIZE + uc->recv_off, n);
+        copied += n;
+        iov_off += n;
+        uc->recv_off += n;
+
+        if (iov_off == iov[i].iov_len) {
+            i ++;
+            iov_off = 0;
+        }
+        if (uc->recv_off == ring->buf_len[bid]) {
+            uc->recv_head = ring->buf_next[bid];
+            if (uc->recv_head == -1) {
+                uc->recv_tail = -1;
+            }
+            uc->recv_off = 0;
+            uc->recv_buffers --;
+            uring_buffer_return(ring, bid);
+        }
+    }
+
+    if (copied > 0) {
+        return copied;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > 0) {
+            break;
+        }
+    }
+    if (i == iovcnt) {
+        /* like read(..) of nothing. */
+        return 0;
+    }
+    if (uc->recv_done) {
+        if (uc->recv_err == 0) {
+            return 0;
+        }
+        errno = uc->recv_err;
+        return -1;
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+
+ssize_t uring_conn_sendmsg(conn* c, struct msghdr* m) {
+    uring_conn_t* uc = &c->uring;
+    struct io_uring_sqe* sqe;
+
+    if (uc->send_done) {
+        uc->send_done = false;
+        if (uc->send_res < 0) {
+            errno = -uc->send_res;
+            return -1;
+        }
+        return uc->send_res;
+    }
+
+    if (! uc->send_busy) {
+        sqe = uring_get_sqe(uc->ring);
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = c->sfd;
+        sqe->addr = (uintptr_t) m;
+        sqe->len = 1;
+        sqe->user_data = uring_user_data(c, URING_OP_SEND);
+        uring_queue_sqe(uc->ring);
+
+        uc->send_busy = true;
+        uc->inflight ++;
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+
+void uring_conn_wait(conn* c, const int new_flags) {
+    uring_conn_t* uc = &c->uring;
+
+    uc->reading = (new_flags & EV_READ) != 0;
+    if (! uc->reading) {
+        uring_conn_pause(uc->ring, c);
+        return;
+    }
+    if (uc->recv_paused && uc->recv_buffers < URING_CONN_RECV_BUFFERS) {
+        uc->recv_paused = false;
+        uring_conn_starve(uc->ring, c);
+        uring_schedule(uc->ring);
+    }
+
+    /* giving way to other connections with data still to read.  nothing
+     * will come to say it's there. */
+    if (uc->recv_head != -1) {
+        uring_conn_ready(uc->ring, c);
+        uring_schedule(uc->ring);
+    }
+}
+
+
+static void uring_conn_unlink(uring_t* ring, conn* c) {
+    conn** prev;
+    conn* last = NULL;
+
+    if (c->uring.ready) {
+        for (prev = &ring->ready_head; *prev != c; prev = &(*prev)->uring.next_ready) {
+            last = *prev;
+        }
+        *prev = c->uring.next_ready;
+        if (ring->ready_tail == c) {
+            ring->ready_tail = last;
+        }
+        c->uring.ready = false;
+    }
+    if (c->uring.starved) {
+        for (prev = &ring->starved; *prev != c; prev = &(*prev)->uring.next_starved) {
+        }
+        *prev = c->uring.next_starved;
+        c->uring.starved = false;
+    }
+}
+
+
+bool uring_conn_close(conn* c) {
+    uring_conn_t* uc = &c->uring;
+    uring_t* ring = uc->ring;
+    struct io_uring_sqe* sqe;
+    int bid;
+
+    if (uc->inflight > 0) {
+        if (! uc->closing) {
+            uc->closing = true;
+
+            sqe = uring_get_sqe(ring);
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = c->sfd;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+            sqe->user_data = uring_user_data(c, URING_OP_CANCEL);
+            uring_queue_sqe(ring);
+            uc->inflight ++;
+        }
+        return false;
+    }
+
+    while ((bid = uc->recv_head) != -1) {
+        uc->recv_head = ring->buf_next[bid];
+        uring_buffer_return(ring, bid);
+    }
+    uc->recv_tail = -1;
+    uc->recv_buffers = 0;
+    uring_conn_unlink(ring, c);
+    uc->ring = NULL;
+    return true;
+}
+
+
+const uring_stats_t* uring_stats(const uring_t* ring) {
+    return &ring->stats;
+}
+
+#endif /* #if defined(USE_URING) */
@@ -0,0 +1,122 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+#if !defined(_uring_h_)
+#define _uring_h_
+
+#include "generic.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#if defined(HAVE_LINUX_IO_URING_H)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+
+/* multishot receives into rings of provided buffers came with linux 6.0. */
+#if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+#define USE_URING
+#endif /* #if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup) */
+#endif /* #if defined(HAVE_LINUX_IO_URING_H) */
+
+#define URING_ENTRIES           1024    /* submission queue entries; the
+                                         * completion queue has four times
+                                         * as many. */
+#define URING_RECV_BUFFERS      1024    /* receive buffers of each thread, a
+                                         * power of two. */
+#define URING_RECV_BUFFER_SIZE  4096
+#define URING_CONN_RECV_BUFFERS 128     /* buffers one connection may hold
+                                         * before it stops receiving... */
+#define URING_CONN_WAIT_BUFFERS 4       /* ... or while it waits to send,
+                                         * rather than to read. */
+#define URING_ROUNDS            16      /* passes over the completions before
+                                         * other events get a turn. */
+
+struct conn_s;
+struct event_base;
+
+typedef struct uring_s uring_t;
+
+typedef struct uring_stats_s uring_stats_t;
+struct uring_stats_s {
+    uint64_t wakeups;                   /* times the ring signalled the
+                                         * thread. */
+    uint64_t enter_calls;               /* io_uring_enter(..) calls... */
+    uint64_t sqes;                      /* ... the requests they submitted... */
+    uint64_t cqes;                      /* ... and the completions reaped. */
+    uint64_t recvs;                     /* completions that received data. */
+    uint64_t sends;                     /* completions of sends. */
+    uint64_t buffer_waits;              /* receives stopped because every
+                                         * buffer was in use... */
+    uint64_t recv_pauses;               /* ... or cancelled because their
+                                         * connection held its share. */
+};
+
+/* a connection whose socket i/o goes through its thread's ring. */
+typedef struct uring_conn_s uring_conn_t;
+struct uring_conn_s {
+    uring_t* ring;                      /* NULL if the connection uses
+                                         * libevent. */
+    int recv_head;                      /* buffers received but not read, by
+                                         * id, the oldest first; -1 if
+                                         * none. */
+    int recv_tail;
+    uint32_t recv_off;                  /* bytes of the oldest already
+                                         * read. */
+    int recv_buffers;                   /* buffers received but not read. */
+    bool recv_armed;                    /* a receive is outstanding. */
+    bool recv_paused;                   /* receiving is held off until the
+                                         * connection reads again. */
+    bool reading;                       /* last waited for EV_READ. */
+    bool recv_done;                     /* receiving has stopped for good... */
+    int recv_err;                       /* ... at the end of the stream if 0,
+                                         * else with this errno. */
+    bool send_busy;                     /* a send is outstanding... */
+    bool send_done;                     /* ... or has finished, with
+                                         * send_res. */
+    int send_res;
+    int inflight;                       /* requests the kernel holds for the
+                                         * connection. */
+    bool closing;                       /* waiting for them to close. */
+    bool ready;                         /* on the ring's run list. */
+    bool starved;                       /* on the ring's list of receives to
+                                         * start again. */
+    struct conn_s* next_ready;
+    struct conn_s* next_starved;
+};
+
+#if defined(USE_URING)
+/*
+ * sets up a ring for the thread that runs base, with its receive buffers, and
+ * hooks it into the thread's event loop.  returns NULL if the kernel can't do
+ * what is needed.
+ */
+extern uring_t* uring_new(struct event_base* base);
+
+/* starts receiving on a new connection's socket. */
+extern void uring_conn_init(uring_t* ring, struct conn_s* c);
+
+/*
+ * readv(..) and sendmsg(..) for a connection on a ring.  reads come from the
+ * buffers received so far.  a send is queued and fails with EAGAIN; the
+ * connection is run again once it is done, and the next call with the same
+ * message returns its result.
+ */
+extern ssize_t uring_conn_readv(struct conn_s* c, const struct iovec* iov, const int iovcnt);
+extern ssize_t uring_conn_sendmsg(struct conn_s* c, struct msghdr* m);
+
+/* the connection is about to wait for new_flags. */
+extern void uring_conn_wait(struct conn_s* c, const int new_flags);
+
+/*
+ * returns true if the connection can be closed now.  otherwise, what the
+ * kernel still holds for it is cancelled, and conn_close(..) is called again
+ * once it is done.
+ */
+extern bool uring_conn_close(struct conn_s* c);
+
+extern const uring_stats_t* uring_stats(const uring_t* ring);
+#endif /* #if defined(USE_URING) */
+
+#endif /* #if !defined(_uring_h_) */
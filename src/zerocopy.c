@@ -0,0 +1,295 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * MSG_ZEROCOPY sends of large values.
+ *
+ * A value of at least settings.zerocopy_min bytes is put into messages of its
+ * own, and the kernel sends those straight from the item's memory instead of
+ * copying them into the socket buffer.  The memory must not change until the
+ * kernel is done with it, which it tells the socket's error queue, so the
+ * items of the replies stay referenced until then: once the replies are
+ * written, their items are pinned to the ids of the sends that used them,
+ * and released as the completions for those ids are read.
+ *
+ * The kernel copies anyway where it has to (loopback, devices that can't
+ * gather), and says so in the completion; such a connection goes back to
+ * plain sends, which are cheaper than a copy that is also tracked.
+ */
+
+#include "generic.h"
+
+#include "zerocopy.h"
+
+#if defined(USE_ZEROCOPY)
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include "memcached.h"
+
+/* the items of the replies written by one or more sends. */
+struct zerocopy_pin_s {
+    zerocopy_pin_t* next;
+    uint32_t first_id;                  /* the sends, by id. */
+    uint32_t last_id;
+    uint32_t pending;                   /* those not yet completed. */
+    int count;
+    item* items[1];
+};
+
+
+static inline size_t zerocopy_pin_size(const int count) {
+    return sizeof(zerocopy_pin_t) + sizeof(item*) * (count > 1 ? count - 1 : 0);
+}
+
+
+void zerocopy_conn_init(conn* c) {
+    zerocopy_conn_t* zc = &c->zerocopy;
+    int one = 1;
+
+    zc->enabled = false;
+    zc->flags = 0;
+    zc->next_id = zc->first_id = zc->done = 0;
+    zc->pinned = NULL;
+    zc->closing = false;
+
+    if (settings.zerocopy_min == 0 ||
+        c->udp ||
+        c->state == conn_listening) {
+        return;
+    }
+#if defined(USE_URING)
+    if (c->uring.ring != NULL) {
+        return;
+    }
+#endif /* #if defined(USE_URING) */
+
+    if (setsockopt(c->sfd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) != 0) {
+        if (settings.verbose > 0) {
+            perror("setsockopt(SO_ZEROCOPY)");
+        }
+        return;
+    }
+    zc->enabled = true;
+}
+
+
+void zerocopy_value_start(conn* c, const size_t nbytes) {
+    stats_t *stats;
+
+    if (settings.zerocopy_min == 0 ||
+        nbytes < settings.zerocopy_min ||
+        c->udp) {
+        return;
+    }
+
+    if (c->zerocopy.enabled) {
+        c->zerocopy.flags = MSG_ZEROCOPY;
+    } else {
+        stats = STATS_GET_TLS();
+        STATS_LOCK(stats);
+        stats->zerocopy_fallbacks++;
+        STATS_UNLOCK(stats);
+    }
+}
+
+
+void zerocopy_value_end(conn* c) {
+    c->zerocopy.flags = 0;
+}
+
+
+ssize_t zerocopy_sendmsg(conn* c, struct msghdr* m) {
+    stats_t *stats = STATS_GET_TLS();
+    ssize_t res;
+
+    if (c->zerocopy.enabled) {
+        res = sendmsg(c->xfd, m, MSG_ZEROCOPY);
+        if (res > 0) {
+            c->zerocopy.next_id++;
+            STATS_LOCK(stats);
+            stats->zerocopy_sends++;
+            stats->zerocopy_bytes += res;
+            STATS_UNLOCK(stats);
+        }
+        if (res >= 0 || errno != ENOBUFS) {
+            return res;
+        }
+        /* no room for the completion; this one is copied. */
+    }
+
+    STATS_LOCK(stats);
+    stats->zerocopy_fallbacks++;
+    STATS_UNLOCK(stats);
+    return sendmsg(c->xfd, m, 0);
+}
+
+
+void zerocopy_pin_items(conn* c) {
+    stats_t *stats = STATS_GET_TLS();
+    zerocopy_conn_t* zc = &c->zerocopy;
+    zerocopy_pin_t *pin, **tail;
+    uint32_t pending = zc->next_id - zc->first_id - zc->done;
+
+    if (pending > 0 && c->ileft > 0) {
+        pin = pool_malloc(zerocopy_pin_size(c->ileft), ZEROCOPY_POOL);
+        if (pin == NULL) {
+            /* better to stop sending from items than to lose track of them. */
+            if (settings.verbose > 0) {
+                fprintf(stderr, "Couldn't pin the items of a zerocopy send\n");
+            }
+            zc->enabled = false;
+        } else {
+            pin->next = NULL;
+            pin->first_id = zc->first_id;
+            pin->last_id = zc->next_id - 1;
+            pin->pending = pending;
+            pin->count = c->ileft;
+            memcpy(pin->items, c->icurr, sizeof(item*) * c->ileft);
+            c->icurr += c->ileft;
+            c->ileft = 0;
+
+            for (tail = &zc->pinned; *tail != NULL; tail = &(*tail)->next)
+                ;
+            *tail = pin;
+
+            STATS_LOCK(stats);
+            stats->zerocopy_pinned += pin->count;
+            STATS_UNLOCK(stats);
+        }
+    }
+
+    /* whatever is left was copied, or is done being sent, and can go now. */
+    zc->first_id = zc->next_id;
+    zc->done = 0;
+}
+
+
+/* the sends lo..hi are done. */
+static void zerocopy_complete(conn* c, const uint32_t lo, const uint32_t hi, const bool copied) {
+    stats_t *stats = STATS_GET_TLS();
+    zerocopy_conn_t* zc = &c->zerocopy;
+    zerocopy_pin_t *pin, **prev;
+    uint32_t id = lo;
+    int i;
+
+    STATS_LOCK(stats);
+    if (copied) {
+        stats->zerocopy_copied += hi - lo + 1;
+    }
+    STATS_UNLOCK(stats);
+
+    if (copied && zc->enabled) {
+        if (settings.verbose > 1) {
+            fprintf(stderr, "<%d zerocopy sends are copied; stopping them\n", c->sfd);
+        }
+        zc->enabled = false;
+    }
+
+    /* the kernel may finish the sends out of order. */
+    do {
+        if ((uint32_t) (id - zc->first_id) < (uint32_t) (zc->next_id - zc->first_id)) {
+            /* a send of the replies still being written. */
+            zc->done++;
+            continue;
+        }
+        for (pin = zc->pinned; pin != NULL; pin = pin->next) {
+            if ((uint32_t) (id - pin->first_id) <= (uint32_t) (pin->last_id - pin->first_id)) {
+                assert(pin->pending > 0);
+                pin->pending--;
+                break;
+            }
+        }
+    } while (id++ != hi);
+
+    prev = &zc->pinned;
+    while ((pin = *prev) != NULL) {
+        if (pin->pending > 0) {
+            prev = &pin->next;
+            continue;
+        }
+
+        *prev = pin->next;
+        for (i = 0; i < pin->count; i++) {
+            assert(ITEM_is_valid(pin->items[i]));
+            item_deref(pin->items[i]);
+        }
+        STATS_LOCK(stats);
+        stats->zerocopy_pinned -= pin->count;
+        STATS_UNLOCK(stats);
+        pool_free(pin, zerocopy_pin_size(pin->count), ZEROCOPY_POOL);
+    }
+}
+
+
+void zerocopy_reap(conn* c) {
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+    struct msghdr msg;
+    struct cmsghdr* cm;
+    struct sock_extended_err* ee;
+
+    while (c->zerocopy.pinned != NULL ||
+           c->zerocopy.next_id != c->zerocopy.first_id) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(c->sfd, &msg, MSG_ERRQUEUE) == -1) {
+            /* EAGAIN once the queue is empty. */
+            return;
+        }
+
+        for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (! ((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                   (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            ee = (struct sock_extended_err*) CMSG_DATA(cm);
+            if (ee->ee_errno != 0 ||
+                ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            zerocopy_complete(c, ee->ee_info, ee->ee_data,
+                              (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0);
+        }
+    }
+}
+
+
+static void zerocopy_close_handler(const int fd, const short which, void *arg) {
+    conn_close((conn*) arg);
+}
+
+
+bool zerocopy_conn_close(conn* c) {
+    zerocopy_conn_t* zc = &c->zerocopy;
+    struct event_base* base = c->event.ev_base;
+    struct timeval tv = {0, ZEROCOPY_CLOSE_POLL_USEC};
+
+    /* the items of replies cut short by the close. */
+    zerocopy_pin_items(c);
+    zerocopy_reap(c);
+    if (zc->pinned == NULL) {
+        return true;
+    }
+
+    /*
+     * the socket stays open for its error queue, but nothing else is read from
+     * it; polling saves waking up for whatever else the peer sends.
+     */
+    if (! zc->closing) {
+        zc->closing = true;
+        event_del(&c->event);
+        evtimer_set(&c->event, zerocopy_close_handler, c);
+        event_base_set(base, &c->event);
+        if (settings.verbose > 1) {
+            fprintf(stderr, "<%d waiting for zerocopy sends before closing\n", c->sfd);
+        }
+    }
+    evtimer_add(&c->event, &tv);
+    return false;
+}
+
+#endif /* #if defined(USE_ZEROCOPY) */
@@ -0,0 +1,87 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+#if !defined(_zerocopy_h_)
+#define _zerocopy_h_
+
+#include "generic.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#if defined(HAVE_LINUX_ERRQUEUE_H)
+#include <linux/errqueue.h>
+
+/* MSG_ZEROCOPY came with linux 4.14. */
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define USE_ZEROCOPY
+#endif /* #if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY) */
+#endif /* #if defined(HAVE_LINUX_ERRQUEUE_H) */
+
+#define ZEROCOPY_CLOSE_POLL_USEC 10000  /* how often a closed connection
+                                         * looks for the kernel to be done
+                                         * with its items. */
+
+struct conn_s;
+
+typedef struct zerocopy_pin_s zerocopy_pin_t;
+
+/* the MSG_ZEROCOPY sends of a tcp connection. */
+typedef struct zerocopy_conn_s zerocopy_conn_t;
+struct zerocopy_conn_s {
+    bool enabled;                       /* large values are sent without a
+                                         * copy. */
+    int flags;                          /* MSG_ZEROCOPY while add_iov(..) is
+                                         * adding a large value, else 0. */
+    uint32_t next_id;                   /* the kernel numbers the sends of a
+                                         * socket from 0. */
+    uint32_t first_id;                  /* the first send of the replies being
+                                         * written... */
+    uint32_t done;                      /* ... and how many of their sends
+                                         * have completed. */
+    zerocopy_pin_t* pinned;             /* items the kernel may still be
+                                         * sending from. */
+    bool closing;                       /* waiting for it to finish before the
+                                         * socket is closed. */
+};
+
+#if defined(USE_ZEROCOPY)
+/* turns MSG_ZEROCOPY on for a new tcp connection, if it is wanted. */
+extern void zerocopy_conn_init(struct conn_s* c);
+
+/*
+ * add_item_value_to_iov(..) brackets a value with these.  a value of at least
+ * settings.zerocopy_min bytes goes into messages of its own, which are sent
+ * with MSG_ZEROCOPY.
+ */
+extern void zerocopy_value_start(struct conn_s* c, const size_t nbytes);
+extern void zerocopy_value_end(struct conn_s* c);
+
+/* sendmsg(..) of a message that holds a large value. */
+extern ssize_t zerocopy_sendmsg(struct conn_s* c, struct msghdr* m);
+
+/*
+ * the replies are written.  if some of them went out without a copy, their
+ * items stay referenced until the kernel is done with them, and are taken
+ * off the connection's list.
+ */
+extern void zerocopy_pin_items(struct conn_s* c);
+
+/*
+ * reads the completions off the socket's error queue and releases the items
+ * of the sends they cover.
+ */
+extern void zerocopy_reap(struct conn_s* c);
+
+/*
+ * returns true if the connection can be closed now.  otherwise conn_close(..)
+ * is called again, every ZEROCOPY_CLOSE_POLL_USEC, until the kernel is done
+ * with its items.
+ */
+extern bool zerocopy_conn_close(struct conn_s* c);
+#else
+#define zerocopy_value_start(c, nbytes)
+#define zerocopy_value_end(c)
+#endif /* #if defined(USE_ZEROCOPY) */
+
+#endif /* #if !defined(_zerocopy_h_) */
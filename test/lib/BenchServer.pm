@@ -0,0 +1,53 @@
+package BenchServer;
+
+# Starts and stops the memcached a benchmark runs against.
+
+use strict;
+use warnings;
+use Exporter 'import';
+use IO::Socket::INET;
+use Time::HiRes qw(sleep);
+
+our @EXPORT = qw(start_server stop_server);
+
+my ($pid, $owner);
+
+# the server goes when the benchmark does, but not when a client it forked
+# exits.
+END { stop_server(); }
+
+# starts opts{binary} on 127.0.0.1:opts{port} with the arguments in
+# opts{args}, under the command in opts{wrapper} if there is one, and returns
+# a connection to it.
+sub start_server {
+    my %opts = @_;
+    my @args = ("-p", $opts{port}, "-U", 0, @{$opts{args} || []});
+    push @args, ("-u", "nobody") if $> == 0;
+
+    $owner = $$;
+    $pid = fork();
+    die "fork: $!\n" unless defined $pid;
+    if ($pid == 0) {
+        # its own group, so that a wrapper and memcached are stopped together.
+        setpgrp(0, 0);
+        open(STDOUT, ">", "/dev/null");
+        my @command = (@{$opts{wrapper} || []}, $opts{binary}, @args);
+        exec(@command) or die "exec $command[0]: $!\n";
+    }
+
+    for (1..50) {
+        my $sock = IO::Socket::INET->new(PeerAddr => "127.0.0.1:$opts{port}");
+        return $sock if $sock;
+        sleep 0.1;
+    }
+    die "can't connect to memcached\n";
+}
+
+sub stop_server {
+    return unless $pid && $$ == $owner;
+    kill 'INT', -$pid;
+    waitpid($pid, 0);
+    $pid = undef;
+}
+
+1;